@@ -0,0 +1,209 @@
+#include "BatchTracker.h"
+
+static float* allocate_plane(int num_floats) {
+    void* plane = NULL;
+    if (posix_memalign(&plane, 64, num_floats * sizeof(float)) != 0) {
+        return NULL;
+    }
+    memset(plane, 0, num_floats * sizeof(float));
+    return (float*)plane;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+
+BatchTracker::BatchTracker(int _num_sensors) {
+    num_sensors = _num_sensors;
+    stride = ((num_sensors + BATCH_LANE_ALIGNMENT - 1) / BATCH_LANE_ALIGNMENT) * BATCH_LANE_ALIGNMENT;
+    num_background_frames = 0;
+
+    running_average_size = DEFAULT_RUNNING_AVERAGE_SIZE;
+    minimum_temperature_differential = DEFAULT_MIN_TEMPERATURE_DIFFERENTIAL;
+    active_pixel_variance_scalar = DEFAULT_ACTIVE_PIXEL_VARIANCE_SCALAR;
+
+    frames = allocate_plane(NUM_FRAME_PIXELS * stride);
+    averages = allocate_plane(NUM_FRAME_PIXELS * stride);
+    variances = allocate_plane(NUM_FRAME_PIXELS * stride);
+    active = allocate_plane(NUM_FRAME_PIXELS * stride);
+    add_to_background = allocate_plane(stride);
+    num_active_pixels = new int[num_sensors];
+
+    trackers = new ThermalTracker[num_sensors];
+}
+
+BatchTracker::~BatchTracker() {
+    free(frames);
+    free(averages);
+    free(variances);
+    free(active);
+    free(add_to_background);
+    delete[] num_active_pixels;
+    delete[] trackers;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+
+void BatchTracker::update(float (*const input[])[FRAME_WIDTH]) {
+    /**
+    * Process one frame from every sensor.
+    * Mirrors ThermalTracker::update, but with the per-pixel stages run across all sensors at once.
+    * @param input Array of num_sensors frame pointers, one per sensor
+    */
+    load_frames(input);
+
+    if (!is_background_finished()) {
+        build_background();
+    } else {
+        find_active_pixels();
+        track_sensors();
+        add_frames_to_background();
+    }
+}
+
+ThermalTracker& BatchTracker::get_tracker(int sensor) { return trackers[sensor]; }
+
+int BatchTracker::get_num_sensors() { return num_sensors; }
+
+bool BatchTracker::is_background_finished() { return num_background_frames >= running_average_size; }
+
+float BatchTracker::get_average(int sensor, int row, int column) {
+    return averages[(row * FRAME_WIDTH + column) * stride + sensor];
+}
+
+float BatchTracker::get_variance(int sensor, int row, int column) {
+    return variances[(row * FRAME_WIDTH + column) * stride + sensor];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+
+void BatchTracker::load_frames(float (*const input[])[FRAME_WIDTH]) {
+    /**
+    * Interleave the sensors' frames into the pixel-major frame plane.
+    * This transpose is the only per-sensor pass over the raw pixels.
+    */
+    for (int k = 0; k < num_sensors; k++) {
+        const float* source = &input[k][0][0];
+        float* destination = frames + k;
+
+        for (int p = 0; p < NUM_FRAME_PIXELS; p++) {
+            destination[p * stride] = source[p];
+        }
+    }
+}
+
+void BatchTracker::build_background() {
+    /**
+    * Add the current frames to the fixed-population background, as ThermalTracker::build_background does.
+    */
+    float* __restrict__ average = averages;
+    float* __restrict__ variance = variances;
+    const float* __restrict__ frame = frames;
+    const int num_lanes = NUM_FRAME_PIXELS * stride;
+
+    if (num_background_frames == 0) {
+        for (int i = 0; i < num_lanes; i++) {
+            average[i] = frame[i];
+            variance[i] = 0;
+        }
+    } else {
+        const float weight = 1.0 / (num_background_frames + 1);
+
+        for (int i = 0; i < num_lanes; i++) {
+            float temp = frame[i];
+            float last_average = average[i];
+
+            average[i] = last_average + (temp - last_average) * weight;
+            variance[i] += (temp - average[i]) * (temp - last_average);
+        }
+    }
+
+    num_background_frames++;
+
+    if (num_background_frames == running_average_size) {
+        for (int i = 0; i < num_lanes; i++) {
+            variance[i] = sqrtf(variance[i] / (num_background_frames - 1));
+        }
+    }
+
+    for (int k = 0; k < num_sensors; k++) {
+        trackers[k].num_background_frames = num_background_frames;
+        trackers[k].running_average_size = running_average_size;
+    }
+}
+
+void BatchTracker::find_active_pixels() {
+    /**
+    * Build the active pixel mask for every sensor.
+    * Branch-free so each pixel row of lanes compiles down to a handful of vector compares.
+    */
+    const float* __restrict__ frame = frames;
+    const float* __restrict__ average = averages;
+    const float* __restrict__ variance = variances;
+    float* __restrict__ mask = active;
+    const float scalar = active_pixel_variance_scalar;
+    const float minimum = minimum_temperature_differential;
+    const int num_lanes = NUM_FRAME_PIXELS * stride;
+
+    for (int i = 0; i < num_lanes; i++) {
+        float difference = fabsf(average[i] - frame[i]);
+        bool is_active = (difference > variance[i] * scalar) & (difference > minimum);
+        mask[i] = is_active ? 1.0f : 0.0f;
+    }
+}
+
+void BatchTracker::track_sensors() {
+    /**
+    * Run the blob and tracking stages per sensor on the pixels flagged by the active mask.
+    */
+    uint8_t active_indexes[NUM_FRAME_PIXELS];
+    float sensor_frame[FRAME_HEIGHT][FRAME_WIDTH]; /**< Only the active pixels are filled in */
+
+    for (int k = 0; k < num_sensors; k++) {
+        int num_active = 0;
+
+        for (int p = 0; p < NUM_FRAME_PIXELS; p++) {
+            if (active[p * stride + k] != 0) {
+                active_indexes[num_active++] = p;
+                sensor_frame[p / FRAME_WIDTH][p % FRAME_WIDTH] = frames[p * stride + k];
+            }
+        }
+
+        num_active_pixels[k] = num_active;
+        add_to_background[k] =
+            trackers[k].track_active_pixels(active_indexes, num_active, sensor_frame) ? 1.0f : 0.0f;
+    }
+}
+
+void BatchTracker::add_frames_to_background() {
+    /**
+    * Add the current frames to the running backgrounds, as ThermalTracker::add_current_frame_to_background does.
+    * Every lane is updated and then blended with its old value, so sensors with activity keep their background.
+    */
+    float* __restrict__ average = averages;
+    float* __restrict__ variance = variances;
+    const float* __restrict__ frame = frames;
+    const float* __restrict__ blend = add_to_background;
+    const float size = running_average_size;
+    const float keep = (size - 1) / size;
+    const float weight = 1 / size;
+
+    for (int p = 0; p < NUM_FRAME_PIXELS; p++) {
+        float* __restrict__ average_row = average + p * stride;
+        float* __restrict__ variance_row = variance + p * stride;
+        const float* __restrict__ frame_row = frame + p * stride;
+
+        for (int k = 0; k < stride; k++) {
+            float temp = frame_row[k];
+            float old_average = average_row[k];
+            float old_variance = variance_row[k];
+
+            float new_average = old_average * keep + temp * weight;
+            float new_variance = old_variance * keep + fabsf(temp - new_average) * weight;
+
+            average_row[k] = old_average + (new_average - old_average) * blend[k];
+            variance_row[k] = old_variance + (new_variance - old_variance) * blend[k];
+        }
+    }
+}
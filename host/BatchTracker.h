@@ -0,0 +1,83 @@
+#ifndef BATCH_TRACKER_H
+#define BATCH_TRACKER_H
+
+#include <stdint.h>
+#include "ThermalTracker.h"
+
+const int NUM_FRAME_PIXELS = FRAME_WIDTH * FRAME_HEIGHT;
+const int BATCH_LANE_ALIGNMENT = 16; /**< Sensor lanes are padded to a multiple of this for full-width vectors */
+
+/**
+* Tracks several sensors in lockstep.
+* A single 16x4 frame is far too small to keep a SIMD unit busy, so the per-pixel stages (background model, pixel
+* thresholding and the active mask) are run for all sensors at once on interleaved data: pixel-major, sensor-minor,
+* giving one vector lane per sensor. Only blob building and tracking drop back to a ThermalTracker per sensor.
+*
+* All sensors share one configuration and must be updated together, one frame each per update.
+*/
+class BatchTracker {
+   public:
+    /**
+    * Create a batch of trackers.
+    * @param num_sensors Number of sensors processed in each update
+    */
+    explicit BatchTracker(int num_sensors);
+    ~BatchTracker();
+
+    /**
+    * Process one frame from every sensor.
+    * @param frames Array of num_sensors frame pointers, one per sensor
+    */
+    void update(float (*const frames[])[FRAME_WIDTH]);
+
+    /**
+    * Get the per-sensor tracker used for the blob and tracking stages (and holding its tracks and movements).
+    * @param sensor Sensor index
+    */
+    ThermalTracker& get_tracker(int sensor);
+
+    int get_num_sensors();
+    bool is_background_finished();
+
+    /**
+    * Get a sensor's background average for a pixel.
+    */
+    float get_average(int sensor, int row, int column);
+
+    /**
+    * Get a sensor's background variance for a pixel.
+    */
+    float get_variance(int sensor, int row, int column);
+
+    // Running configuration, shared by every lane
+    int running_average_size;
+    float minimum_temperature_differential;
+    float active_pixel_variance_scalar;
+
+   private:
+    void load_frames(float (*const frames[])[FRAME_WIDTH]);
+    void build_background();
+    void find_active_pixels();
+    void track_sensors();
+    void add_frames_to_background();
+
+    int num_sensors;
+    int stride; /**< Lanes per pixel, num_sensors rounded up to BATCH_LANE_ALIGNMENT */
+    int num_background_frames;
+
+    // Interleaved [pixel][lane] planes
+    float* frames;
+    float* averages;
+    float* variances;
+    float* active;
+
+    float* add_to_background; /**< Per lane; 1 if the lane's frame goes into its background this update */
+    int* num_active_pixels;
+
+    ThermalTracker* trackers;
+
+    BatchTracker(const BatchTracker&);
+    BatchTracker& operator=(const BatchTracker&);
+};
+
+#endif
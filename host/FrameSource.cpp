@@ -0,0 +1,104 @@
+#include "FrameSource.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// File source
+
+FileFrameSource::FileFrameSource(const char* path, unsigned int _stream) {
+    file = fopen(path, "rb");
+    stream = _stream;
+}
+
+FileFrameSource::~FileFrameSource() {
+    if (file) {
+        fclose(file);
+    }
+}
+
+bool FileFrameSource::is_open() { return file != NULL; }
+
+bool FileFrameSource::read(HostFrame& frame) {
+    /**
+    * Read the next frame from the recording.
+    * A partial frame at the end of the file is treated as the end of the recording.
+    */
+    if (!file) {
+        return false;
+    }
+
+    frame.stream = stream;
+    return fread(frame.pixels, sizeof(frame.pixels), 1, file) == 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// UDP source
+
+UdpFrameSource::UdpFrameSource(int port, bool loopback_only) {
+    num_malformed_datagrams = 0;
+    socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (socket_fd >= 0) {
+        // Sensors send in bursts after WiFi stalls; give the kernel room to hold them until the reader catches up
+        int receive_buffer_size = UDP_RECEIVE_BUFFER_SIZE;
+        setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof(receive_buffer_size));
+
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(loopback_only ? INADDR_LOOPBACK : INADDR_ANY);
+
+        if (bind(socket_fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            ::close(socket_fd);
+            socket_fd = -1;
+        }
+    }
+}
+
+UdpFrameSource::~UdpFrameSource() { close(); }
+
+bool UdpFrameSource::is_open() { return socket_fd >= 0; }
+
+bool UdpFrameSource::read(HostFrame& frame) {
+    /**
+    * Block until the next valid frame datagram arrives.
+    * Datagrams of the wrong size are counted and discarded.
+    * @return False once the socket has been closed
+    */
+    uint8_t datagram[UDP_FRAME_SIZE + 1];
+
+    while (socket_fd >= 0) {
+        ssize_t length = recv(socket_fd, datagram, sizeof(datagram), 0);
+
+        // Shutting the socket down from another thread wakes recv with a zero length
+        if (length <= 0) {
+            return false;
+        }
+
+        if (length != UDP_FRAME_SIZE) {
+            num_malformed_datagrams++;
+            continue;
+        }
+
+        frame.stream = (datagram[0] << 8) | datagram[1];
+        memcpy(frame.pixels, datagram + UDP_FRAME_HEADER_SIZE, sizeof(frame.pixels));
+        return true;
+    }
+
+    return false;
+}
+
+void UdpFrameSource::close() {
+    /**
+    * Close the socket, releasing any reader blocked in read()
+    */
+    if (socket_fd >= 0) {
+        shutdown(socket_fd, SHUT_RDWR);
+        ::close(socket_fd);
+        socket_fd = -1;
+    }
+}
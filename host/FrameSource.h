@@ -0,0 +1,95 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <stdio.h>
+#include "ThermalTracker.h"
+
+/**
+* A single thermal frame as received by the host service, tagged with the stream it belongs to.
+*/
+struct HostFrame {
+    unsigned int stream;
+    float pixels[FRAME_HEIGHT][FRAME_WIDTH];
+};
+
+/**
+* Interface for anything that can feed thermal frames into the host tracking service.
+*/
+class FrameSource {
+   public:
+    virtual ~FrameSource() {}
+
+    /**
+    * Read the next frame from the source.
+    * @param frame Frame to read the pixels and stream number into
+    * @return False if the source has no more frames
+    */
+    virtual bool read(HostFrame& frame) = 0;
+};
+
+/**
+* Replays a recorded frame stream from disk.
+* Recordings are raw, native-endian float32 frames of FRAME_HEIGHT x FRAME_WIDTH pixels, stored row by row.
+*/
+class FileFrameSource : public FrameSource {
+   public:
+    /**
+    * Open a recording for replay
+    * @param path Path to the recording
+    * @param stream Stream number assigned to every frame read from the file
+    */
+    FileFrameSource(const char* path, unsigned int stream);
+    ~FileFrameSource();
+
+    /**
+    * Determine if the recording was opened successfully
+    * @return True if frames can be read from the file
+    */
+    bool is_open();
+
+    bool read(HostFrame& frame);
+
+   private:
+    FILE* file;
+    unsigned int stream;
+};
+
+/**
+* Receives live frames from sensors (or a replay tool) over UDP.
+* Each datagram carries one frame: a big-endian uint16 stream number followed by the native-endian float32 pixels.
+*/
+class UdpFrameSource : public FrameSource {
+   public:
+    /**
+    * Bind a UDP socket to receive frames on.
+    * @param port Port number to listen on
+    * @param loopback_only Only accept frames sent from the local machine
+    */
+    UdpFrameSource(int port, bool loopback_only = false);
+    ~UdpFrameSource();
+
+    bool is_open();
+
+    /**
+    * Block until the next valid frame datagram arrives.
+    * Datagrams of the wrong size are counted and discarded.
+    * @return False once the socket has been closed
+    */
+    bool read(HostFrame& frame);
+
+    /**
+    * Close the socket, releasing any reader blocked in read()
+    */
+    void close();
+
+    unsigned long num_malformed_datagrams;
+
+   private:
+    int socket_fd;
+};
+
+const int UDP_FRAME_HEADER_SIZE = 2;
+const int UDP_FRAME_SIZE = UDP_FRAME_HEADER_SIZE + FRAME_HEIGHT * FRAME_WIDTH * sizeof(float);
+const int UDP_RECEIVE_BUFFER_SIZE = 4 * 1024 * 1024;
+
+#endif
@@ -0,0 +1,111 @@
+#include "SocketTransport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+
+SocketTransport::SocketTransport() {
+    memset(&address, 0, sizeof(address));
+    socket_fd = -1;
+}
+
+SocketTransport::~SocketTransport() { close(); }
+
+////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+
+int SocketTransport::resolve(const char* host) {
+    /**
+    * Look up the IPv4 address of a host.
+    */
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* found;
+    if (getaddrinfo(host, NULL, &hints, &found) != 0) {
+        return TRANSPORT_FAILED;
+    }
+
+    address = *(sockaddr_in*)found->ai_addr;
+    freeaddrinfo(found);
+    return TRANSPORT_DONE;
+}
+
+int SocketTransport::connect(uint16_t port) {
+    /**
+    * Open a connection to the address last resolved.
+    * The first call starts connecting; later calls check whether the socket has become writable.
+    */
+    if (socket_fd < 0) {
+        socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (socket_fd < 0) {
+            return TRANSPORT_FAILED;
+        }
+        fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL) | O_NONBLOCK);
+
+        address.sin_port = htons(port);
+        if (::connect(socket_fd, (sockaddr*)&address, sizeof(address)) == 0) {
+            return TRANSPORT_DONE;
+        }
+        if (errno != EINPROGRESS) {
+            close();
+            return TRANSPORT_FAILED;
+        }
+    }
+
+    pollfd waiting = {socket_fd, POLLOUT, 0};
+    if (poll(&waiting, 1, 0) == 0) {
+        return TRANSPORT_PENDING;
+    }
+
+    int error = 0;
+    socklen_t error_size = sizeof(error);
+    getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, &error, &error_size);
+    return error == 0 ? TRANSPORT_DONE : TRANSPORT_FAILED;
+}
+
+int SocketTransport::write(const uint8_t* data, size_t length) {
+    /**
+    * Send as much of some data as the socket buffer will take.
+    */
+    ssize_t sent = send(socket_fd, data, length, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    if (sent < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    return sent;
+}
+
+int SocketTransport::read(uint8_t* buffer, size_t length) {
+    /**
+    * Read whatever has been received.
+    */
+    ssize_t received = recv(socket_fd, buffer, length, MSG_DONTWAIT);
+
+    if (received == 0) {
+        return TRANSPORT_CLOSED;
+    }
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : TRANSPORT_CLOSED;
+    }
+    return received;
+}
+
+void SocketTransport::close() {
+    /**
+    * Close the connection, if open.
+    */
+    if (socket_fd >= 0) {
+        ::close(socket_fd);
+        socket_fd = -1;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef SOCKET_TRANSPORT_H
+#define SOCKET_TRANSPORT_H
+
+#include <netinet/in.h>
+#include "UploadTransport.h"
+
+/**
+* UploadTransport over a non-blocking POSIX socket, for running the Uploader on the host.
+* Connecting, sending and receiving never wait. Looking up a name uses getaddrinfo(), which does wait; dotted addresses
+* and "localhost" are answered without touching the network.
+*/
+class SocketTransport : public UploadTransport {
+   public:
+    SocketTransport();
+    ~SocketTransport();
+
+    int resolve(const char* host);
+    int connect(uint16_t port);
+    int write(const uint8_t* data, size_t length);
+    int read(uint8_t* buffer, size_t length);
+    void close();
+
+   private:
+    sockaddr_in address;
+    int socket_fd;
+};
+
+#endif
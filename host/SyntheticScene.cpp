@@ -0,0 +1,128 @@
+#include "SyntheticScene.h"
+
+SyntheticScene::SyntheticScene(uint32_t seed, float _spawn_rate) {
+    state = seed ? seed : 1;
+    spawn_rate = _spawn_rate;
+
+    ambient = DEFAULT_SCENE_AMBIENT;
+    noise = DEFAULT_SCENE_NOISE;
+    body_temperature = DEFAULT_SCENE_BODY_TEMPERATURE;
+    min_speed = 0.3;
+    max_speed = 0.8;
+    position_jitter = 0;
+    turn_rate = 0;
+    crossing_column = (FRAME_WIDTH - 1) / 2.0;
+    walker_height = FRAME_HEIGHT;
+    num_lanes = 1;
+
+    num_walkers = 0;
+    num_frames = 0;
+    for (int i = 0; i < NUM_DIRECTION_CATEGORIES; i++) {
+        true_movements[i] = 0;
+    }
+    true_crossings[LEFT] = 0;
+    true_crossings[RIGHT] = 0;
+    last_crossing_frame = -1;
+}
+
+float SyntheticScene::uniform() {
+    // xorshift32 - deterministic across platforms, unlike rand()
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) / float(1 << 24);
+}
+
+float SyntheticScene::gaussian() {
+    // Irwin-Hall approximation; plenty for sensor noise
+    float sum = 0;
+    for (int i = 0; i < 12; i++) {
+        sum += uniform();
+    }
+    return sum - 6;
+}
+
+void SyntheticScene::add_walker(float x, float speed, int width, int lane) {
+    if (num_walkers < MAX_SCENE_WALKERS) {
+        walkers[num_walkers].x = x;
+        walkers[num_walkers].speed = speed;
+        walkers[num_walkers].width = width;
+        walkers[num_walkers].lane = lane;
+        num_walkers++;
+    }
+}
+
+int SyntheticScene::get_num_walkers() { return num_walkers; }
+
+void SyntheticScene::empty_frame(float frame[FRAME_HEIGHT][FRAME_WIDTH]) {
+    for (int i = 0; i < FRAME_HEIGHT; i++) {
+        for (int j = 0; j < FRAME_WIDTH; j++) {
+            frame[i][j] = ambient + gaussian() * noise;
+        }
+    }
+}
+
+void SyntheticScene::render_walker(float frame[FRAME_HEIGHT][FRAME_WIDTH], float x, int width, int lane) {
+    int left = int(x - width / 2.0 + 0.5);
+    int top = num_lanes > 1 ? lane * (FRAME_HEIGHT - walker_height) / (num_lanes - 1) : 0;
+    int bottom = constrain(top + walker_height, 0, FRAME_HEIGHT);
+
+    for (int j = left; j < left + width; j++) {
+        if (j >= 0 && j < FRAME_WIDTH) {
+            for (int i = top; i < bottom; i++) {
+                frame[i][j] = body_temperature + gaussian() * noise;
+            }
+        }
+    }
+}
+
+void SyntheticScene::next_frame(float frame[FRAME_HEIGHT][FRAME_WIDTH]) {
+    /**
+    * Advance the scene by one frame and render it.
+    * Walkers enter just outside the frame edges and are counted once they have left the opposite side.
+    * @param frame Buffer to render the frame into
+    */
+    if (uniform() < spawn_rate) {
+        float speed = min_speed + uniform() * (max_speed - min_speed);
+        int width = 2 + (uniform() < 0.5 ? 0 : 1);
+        int lane = num_lanes > 1 ? int(uniform() * num_lanes) : 0;
+
+        if (uniform() < 0.5) {
+            add_walker(-width, speed, width, lane);
+        } else {
+            add_walker(FRAME_WIDTH + width - 1, -speed, width, lane);
+        }
+    }
+
+    empty_frame(frame);
+
+    int i = 0;
+    while (i < num_walkers) {
+        Walker& walker = walkers[i];
+        if (turn_rate > 0 && uniform() < turn_rate) {
+            walker.speed = -walker.speed;
+        }
+
+        float last_x = walker.x;
+        walker.x += walker.speed;
+
+        if ((last_x < crossing_column) != (walker.x < crossing_column)) {
+            true_crossings[walker.speed > 0 ? RIGHT : LEFT]++;
+            last_crossing_frame = num_frames;
+        }
+
+        bool gone_right = walker.x - walker.width > FRAME_WIDTH;
+        bool gone_left = walker.x + walker.width < -1;
+
+        if (gone_right || gone_left) {
+            true_movements[gone_right ? RIGHT : LEFT]++;
+            walkers[i] = walkers[--num_walkers];
+            continue;
+        }
+
+        render_walker(frame, walker.x + gaussian() * position_jitter, walker.width, walker.lane);
+        i++;
+    }
+
+    num_frames++;
+}
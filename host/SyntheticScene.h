@@ -0,0 +1,86 @@
+#ifndef SYNTHETIC_SCENE_H
+#define SYNTHETIC_SCENE_H
+
+#include <stdint.h>
+#include "ThermalTracker.h"
+
+const int MAX_SCENE_WALKERS = 64;
+const float DEFAULT_SCENE_AMBIENT = 20.0;
+const float DEFAULT_SCENE_NOISE = 0.1;
+const float DEFAULT_SCENE_BODY_TEMPERATURE = 30.0;
+
+/**
+* Generates thermal frames of people walking across the sensor, with known ground-truth movement counts.
+* Used to benchmark the tracker and to measure counting accuracy without recordings.
+*/
+class SyntheticScene {
+   public:
+    /**
+    * Create a scene.
+    * @param seed Random seed; identical seeds produce identical frame sequences
+    * @param spawn_rate Probability per frame that a new person enters from one side
+    */
+    SyntheticScene(uint32_t seed, float spawn_rate);
+
+    /**
+    * Advance the scene by one frame and render it.
+    * @param frame Buffer to render the frame into
+    */
+    void next_frame(float frame[FRAME_HEIGHT][FRAME_WIDTH]);
+
+    /**
+    * Render an empty frame (background noise only) without advancing the walkers.
+    * @param frame Buffer to render the frame into
+    */
+    void empty_frame(float frame[FRAME_HEIGHT][FRAME_WIDTH]);
+
+    /**
+    * Add a person to the scene.
+    * @param x Starting column of the person's centre
+    * @param speed Columns moved per frame. Negative speeds walk left.
+    * @param width Width of the person in pixels
+    * @param lane Lane the person keeps to, from 0 to num_lanes - 1
+    */
+    void add_walker(float x, float speed, int width, int lane = 0);
+
+    int get_num_walkers();
+
+    /**
+    * Uniform random number between 0 and 1
+    */
+    float uniform();
+
+    float ambient;
+    float noise;
+    float body_temperature;
+    float spawn_rate;
+    float min_speed;
+    float max_speed;
+    float position_jitter; /**< Standard deviation of the per-frame wobble in each walker's position */
+    float turn_rate;       /**< Probability per frame that a walker turns around */
+    float crossing_column; /**< Column the crossing ground truth is kept for */
+    int walker_height;     /**< Rows each walker covers; the whole frame for the usual overhead view */
+    int num_lanes;         /**< Horizontal lanes walkers keep to, spread evenly down the frame */
+
+    long true_movements[NUM_DIRECTION_CATEGORIES]; /**< Ground truth: walkers that crossed the whole frame */
+    long true_crossings[2];                        /**< Ground truth: crossings of crossing_column, by LEFT and RIGHT */
+    long last_crossing_frame;                      /**< Frame the last of those crossings happened on */
+    long num_frames;
+
+   private:
+    struct Walker {
+        float x;
+        float speed;
+        int width;
+        int lane;
+    };
+
+    float gaussian();
+    void render_walker(float frame[FRAME_HEIGHT][FRAME_WIDTH], float x, int width, int lane);
+
+    Walker walkers[MAX_SCENE_WALKERS];
+    int num_walkers;
+    uint32_t state;
+};
+
+#endif
@@ -0,0 +1,409 @@
+#include "TrackerService.h"
+
+// Trackers report events through plain function pointers, so the worker records which stream it is running
+static thread_local StreamWorker* active_stream = NULL;
+static thread_local int active_worker = -1;
+
+static void handle_tracked_start(const TrackedBlob& /* blob */) {
+    if (active_stream) {
+        active_stream->num_track_starts++;
+    }
+}
+
+static void handle_tracked_end(const TrackedBlob& /* blob */) {
+    if (active_stream) {
+        active_stream->num_track_ends++;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Stream worker
+
+StreamWorker::StreamWorker(unsigned int _id, WorkStealingPool* _pool, unsigned int _max_queued_frames)
+    : is_scheduled(false), num_track_starts(0), num_track_ends(0) {
+    id = _id;
+    pool = _pool;
+    max_queued_frames = _max_queued_frames;
+
+    num_frames = 0;
+    num_dropped_frames = 0;
+    total_latency_us = 0;
+    max_latency_us = 0;
+    for (int i = 0; i < NUM_DIRECTION_CATEGORIES; i++) {
+        movements[i] = 0;
+    }
+
+    tracker.set_tracking_start_callback(handle_tracked_start);
+    tracker.set_tracking_end_callback(handle_tracked_end);
+}
+
+bool StreamWorker::push(const float pixels[FRAME_HEIGHT][FRAME_WIDTH]) {
+    /**
+    * Queue a frame for the stream and schedule the stream on the pool if it is idle.
+    * @param pixels Frame to queue
+    * @return False if the stream's queue is full and the frame was not accepted
+    */
+    {
+        std::lock_guard<std::mutex> guard(queue_lock);
+        if (queue.size() >= max_queued_frames) {
+            return false;
+        }
+
+        queue.push_back(QueuedFrame());
+        memcpy(queue.back().pixels, pixels, sizeof(queue.back().pixels));
+        queue.back().received = host_clock::now();
+    }
+
+    if (!is_scheduled.exchange(true)) {
+        pool->submit(this);
+    }
+
+    return true;
+}
+
+void StreamWorker::run() {
+    /**
+    * Process up to STREAM_BATCH_FRAMES queued frames.
+    * Called from a pool worker; the stream reschedules itself if frames are still waiting afterwards.
+    */
+    QueuedFrame current;
+
+    for (unsigned int i = 0; i < STREAM_BATCH_FRAMES; i++) {
+        {
+            std::lock_guard<std::mutex> guard(queue_lock);
+            if (queue.empty()) {
+                break;
+            }
+            current = queue.front();
+            queue.pop_front();
+        }
+
+        active_stream = this;
+        tracker.update(current.pixels);
+        active_stream = NULL;
+
+        double latency_us =
+            std::chrono::duration<double, std::micro>(host_clock::now() - current.received).count();
+
+        std::lock_guard<std::mutex> guard(stats_lock);
+        num_frames++;
+        total_latency_us += latency_us;
+        if (latency_us > max_latency_us) {
+            max_latency_us = latency_us;
+        }
+        for (int j = 0; j < NUM_DIRECTION_CATEGORIES; j++) {
+            movements[j] = tracker.movements[j];
+        }
+    }
+
+    // Let go of the stream, then take it back if a frame was queued while it was still marked as scheduled
+    is_scheduled = false;
+
+    bool has_frames;
+    {
+        std::lock_guard<std::mutex> guard(queue_lock);
+        has_frames = !queue.empty();
+    }
+
+    if (has_frames && !is_scheduled.exchange(true)) {
+        pool->submit(this);
+    }
+}
+
+void StreamWorker::add_dropped_frame() {
+    std::lock_guard<std::mutex> guard(stats_lock);
+    num_dropped_frames++;
+}
+
+StreamStats StreamWorker::get_stats() {
+    StreamStats stats;
+
+    std::lock_guard<std::mutex> guard(stats_lock);
+    stats.num_frames = num_frames;
+    stats.num_dropped_frames = num_dropped_frames;
+    stats.num_track_starts = num_track_starts;
+    stats.num_track_ends = num_track_ends;
+    stats.mean_latency_us = num_frames > 0 ? total_latency_us / num_frames : 0;
+    stats.max_latency_us = max_latency_us;
+
+    for (int i = 0; i < NUM_DIRECTION_CATEGORIES; i++) {
+        stats.movements[i] = movements[i];
+    }
+
+    std::vector<TrackedBlob> tracks;
+    stats.num_live_tracks = read_tracks(tracks) ? tracks.size() : -1;
+
+    return stats;
+}
+
+bool StreamWorker::read_tracks(std::vector<TrackedBlob>& tracks) {
+    /**
+    * Copy out the stream's live tracks without stopping or locking its tracker.
+    * Safe to call while a worker is running the stream.
+    * @param tracks Filled with the tracks that were live at the time of the read
+    * @return False if the tracks were changing too fast to read
+    */
+    std::vector<TrackHandle> handles(tracker.get_blob_capacity());
+    int num_handles = tracker.read_track_handles(&handles[0]);
+    if (num_handles < 0) {
+        return false;
+    }
+
+    // Tracks that ended since the handles were read are skipped
+    tracks.clear();
+    TrackedBlob track;
+    for (int i = 0; i < num_handles; i++) {
+        if (tracker.read_track(handles[i], track)) {
+            tracks.push_back(track);
+        }
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Work-stealing pool
+
+WorkStealingPool::WorkStealingPool(unsigned int num_workers)
+    : running(true), num_pending(0), next_queue(0), num_steals(0) {
+    if (num_workers == 0) {
+        num_workers = 1;
+    }
+
+    for (unsigned int i = 0; i < num_workers; i++) {
+        queues.push_back(new WorkerQueue());
+        queues.back()->busy_ns = 0;
+    }
+
+    for (unsigned int i = 0; i < num_workers; i++) {
+        threads.push_back(std::thread(&WorkStealingPool::run_worker, this, i));
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    stop();
+
+    for (unsigned int i = 0; i < queues.size(); i++) {
+        delete queues[i];
+    }
+}
+
+void WorkStealingPool::submit(StreamWorker* stream) {
+    /**
+    * Schedule a stream to run on the pool.
+    * Streams resubmitted from a worker stay on that worker's deque to keep their tracker state cache-warm.
+    * @param stream Stream to run
+    */
+    unsigned int index;
+    if (active_worker >= 0) {
+        index = active_worker;
+    } else {
+        index = next_queue++ % queues.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(queues[index]->lock);
+        queues[index]->tasks.push_back(stream);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        num_pending++;
+    }
+    wake.notify_one();
+}
+
+void WorkStealingPool::stop() {
+    /**
+    * Stop and join all of the worker threads. Any tasks still queued are abandoned.
+    */
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        running = false;
+    }
+    wake.notify_all();
+
+    for (unsigned int i = 0; i < threads.size(); i++) {
+        if (threads[i].joinable()) {
+            threads[i].join();
+        }
+    }
+}
+
+unsigned int WorkStealingPool::get_num_workers() { return queues.size(); }
+
+double WorkStealingPool::get_busy_seconds() {
+    uint64_t busy_ns = 0;
+    for (unsigned int i = 0; i < queues.size(); i++) {
+        busy_ns += queues[i]->busy_ns;
+    }
+
+    return busy_ns / 1e9;
+}
+
+uint64_t WorkStealingPool::get_num_steals() { return num_steals; }
+
+bool WorkStealingPool::take_task(unsigned int index, StreamWorker*& task) {
+    /**
+    * Take the newest task from the worker's own deque, or steal the oldest task from another worker.
+    * @param index Index of the worker looking for work
+    * @param task Set to the task to run
+    * @return True if a task was found
+    */
+    {
+        WorkerQueue* own = queues[index];
+        std::lock_guard<std::mutex> guard(own->lock);
+        if (!own->tasks.empty()) {
+            task = own->tasks.back();
+            own->tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (unsigned int i = 1; i < queues.size(); i++) {
+        WorkerQueue* victim = queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if (!victim->tasks.empty()) {
+            task = victim->tasks.front();
+            victim->tasks.pop_front();
+            num_steals++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingPool::run_worker(unsigned int index) {
+    active_worker = index;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(sleep_lock);
+            wake.wait(guard, [this] { return num_pending > 0 || !running; });
+            if (!running) {
+                return;
+            }
+            num_pending--;
+        }
+
+        // Every pending count has a matching task, but another worker may have stolen ours; keep looking until found
+        StreamWorker* task = NULL;
+        while (!take_task(index, task)) {
+            std::this_thread::yield();
+        }
+
+        host_clock::time_point start = host_clock::now();
+        task->run();
+        host_clock::duration busy = host_clock::now() - start;
+        queues[index]->busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Service
+
+TrackerService::TrackerService(unsigned int num_threads, unsigned int _max_queued_frames) : pool(num_threads) {
+    max_queued_frames = _max_queued_frames;
+    start_time = host_clock::now();
+}
+
+TrackerService::~TrackerService() {
+    pool.stop();
+
+    for (std::map<unsigned int, StreamWorker*>::iterator it = streams.begin(); it != streams.end(); ++it) {
+        delete it->second;
+    }
+}
+
+StreamWorker* TrackerService::get_stream(unsigned int stream) {
+    std::lock_guard<std::mutex> guard(streams_lock);
+
+    std::map<unsigned int, StreamWorker*>::iterator it = streams.find(stream);
+    if (it != streams.end()) {
+        return it->second;
+    }
+
+    StreamWorker* worker = new StreamWorker(stream, &pool, max_queued_frames);
+    streams[stream] = worker;
+    return worker;
+}
+
+bool TrackerService::submit(unsigned int stream, const float pixels[FRAME_HEIGHT][FRAME_WIDTH], bool block) {
+    /**
+    * Hand a frame to the stream it belongs to, creating the stream on first use.
+    * @param stream Stream number of the frame
+    * @param pixels Frame to process
+    * @param block Wait for room in the stream's queue instead of dropping the frame
+    * @return True if the frame was queued
+    */
+    StreamWorker* worker = get_stream(stream);
+
+    while (!worker->push(pixels)) {
+        if (!block) {
+            worker->add_dropped_frame();
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    return true;
+}
+
+void TrackerService::drain() {
+    /**
+    * Wait until every queued frame has been processed.
+    * A stream stays scheduled until its queue is empty, so the service is idle once no stream is scheduled.
+    */
+    bool busy = true;
+
+    while (busy) {
+        busy = false;
+        {
+            std::lock_guard<std::mutex> guard(streams_lock);
+            for (std::map<unsigned int, StreamWorker*>::iterator it = streams.begin(); it != streams.end(); ++it) {
+                if (it->second->is_scheduled) {
+                    busy = true;
+                    break;
+                }
+            }
+        }
+
+        if (busy) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void TrackerService::print_stats(FILE* output) {
+    /**
+    * Print aggregate throughput and the per-stream statistics.
+    * Throughput per core is measured against the time workers actually spent processing, not wall time.
+    * @param output Stream to print to
+    */
+    double elapsed = std::chrono::duration<double>(host_clock::now() - start_time).count();
+    double busy = pool.get_busy_seconds();
+    uint64_t total_frames = 0;
+
+    std::lock_guard<std::mutex> guard(streams_lock);
+
+    fprintf(output, "%8s %10s %8s %12s %12s %7s %7s %5s %6s %6s %6s %6s %6s\n", "stream", "frames", "dropped",
+            "mean_lat_us", "max_lat_us", "starts", "ends", "live", "left", "right", "up", "down", "nodir");
+
+    for (std::map<unsigned int, StreamWorker*>::iterator it = streams.begin(); it != streams.end(); ++it) {
+        StreamStats stats = it->second->get_stats();
+        total_frames += stats.num_frames;
+
+        fprintf(output, "%8u %10llu %8llu %12.1f %12.1f %7llu %7llu %5d %6ld %6ld %6ld %6ld %6ld\n", it->first,
+                (unsigned long long)stats.num_frames, (unsigned long long)stats.num_dropped_frames,
+                stats.mean_latency_us, stats.max_latency_us, (unsigned long long)stats.num_track_starts,
+                (unsigned long long)stats.num_track_ends, stats.num_live_tracks, stats.movements[LEFT],
+                stats.movements[RIGHT], stats.movements[UP], stats.movements[DOWN], stats.movements[NO_DIRECTION]);
+    }
+
+    fprintf(output, "streams: %u  workers: %u  frames: %llu  elapsed: %.2f s  throughput: %.0f frames/s  ",
+            (unsigned int)streams.size(), pool.get_num_workers(), (unsigned long long)total_frames, elapsed,
+            elapsed > 0 ? total_frames / elapsed : 0);
+    fprintf(output, "per core: %.0f frames/s  steals: %llu\n", busy > 0 ? total_frames / busy : 0,
+            (unsigned long long)pool.get_num_steals());
+}
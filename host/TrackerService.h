@@ -0,0 +1,190 @@
+#ifndef TRACKER_SERVICE_H
+#define TRACKER_SERVICE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ThermalTracker.h"
+
+const unsigned int DEFAULT_MAX_QUEUED_FRAMES = 256;
+const unsigned int STREAM_BATCH_FRAMES = 32; /**< Frames a worker processes for one stream before yielding it */
+
+typedef std::chrono::steady_clock host_clock;
+
+class WorkStealingPool;
+
+/**
+* Snapshot of the statistics gathered for a single stream.
+*/
+struct StreamStats {
+    uint64_t num_frames;
+    uint64_t num_dropped_frames;
+    uint64_t num_track_starts;
+    uint64_t num_track_ends;
+    double mean_latency_us;
+    double max_latency_us;
+    long movements[NUM_DIRECTION_CATEGORIES];
+    int num_live_tracks; /**< -1 if the tracks were changing too fast to read */
+};
+
+/**
+* One sensor stream: a ThermalTracker plus the queue of frames waiting for it.
+* A stream is only ever scheduled on one worker at a time, so its frames are always processed in arrival order.
+*/
+class StreamWorker {
+   public:
+    StreamWorker(unsigned int id, WorkStealingPool* pool, unsigned int max_queued_frames);
+
+    /**
+    * Queue a frame for the stream and schedule the stream on the pool if it is idle.
+    * @param pixels Frame to queue
+    * @return False if the stream's queue is full and the frame was not accepted
+    */
+    bool push(const float pixels[FRAME_HEIGHT][FRAME_WIDTH]);
+
+    /**
+    * Process up to STREAM_BATCH_FRAMES queued frames.
+    * Called from a pool worker; the stream reschedules itself if frames are still waiting afterwards.
+    */
+    void run();
+
+    /**
+    * Record a frame that was dropped before it reached the queue.
+    */
+    void add_dropped_frame();
+
+    StreamStats get_stats();
+
+    /**
+    * Copy out the stream's live tracks without stopping or locking its tracker.
+    * Safe to call while a worker is running the stream.
+    * @param tracks Filled with the tracks that were live at the time of the read
+    * @return False if the tracks were changing too fast to read
+    */
+    bool read_tracks(std::vector<TrackedBlob>& tracks);
+
+    unsigned int id;
+    ThermalTracker tracker;
+    std::atomic<bool> is_scheduled;
+
+    std::atomic<uint64_t> num_track_starts;
+    std::atomic<uint64_t> num_track_ends;
+
+   private:
+    struct QueuedFrame {
+        float pixels[FRAME_HEIGHT][FRAME_WIDTH];
+        host_clock::time_point received;
+    };
+
+    WorkStealingPool* pool;
+    unsigned int max_queued_frames;
+
+    std::mutex queue_lock;
+    std::deque<QueuedFrame> queue;
+
+    std::mutex stats_lock;
+    uint64_t num_frames;
+    uint64_t num_dropped_frames;
+    double total_latency_us;
+    double max_latency_us;
+    long movements[NUM_DIRECTION_CATEGORIES];
+};
+
+/**
+* Fixed set of worker threads, each with its own task deque.
+* Workers take tasks from the back of their own deque and steal from the front of the others when they run dry.
+*/
+class WorkStealingPool {
+   public:
+    explicit WorkStealingPool(unsigned int num_workers);
+    ~WorkStealingPool();
+
+    /**
+    * Schedule a stream to run on the pool.
+    * Streams resubmitted from a worker stay on that worker's deque to keep their tracker state cache-warm.
+    * @param stream Stream to run
+    */
+    void submit(StreamWorker* stream);
+
+    /**
+    * Stop and join all of the worker threads. Any tasks still queued are abandoned.
+    */
+    void stop();
+
+    unsigned int get_num_workers();
+
+    /**
+    * Get the total time the workers have spent processing streams.
+    * @return Busy time summed across all workers, in seconds
+    */
+    double get_busy_seconds();
+
+    uint64_t get_num_steals();
+
+   private:
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<StreamWorker*> tasks;
+        std::atomic<uint64_t> busy_ns;
+    };
+
+    void run_worker(unsigned int index);
+    bool take_task(unsigned int index, StreamWorker*& task);
+
+    std::vector<WorkerQueue*> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::atomic<bool> running;
+    std::atomic<unsigned int> num_pending;
+    std::atomic<unsigned int> next_queue;
+    std::atomic<uint64_t> num_steals;
+};
+
+/**
+* Runs one ThermalTracker per incoming frame stream, sharded across a work-stealing pool.
+*/
+class TrackerService {
+   public:
+    TrackerService(unsigned int num_threads, unsigned int max_queued_frames = DEFAULT_MAX_QUEUED_FRAMES);
+    ~TrackerService();
+
+    /**
+    * Hand a frame to the stream it belongs to, creating the stream on first use.
+    * @param stream Stream number of the frame
+    * @param pixels Frame to process
+    * @param block Wait for room in the stream's queue instead of dropping the frame
+    * @return True if the frame was queued
+    */
+    bool submit(unsigned int stream, const float pixels[FRAME_HEIGHT][FRAME_WIDTH], bool block);
+
+    /**
+    * Wait until every queued frame has been processed.
+    */
+    void drain();
+
+    /**
+    * Print aggregate throughput and the per-stream statistics.
+    * @param output Stream to print to
+    */
+    void print_stats(FILE* output);
+
+   private:
+    StreamWorker* get_stream(unsigned int stream);
+
+    WorkStealingPool pool;
+    unsigned int max_queued_frames;
+    host_clock::time_point start_time;
+
+    std::mutex streams_lock;
+    std::map<unsigned int, StreamWorker*> streams;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <chrono>
+
+HardwareSerial Serial;
+
+static std::chrono::steady_clock::time_point host_start_time() {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return start;
+}
+
+unsigned long millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - host_start_time())
+        .count();
+}
+
+unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - host_start_time())
+        .count();
+}
+
+size_t HardwareSerial::write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) { return fwrite(buffer, 1, size, stdout); }
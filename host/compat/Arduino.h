@@ -0,0 +1,74 @@
+/*
+ * Minimal Arduino core shim for building the NodeMLX libraries on a Linux host.
+ * Only the parts of the core that the ThermalTracker and Logging libraries rely on are provided.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+/**
+* Milliseconds elapsed since the first call to any of the host timing functions.
+*/
+unsigned long millis();
+
+/**
+* Microseconds elapsed since the first call to any of the host timing functions.
+*/
+unsigned long micros();
+
+// Flash is ordinary memory on the host
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(text) (text)
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+template <typename T, typename L, typename H>
+inline T constrain(T value, L low, H high) {
+    return value < low ? low : (value > high ? high : value);
+}
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+/**
+* Byte output, with only the write methods of the core's Print.
+*/
+class Print {
+   public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t written = 0;
+        while (size--) {
+            written += write(*buffer++);
+        }
+        return written;
+    }
+};
+
+/**
+* Serial port that writes to standard output.
+*/
+class HardwareSerial : public Print {
+   public:
+    void begin(unsigned long /* baud */) {}
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buffer, size_t size);
+};
+
+extern HardwareSerial Serial;
+
+#endif
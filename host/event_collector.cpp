@@ -0,0 +1,264 @@
+/*
+ * NodeMLX event collector
+ *
+ * Stand-in for the server NodeMLX posts its tracking event batches to. Accepts POST /events/<device> with a batch
+ * (see EventQueue.h), drops events it has already stored (retried batches deliver them again) and prints each new
+ * event as a line of JSON. It can fail a share of the requests, with a 503 before storing the batch or by dropping
+ * the connection after storing it, to exercise the device's retries.
+ *
+ * Stops after -n batches, or on Ctrl-C, and prints a summary of what it stored for each device and boot.
+ *
+ * Usage: event_collector [-p port] [-e error_percent] [-l lost_reply_percent] [-n batches] [-s seed]
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include "EventQueue.h"
+
+const int DEFAULT_COLLECTOR_PORT = 8080;
+const size_t MAX_REQUEST_SIZE = 16 * 1024;
+const char* EVENTS_PATH = "/events/";
+
+const char* EVENT_TYPE_NAMES[] = {"start", "end", "cross"};
+
+/**
+* Events stored from one boot of one device.
+*/
+struct EventStream {
+    std::set<uint32_t> sequences;
+    uint32_t num_dropped; /**< Reported by the device */
+};
+
+static std::map<std::pair<std::string, uint32_t>, EventStream> streams;
+static unsigned long num_batches = 0;
+static unsigned long num_new_events = 0;
+static unsigned long num_duplicate_events = 0;
+static unsigned long num_bad_requests = 0;
+static volatile sig_atomic_t stopping = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+// HTTP
+
+static bool read_request(int client_fd, std::string& head, std::string& body) {
+    /**
+    * Read a request up to the end of its body.
+    * @return False if the connection closed early or the request is too large
+    */
+    std::string request;
+    char buffer[1024];
+
+    for (;;) {
+        size_t head_end = request.find("\r\n\r\n");
+        if (head_end != std::string::npos) {
+            size_t length_at = request.find("Content-Length: ");
+            size_t body_length = length_at < head_end ? strtoul(request.c_str() + length_at + 16, NULL, 10) : 0;
+
+            if (request.size() >= head_end + 4 + body_length) {
+                head = request.substr(0, head_end);
+                body = request.substr(head_end + 4, body_length);
+                return true;
+            }
+        }
+
+        if (request.size() > MAX_REQUEST_SIZE) {
+            return false;
+        }
+
+        ssize_t length = recv(client_fd, buffer, sizeof(buffer), 0);
+        if (length <= 0) {
+            return false;
+        }
+        request.append(buffer, length);
+    }
+}
+
+static void send_status(int client_fd, const char* status) {
+    std::string response = std::string("HTTP/1.1 ") + status + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    send(client_fd, response.data(), response.size(), MSG_NOSIGNAL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Batches
+
+static void print_event(const std::string& device, uint32_t boot_id, const EventRecord& record) {
+    printf("{\"device\":\"%s\",\"boot\":%u,\"seq\":%u,\"time\":%u,\"type\":\"%s\",\"track\":%u,\"frames\":%u,"
+           "\"travel\":[%.2f,%.2f],\"temp\":%.2f,\"size\":%u,\"start\":[%.1f,%.1f]",
+           device.c_str(), boot_id, record.sequence, record.time,
+           record.type <= TRACKING_EVENT_CROSSING ? EVENT_TYPE_NAMES[record.type] : "unknown", record.track_id,
+           record.frames, record.travel[X] / 100.0, record.travel[Y] / 100.0, record.temperature / 100.0, record.size,
+           record.start_position[X] / 10.0, record.start_position[Y] / 10.0);
+
+    if (record.type == TRACKING_EVENT_CROSSING) {
+        printf(",\"line\":%u,\"dir\":\"%s\"", record.line, record.crossing == CROSSING_FORWARD ? "fwd" : "back");
+    }
+    printf("}\n");
+}
+
+static bool store_batch(const std::string& device, const std::string& body) {
+    /**
+    * Store the events of a batch that have not been stored before.
+    * @return False if the batch is malformed
+    */
+    EventBatchHeader header;
+    EventRecord records[255];
+    int num_records = decode_event_batch((const uint8_t*)body.data(), body.size(), header, records, 255);
+    if (num_records < 0) {
+        return false;
+    }
+
+    EventStream& stream = streams[std::make_pair(device, header.boot_id)];
+    stream.num_dropped = header.num_dropped;
+
+    int num_new = 0;
+    for (int i = 0; i < num_records; i++) {
+        if (stream.sequences.insert(records[i].sequence).second) {
+            print_event(device, header.boot_id, records[i]);
+            num_new++;
+        }
+    }
+    fflush(stdout);
+
+    num_batches++;
+    num_new_events += num_new;
+    num_duplicate_events += num_records - num_new;
+    fprintf(stderr, "%s boot %08x: batch of %d, %d new, %d already stored, %u dropped on the device\n", device.c_str(),
+            header.boot_id, num_records, num_new, num_records - num_new, header.num_dropped);
+    return true;
+}
+
+static void print_summary() {
+    fprintf(stderr, "\n%lu batches, %lu events stored, %lu duplicates dropped, %lu bad requests\n", num_batches,
+            num_new_events, num_duplicate_events, num_bad_requests);
+
+    for (std::map<std::pair<std::string, uint32_t>, EventStream>::iterator i = streams.begin(); i != streams.end();
+         ++i) {
+        const EventStream& stream = i->second;
+        uint32_t last = *stream.sequences.rbegin();
+        unsigned long num_missing = last + 1 - stream.sequences.size();
+
+        fprintf(stderr, "  %s boot %08x: %zu events, sequence 0-%u, %lu missing, %u dropped on the device\n",
+                i->first.first.c_str(), i->first.second, stream.sequences.size(), last, num_missing,
+                stream.num_dropped);
+    }
+}
+
+static void stop(int /* signal */) { stopping = 1; }
+
+static void print_usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [-p port] [-e error_percent] [-l lost_reply_percent] [-n batches] [-s seed]\n"
+            "  -p  Port to listen on (default: %d)\n"
+            "  -e  Answer this share of batches with a 503, without storing them\n"
+            "  -l  Store this share of batches but close the connection without answering\n"
+            "  -n  Exit after storing this many batches\n"
+            "  -s  Seed for choosing the requests to fail\n",
+            name, DEFAULT_COLLECTOR_PORT);
+}
+
+int main(int argc, char* argv[]) {
+    int port = DEFAULT_COLLECTOR_PORT;
+    int error_percent = 0;
+    int lost_reply_percent = 0;
+    unsigned long max_batches = 0;
+    unsigned int seed = 1;
+
+    int option;
+    while ((option = getopt(argc, argv, "p:e:l:n:s:h")) != -1) {
+        switch (option) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'e':
+                error_percent = atoi(optarg);
+                break;
+            case 'l':
+                lost_reply_percent = atoi(optarg);
+                break;
+            case 'n':
+                max_batches = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(listen_fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd, 8) != 0) {
+        perror("listen");
+        return 1;
+    }
+    fprintf(stderr, "Collecting events on port %d\n", port);
+
+    // No SA_RESTART, so Ctrl-C interrupts accept()
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    while (!stopping && (max_batches == 0 || num_batches < max_batches)) {
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            continue;
+        }
+
+        std::string head, body;
+        if (!read_request(client_fd, head, body)) {
+            num_bad_requests++;
+            close(client_fd);
+            continue;
+        }
+
+        // "POST /events/<device> HTTP/1.1"
+        size_t path_end = head.find(' ', 5);
+        if (head.compare(0, 5 + strlen(EVENTS_PATH), std::string("POST ") + EVENTS_PATH) != 0 ||
+            path_end == std::string::npos) {
+            num_bad_requests++;
+            send_status(client_fd, "404 Not Found");
+            close(client_fd);
+            continue;
+        }
+        std::string device = head.substr(5 + strlen(EVENTS_PATH), path_end - 5 - strlen(EVENTS_PATH));
+
+        if (percent(random) < error_percent) {
+            send_status(client_fd, "503 Service Unavailable");
+        } else if (!store_batch(device, body)) {
+            num_bad_requests++;
+            send_status(client_fd, "400 Bad Request");
+        } else if (percent(random) >= lost_reply_percent) {
+            send_status(client_fd, "200 OK");
+        }
+
+        close(client_fd);
+    }
+
+    print_summary();
+    close(listen_fd);
+    return 0;
+}
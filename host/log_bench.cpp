@@ -0,0 +1,314 @@
+/*
+ * NodeMLX logging benchmark
+ *
+ * Times log messages through the Logging library into a Print that counts its write calls, each of which is a call
+ * into the UART driver on the device. Enabled messages are compared with the way Logging used to send them, one
+ * print per character or field. Filtered messages are compared between calling Log.Debug() etc. directly, which
+ * evaluates the arguments and makes the call, and the LOGGING_DEBUG() etc. macros, which skip both and compile away
+ * entirely above LOG_LEVEL_MAX. It first checks that both ways write exactly the same bytes.
+ *
+ * Build with -DLOG_LEVEL_MAX=LOG_LEVEL_INFOS so that debug messages are compiled out.
+ *
+ * Usage: log_bench [messages]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include "Logging.h"
+
+#if LOG_LEVEL_MAX != LOG_LEVEL_INFOS
+#error "Build log_bench with -DLOG_LEVEL_MAX=LOG_LEVEL_INFOS"
+#endif
+
+typedef std::chrono::steady_clock bench_clock;
+
+const long DEFAULT_NUM_MESSAGES = 1000000;
+const char* DEVICE_NAME = "thermal40deg";
+const char PACKET_START = '#';
+const char PACKET_END = '$';
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+/**
+* Print that counts its writes, and optionally keeps what is written.
+*/
+class CountingPrint : public Print {
+   public:
+    CountingPrint() : num_writes(0), num_bytes(0), keep(false) {}
+
+    size_t write(uint8_t c) {
+        num_writes++;
+        num_bytes++;
+        if (keep) {
+            output += char(c);
+        }
+        return 1;
+    }
+
+    size_t write(const uint8_t* buffer, size_t size) {
+        num_writes++;
+        num_bytes += size;
+        if (keep) {
+            output.append((const char*)buffer, size);
+        }
+        return size;
+    }
+
+    void reset() {
+        num_writes = 0;
+        num_bytes = 0;
+        output.clear();
+    }
+
+    unsigned long num_writes;
+    unsigned long num_bytes;
+    bool keep;
+    std::string output;
+};
+
+static CountingPrint sink;
+
+////////////////////////////////////////////////////////////////////////////////
+// Logging as it was
+
+/*
+ * Logging::print before messages were buffered, with the core's Print methods it called: print(const char*) and
+ * numbers are one write each, and print(char) is one write per character.
+ */
+
+static void legacy_print(const char* s) { sink.write((const uint8_t*)s, strlen(s)); }
+
+static void legacy_print(char c) { sink.write(c); }
+
+static void legacy_print(long n, int base) {
+    char buffer[8 * sizeof(long) + 2];
+    char* digits = &buffer[sizeof(buffer) - 1];
+    *digits = '\0';
+
+    bool negative = base == DEC && n < 0;
+    unsigned long value = negative ? -n : n;
+    do {
+        char digit = value % base;
+        *--digits = digit < 10 ? digit + '0' : digit + 'A' - 10;
+        value /= base;
+    } while (value > 0);
+
+    if (negative) {
+        *--digits = '-';
+    }
+    legacy_print(digits);
+}
+
+static void legacy_vprint(const char* prefix, const char* format, va_list args) {
+    legacy_print(prefix);
+    for (; *format != 0; ++format) {
+        if (*format == '%') {
+            ++format;
+            if (*format == '\0') break;
+            if (*format == '%') {
+                legacy_print(*format);
+                continue;
+            }
+            if (*format == 's') {
+                legacy_print(va_arg(args, const char*));
+                continue;
+            }
+            if (*format == 'd' || *format == 'i') {
+                legacy_print((long)va_arg(args, int), DEC);
+                continue;
+            }
+            if (*format == 'x') {
+                legacy_print((long)va_arg(args, int), HEX);
+                continue;
+            }
+            if (*format == 'X') {
+                legacy_print("0x");
+                legacy_print((long)va_arg(args, int), HEX);
+                continue;
+            }
+            if (*format == 'b') {
+                legacy_print((long)va_arg(args, int), BIN);
+                continue;
+            }
+            if (*format == 'B') {
+                legacy_print("0b");
+                legacy_print((long)va_arg(args, int), BIN);
+                continue;
+            }
+            if (*format == 'l') {
+                legacy_print(va_arg(args, long), DEC);
+                continue;
+            }
+            if (*format == 'c') {
+                legacy_print(char(va_arg(args, int)));
+                continue;
+            }
+            if (*format == 't') {
+                legacy_print(va_arg(args, int) == 1 ? "T" : "F");
+                continue;
+            }
+            if (*format == 'T') {
+                legacy_print(va_arg(args, int) == 1 ? "true" : "false");
+                continue;
+            }
+        } else if (*format == '\n') {
+            legacy_print('\r');
+        }
+        legacy_print(*format);
+    }
+    legacy_print("\n");
+}
+
+static void legacy_info(const char* format, ...) {
+    if (LOG_LEVEL_INFOS <= Log.getLevel()) {
+        va_list args;
+        va_start(args, format);
+        legacy_vprint("INFO:\t", format, args);
+        va_end(args);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Messages
+
+static unsigned long num_arguments_evaluated = 0;
+
+/**
+* Stands in for work done to build a message's arguments, such as reading a timer or a sensor.
+*/
+static int argument(int value) {
+    num_arguments_evaluated++;
+    return value;
+}
+
+// The line crossing packet NodeMLX prints, and the debug message it prints every frame
+#define CROSSING_ARGUMENTS(i)                                                                                    \
+    "%c{\"id\":\"%s\",\"type\":\"cross\",\"t_id\":%d,\"line\":%d,\"dir\":\"%s\"}%c", PACKET_START, DEVICE_NAME, \
+        argument(i), 0, (i) & 1 ? "fwd" : "back", PACKET_END
+#define FRAME_DEBUG_ARGUMENTS(i) "Blobs in frame: %d\tprocess time %l us", argument((i) & 3), long(argument(i))
+
+static void legacy_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    legacy_vprint("ERROR:\t", format, args);
+    va_end(args);
+}
+
+static bool check_output() {
+    /**
+    * Check the buffered Logging writes exactly what it used to, for every wildcard and for lines longer than its
+    * buffer.
+    * @return True if the outputs match
+    */
+    std::string long_text(LOGGING_BUFFER_SIZE * 2 + 17, 'x');
+    sink.keep = true;
+
+    sink.reset();
+    LOGGING_INFO(CROSSING_ARGUMENTS(7));
+    LOGGING_INFO("%d %d %l %l %x %X %b %B", -12345, 0, -2147483647L, 99L, 0xBEEF, -1, 5, 0);
+    LOGGING_INFO("%s|%c|%t|%T|%t|%T|%%|100%", "text", 'q', 1, 0, 0, 1);
+    LOGGING_INFO("two\nlines, and %s", long_text.c_str());
+    LOGGING_ERROR("error %d", 42);
+    std::string buffered = sink.output;
+
+    sink.reset();
+    legacy_info(CROSSING_ARGUMENTS(7));
+    legacy_info("%d %d %l %l %x %X %b %B", -12345, 0, -2147483647L, 99L, 0xBEEF, -1, 5, 0);
+    legacy_info("%s|%c|%t|%T|%t|%T|%%|100%", "text", 'q', 1, 0, 0, 1);
+    legacy_info("two\nlines, and %s", long_text.c_str());
+    legacy_error("error %d", 42);
+    std::string before = sink.output;
+
+    sink.keep = false;
+    sink.reset();
+    num_arguments_evaluated = 0;
+
+    if (buffered != before) {
+        fprintf(stderr, "Output differs:\n--- before\n%s--- buffered\n%s", before.c_str(), buffered.c_str());
+        return false;
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+
+static void report(const char* name, long num_messages, double seconds) {
+    double nanoseconds = seconds * 1e9 / num_messages;
+
+    // A loop of compiled-out messages is removed altogether
+    if (nanoseconds < 0.01) {
+        printf("%-46s %12s %10s", name, "no code", "0");
+    } else {
+        printf("%-46s %12.0f %10.2f", name, num_messages / seconds, nanoseconds);
+    }
+    printf(" %10.2f %10.2f\n", double(sink.num_writes) / num_messages,
+           double(num_arguments_evaluated) / num_messages);
+    sink.reset();
+    num_arguments_evaluated = 0;
+}
+
+int main(int argc, char* argv[]) {
+    long num_messages = argc > 1 ? atol(argv[1]) : DEFAULT_NUM_MESSAGES;
+    if (num_messages <= 0) {
+        fprintf(stderr, "Usage: %s [messages]\n", argv[0]);
+        return 1;
+    }
+
+    Log.Init(LOG_LEVEL_INFOS, &sink);
+    if (!check_output()) {
+        return 1;
+    }
+
+    printf("%-46s %12s %10s %10s %10s\n", "", "messages/s", "ns/msg", "writes/msg", "args/msg");
+    bench_clock::time_point start;
+
+    // Enabled
+    start = bench_clock::now();
+    for (long i = 0; i < num_messages; i++) {
+        legacy_info(CROSSING_ARGUMENTS(i));
+    }
+    report("info packet, a print per character (before)", num_messages, seconds_since(start));
+
+    start = bench_clock::now();
+    for (long i = 0; i < num_messages; i++) {
+        LOGGING_INFO(CROSSING_ARGUMENTS(i));
+    }
+    report("info packet, buffered (LOGGING_INFO)", num_messages, seconds_since(start));
+
+    // Filtered at run time
+    Log.Init(LOG_LEVEL_ERRORS, &sink);
+
+    start = bench_clock::now();
+    for (long i = 0; i < num_messages; i++) {
+        Log.Info(CROSSING_ARGUMENTS(i));
+    }
+    report("info packet, level off (Log.Info)", num_messages, seconds_since(start));
+
+    start = bench_clock::now();
+    for (long i = 0; i < num_messages; i++) {
+        LOGGING_INFO(CROSSING_ARGUMENTS(i));
+    }
+    report("info packet, level off (LOGGING_INFO)", num_messages, seconds_since(start));
+
+    // Above LOG_LEVEL_MAX
+    Log.Init(LOG_LEVEL_VERBOSE, &sink);
+
+    start = bench_clock::now();
+    for (long i = 0; i < num_messages; i++) {
+        Log.Debug(FRAME_DEBUG_ARGUMENTS(i));
+    }
+    report("frame debug, compiled out (Log.Debug)", num_messages, seconds_since(start));
+
+    start = bench_clock::now();
+    for (long i = 0; i < num_messages; i++) {
+        LOGGING_DEBUG(FRAME_DEBUG_ARGUMENTS(i));
+    }
+    report("frame debug, compiled out (LOGGING_DEBUG)", num_messages, seconds_since(start));
+
+    return 0;
+}
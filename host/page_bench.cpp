@@ -0,0 +1,531 @@
+/*
+ * NodeMLX web page benchmark
+ *
+ * Host-side comparison of the two ways NodeMLX has generated its live view pages: concatenating the whole page into
+ * an Arduino String and sending it in one go, and streaming it through a PageWriter. Reports heap operations, peak
+ * heap use, socket writes and render time per page. The String path is modelled on the ESP8266 core's String, which
+ * reallocates to the exact length needed on every append that outgrows it.
+ * Then compares the bytes a viewer transfers per refresh with the HTML views against the /frame.bin and /frame.json
+ * endpoints that clients render themselves, including the 304 sent when the frame has not changed.
+ * Finally times serving the same frame to several clients with and without the shared FrameCache, which holds each
+ * view's formatted pixel text.
+ *
+ * Usage: page_bench [pages]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "FrameCache.h"
+#include "FrameExport.h"
+#include "PageWriter.h"
+#include "SyntheticScene.h"
+#include "ThermalTracker.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+const int COLD_HUE = 240;
+const int HOT_HUE = 0;
+const float MIN_DISPLAY_TEMPERATURE = 20;
+const float MAX_DISPLAY_TEMPERATURE = 50;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Heap accounting
+
+static long num_heap_operations = 0;
+static long heap_in_use = 0;
+static long peak_heap_in_use = 0;
+
+static void* counted_realloc(void* block, size_t old_size, size_t new_size) {
+    num_heap_operations++;
+    heap_in_use += long(new_size) - long(old_size);
+    if (heap_in_use > peak_heap_in_use) {
+        peak_heap_in_use = heap_in_use;
+    }
+    return realloc(block, new_size);
+}
+
+static void counted_free(void* block, size_t size) {
+    if (block) {
+        num_heap_operations++;
+        heap_in_use -= size;
+        free(block);
+    }
+}
+
+/**
+* Just enough of the ESP8266 core's String to reproduce its allocations: every append that does not fit reallocates
+* the buffer to exactly the new length.
+*/
+class CoreString {
+   public:
+    CoreString() : buffer(NULL), capacity(0), length(0) {}
+    CoreString(const char* text) : buffer(NULL), capacity(0), length(0) { *this += text; }
+    CoreString(CoreString&& other) : buffer(other.buffer), capacity(other.capacity), length(other.length) {
+        other.buffer = NULL;
+        other.capacity = 0;
+        other.length = 0;
+    }
+    ~CoreString() { counted_free(buffer, capacity + 1); }
+
+    CoreString& operator+=(const char* text) {
+        append(text, strlen(text));
+        return *this;
+    }
+
+    CoreString& operator+=(const CoreString& other) {
+        append(other.buffer ? other.buffer : "", other.length);
+        return *this;
+    }
+
+    const char* c_str() const { return buffer ? buffer : ""; }
+    size_t size() const { return length; }
+
+   private:
+    void append(const char* text, size_t count) {
+        if (length + count > capacity || !buffer) {
+            buffer = (char*)counted_realloc(buffer, buffer ? capacity + 1 : 0, length + count + 1);
+            capacity = length + count;
+        }
+        memcpy(buffer + length, text, count);
+        length += count;
+        buffer[length] = '\0';
+    }
+
+    char* buffer;
+    size_t capacity;
+    size_t length;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Sockets
+
+static long num_socket_writes = 0;
+static long socket_bytes = 0;
+static char* captured = NULL;
+static size_t captured_length = 0;
+
+static size_t socket_write(void* /* context */, const uint8_t* data, size_t length) {
+    num_socket_writes++;
+    socket_bytes += length;
+    if (captured) {
+        memcpy(captured + captured_length, data, length);
+        captured_length += length;
+    }
+    return length;
+}
+
+static int calculate_hue(float temperature) {
+    // The integer arithmetic of Arduino's map()
+    long temp = constrain(temperature * 5, MIN_DISPLAY_TEMPERATURE * 5, MAX_DISPLAY_TEMPERATURE * 5);
+    long low = MIN_DISPLAY_TEMPERATURE * 5;
+    long high = MAX_DISPLAY_TEMPERATURE * 5;
+    return (temp - low) * (HOT_HUE - COLD_HUE) / (high - low) + COLD_HUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// String pages, as NodeMLX built them before PageWriter
+
+static CoreString generate_colour_map(const float temperatures[4][16]) {
+    CoreString css =
+        "<style type=\"text/css\">\n.thermal{color: 0xFFFFFF; border: 1px solid black; width: 100%; height: 60%}\n";
+
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 16; x++) {
+            char row[50];
+            snprintf(row, sizeof(row), ".r%dc%d{background-color: hsl(%d,100%%,50%%)}\n", y, x,
+                     calculate_hue(temperatures[y][x]));
+            css += row;
+        }
+    }
+    css += "</style>\n";
+    return css;
+}
+
+static CoreString generate_temperature_table(const float temperature[4][16]) {
+    CoreString table = "<table class=thermal>\n";
+
+    for (int row = 0; row < 4; row++) {
+        table += "<tr>\n";
+
+        for (int column = 0; column < 16; column++) {
+            char cell[50];
+            snprintf(cell, sizeof(cell), "<th class=r%dc%d> %.2f </th>\n", row, column, temperature[row][column]);
+            table += cell;
+        }
+        table += "</tr>\n";
+    }
+
+    table += "</table>\n";
+    return table;
+}
+
+static void send_string_live_view(const float values[4][16]) {
+    CoreString page = "";
+    page += generate_colour_map(values);
+    page += "<html><head><title> NodeMLX Live Feed</title><meta http-equiv=\"refresh\" content=\"0.25\"/></head><body>";
+    page += generate_temperature_table(values);
+    page += "<hr><a href=\"\\\">Back</a></body></html>";
+
+    // ESP8266WebServer::send writes the headers, then the whole page
+    CoreString header = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: ";
+    char length[12];
+    snprintf(length, sizeof(length), "%d", int(page.size()));
+    header += length;
+    header += "\r\nConnection: close\r\n\r\n";
+    socket_write(NULL, (const uint8_t*)header.c_str(), header.size());
+    socket_write(NULL, (const uint8_t*)page.c_str(), page.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Streamed pages, as NodeMLX sends them now
+
+const char LIVE_PAGE_HEADER[] PROGMEM =
+    "<html><head><title> NodeMLX Live Feed</title><style type=\"text/css\">\n.thermal{color: 0xFFFFFF; border: 1px "
+    "solid black; width: 100%; height: 60%}\n</style><meta http-equiv=\"refresh\" content=\"0.25\"/></head><body>";
+const char LIVE_PAGE_FOOTER[] PROGMEM = "<hr><a href=\"\\\">Back</a></body></html>";
+
+static void send_streamed_live_view(const float temperature[4][16], PageWriter& page) {
+    page.begin("text/html");
+    page.print_P(LIVE_PAGE_HEADER);
+    page.print_P(PSTR("<table class=thermal>\n"));
+
+    for (int row = 0; row < 4; row++) {
+        page.print_P(PSTR("<tr>\n"));
+
+        for (int column = 0; column < 16; column++) {
+            page.print_P(PSTR("<th style=\"background-color:hsl("));
+            page.print(calculate_hue(temperature[row][column]));
+            page.print_P(PSTR(",100%,50%)\"> "));
+            page.print(temperature[row][column], 2);
+            page.print_P(PSTR(" </th>\n"));
+        }
+        page.print_P(PSTR("</tr>\n"));
+    }
+
+    page.print_P(PSTR("</table>\n"));
+    page.print_P(LIVE_PAGE_FOOTER);
+    page.finish();
+}
+
+static void send_cached_live_view(const frame_text temperature[4][16], const uint8_t colours[4][16],
+                                  PageWriter& page) {
+    // As send_streamed_live_view, with the text and hues from the FrameCache
+    page.begin("text/html");
+    page.print_P(LIVE_PAGE_HEADER);
+    page.print_P(PSTR("<table class=thermal>\n"));
+
+    for (int row = 0; row < 4; row++) {
+        page.print_P(PSTR("<tr>\n"));
+
+        for (int column = 0; column < 16; column++) {
+            page.print_P(PSTR("<th style=\"background-color:hsl("));
+            page.print(COLD_HUE + (HOT_HUE - COLD_HUE) * colours[row][column] / (FRAME_COLOUR_LEVELS - 1));
+            page.print_P(PSTR(",100%,50%)\"> "));
+            page.print(temperature[row][column]);
+            page.print_P(PSTR(" </th>\n"));
+        }
+        page.print_P(PSTR("</tr>\n"));
+    }
+
+    page.print_P(PSTR("</table>\n"));
+    page.print_P(LIVE_PAGE_FOOTER);
+    page.finish();
+}
+
+/**
+* Check a captured chunked response: the body must decode to bytes_written bytes and end with the empty chunk.
+* @return true if the framing is valid
+*/
+static bool check_chunked(const char* response, size_t length, unsigned long body_length) {
+    const char* body = strstr(response, "\r\n\r\n");
+    if (!body) {
+        return false;
+    }
+
+    const char* position = body + 4;
+    const char* end = response + length;
+    unsigned long decoded = 0;
+
+    while (position < end) {
+        char* after;
+        unsigned long chunk = strtoul(position, &after, 16);
+        if (after[0] != '\r' || after[1] != '\n' || after + 2 + chunk + 2 > end) {
+            return false;
+        }
+        if (chunk == 0) {
+            return after + 4 == end && decoded == body_length;
+        }
+        position = after + 2 + chunk;
+        if (position[0] != '\r' || position[1] != '\n') {
+            return false;
+        }
+        position += 2;
+        decoded += chunk;
+    }
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Frame endpoints
+
+static long send_frame(ThermalTracker& tracker, bool json) {
+    /**
+    * Send a live frame the way NodeMLX's send_frame does.
+    * @return Bytes sent
+    */
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"live-%lu\"", tracker.frame_sequence);
+    float values[FRAME_HEIGHT][FRAME_WIDTH];
+    get_frame_view(tracker, VIEW_LIVE, values);
+
+    socket_bytes = 0;
+    PageWriter page(socket_write, NULL);
+    if (json) {
+        frame_text text[FRAME_HEIGHT][FRAME_WIDTH];
+        format_frame_text(values, text);
+        page.begin("application/json", etag);
+        write_frame_json(page, text, VIEW_LIVE, tracker.frame_sequence);
+    } else {
+        uint8_t packed[FRAME_EXPORT_BINARY_SIZE];
+        size_t length = encode_frame_binary(values, VIEW_LIVE, tracker.frame_sequence, packed);
+        page.begin("application/octet-stream", etag);
+        page.write(packed, length);
+    }
+    page.finish();
+
+    return socket_bytes;
+}
+
+static bool check_binary(ThermalTracker& tracker) {
+    /**
+    * Check that every view survives packing to within the hundredths it is sent in.
+    */
+    for (int view = 0; view < NUM_FRAME_VIEWS; view++) {
+        float values[FRAME_HEIGHT][FRAME_WIDTH];
+        uint8_t packed[FRAME_EXPORT_BINARY_SIZE];
+        get_frame_view(tracker, view, values);
+        encode_frame_binary(values, view, tracker.frame_sequence, packed);
+
+        unsigned long sequence = packed[4] | packed[5] << 8 | packed[6] << 16 | (unsigned long)packed[7] << 24;
+        if (packed[1] != view || packed[2] != FRAME_WIDTH || packed[3] != FRAME_HEIGHT ||
+            sequence != tracker.frame_sequence) {
+            return false;
+        }
+
+        for (int i = 0; i < FRAME_HEIGHT * FRAME_WIDTH; i++) {
+            int16_t value = int16_t(packed[FRAME_EXPORT_HEADER_SIZE + 2 * i] |
+                                    packed[FRAME_EXPORT_HEADER_SIZE + 2 * i + 1] << 8);
+            if (fabs(value / FRAME_EXPORT_SCALE - values[i / FRAME_WIDTH][i % FRAME_WIDTH]) > 0.0051) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static int bench_frames(float frame[FRAME_HEIGHT][FRAME_WIDTH], long string_page_bytes,
+                        long streamed_page_bytes) {
+    /**
+    * Compare the bytes per refresh of the HTML live view against the frame endpoints.
+    */
+    ThermalTracker tracker;
+    SyntheticScene scene(1, 0);
+    float empty[FRAME_HEIGHT][FRAME_WIDTH];
+    for (int i = 0; i < DEFAULT_RUNNING_AVERAGE_SIZE; i++) {
+        scene.empty_frame(empty);
+        tracker.update(empty);
+    }
+    tracker.update(frame);
+
+    if (!check_binary(tracker)) {
+        printf("Binary frame check FAILED\n");
+        return 1;
+    }
+
+    // ESP8266WebServer::send(304, "text/plain", "") after sendHeader("ETag", ...)
+    char not_modified[160];
+    snprintf(not_modified, sizeof(not_modified),
+             "HTTP/1.1 304 Not Modified\r\nContent-Type: text/plain\r\nETag: \"live-%lu\"\r\nContent-Length: 0\r\n"
+             "Connection: close\r\n\r\n",
+             tracker.frame_sequence);
+
+    const char* names[] = {"HTML, String", "HTML, streamed", "frame.json", "frame.bin", "304"};
+    long bytes[] = {string_page_bytes, streamed_page_bytes, send_frame(tracker, true), send_frame(tracker, false),
+                    long(strlen(not_modified))};
+
+    printf("\nBytes per live view refresh (at 4 refreshes/s per client):\n");
+    for (int i = 0; i < 5; i++) {
+        printf("%-15s %5ld B  %6.1f KB/s  %5.1f%%\n", names[i], bytes[i], bytes[i] * 4 / 1024.0,
+               100.0 * bytes[i] / bytes[0]);
+    }
+    printf("Binary frames decode to within 0.01 for every view\n");
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Frame cache
+
+const int CACHE_BENCH_VIEWS[] = {VIEW_LIVE, VIEW_DIFF};
+const int NUM_CACHE_BENCH_VIEWS = 2;
+
+static void serve_uncached(ThermalTracker& tracker) {
+    /**
+    * Serve one client's live and diff pages and binary frame the way NodeMLX did before FrameCache: every request
+    * works out its view and colours itself.
+    */
+    for (int i = 0; i < NUM_CACHE_BENCH_VIEWS; i++) {
+        float values[FRAME_HEIGHT][FRAME_WIDTH];
+        get_frame_view(tracker, CACHE_BENCH_VIEWS[i], values);
+        PageWriter page(socket_write, NULL);
+        send_streamed_live_view(values, page);
+    }
+
+    float values[FRAME_HEIGHT][FRAME_WIDTH];
+    uint8_t packed[FRAME_EXPORT_BINARY_SIZE];
+    get_frame_view(tracker, VIEW_LIVE, values);
+    size_t length = encode_frame_binary(values, VIEW_LIVE, tracker.frame_sequence, packed);
+    PageWriter page(socket_write, NULL);
+    page.begin("application/octet-stream");
+    page.write(packed, length);
+    page.finish();
+}
+
+static void serve_cached(FrameCache& cache) {
+    /**
+    * Serve the same requests from the frame cache, as NodeMLX does now.
+    */
+    for (int i = 0; i < NUM_CACHE_BENCH_VIEWS; i++) {
+        PageWriter page(socket_write, NULL);
+        send_cached_live_view(cache.get_text(CACHE_BENCH_VIEWS[i]), cache.get_colours(CACHE_BENCH_VIEWS[i]), page);
+    }
+
+    PageWriter page(socket_write, NULL);
+    page.begin("application/octet-stream");
+    page.write(cache.get_packed(VIEW_LIVE), FRAME_EXPORT_BINARY_SIZE);
+    page.finish();
+}
+
+static void bench_cache(int num_frames) {
+    /**
+    * Time serving each new frame to several clients, each fetching the live and diff pages and the binary frame,
+    * with and without the frame cache. With the cache the first client of a frame pays for formatting it, so it is
+    * timed apart from the others. Only the serving is timed, not the tracker updates between frames.
+    */
+    const int num_clients = 4;
+    double seconds[2][2] = {{0, 0}, {0, 0}};
+    unsigned long num_hits = 0;
+    unsigned long num_misses = 0;
+
+    for (int cached = 0; cached < 2; cached++) {
+        ThermalTracker tracker;
+        FrameCache cache(tracker);
+        SyntheticScene scene(1, 0.05);
+        float frame[FRAME_HEIGHT][FRAME_WIDTH];
+
+        for (int i = 0; i < num_frames; i++) {
+            scene.next_frame(frame);
+            tracker.update(frame);
+
+            for (int client = 0; client < num_clients; client++) {
+                bench_clock::time_point start = bench_clock::now();
+                if (cached) {
+                    serve_cached(cache);
+                } else {
+                    serve_uncached(tracker);
+                }
+                seconds[cached][client > 0] += seconds_since(start);
+            }
+        }
+
+        num_hits = cache.num_hits;
+        num_misses = cache.num_misses;
+    }
+
+    printf("\nServing each frame to %d clients (live + diff pages, frame.bin each), FrameCache %d B:\n", num_clients,
+           int(sizeof(FrameCache)));
+    const char* names[] = {"uncached", "cached"};
+    for (int cached = 0; cached < 2; cached++) {
+        printf("%-9s first client %6.2f us  each other client %6.2f us  all %6.2f us/frame\n", names[cached],
+               seconds[cached][0] * 1e6 / num_frames, seconds[cached][1] * 1e6 / num_frames / (num_clients - 1),
+               (seconds[cached][0] + seconds[cached][1]) * 1e6 / num_frames);
+    }
+    printf("%lu hits, %lu misses\n", num_hits, num_misses);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void report(const char* name, int num_pages, double seconds) {
+    printf("%-9s %6.1f heap ops/page  %6ld B peak heap  %5.1f writes/page  %6.0f B/page  %6.2f us/page\n", name,
+           double(num_heap_operations) / num_pages, peak_heap_in_use, double(num_socket_writes) / num_pages,
+           double(socket_bytes) / num_pages, seconds * 1e6 / num_pages);
+}
+
+static void reset_counters() {
+    num_heap_operations = 0;
+    heap_in_use = 0;
+    peak_heap_in_use = 0;
+    num_socket_writes = 0;
+    socket_bytes = 0;
+}
+
+int main(int argc, char* argv[]) {
+    int num_pages = argc > 1 ? atoi(argv[1]) : 20000;
+    if (num_pages <= 0) {
+        fprintf(stderr, "Usage: %s [pages]\n", argv[0]);
+        return 1;
+    }
+
+    // A busy frame, so the temperatures have their full number of digits
+    SyntheticScene scene(1, 0.05);
+    float frame[FRAME_HEIGHT][FRAME_WIDTH];
+    for (int i = 0; i < DEFAULT_RUNNING_AVERAGE_SIZE + 50; i++) {
+        scene.next_frame(frame);
+    }
+
+    reset_counters();
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < num_pages; i++) {
+        send_string_live_view(frame);
+    }
+    report("String", num_pages, seconds_since(start));
+    long string_page_bytes = socket_bytes / num_pages;
+
+    reset_counters();
+    start = bench_clock::now();
+    for (int i = 0; i < num_pages; i++) {
+        PageWriter page(socket_write, NULL);
+        send_streamed_live_view(frame, page);
+    }
+    report("streamed", num_pages, seconds_since(start));
+    long streamed_page_bytes = socket_bytes / num_pages;
+    printf("PageWriter buffer %d B (on the stack)\n", int(sizeof(PageWriter)));
+
+    // Check the chunk framing of one page
+    static char response[16384];
+    captured = response;
+    PageWriter page(socket_write, NULL);
+    send_streamed_live_view(frame, page);
+    captured = NULL;
+
+    if (!check_chunked(response, captured_length, page.bytes_written)) {
+        printf("Chunked framing check FAILED\n");
+        return 1;
+    }
+    printf("Chunked framing OK: %lu body bytes in %u chunks\n", page.bytes_written, page.num_chunks);
+
+    if (bench_frames(frame, string_page_bytes, streamed_page_bytes) != 0) {
+        return 1;
+    }
+
+    bench_cache(num_pages / 4);
+    return 0;
+}
@@ -0,0 +1,308 @@
+/*
+ * NodeMLX scheduler simulation
+ *
+ * Runs NodeMLX's main loop against a simulated clock under synthetic web and SD card load, first as it used to be
+ * (SimpleTimer callbacks, then server.handleClient(), each running to completion) and then under FrameScheduler (frame
+ * acquisition as a deadline task, the web server and SD writes as budgeted background tasks). Both runs see the same
+ * requests. Reports the sensor frames that were never read, the scheduler's deadline statistics, and how long web
+ * requests and SD writes waited.
+ *
+ * Usage: scheduler_sim [-d seconds] [-w requests_per_second] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <set>
+#include <vector>
+#include "FrameScheduler.h"
+
+const double DEFAULT_DURATION = 60;
+const double DEFAULT_WEB_RATE = 12;
+
+// Workload, in us. The frame interval is NodeMLX's THERMAL_FRAME_INTERVAL; the sensor itself runs at 32 Hz.
+const unsigned long SENSOR_PERIOD = 31250;
+const unsigned long FRAME_INTERVAL = 31000;
+const unsigned long MIN_FRAME_WORK = 5000; /**< Reading the frame over I2C, then tracking it */
+const unsigned long MAX_FRAME_WORK = 7000;
+const unsigned long MIN_REQUEST_WORK = 3000; /**< Generating and sending one page */
+const unsigned long MAX_REQUEST_WORK = 15000;
+const unsigned long SD_WRITE_INTERVAL = 1000000;
+const int SD_WRITE_STEPS = 10; /**< Open, write and close, split into steps for the scheduler */
+const unsigned long SD_STEP_WORK = 8000;
+const unsigned long LOOP_OVERHEAD = 30;
+
+// Background task budgets
+const unsigned long WEB_BUDGET = 16000;
+const unsigned long SD_BUDGET = 10000;
+
+////////////////////////////////////////////////////////////////////////////////
+// Simulated clock
+
+static unsigned long now_micros = 0;
+
+unsigned long micros() { return now_micros; }
+
+unsigned long millis() { return now_micros / 1000; }
+
+static void work(unsigned long duration) { now_micros += duration; }
+
+////////////////////////////////////////////////////////////////////////////////
+// Workload
+
+struct Request {
+    unsigned long arrival;
+    unsigned long work;
+};
+
+struct RunStats {
+    std::set<unsigned long> frames_read; /**< Sensor frames read, by index */
+    unsigned long num_reads;
+    unsigned long num_missed_periods; /**< Frames NodeMLX would count as missed: periods over 1.5 intervals */
+    unsigned long last_read;
+    unsigned long max_read_period;
+    std::vector<unsigned long> request_waits;
+    unsigned long num_sd_writes;
+    unsigned long max_sd_write_time; /**< From the write falling due to it finishing */
+};
+
+static std::vector<Request> requests;
+static std::deque<Request> pending_requests;
+static size_t next_request;
+static std::mt19937 frame_random;
+static RunStats stats;
+
+static unsigned long next_sd_write;
+static unsigned long sd_write_start;
+static int sd_steps_left;
+
+static void start_run(unsigned seed) {
+    now_micros = 0;
+    pending_requests.clear();
+    next_request = 0;
+    frame_random.seed(seed);
+    stats = RunStats();
+    next_sd_write = SD_WRITE_INTERVAL;
+    sd_steps_left = 0;
+}
+
+static void process_frame() {
+    // The sensor read gets the last frame the sensor finished
+    unsigned long start = now_micros;
+    stats.frames_read.insert(start / SENSOR_PERIOD);
+    stats.num_reads++;
+
+    if (stats.num_reads > 1) {
+        unsigned long period = start - stats.last_read;
+        stats.max_read_period = std::max(stats.max_read_period, period);
+        if (period > FRAME_INTERVAL * 3 / 2) {
+            stats.num_missed_periods += (period + FRAME_INTERVAL / 2) / FRAME_INTERVAL - 1;
+        }
+    }
+    stats.last_read = start;
+
+    std::uniform_int_distribution<unsigned long> frame_work(MIN_FRAME_WORK, MAX_FRAME_WORK);
+    work(frame_work(frame_random));
+}
+
+static void handle_client() {
+    // Like ESP8266WebServer::handleClient(), one waiting request per call
+    while (next_request < requests.size() && requests[next_request].arrival <= now_micros) {
+        pending_requests.push_back(requests[next_request++]);
+    }
+    if (pending_requests.empty()) {
+        return;
+    }
+
+    Request request = pending_requests.front();
+    pending_requests.pop_front();
+    work(request.work);
+    stats.request_waits.push_back(now_micros - request.arrival);
+}
+
+static void finish_sd_write() {
+    stats.num_sd_writes++;
+    stats.max_sd_write_time = std::max(stats.max_sd_write_time, now_micros - sd_write_start);
+}
+
+static void write_sd_blocking() {
+    sd_write_start = now_micros;
+    work(SD_WRITE_STEPS * SD_STEP_WORK);
+    finish_sd_write();
+}
+
+static void write_sd_step() {
+    if (sd_steps_left == 0 && long(now_micros - next_sd_write) >= 0) {
+        sd_write_start = next_sd_write;
+        sd_steps_left = SD_WRITE_STEPS;
+        next_sd_write += SD_WRITE_INTERVAL;
+    }
+    if (sd_steps_left == 0) {
+        return;
+    }
+
+    work(SD_STEP_WORK);
+    if (--sd_steps_left == 0) {
+        finish_sd_write();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The loop as it was: SimpleTimer, then the web server
+
+struct SimpleTimerSlot {
+    unsigned long previous;
+    unsigned long delay;
+    void (*callback)();
+};
+
+static void run_simple_timer(SimpleTimerSlot* slots, int num_slots) {
+    // SimpleTimer::run() calls each timer that is due once, advancing it by one interval
+    unsigned long current = millis();
+    for (int i = 0; i < num_slots; i++) {
+        if (current - slots[i].previous >= slots[i].delay) {
+            slots[i].previous += slots[i].delay;
+            slots[i].callback();
+        }
+    }
+}
+
+static void run_loop(unsigned long duration, unsigned seed) {
+    start_run(seed);
+    SimpleTimerSlot slots[] = {{0, FRAME_INTERVAL / 1000, process_frame},
+                               {0, SD_WRITE_INTERVAL / 1000, write_sd_blocking}};
+
+    while (now_micros < duration) {
+        run_simple_timer(slots, 2);
+        handle_client();
+        work(LOOP_OVERHEAD);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The loop under FrameScheduler
+
+static FrameScheduler run_scheduler(unsigned long duration, unsigned seed) {
+    start_run(seed);
+    FrameScheduler scheduler;
+    scheduler.add_deadline_task("frame", process_frame, FRAME_INTERVAL, FRAME_INTERVAL);
+    scheduler.add_background_task("web", handle_client, WEB_BUDGET);
+    scheduler.add_background_task("sd", write_sd_step, SD_BUDGET);
+
+    while (now_micros < duration) {
+        scheduler.run();
+        work(LOOP_OVERHEAD);
+    }
+
+    return scheduler;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static unsigned long get_percentile(std::vector<unsigned long> values, double fraction) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, size_t(fraction * values.size()))];
+}
+
+static unsigned long report(const char* name, unsigned long duration) {
+    /**
+    * Print the statistics of a run.
+    * @return Number of sensor frames that were never read
+    */
+    unsigned long num_sensor_frames = duration / SENSOR_PERIOD;
+    unsigned long num_dropped = 0;
+    for (unsigned long frame = 1; frame < num_sensor_frames; frame++) {
+        if (stats.frames_read.count(frame) == 0) {
+            num_dropped++;
+        }
+    }
+
+    unsigned long total_wait = 0;
+    for (size_t i = 0; i < stats.request_waits.size(); i++) {
+        total_wait += stats.request_waits[i];
+    }
+
+    printf("%-14s %6lu %7lu %6lu %7.1f  %6zu %6.1f %6.1f %6.1f  %4lu %6.1f\n", name, num_sensor_frames, num_dropped,
+           stats.num_missed_periods, stats.max_read_period / 1000.0, stats.request_waits.size(),
+           stats.request_waits.empty() ? 0 : total_wait / 1000.0 / stats.request_waits.size(),
+           get_percentile(stats.request_waits, 0.99) / 1000.0, get_percentile(stats.request_waits, 1) / 1000.0,
+           stats.num_sd_writes, stats.max_sd_write_time / 1000.0);
+
+    return num_dropped;
+}
+
+static void print_usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [-d seconds] [-w requests_per_second] [-s seed]\n"
+            "  -d  Simulated seconds to run for (default: %.0f)\n"
+            "  -w  Mean web requests per second (default: %.0f)\n"
+            "  -s  Random seed\n",
+            name, DEFAULT_DURATION, DEFAULT_WEB_RATE);
+}
+
+int main(int argc, char* argv[]) {
+    double duration_seconds = DEFAULT_DURATION;
+    double web_rate = DEFAULT_WEB_RATE;
+    unsigned seed = 1;
+
+    int option;
+    while ((option = getopt(argc, argv, "d:w:s:h")) != -1) {
+        switch (option) {
+            case 'd':
+                duration_seconds = atof(optarg);
+                break;
+            case 'w':
+                web_rate = atof(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    if (duration_seconds <= 0 || web_rate <= 0 || optind != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Requests arrive at random, the same ones for both runs
+    unsigned long duration = duration_seconds * 1e6;
+    std::mt19937 request_random(seed);
+    std::exponential_distribution<double> gap(web_rate / 1e6);
+    std::uniform_int_distribution<unsigned long> request_work(MIN_REQUEST_WORK, MAX_REQUEST_WORK);
+    for (double arrival = gap(request_random); arrival < duration; arrival += gap(request_random)) {
+        Request request = {(unsigned long)arrival, request_work(request_random)};
+        requests.push_back(request);
+    }
+
+    printf("%.0f s, %zu web requests taking %lu-%lu ms, an %lu ms SD write every %lu s\n\n", duration_seconds,
+           requests.size(), MIN_REQUEST_WORK / 1000, MAX_REQUEST_WORK / 1000, SD_WRITE_STEPS * SD_STEP_WORK / 1000,
+           SD_WRITE_INTERVAL / 1000000);
+    printf("                       sensor frames     max gap   web requests (ms wait)     SD writes\n");
+    printf("               frames dropped missed    (ms)    served   mean    p99    max  done max ms\n");
+
+    run_loop(duration, seed);
+    report("SimpleTimer", duration);
+
+    FrameScheduler scheduler = run_scheduler(duration, seed);
+    unsigned long num_dropped = report("FrameScheduler", duration);
+
+    printf("\nFrameScheduler tasks        runs  misses skipped deferred  max late (us)  max run (us)\n");
+    for (int i = 0; i < scheduler.num_tasks; i++) {
+        const ScheduledTask& task = scheduler.tasks[i];
+        printf("%-6s %-10s %13lu %7lu %7lu %8lu %14lu %13lu\n", task.name,
+               task.kind == TASK_DEADLINE ? "deadline" : "background", task.num_runs, task.num_deadline_misses,
+               task.num_skipped_releases, task.num_deferrals, task.max_lateness, task.max_run_time);
+    }
+
+    return num_dropped == 0 ? 0 : 1;
+}
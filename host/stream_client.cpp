@@ -0,0 +1,280 @@
+/*
+ * NodeMLX frame stream test client
+ *
+ * Subscribes to a device's Server-Sent Events frame stream, checks every frame it is sent and reports the delivered
+ * frame rate against the rate the device published frames at (from the event ids, which are frame sequence numbers).
+ *
+ * Usage: stream_client [-p port] [-d seconds] [-r min_rate] host
+ */
+
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include "FrameExport.h"
+
+typedef std::chrono::steady_clock stream_clock;
+
+const int DEFAULT_STREAM_PORT = 81;
+const double DEFAULT_DURATION = 10;
+
+static void print_usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [-p port] [-d seconds] [-r min_rate] host\n"
+            "  -p  Stream port (default: %d)\n"
+            "  -d  Seconds to listen for (default: %.0f)\n"
+            "  -r  Fail unless at least this many frames per second are delivered\n",
+            name, DEFAULT_STREAM_PORT, DEFAULT_DURATION);
+}
+
+static int connect_to(const char* host, int port) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+    addrinfo* addresses;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0) {
+        return -1;
+    }
+
+    int socket_fd = -1;
+    for (addrinfo* address = addresses; address; address = address->ai_next) {
+        socket_fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (socket_fd >= 0 && connect(socket_fd, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+        if (socket_fd >= 0) {
+            close(socket_fd);
+            socket_fd = -1;
+        }
+    }
+
+    freeaddrinfo(addresses);
+    return socket_fd;
+}
+
+/**
+* Decode base64 text.
+* @return Number of bytes decoded, or -1 if the text is not valid base64 or does not fit
+*/
+static int decode_base64(const std::string& text, uint8_t* output, size_t capacity) {
+    if (text.size() % 4 != 0) {
+        return -1;
+    }
+
+    size_t length = 0;
+    for (size_t i = 0; i < text.size(); i += 4) {
+        uint32_t group = 0;
+        int num_padding = 0;
+        for (int j = 0; j < 4; j++) {
+            char c = text[i + j];
+            int value;
+            if (c >= 'A' && c <= 'Z') {
+                value = c - 'A';
+            } else if (c >= 'a' && c <= 'z') {
+                value = c - 'a' + 26;
+            } else if (c >= '0' && c <= '9') {
+                value = c - '0' + 52;
+            } else if (c == '+' || c == '/') {
+                value = c == '+' ? 62 : 63;
+            } else if (c == '=' && j >= 2) {
+                value = 0;
+                num_padding++;
+            } else {
+                return -1;
+            }
+            group = group << 6 | value;
+        }
+
+        for (int j = 0; j < 3 - num_padding; j++) {
+            if (length == capacity) {
+                return -1;
+            }
+            output[length++] = (group >> (16 - 8 * j)) & 0xFF;
+        }
+    }
+
+    return length;
+}
+
+struct StreamStats {
+    long num_events;
+    long num_bad_events;   /**< Events that did not decode to a frame matching their id */
+    long num_out_of_order; /**< Events whose id was not above the last one */
+    unsigned long first_sequence;
+    unsigned long last_sequence;
+    unsigned long largest_gap; /**< Most frames missed in a row */
+};
+
+/**
+* Check one event and add it to the statistics.
+*/
+static void check_event(const std::string& id, const std::string& data, StreamStats& stats) {
+    uint8_t frame[FRAME_EXPORT_BINARY_SIZE + 3];
+    int length = decode_base64(data, frame, sizeof(frame));
+    unsigned long sequence = strtoul(id.c_str(), NULL, 10);
+
+    if (length != FRAME_EXPORT_BINARY_SIZE || frame[0] != FRAME_EXPORT_VERSION || frame[2] != FRAME_WIDTH ||
+        frame[3] != FRAME_HEIGHT ||
+        (frame[4] | frame[5] << 8 | frame[6] << 16 | (unsigned long)frame[7] << 24) != sequence) {
+        stats.num_bad_events++;
+        return;
+    }
+
+    if (stats.num_events > 0) {
+        if (sequence <= stats.last_sequence) {
+            stats.num_out_of_order++;
+            return;
+        }
+        if (sequence - stats.last_sequence - 1 > stats.largest_gap) {
+            stats.largest_gap = sequence - stats.last_sequence - 1;
+        }
+    } else {
+        stats.first_sequence = sequence;
+    }
+
+    stats.last_sequence = sequence;
+    stats.num_events++;
+}
+
+int main(int argc, char* argv[]) {
+    int port = DEFAULT_STREAM_PORT;
+    double duration = DEFAULT_DURATION;
+    double min_rate = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "p:d:r:h")) != -1) {
+        switch (option) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'd':
+                duration = atof(optarg);
+                break;
+            case 'r':
+                min_rate = atof(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char* host = argv[optind];
+
+    int socket_fd = connect_to(host, port);
+    if (socket_fd < 0) {
+        fprintf(stderr, "Could not connect to %s:%d\n", host, port);
+        return 1;
+    }
+
+    std::string request = "GET / HTTP/1.1\r\nHost: ";
+    request += host;
+    request += "\r\nAccept: text/event-stream\r\n\r\n";
+    if (send(socket_fd, request.data(), request.size(), 0) != (ssize_t)request.size()) {
+        fprintf(stderr, "Could not send the request\n");
+        return 1;
+    }
+
+    StreamStats stats;
+    memset(&stats, 0, sizeof(stats));
+    std::string received;
+    std::string id;
+    std::string data;
+    bool in_body = false;
+    bool closed = false;
+
+    stream_clock::time_point start = stream_clock::now();
+    stream_clock::time_point first_event;
+    double elapsed = 0;
+
+    while (!closed && (elapsed = std::chrono::duration<double>(stream_clock::now() - start).count()) < duration) {
+        pollfd poll_fd = {socket_fd, POLLIN, 0};
+        if (poll(&poll_fd, 1, 100) <= 0) {
+            continue;
+        }
+
+        char buffer[4096];
+        ssize_t num_read = recv(socket_fd, buffer, sizeof(buffer), 0);
+        if (num_read <= 0) {
+            closed = true;
+            break;
+        }
+        received.append(buffer, num_read);
+
+        if (!in_body) {
+            size_t end = received.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                continue;
+            }
+            if (received.compare(0, 12, "HTTP/1.1 200") != 0 ||
+                received.find("text/event-stream") == std::string::npos) {
+                fprintf(stderr, "Not an event stream:\n%s\n", received.substr(0, end).c_str());
+                return 1;
+            }
+            received.erase(0, end + 4);
+            in_body = true;
+        }
+
+        // Events are fields on lines of their own, ended by a blank line
+        size_t line_end;
+        while ((line_end = received.find('\n')) != std::string::npos) {
+            std::string line = received.substr(0, line_end);
+            received.erase(0, line_end + 1);
+
+            if (line.compare(0, 4, "id: ") == 0) {
+                id = line.substr(4);
+            } else if (line.compare(0, 6, "data: ") == 0) {
+                data = line.substr(6);
+            } else if (line.empty() && !data.empty()) {
+                if (stats.num_events == 0) {
+                    first_event = stream_clock::now();
+                }
+                check_event(id, data, stats);
+                data.clear();
+            }
+        }
+    }
+
+    close(socket_fd);
+
+    if (stats.num_events < 2) {
+        fprintf(stderr, "Received %ld frames in %.1f s%s\n", stats.num_events, elapsed,
+                closed ? " before the device closed the stream" : "");
+        return 1;
+    }
+
+    // Rates are taken from the first frame on, so connecting is not counted
+    double streaming_time = std::chrono::duration<double>(stream_clock::now() - first_event).count();
+    unsigned long num_published = stats.last_sequence - stats.first_sequence + 1;
+    double delivered_rate = stats.num_events / streaming_time;
+    double published_rate = num_published / streaming_time;
+
+    printf("%ld frames in %.1f s: delivered %.1f fps of %.1f fps published (%.1f%%)\n", stats.num_events,
+           streaming_time, delivered_rate, published_rate, 100.0 * stats.num_events / num_published);
+    printf("missed %lu frames, largest gap %lu, %ld out of order, %ld bad%s\n", num_published - stats.num_events,
+           stats.largest_gap, stats.num_out_of_order, stats.num_bad_events,
+           closed ? " (stream closed by the device)" : "");
+
+    if (stats.num_bad_events > 0 || stats.num_out_of_order > 0) {
+        return 1;
+    }
+    if (min_rate > 0 && delivered_rate < min_rate) {
+        printf("Delivered frame rate is below %.1f fps\n", min_rate);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,502 @@
+/*
+ * NodeMLX serial telemetry decoder
+ *
+ * Reads the serial output of a device sending binary telemetry (SERIAL_BINARY_TELEMETRY, see SerialTelemetry.h) and
+ * writes it back out as the log lines the device prints without it, so tools reading the "#{json}$" packets keep
+ * working. Log text between records is passed through unchanged. Frames have no JSON packet on the device, so they
+ * are written as {"id":"frame","seq","pixels":[[row 0], ...]}. Damaged records are dropped and counted.
+ *
+ * With -t it runs a self-test instead: a synthetic scene is tracked, every event is both encoded and formatted as
+ * NodeMLX formats it, and the decoded stream must reproduce the JSON exactly. Some records are damaged on the way to
+ * check that the CRC catches them. It reports the bytes each kind of record takes in both forms.
+ *
+ * Usage: telemetry_decode [-i device_name] [-b baud] [file | serial device]
+ *        telemetry_decode -t frames
+ */
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "SerialTelemetry.h"
+#include "SyntheticScene.h"
+
+const char* DEFAULT_DEVICE_NAME = "thermal40deg";
+const long DEFAULT_BAUD = 115200;
+const char PACKET_START = '#';
+const char PACKET_END = '$';
+const int SELF_TEST_DAMAGE_INTERVAL = 37; /**< Every this many records is damaged in the self-test */
+const int SELF_TEST_TEXT_INTERVAL = 100;  /**< Frames between log lines in the self-test */
+const int REFRESH_RATE = 32;
+
+const char* RECORD_NAMES[] = {"unknown", "track start", "track end", "line crossing", "movements", "ambient", "frame"};
+
+////////////////////////////////////////////////////////////////////////////////
+// Conversion
+
+static std::string format(const char* format_string, ...) __attribute__((format(printf, 1, 2)));
+
+static std::string format(const char* format_string, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, format_string);
+    vsnprintf(buffer, sizeof(buffer), format_string, args);
+    va_end(args);
+    return buffer;
+}
+
+static std::string format_hundredths(int value) {
+    return format("%s%d.%02d", value < 0 ? "-" : "", abs(value) / 100, abs(value) % 100);
+}
+
+static std::string convert_record(const TelemetryRecord& record, const char* device_name) {
+    /**
+    * Write a record as the log line the device prints in its place.
+    */
+    switch (record.type) {
+        case TELEMETRY_TRACK_START:
+            return format("INFO:\t%c{\"id\":\"%s\",\"type\":\"start\",\"t_id\":%d,\"size\":%d,\"start_x\":%d,"
+                          "\"start_y\":%d,\"temp\":%d,\"w\":%d,\"h\":%d}%c\n",
+                          PACKET_START, device_name, record.track_id, record.size, record.start_position[X] / 10,
+                          record.start_position[Y] / 10, record.temperature, record.width, record.height, PACKET_END);
+
+        case TELEMETRY_TRACK_END:
+            if (record.has_diagnostics) {
+                return format("INFO:\t%c{\"id\":\"%s\",\"type\":\"end\",\"t_id\":%d,\"av_diff\":%d,\"max_diff\":%d,"
+                              "\"time\":%d,\"frames\":%d,\"size\":%d,\"travel\":%d,\"temp\":%d,\"w\":%d,\"h\":%d,"
+                              "\"dead\":%d}%c\n",
+                              PACKET_START, device_name, record.track_id, record.average_difference,
+                              record.max_difference, int(record.duration), record.frames, record.size, record.travel,
+                              record.temperature, record.width, record.height, record.max_dead_frames, PACKET_END);
+            }
+            return format("INFO:\t%c{\"id\":\"%s\",\"type\":\"end\",\"t_id\":%d,\"time\":%d,\"frames\":%d,\"size\":%d,"
+                          "\"travel\":%d,\"temp\":%d,\"w\":%d,\"h\":%d,\"dead\":%d}%c\n",
+                          PACKET_START, device_name, record.track_id, int(record.duration), record.frames, record.size,
+                          record.travel, record.temperature, record.width, record.height, record.max_dead_frames,
+                          PACKET_END);
+
+        case TELEMETRY_LINE_CROSSING:
+            return format("INFO:\t%c{\"id\":\"%s\",\"type\":\"cross\",\"t_id\":%d,\"line\":%d,\"dir\":\"%s\"}%c\n",
+                          PACKET_START, device_name, record.track_id, record.line,
+                          record.crossing == CROSSING_FORWARD ? "fwd" : "back", PACKET_END);
+
+        case TELEMETRY_MOVEMENTS:
+            return format("DEBUG:\t%c{\"id\":\"thermal\",\"left\":%d,\"right\":%d,\"zero\":%d,\"blobs\":%d}%c\n",
+                          PACKET_START, int32_t(record.movements[LEFT]), int32_t(record.movements[RIGHT]),
+                          int32_t(record.movements[NO_DIRECTION]), record.num_blobs, PACKET_END);
+
+        case TELEMETRY_AMBIENT:
+            return format("INFO:\t%c{\"id\":\"ambient\", \"temp\":%s}%c\n", PACKET_START,
+                          format_hundredths(record.temperature).c_str(), PACKET_END);
+
+        case TELEMETRY_FRAME: {
+            uint32_t sequence = record.frame[4] | (record.frame[5] << 8) | (record.frame[6] << 16) |
+                                (uint32_t(record.frame[7]) << 24);
+            std::string line = format("INFO:\t%c{\"id\":\"frame\",\"seq\":%u,\"pixels\":[", PACKET_START, sequence);
+
+            const uint8_t* pixel = record.frame + FRAME_EXPORT_HEADER_SIZE;
+            for (int i = 0; i < FRAME_HEIGHT; i++) {
+                line += i ? ",[" : "[";
+                for (int j = 0; j < FRAME_WIDTH; j++, pixel += 2) {
+                    line += (j ? "," : "") + format_hundredths(int16_t(pixel[0] | (pixel[1] << 8)));
+                }
+                line += "]";
+            }
+            return line + format("]}%c\n", PACKET_END);
+        }
+    }
+
+    return "";
+}
+
+static bool is_text(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] < ' ' && data[i] != '\t' && data[i] != '\r' && data[i] != '\n') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* Turns a byte stream from a device back into its log lines.
+*/
+struct Converter {
+    TelemetryDecoder decoder;
+    const char* device_name;
+    unsigned long num_by_type[TELEMETRY_FRAME + 1];
+    unsigned long num_text_chunks;
+    unsigned long num_damaged;
+    unsigned long num_bytes;
+
+    Converter(const char* name) : device_name(name), num_text_chunks(0), num_damaged(0), num_bytes(0) {
+        memset(num_by_type, 0, sizeof(num_by_type));
+    }
+
+    /**
+    * Add the next byte of the stream.
+    * @param output Where to append any line the byte completes
+    */
+    void feed(uint8_t byte, std::string& output) {
+        num_bytes++;
+
+        int chunk = decoder.feed(byte);
+        if (chunk == TELEMETRY_CHUNK_RECORD) {
+            TelemetryRecord record;
+            if (decoder.get_record(record)) {
+                num_by_type[record.type]++;
+                output += convert_record(record, device_name);
+            } else {
+                num_damaged++;
+            }
+        } else if (chunk == TELEMETRY_CHUNK_OTHER) {
+            if (is_text(decoder.chunk, decoder.chunk_length)) {
+                num_text_chunks++;
+                output.append((const char*)decoder.chunk, decoder.chunk_length);
+            } else {
+                num_damaged++;
+            }
+        }
+    }
+
+    /**
+    * End the stream, passing on anything after the last delimiter, such as a final log line.
+    */
+    void finish(std::string& output) {
+        feed(0, output);
+        num_bytes--;
+    }
+
+    void print_summary() {
+        fprintf(stderr, "%lu bytes:", num_bytes);
+        for (int type = TELEMETRY_TRACK_START; type <= TELEMETRY_FRAME; type++) {
+            fprintf(stderr, " %lu %s,", num_by_type[type], RECORD_NAMES[type]);
+        }
+        fprintf(stderr, " %lu text, %lu damaged\n", num_text_chunks, num_damaged);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Serial
+
+static speed_t get_speed(long baud) {
+    switch (baud) {
+        case 9600:
+            return B9600;
+        case 19200:
+            return B19200;
+        case 38400:
+            return B38400;
+        case 57600:
+            return B57600;
+        case 115200:
+            return B115200;
+        case 230400:
+            return B230400;
+        case 460800:
+            return B460800;
+        case 921600:
+            return B921600;
+    }
+    return B0;
+}
+
+static int open_input(const char* path, long baud) {
+    /**
+    * Open a file, or a serial device set to raw mode at the given baud rate.
+    * @return File descriptor, or -1 on failure
+    */
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0 || !isatty(fd)) {
+        return fd;
+    }
+
+    termios settings;
+    speed_t speed = get_speed(baud);
+    if (speed == B0 || tcgetattr(fd, &settings) != 0) {
+        fprintf(stderr, "Unsupported baud rate %ld\n", baud);
+        close(fd);
+        return -1;
+    }
+
+    cfmakeraw(&settings);
+    cfsetispeed(&settings, speed);
+    cfsetospeed(&settings, speed);
+    settings.c_cc[VMIN] = 1;
+    settings.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &settings);
+    return fd;
+}
+
+static int convert(int fd, const char* device_name) {
+    Converter converter(device_name);
+    uint8_t buffer[4096];
+    std::string output;
+
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < length; i++) {
+            converter.feed(buffer[i], output);
+        }
+        fwrite(output.data(), 1, output.size(), stdout);
+        fflush(stdout);
+        output.clear();
+    }
+
+    converter.finish(output);
+    fwrite(output.data(), 1, output.size(), stdout);
+
+    converter.print_summary();
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Self-test
+
+/** Stream the self-test's encoder writes to, damaging some records on the way */
+static std::vector<uint8_t> test_stream;
+static std::string expected_output;
+static unsigned long num_test_records = 0;
+static unsigned long num_damaged_records = 0;
+static unsigned long json_bytes[TELEMETRY_FRAME + 1];
+static unsigned long binary_bytes[TELEMETRY_FRAME + 1];
+static unsigned long record_counts[TELEMETRY_FRAME + 1];
+static int last_record_type = 0;
+
+static size_t write_to_stream(void* /* context */, const uint8_t* data, size_t length) {
+    size_t start = test_stream.size();
+    test_stream.insert(test_stream.end(), data, data + length);
+
+    binary_bytes[last_record_type] += length;
+    record_counts[last_record_type]++;
+
+    // Flip a bit in the middle of the record; the CRC must catch it, and the record must not be converted
+    if (++num_test_records % SELF_TEST_DAMAGE_INTERVAL == 0) {
+        test_stream[start + length / 2] ^= 0x10;
+        num_damaged_records++;
+    }
+
+    return length;
+}
+
+static TelemetryEncoder test_encoder(write_to_stream, NULL);
+
+/**
+* Note the JSON line the device would have printed for the record about to be encoded.
+*/
+static void expect(int type, const std::string& line, bool is_converted) {
+    last_record_type = type;
+    json_bytes[type] += line.size();
+
+    // A damaged record is dropped, so it has no line
+    if (is_converted && (num_test_records + 1) % SELF_TEST_DAMAGE_INTERVAL != 0) {
+        expected_output += line;
+    }
+}
+
+// As NodeMLX prints each packet
+
+static void test_tracked_start(const TrackedBlob& blob) {
+    expect(TELEMETRY_TRACK_START,
+           format("INFO:\t%c{\"id\":\"%s\",\"type\":\"start\",\"t_id\":%d,\"size\":%d,\"start_x\":%d,\"start_y\":%d,"
+                  "\"temp\":%d,\"w\":%d,\"h\":%d}%c\n",
+                  PACKET_START, DEFAULT_DEVICE_NAME, blob.id, int(blob.max_size), int(blob.start_pos[X]),
+                  int(blob.start_pos[Y]), int(blob._blob.average_temperature * 100), int(blob.max_width),
+                  int(blob.max_height), PACKET_END),
+           true);
+    test_encoder.write_track_start(blob);
+}
+
+static void test_tracked_end(const TrackedBlob& blob) {
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_SUMMARY
+    std::string line = format(
+        "INFO:\t%c{\"id\":\"%s\",\"type\":\"end\",\"t_id\":%d,\"av_diff\":%d,\"max_diff\":%d,\"time\":%d,\"frames\":%d,"
+        "\"size\":%d,\"travel\":%d,\"temp\":%d,\"w\":%d,\"h\":%d,\"dead\":%d}%c\n",
+        PACKET_START, DEFAULT_DEVICE_NAME, blob.id, int(blob.average_difference), int(blob.max_difference),
+        int(blob.event_duration), blob.times_updated, int(blob.max_size), int(blob.travel[X] * 100),
+        int(blob._blob.average_temperature * 100), int(blob.max_width), int(blob.max_height),
+        int(blob.max_num_dead_frames), PACKET_END);
+#else
+    std::string line =
+        format("INFO:\t%c{\"id\":\"%s\",\"type\":\"end\",\"t_id\":%d,\"time\":%d,\"frames\":%d,\"size\":%d,"
+               "\"travel\":%d,\"temp\":%d,\"w\":%d,\"h\":%d,\"dead\":%d}%c\n",
+               PACKET_START, DEFAULT_DEVICE_NAME, blob.id, int(blob.event_duration), blob.times_updated,
+               int(blob.max_size), int(blob.travel[X] * 100), int(blob._blob.average_temperature * 100),
+               int(blob.max_width), int(blob.max_height), int(blob.max_num_dead_frames), PACKET_END);
+#endif
+    expect(TELEMETRY_TRACK_END, line, true);
+    test_encoder.write_track_end(blob);
+}
+
+static void test_line_crossing(const TrackedBlob& blob, int line, int crossing) {
+    expect(TELEMETRY_LINE_CROSSING,
+           format("INFO:\t%c{\"id\":\"%s\",\"type\":\"cross\",\"t_id\":%d,\"line\":%d,\"dir\":\"%s\"}%c\n",
+                  PACKET_START, DEFAULT_DEVICE_NAME, blob.id, line, crossing == CROSSING_FORWARD ? "fwd" : "back",
+                  PACKET_END),
+           true);
+    test_encoder.write_line_crossing(blob, line, crossing);
+}
+
+static int self_test(int num_frames) {
+    /**
+    * Track a synthetic scene, encode everything NodeMLX would print, and check the converter gives the JSON back.
+    * @return 0 if every undamaged record converts exactly and every damaged one is dropped
+    */
+    ThermalTracker tracker;
+    tracker.set_tracking_start_callback(test_tracked_start);
+    tracker.set_tracking_end_callback(test_tracked_end);
+    tracker.set_line_crossing_callback(test_line_crossing);
+    tracker.add_counting_line((FRAME_WIDTH - 1) / 2.0, 0, (FRAME_WIDTH - 1) / 2.0, FRAME_HEIGHT - 1);
+
+    SyntheticScene scene(7, 0.02);
+    long movements[NUM_DIRECTION_CATEGORIES];
+
+    for (int i = 0; i < num_frames; i++) {
+        if (i < DEFAULT_RUNNING_AVERAGE_SIZE * 2) {
+            scene.empty_frame(tracker.get_back_buffer());
+        } else {
+            scene.next_frame(tracker.get_back_buffer());
+        }
+        tracker.update();
+
+        // Frames are checked for damage only; their JSON form is the converter's own
+        last_record_type = TELEMETRY_FRAME;
+        test_encoder.write_frame(tracker.frame, tracker.frame_sequence);
+
+        if (tracker.has_new_movements()) {
+            tracker.get_movements(movements);
+            expect(TELEMETRY_MOVEMENTS,
+                   format("DEBUG:\t%c{\"id\":\"thermal\",\"left\":%ld,\"right\":%ld,\"zero\":%ld,\"blobs\":%d}%c\n",
+                          PACKET_START, movements[LEFT], movements[RIGHT], movements[NO_DIRECTION],
+                          tracker.num_last_blobs, PACKET_END),
+                   true);
+            test_encoder.write_movements(movements, tracker.num_last_blobs);
+        }
+
+        if (i % (REFRESH_RATE * 5) == 0) {
+            float ambient = scene.ambient + 2 * scene.uniform() - 1;
+            expect(TELEMETRY_AMBIENT,
+                   format("INFO:\t%c{\"id\":\"ambient\", \"temp\":%.2f}%c\n", PACKET_START, ambient, PACKET_END), true);
+            test_encoder.write_ambient(ambient);
+        }
+
+        // Log text printed between records must come through untouched
+        if (i % SELF_TEST_TEXT_INTERVAL == 0) {
+            std::string text = format("INFO:\tBlobs in frame: %d\n", tracker.num_last_blobs);
+            test_stream.insert(test_stream.end(), text.begin(), text.end());
+            expected_output += text;
+        }
+    }
+
+    Converter converter(DEFAULT_DEVICE_NAME);
+    std::string output;
+    for (size_t i = 0; i < test_stream.size(); i++) {
+        converter.feed(test_stream[i], output);
+    }
+    converter.finish(output);
+
+    // Frames were not added to the expected output, so leave them out of the comparison
+    std::string events;
+    size_t line_start = 0;
+    while (line_start < output.size()) {
+        size_t line_end = output.find('\n', line_start) + 1;
+        std::string line = output.substr(line_start, line_end - line_start);
+        if (line.compare(0, 21, "INFO:\t#{\"id\":\"frame\",") != 0) {
+            events += line;
+        }
+        line_start = line_end;
+    }
+
+    printf("%d frames, %lu records, %lu damaged on purpose\n\n", num_frames, num_test_records, num_damaged_records);
+    printf("%-14s %8s %12s %12s\n", "record", "count", "JSON bytes", "binary bytes");
+    for (int type = TELEMETRY_TRACK_START; type <= TELEMETRY_FRAME; type++) {
+        if (record_counts[type] == 0) {
+            continue;
+        }
+        printf("%-14s %8lu %12.1f %12.1f\n", RECORD_NAMES[type], record_counts[type],
+               type == TELEMETRY_FRAME ? 0.0 : double(json_bytes[type]) / record_counts[type],
+               double(binary_bytes[type]) / record_counts[type]);
+    }
+
+    double frame_rate_bytes = double(binary_bytes[TELEMETRY_FRAME]) / record_counts[TELEMETRY_FRAME] * REFRESH_RATE;
+    printf("\nFrames at %d Hz: %.0f bytes/s, %.0f%% of %ld baud\n\n", REFRESH_RATE, frame_rate_bytes,
+           frame_rate_bytes * 10 / DEFAULT_BAUD * 100, DEFAULT_BAUD);
+    converter.print_summary();
+
+    bool passed = events == expected_output && converter.num_damaged == num_damaged_records &&
+                  converter.num_by_type[TELEMETRY_FRAME] + converter.num_by_type[TELEMETRY_TRACK_START] +
+                          converter.num_by_type[TELEMETRY_TRACK_END] +
+                          converter.num_by_type[TELEMETRY_LINE_CROSSING] + converter.num_by_type[TELEMETRY_MOVEMENTS] +
+                          converter.num_by_type[TELEMETRY_AMBIENT] ==
+                      num_test_records - num_damaged_records;
+
+    if (events != expected_output) {
+        size_t mismatch = 0;
+        while (mismatch < events.size() && mismatch < expected_output.size() &&
+               events[mismatch] == expected_output[mismatch]) {
+            mismatch++;
+        }
+        size_t line_start = expected_output.rfind('\n', mismatch) + 1;
+        fprintf(stderr, "Converted output differs at byte %zu:\n  expected %s\n  got      %s\n", mismatch,
+                expected_output.substr(line_start, expected_output.find('\n', line_start) - line_start).c_str(),
+                events.substr(line_start, events.find('\n', line_start) - line_start).c_str());
+    }
+
+    printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Main
+
+static void print_usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [-i device_name] [-b baud] [file | serial device]\n"
+            "       %s -t frames\n"
+            "  -i  Device name to put in the packets (default: %s)\n"
+            "  -b  Baud rate, when reading a serial device (default: %ld)\n"
+            "  -t  Run the self-test on this many synthetic frames\n"
+            "Reads standard input if no file is given.\n",
+            name, name, DEFAULT_DEVICE_NAME, DEFAULT_BAUD);
+}
+
+int main(int argc, char* argv[]) {
+    const char* device_name = DEFAULT_DEVICE_NAME;
+    long baud = DEFAULT_BAUD;
+    int num_test_frames = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "i:b:t:h")) != -1) {
+        switch (option) {
+            case 'i':
+                device_name = optarg;
+                break;
+            case 'b':
+                baud = atol(optarg);
+                break;
+            case 't':
+                num_test_frames = atoi(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    if (num_test_frames > 0) {
+        return self_test(num_test_frames);
+    }
+
+    int fd = optind < argc ? open_input(argv[optind], baud) : STDIN_FILENO;
+    if (fd < 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    return convert(fd, device_name);
+}
@@ -0,0 +1,877 @@
+/*
+ * NodeMLX tracker benchmarks
+ *
+ * Host-side timing of the tracking library on synthetic scenes. Each benchmark prints its throughput and, where
+ * relevant, checks its results against the plain ThermalTracker::update path.
+ *
+ * Usage: tracker_bench <benchmark> [options]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "BatchTracker.h"
+#include "SyntheticScene.h"
+#include "ThermalTracker.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+/**
+* Render a synthetic recording into memory so scene generation is not part of the timing.
+* @param seed Scene seed
+* @param spawn_rate Probability per frame of a new walker
+* @param num_frames Frames to render
+* @param frames Buffer of num_frames frames
+*/
+static void render_scene(uint32_t seed, float spawn_rate, int num_frames, float (*frames)[FRAME_HEIGHT][FRAME_WIDTH]) {
+    SyntheticScene scene(seed, spawn_rate);
+
+    // Keep the scene empty while the trackers build their backgrounds
+    for (int i = 0; i < num_frames; i++) {
+        if (i < DEFAULT_RUNNING_AVERAGE_SIZE) {
+            scene.empty_frame(frames[i]);
+        } else {
+            scene.next_frame(frames[i]);
+        }
+    }
+}
+
+static long total_movements(ThermalTracker& tracker) {
+    long total = 0;
+    for (int i = 0; i < NUM_DIRECTION_CATEGORIES; i++) {
+        total += tracker.movements[i];
+    }
+    return total;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Batch
+
+static int bench_batch(int num_sensors, int num_frames) {
+    /**
+    * Compare K independent ThermalTracker::update calls against one BatchTracker running K lanes.
+    */
+    std::vector<float> storage((size_t)num_sensors * num_frames * FRAME_HEIGHT * FRAME_WIDTH);
+    typedef float frame_t[FRAME_HEIGHT][FRAME_WIDTH];
+    frame_t* recordings = (frame_t*)&storage[0];
+
+    for (int k = 0; k < num_sensors; k++) {
+        render_scene(k + 1, 0.02, num_frames, recordings + (size_t)k * num_frames);
+    }
+
+    // Independent trackers, interleaved frame by frame as they would be served live
+    std::vector<ThermalTracker*> trackers;
+    for (int k = 0; k < num_sensors; k++) {
+        trackers.push_back(new ThermalTracker());
+    }
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < num_frames; i++) {
+        for (int k = 0; k < num_sensors; k++) {
+            trackers[k]->update(recordings[(size_t)k * num_frames + i]);
+        }
+    }
+    double independent_time = seconds_since(start);
+
+    // Batched lanes
+    BatchTracker batch(num_sensors);
+    std::vector<float (*)[FRAME_WIDTH]> inputs(num_sensors);
+
+    start = bench_clock::now();
+    for (int i = 0; i < num_frames; i++) {
+        for (int k = 0; k < num_sensors; k++) {
+            inputs[k] = recordings[(size_t)k * num_frames + i];
+        }
+        batch.update(&inputs[0]);
+    }
+    double batch_time = seconds_since(start);
+
+    long independent_movements = 0;
+    long batch_movements = 0;
+    int mismatched_sensors = 0;
+    for (int k = 0; k < num_sensors; k++) {
+        independent_movements += total_movements(*trackers[k]);
+        batch_movements += total_movements(batch.get_tracker(k));
+        if (total_movements(*trackers[k]) != total_movements(batch.get_tracker(k))) {
+            mismatched_sensors++;
+        }
+        delete trackers[k];
+    }
+
+    double sensor_frames = (double)num_sensors * num_frames;
+    printf("batch: %d sensors x %d frames\n", num_sensors, num_frames);
+    printf("  independent update: %10.0f sensor-frames/s  movements %ld\n", sensor_frames / independent_time,
+           independent_movements);
+    printf("  batched lanes:      %10.0f sensor-frames/s  movements %ld  (%d sensors differ)\n",
+           sensor_frames / batch_time, batch_movements, mismatched_sensors);
+    printf("  speedup: %.2fx\n", independent_time / batch_time);
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Offline batch update
+
+static long num_callback_events = 0;
+
+static void count_tracking_event(const TrackedBlob& /* blob */) { num_callback_events++; }
+
+static int bench_offline(int num_frames, int block_size) {
+    /**
+    * Single-core offline replay: per-frame update with callbacks vs update_batch over contiguous blocks.
+    */
+    typedef float frame_t[FRAME_HEIGHT][FRAME_WIDTH];
+    std::vector<float> storage((size_t)num_frames * FRAME_HEIGHT * FRAME_WIDTH);
+    frame_t* recording = (frame_t*)&storage[0];
+    render_scene(1, 0.01, num_frames, recording);
+
+    ThermalTracker per_frame;
+    per_frame.set_tracking_start_callback(count_tracking_event);
+    per_frame.set_tracking_end_callback(count_tracking_event);
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < num_frames; i++) {
+        per_frame.update(recording[i]);
+    }
+    double per_frame_time = seconds_since(start);
+
+    ThermalTracker batched;
+    std::vector<TrackingEvent> buffer(block_size * 2);
+    EventSink events(&buffer[0], buffer.size());
+    long num_batch_events = 0;
+
+    start = bench_clock::now();
+    for (int i = 0; i < num_frames; i += block_size) {
+        int count = num_frames - i < block_size ? num_frames - i : block_size;
+        events.clear();
+        batched.update_batch(&recording[i][0][0], count, events);
+        num_batch_events += events.num_events;
+    }
+    double batch_time = seconds_since(start);
+
+    printf("offline: %d frames, blocks of %d\n", num_frames, block_size);
+    printf("  update + callbacks: %10.0f frames/s  events %ld  movements %ld\n", num_frames / per_frame_time,
+           num_callback_events, total_movements(per_frame));
+    printf("  update_batch:       %10.0f frames/s  events %ld  movements %ld  (dropped %lu)\n", num_frames / batch_time,
+           num_batch_events, total_movements(batched), events.num_dropped_events);
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Idle fast path
+
+static int bench_idle(int num_frames, float spawn_rate) {
+    /**
+    * Per-frame update on a mostly-empty scene, reporting the tracker's own idle and active frame counters.
+    */
+    typedef float frame_t[FRAME_HEIGHT][FRAME_WIDTH];
+    std::vector<float> storage((size_t)num_frames * FRAME_HEIGHT * FRAME_WIDTH);
+    frame_t* recording = (frame_t*)&storage[0];
+    render_scene(1, spawn_rate, num_frames, recording);
+
+    ThermalTracker tracker;
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < num_frames; i++) {
+        tracker.update(recording[i]);
+    }
+    double total_time = seconds_since(start);
+
+    double idle_us = tracker.num_idle_frames ? (double)tracker.idle_frame_micros / tracker.num_idle_frames : 0;
+    double active_us = tracker.num_active_frames ? (double)tracker.active_frame_micros / tracker.num_active_frames : 0;
+
+    printf("idle: %d frames, spawn rate %.3f\n", num_frames, spawn_rate);
+    printf("  overall:       %10.0f frames/s  movements %ld\n", num_frames / total_time, total_movements(tracker));
+    printf("  idle frames:   %10lu  mean %.3f us\n", tracker.num_idle_frames, idle_us);
+    printf("  active frames: %10lu  mean %.3f us\n", tracker.num_active_frames, active_us);
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Blob building
+
+static void add_eight_blobs(float frame[FRAME_HEIGHT][FRAME_WIDTH], float temperature) {
+    // Four 3x1 blobs on each of rows 0 and 2, one pixel apart - eight separate blobs with no adjacency fuzz
+    for (int row = 0; row < FRAME_HEIGHT; row += 2) {
+        for (int column = 0; column + 3 <= FRAME_WIDTH; column += 4) {
+            for (int j = column; j < column + 3; j++) {
+                frame[row][j] = temperature;
+            }
+        }
+    }
+}
+
+static int bench_blobs8(int num_frames) {
+    /**
+    * Blob building and tracking on frames holding MAX_BLOBS blobs, the worst case for the clustering scratch space.
+    */
+    const int period = 50; /**< Blobs for 40 frames, then 10 empty ones, so they never settle into the background */
+    typedef float frame_t[FRAME_HEIGHT][FRAME_WIDTH];
+    std::vector<float> storage((size_t)(DEFAULT_RUNNING_AVERAGE_SIZE + period) * FRAME_HEIGHT * FRAME_WIDTH);
+    frame_t* recording = (frame_t*)&storage[0];
+
+    SyntheticScene scene(1, 0);
+    for (int i = 0; i < DEFAULT_RUNNING_AVERAGE_SIZE + period; i++) {
+        scene.empty_frame(recording[i]);
+        if (i >= DEFAULT_RUNNING_AVERAGE_SIZE && i < DEFAULT_RUNNING_AVERAGE_SIZE + period - 10) {
+            add_eight_blobs(recording[i], scene.body_temperature);
+        }
+    }
+
+    ThermalTracker tracker;
+    Pixel::adjacency_fuzz = 0;
+    for (int i = 0; i < DEFAULT_RUNNING_AVERAGE_SIZE; i++) {
+        tracker.update(recording[i]);
+    }
+    tracker.update(recording[DEFAULT_RUNNING_AVERAGE_SIZE]);
+
+    // Clustering alone, on the frame just loaded
+    Blob blobs[MAX_BLOBS];
+    int num_blobs = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < num_frames; i++) {
+        num_blobs = tracker.get_blobs(blobs);
+    }
+    double get_blobs_time = seconds_since(start);
+
+    // Full updates, 80% of them with eight blobs in view
+    start = bench_clock::now();
+    for (int i = 0; i < num_frames; i++) {
+        tracker.update(recording[DEFAULT_RUNNING_AVERAGE_SIZE + i % period]);
+    }
+    double update_time = seconds_since(start);
+
+    printf("blobs8: %d frames\n", num_frames);
+    printf("  get_blobs: %10.0f frames/s  (%d blobs)\n", num_frames / get_blobs_time, num_blobs);
+    printf("  update:    %10.0f frames/s  (blobs in 40 of every %d frames)\n", num_frames / update_time, period);
+    if (TRACKER_STACK_PAINT_SIZE > 0) {
+        printf("  stack high-water below update: %u bytes%s\n", tracker.stack_high_water,
+               tracker.stack_paint_exhausted ? " or more" : "");
+    }
+
+    Pixel::adjacency_fuzz = DEFAULT_ADJACENCY_FUZZ;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Capacity
+
+static int bench_capacity(int blob_capacity, int num_frames, float spawn_rate) {
+    /**
+    * Track a crowded scene with the default blob capacity and with a larger one.
+    * Reports throughput, counted vs true movements, and how often each capacity overflowed. Two lanes of platoons
+    * then fill more tracks than the default capacity holds, and a grid of sixteen single-pixel blobs (no adjacency
+    * fuzz or minimum size) shows the blob overflow counters at work.
+    */
+    typedef float frame_t[FRAME_HEIGHT][FRAME_WIDTH];
+    std::vector<float> storage((size_t)num_frames * FRAME_HEIGHT * FRAME_WIDTH);
+    frame_t* recording = (frame_t*)&storage[0];
+
+    SyntheticScene scene(1, spawn_rate);
+    for (int i = 0; i < num_frames; i++) {
+        if (i < DEFAULT_RUNNING_AVERAGE_SIZE) {
+            scene.empty_frame(recording[i]);
+        } else {
+            scene.next_frame(recording[i]);
+        }
+    }
+
+    long true_total = 0;
+    for (int i = 0; i < NUM_DIRECTION_CATEGORIES; i++) {
+        true_total += scene.true_movements[i];
+    }
+
+    printf("capacity: %d frames, spawn rate %.3f, %ld true movements\n", num_frames, spawn_rate, true_total);
+
+    int capacities[2] = {MAX_BLOBS, blob_capacity};
+    for (int c = 0; c < 2; c++) {
+        ThermalTracker tracker(capacities[c]);
+
+        bench_clock::time_point start = bench_clock::now();
+        for (int i = 0; i < num_frames; i++) {
+            tracker.update(recording[i]);
+        }
+        double total_time = seconds_since(start);
+
+        printf("  capacity %2d: %10.0f frames/s  movements %ld  blob overflows %lu (%lu pixels)  track overflows %lu\n",
+               tracker.get_blob_capacity(), num_frames / total_time, total_movements(tracker),
+               tracker.num_blob_overflows, tracker.num_dropped_pixels, tracker.num_track_overflows);
+    }
+
+    // Platoons of five single-pixel walkers, five frames apart, in each of two one-row lanes going opposite ways; the
+    // quiet gap between platoons keeps them out of the background. Up to eight blobs are in view, and the tracks of
+    // walkers that have just left linger on top of those.
+    const int platoon_period = 60;
+    const int platoon_size = 5;
+    const int platoon_spacing = 5;
+    SyntheticScene lanes(2, 0);
+    lanes.num_lanes = 2;
+    lanes.walker_height = 1;
+    for (int i = 0; i < num_frames; i++) {
+        if (i < DEFAULT_RUNNING_AVERAGE_SIZE) {
+            lanes.empty_frame(recording[i]);
+            continue;
+        }
+
+        int phase = (i - DEFAULT_RUNNING_AVERAGE_SIZE) % platoon_period;
+        if (phase < platoon_size * platoon_spacing && phase % platoon_spacing == 0) {
+            lanes.add_walker(-1, 1, 1, 0);
+            lanes.add_walker(FRAME_WIDTH, -1, 1, 1);
+        }
+        lanes.next_frame(recording[i]);
+    }
+
+    true_total = 0;
+    for (int i = 0; i < NUM_DIRECTION_CATEGORIES; i++) {
+        true_total += lanes.true_movements[i];
+    }
+
+    printf("lanes: platoons of single-pixel walkers, %ld true movements\n", true_total);
+    for (int c = 0; c < 2; c++) {
+        ThermalTracker tracker(capacities[c]);
+        tracker.min_blob_size = 1;
+
+        bench_clock::time_point start = bench_clock::now();
+        for (int i = 0; i < num_frames; i++) {
+            tracker.update(recording[i]);
+        }
+        double total_time = seconds_since(start);
+
+        printf("  capacity %2d: %10.0f frames/s  movements %ld  blob overflows %lu (%lu pixels)  track overflows %lu\n",
+               tracker.get_blob_capacity(), num_frames / total_time, total_movements(tracker),
+               tracker.num_blob_overflows, tracker.num_dropped_pixels, tracker.num_track_overflows);
+    }
+
+    // Sixteen blobs for 40 frames, then 10 empty ones
+    const int period = 50;
+    for (int i = 0; i < DEFAULT_RUNNING_AVERAGE_SIZE + period; i++) {
+        scene.empty_frame(recording[i]);
+        if (i >= DEFAULT_RUNNING_AVERAGE_SIZE && i < DEFAULT_RUNNING_AVERAGE_SIZE + period - 10) {
+            for (int row = 0; row < FRAME_HEIGHT; row += 2) {
+                for (int column = 0; column < FRAME_WIDTH; column += 2) {
+                    recording[i][row][column] = scene.body_temperature;
+                }
+            }
+        }
+    }
+
+    printf("grid: 16 single-pixel blobs\n");
+    for (int c = 0; c < 2; c++) {
+        ThermalTracker tracker(capacities[c]);
+        tracker.min_blob_size = 1;
+        Pixel::adjacency_fuzz = 0;
+
+        for (int i = 0; i < DEFAULT_RUNNING_AVERAGE_SIZE; i++) {
+            tracker.update(recording[i]);
+        }
+
+        bench_clock::time_point start = bench_clock::now();
+        for (int i = 0; i < num_frames; i++) {
+            tracker.update(recording[DEFAULT_RUNNING_AVERAGE_SIZE + i % period]);
+        }
+        double total_time = seconds_since(start);
+
+        printf("  capacity %2d: %10.0f frames/s  blob overflows %lu (%lu pixels)  track overflows %lu\n",
+               tracker.get_blob_capacity(), num_frames / total_time, tracker.num_blob_overflows,
+               tracker.num_dropped_pixels, tracker.num_track_overflows);
+    }
+    Pixel::adjacency_fuzz = DEFAULT_ADJACENCY_FUZZ;
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Prediction
+
+static long num_track_starts = 0;
+
+static void count_track_start(const TrackedBlob& /* blob */) { num_track_starts++; }
+
+static int bench_predictor(int num_frames, float spawn_rate) {
+    /**
+    * Counting accuracy and cost of each position predictor as the walkers' centroids get noisier.
+    * Track starts above the true number of walkers are broken tracks. The cost of the prediction itself is timed
+    * separately, on one track fed a blob walking across the frame. Costs are relative to PREDICT_LAST_MOVEMENT, since
+    * the absolute times vary too much between hosts and runs to compare.
+    */
+    static const char* predictor_names[] = {"last movement", "kalman", "kalman steady"};
+    const int last_predictor = TRACKER_POSITION_FILTER ? PREDICT_KALMAN_STEADY : PREDICT_LAST_MOVEMENT;
+    static const float jitters[] = {0, 0.25, 0.5, 0.75};
+    const int num_jitters = sizeof(jitters) / sizeof(jitters[0]);
+    typedef float frame_t[FRAME_HEIGHT][FRAME_WIDTH];
+    std::vector<float> storage((size_t)num_frames * FRAME_HEIGHT * FRAME_WIDTH);
+    frame_t* recording = (frame_t*)&storage[0];
+
+    printf("predictor: %d frames, spawn rate %.3f\n", num_frames, spawn_rate);
+    if (!TRACKER_POSITION_FILTER) {
+        printf("  built without TRACKER_POSITION_FILTER; only last movement is available\n");
+    }
+
+    // A three-pixel-wide blob walking right, one column every other frame
+    const int num_steps = 2 * (FRAME_WIDTH - 3);
+    Blob steps[num_steps];
+    for (int i = 0; i < num_steps; i++) {
+        for (int row = 0; row < FRAME_HEIGHT; row++) {
+            for (int column = i / 2; column < i / 2 + 3; column++) {
+                steps[i].add_pixel(column, row, DEFAULT_SCENE_BODY_TEMPERATURE);
+            }
+        }
+    }
+
+    double base_update_time = 0;
+    for (int predictor = PREDICT_LAST_MOVEMENT; predictor <= last_predictor; predictor++) {
+        const int num_updates = 10000000;
+        TrackedBlob::set_predictor(predictor, DEFAULT_PROCESS_NOISE, DEFAULT_MEASUREMENT_NOISE);
+        TrackedBlob track;
+        track.set(steps[0]);
+
+        bench_clock::time_point start = bench_clock::now();
+        for (int i = 1; i < num_updates; i++) {
+            const Blob& step = steps[i % num_steps];
+            if (i % num_steps == 0) {
+                track.set(step);
+            } else {
+                track.update_movements(step);
+                track.copy_blob(step);
+            }
+        }
+        double total_time = seconds_since(start);
+        if (predictor == PREDICT_LAST_MOVEMENT) {
+            base_update_time = total_time;
+        }
+
+        printf("  %-14s %5.2fx update cost  (predicted x %.2f)\n", predictor_names[predictor],
+               total_time / base_update_time, float(track.predicted_position[X]));
+    }
+
+    printf("  %6s  %-14s %8s %8s %8s %8s %10s\n", "jitter", "predictor", "true", "counted", "error", "starts",
+           "frame cost");
+
+    for (int j = 0; j < num_jitters; j++) {
+        SyntheticScene scene(1, spawn_rate);
+        scene.position_jitter = jitters[j];
+        for (int i = 0; i < num_frames; i++) {
+            if (i < DEFAULT_RUNNING_AVERAGE_SIZE) {
+                scene.empty_frame(recording[i]);
+            } else {
+                scene.next_frame(recording[i]);
+            }
+        }
+        long true_total = scene.true_movements[LEFT] + scene.true_movements[RIGHT];
+
+        double base_frame_time = 0;
+        for (int predictor = PREDICT_LAST_MOVEMENT; predictor <= last_predictor; predictor++) {
+            ThermalTracker tracker;
+            TrackedBlob::set_predictor(predictor, DEFAULT_PROCESS_NOISE, DEFAULT_MEASUREMENT_NOISE);
+            tracker.set_tracking_start_callback(count_track_start);
+            num_track_starts = 0;
+
+            bench_clock::time_point start = bench_clock::now();
+            for (int i = 0; i < num_frames; i++) {
+                tracker.update(recording[i]);
+            }
+            double total_time = seconds_since(start);
+            if (predictor == PREDICT_LAST_MOVEMENT) {
+                base_frame_time = total_time;
+            }
+
+            long counted = tracker.movements[LEFT] + tracker.movements[RIGHT];
+            printf("  %6.2f  %-14s %8ld %8ld %7.1f%% %8ld %9.2fx\n", jitters[j], predictor_names[predictor], true_total,
+                   counted, true_total ? 100.0 * (counted - true_total) / true_total : 0, num_track_starts,
+                   total_time / base_frame_time);
+        }
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Counting lines
+
+static SyntheticScene* latency_scene = NULL;
+static std::vector<long> line_latencies;
+static std::vector<long> end_latencies;
+
+static long frames_since_crossing() { return latency_scene->num_frames - 1 - latency_scene->last_crossing_frame; }
+
+static void time_line_crossing(const TrackedBlob& /* blob */, int /* line */, int /* crossing */) {
+    line_latencies.push_back(frames_since_crossing());
+}
+
+static void time_tracking_end(const TrackedBlob& blob) {
+    if (abs(blob.travel[X]) > DEFAULT_MIN_TRAVEL_THRESHOLD) {
+        end_latencies.push_back(frames_since_crossing());
+    }
+}
+
+static long median(std::vector<long>& values) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+static int bench_lines(int num_frames, float spawn_rate) {
+    /**
+    * Counts from a counting line down the middle of the frame against the movements counted when tracks end, as
+    * more of the walkers turn around part way across.
+    * Both are compared with the crossings of the middle column. Latency is the frames from the last true crossing to
+    * the count, so it is only meaningful with one walker in view at a time (a low spawn rate); the median is given
+    * because a count from a broken or ghost track is timed against whichever walker crossed last.
+    */
+    static const float turn_rates[] = {0, 0.005, 0.01, 0.02};
+    const int num_turn_rates = sizeof(turn_rates) / sizeof(turn_rates[0]);
+
+    printf("lines: %d frames, spawn rate %.3f\n", num_frames, spawn_rate);
+    printf("  %6s %-6s %7s %7s %7s %7s %9s %9s\n", "turn", "count", "right", "left", "net", "wrong", "frames",
+           "ns/frame");
+
+    for (int t = 0; t < num_turn_rates; t++) {
+        float frame[FRAME_HEIGHT][FRAME_WIDTH];
+        SyntheticScene scene(1, spawn_rate);
+        scene.turn_rate = turn_rates[t];
+        latency_scene = &scene;
+        line_latencies.clear();
+        end_latencies.clear();
+
+        ThermalTracker tracker;
+        int line = tracker.add_counting_line(scene.crossing_column, 0, scene.crossing_column, FRAME_HEIGHT - 1);
+        tracker.set_line_crossing_callback(time_line_crossing);
+        tracker.set_tracking_end_callback(time_tracking_end);
+
+        bench_clock::time_point start = bench_clock::now();
+        for (int i = 0; i < num_frames; i++) {
+            if (i < DEFAULT_RUNNING_AVERAGE_SIZE) {
+                scene.empty_frame(frame);
+            } else {
+                scene.next_frame(frame);
+            }
+            tracker.update(frame);
+        }
+        double total_time = seconds_since(start);
+
+        long true_right = scene.true_crossings[RIGHT];
+        long true_left = scene.true_crossings[LEFT];
+        long line_right = tracker.counting_lines[line].crossings[CROSSING_FORWARD];
+        long line_left = tracker.counting_lines[line].crossings[CROSSING_BACKWARD];
+        long end_right = tracker.movements[RIGHT];
+        long end_left = tracker.movements[LEFT];
+
+        // Per-direction shortfall and excess both count as wrong
+        printf("  %6.3f %-6s %7ld %7ld %7ld %7s %9s %9.1f\n", turn_rates[t], "true", true_right, true_left,
+               true_right - true_left, "", "", total_time * 1e9 / num_frames);
+        printf("  %6s %-6s %7ld %7ld %7ld %7ld %9ld\n", "", "line", line_right, line_left, line_right - line_left,
+               labs(line_right - true_right) + labs(line_left - true_left), median(line_latencies));
+        printf("  %6s %-6s %7ld %7ld %7ld %7ld %9ld\n", "", "end", end_right, end_left, end_right - end_left,
+               labs(end_right - true_right) + labs(end_left - true_left), median(end_latencies));
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Crowds
+
+static int bench_crowd(int num_frames, int max_merged_frames) {
+    /**
+    * Counting accuracy as the scene gets busier, with and without merge handling.
+    * Left and right counts are compared with the scene's ground truth; "nodir" counts tracks that ended without a
+    * direction, which is mostly merged tracks dying.
+    * Walkers keep to a brisk pace: slower ones stay in view long enough for a busy scene to be folded into the
+    * background, and that error would swamp the one being measured.
+    */
+    static const float spawn_rates[] = {0.005, 0.01, 0.02, 0.04};
+    const int num_rates = sizeof(spawn_rates) / sizeof(spawn_rates[0]);
+    typedef float frame_t[FRAME_HEIGHT][FRAME_WIDTH];
+    std::vector<float> storage((size_t)num_frames * FRAME_HEIGHT * FRAME_WIDTH);
+    frame_t* recording = (frame_t*)&storage[0];
+
+    printf("crowd: %d frames, merged for up to %d frames\n", num_frames, max_merged_frames);
+    printf("  %6s %-8s %7s %7s %7s %7s %7s %7s %7s %9s\n", "spawn", "merging", "true", "counted", "error", "wrong",
+           "nodir", "merges", "splits", "ns/frame");
+
+    for (int r = 0; r < num_rates; r++) {
+        SyntheticScene scene(1, spawn_rates[r]);
+        scene.min_speed = 0.6;
+        scene.max_speed = 1.0;
+        for (int i = 0; i < num_frames; i++) {
+            if (i < DEFAULT_RUNNING_AVERAGE_SIZE) {
+                scene.empty_frame(recording[i]);
+            } else {
+                scene.next_frame(recording[i]);
+            }
+        }
+
+        for (int merging = 0; merging < 2; merging++) {
+            ThermalTracker tracker;
+            tracker.max_merged_frames = merging ? max_merged_frames : 0;
+
+            bench_clock::time_point start = bench_clock::now();
+            for (int i = 0; i < num_frames; i++) {
+                tracker.update(recording[i]);
+            }
+            double total_time = seconds_since(start);
+
+            // Per-direction shortfall and excess both count as errors
+            long true_total = scene.true_movements[LEFT] + scene.true_movements[RIGHT];
+            long counted = tracker.movements[LEFT] + tracker.movements[RIGHT];
+            long wrong = labs(tracker.movements[LEFT] - scene.true_movements[LEFT]) +
+                         labs(tracker.movements[RIGHT] - scene.true_movements[RIGHT]);
+
+            printf("  %6.3f %-8s %7ld %7ld %6.1f%% %7ld %7ld %7lu %7lu %9.1f\n", spawn_rates[r], merging ? "on" : "off",
+                   true_total, counted, true_total ? 100.0 * (counted - true_total) / true_total : 0, wrong,
+                   tracker.movements[NO_DIRECTION], tracker.num_track_merges, tracker.num_track_splits,
+                   total_time * 1e9 / num_frames);
+        }
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Memory
+
+static int bench_sizes() {
+    /**
+    * Report the size of the tracking structures for the layout this benchmark was built with.
+    */
+#ifdef TRACKED_BLOB_COMPACT
+    printf("sizes: compact layout\n");
+#else
+    printf("sizes: full layout\n");
+#endif
+    printf("  Blob:           %5u bytes\n", (unsigned int)sizeof(Blob));
+    printf("  TrackedBlob:    %5u bytes\n", (unsigned int)sizeof(TrackedBlob));
+    printf("  ThermalTracker: %5u bytes\n", (unsigned int)sizeof(ThermalTracker));
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Diagnostics
+
+// Work the diagnostics add, by level: difference evaluations and float divides per track update, and stores per
+// matching matrix evaluation. Read off update_differences() and get_difference().
+static const int DIAGNOSTIC_EVALUATIONS_PER_UPDATE[] = {0, 1, 1};
+static const int DIAGNOSTIC_DIVIDES_PER_UPDATE[] = {0, 1, 6};
+static const int DIAGNOSTIC_STORES_PER_EVALUATION[] = {0, 0, 6};
+
+static volatile float difference_sink;
+
+static void make_test_blob(Blob& blob, int x) {
+    // A 2x2 blob at column x
+    blob.clear();
+    blob.add_pixel(x, 1, 30.0);
+    blob.add_pixel(x + 1, 1, 31.0);
+    blob.add_pixel(x, 2, 30.5);
+    blob.add_pixel(x + 1, 2, 29.5);
+}
+
+static int bench_diagnostics(int num_frames) {
+    /**
+    * Cost of the diagnostics level this benchmark was built with. Build once per TRACKER_DIAGNOSTICS_LEVEL to
+    * compare.
+    * The two calls the level changes, TrackedBlob::update_blob() and get_difference(), are timed on their own, since
+    * on a host with hardware floating point their difference disappears into the noise of a whole frame.
+    */
+    static const char* level_names[] = {"none", "summary", "full"};
+    const int num_calls = num_frames * 10;
+
+    Blob steps[2];
+    make_test_blob(steps[0], 6);
+    make_test_blob(steps[1], 7);
+
+    TrackedBlob track;
+    track.set(steps[0], 1);
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < num_calls; i++) {
+        track.update_blob(steps[(i + 1) & 1]);
+    }
+    double update_time = seconds_since(start);
+
+    float total_difference = 0;
+    start = bench_clock::now();
+    for (int i = 0; i < num_calls; i++) {
+        total_difference += track.get_difference(steps[i & 1]);
+    }
+    double difference_time = seconds_since(start);
+    difference_sink = total_difference;
+
+    int level = TRACKER_DIAGNOSTICS_LEVEL;
+    printf("diagnostics: level %s, %d calls, %d frames\n", level_names[level], num_calls, num_frames);
+    printf("  update_blob:      %8.1f ns  +%d difference evaluations, +%d divides\n",
+           update_time * 1e9 / num_calls, DIAGNOSTIC_EVALUATIONS_PER_UPDATE[level],
+           DIAGNOSTIC_DIVIDES_PER_UPDATE[level]);
+    printf("  get_difference:   %8.1f ns  +%d stores\n", difference_time * 1e9 / num_calls,
+           DIAGNOSTIC_STORES_PER_EVALUATION[level]);
+    printf("  TrackedBlob:      %8u bytes\n", (unsigned int)sizeof(TrackedBlob));
+
+    typedef float frame_t[FRAME_HEIGHT][FRAME_WIDTH];
+    std::vector<float> storage((size_t)num_frames * FRAME_HEIGHT * FRAME_WIDTH);
+    frame_t* recording = (frame_t*)&storage[0];
+    render_scene(1, 0.02, num_frames, recording);
+
+    ThermalTracker tracker;
+
+    start = bench_clock::now();
+    for (int i = 0; i < num_frames; i++) {
+        tracker.update(recording[i]);
+    }
+    double total_time = seconds_since(start);
+
+    printf("  per frame:        %8.1f ns  movements %ld\n", total_time * 1e9 / num_frames, total_movements(tracker));
+    printf("  per active frame: %8.3f us  (%lu active frames)\n",
+           tracker.num_active_frames ? (double)tracker.active_frame_micros / tracker.num_active_frames : 0,
+           tracker.num_active_frames);
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Stage timing
+
+static int bench_stages(int num_frames, float spawn_rate) {
+    /**
+    * Per-stage timing of the update, as collected by the tracker itself.
+    * Build with -DTRACKER_STAGE_TIMING=1 for the stage table; comparing the per-frame cost with a build without it
+    * shows what the timers cost.
+    */
+    typedef float frame_t[FRAME_HEIGHT][FRAME_WIDTH];
+    std::vector<float> storage((size_t)num_frames * FRAME_HEIGHT * FRAME_WIDTH);
+    frame_t* recording = (frame_t*)&storage[0];
+    render_scene(1, spawn_rate, num_frames, recording);
+
+    ThermalTracker tracker;
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < num_frames; i++) {
+        tracker.update(recording[i]);
+    }
+    double total_time = seconds_since(start);
+
+    printf("stages: timing %s, %d frames, spawn rate %.3f\n", TRACKER_STAGE_TIMING ? "on" : "off", num_frames,
+           spawn_rate);
+    printf("  per frame: %8.1f ns  movements %ld\n", total_time * 1e9 / num_frames, total_movements(tracker));
+
+    StageTiming timing;
+    if (!tracker.get_stage_timing(STAGE_FRAME, timing)) {
+        return 0;
+    }
+
+    printf("  %-12s %10s %9s %9s %9s %9s\n", "stage (us)", "count", "min", "mean", "max", "p99");
+    for (int stage = 0; stage < NUM_TRACKER_STAGES; stage++) {
+        tracker.get_stage_timing(stage, timing);
+        printf("  %-12s %10lu %9.3f %9.3f %9.3f %9.3f\n", ThermalTracker::get_stage_name(stage), timing.count,
+               timing.min, timing.mean, timing.max, timing.p99);
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Main
+
+static void print_usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s <benchmark> [options]\n"
+            "  batch [sensors] [frames]   Lockstep BatchTracker vs independent trackers (default 16 x 4000)\n"
+            "  offline [frames] [block]   update_batch vs per-frame update with callbacks (default 100000, 4096)\n"
+            "  idle [frames] [spawn]      Idle vs active frame costs on a quiet scene (default 100000, 0.002)\n"
+            "  blobs8 [frames]            Blob building and tracking with eight blobs in view (default 200000)\n"
+            "  capacity [blobs] [frames] [spawn]  Crowded scene at the default and a larger capacity (default 32,\n"
+            "                             200000, 0.1)\n"
+            "  predictor [frames] [spawn] Counting accuracy and relative cost of each position predictor (default\n"
+            "                             400000, 0.02)\n"
+            "  lines [frames] [spawn]     Counting line vs track-end counts, latency and turnarounds (default 400000,\n"
+            "                             0.005)\n"
+            "  crowd [frames] [merged]    Counting accuracy at increasing densities, with and without merging\n"
+            "                             (default 400000, 16)\n"
+            "  sizes                      Size of the tracking structures (build with -DTRACKED_BLOB_COMPACT to\n"
+            "                             compare)\n"
+            "  diagnostics [frames]       Tracking cost at the built TRACKER_DIAGNOSTICS_LEVEL (default 200000)\n"
+            "  stages [frames] [spawn]    Per-stage timing, with -DTRACKER_STAGE_TIMING=1 (default 200000, 0.02)\n",
+            name);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "batch") == 0) {
+        int num_sensors = argc > 2 ? atoi(argv[2]) : 16;
+        int num_frames = argc > 3 ? atoi(argv[3]) : 4000;
+        return bench_batch(num_sensors, num_frames);
+    }
+
+    if (strcmp(argv[1], "offline") == 0) {
+        int num_frames = argc > 2 ? atoi(argv[2]) : 100000;
+        int block_size = argc > 3 ? atoi(argv[3]) : 4096;
+        return bench_offline(num_frames, block_size);
+    }
+
+    if (strcmp(argv[1], "idle") == 0) {
+        int num_frames = argc > 2 ? atoi(argv[2]) : 100000;
+        float spawn_rate = argc > 3 ? atof(argv[3]) : 0.002;
+        return bench_idle(num_frames, spawn_rate);
+    }
+
+    if (strcmp(argv[1], "blobs8") == 0) {
+        int num_frames = argc > 2 ? atoi(argv[2]) : 200000;
+        return bench_blobs8(num_frames);
+    }
+
+    if (strcmp(argv[1], "diagnostics") == 0) {
+        int num_frames = argc > 2 ? atoi(argv[2]) : 200000;
+        return bench_diagnostics(num_frames);
+    }
+
+    if (strcmp(argv[1], "stages") == 0) {
+        int num_frames = argc > 2 ? atoi(argv[2]) : 200000;
+        float spawn_rate = argc > 3 ? atof(argv[3]) : 0.02;
+        return bench_stages(num_frames, spawn_rate);
+    }
+
+    if (strcmp(argv[1], "capacity") == 0) {
+        int blob_capacity = argc > 2 ? atoi(argv[2]) : 32;
+        int num_frames = argc > 3 ? atoi(argv[3]) : 200000;
+        float spawn_rate = argc > 4 ? atof(argv[4]) : 0.1;
+        return bench_capacity(blob_capacity, num_frames, spawn_rate);
+    }
+
+    if (strcmp(argv[1], "predictor") == 0) {
+        int num_frames = argc > 2 ? atoi(argv[2]) : 400000;
+        float spawn_rate = argc > 3 ? atof(argv[3]) : 0.02;
+        return bench_predictor(num_frames, spawn_rate);
+    }
+
+    if (strcmp(argv[1], "lines") == 0) {
+        int num_frames = argc > 2 ? atoi(argv[2]) : 400000;
+        float spawn_rate = argc > 3 ? atof(argv[3]) : 0.005;
+        return bench_lines(num_frames, spawn_rate);
+    }
+
+    if (strcmp(argv[1], "crowd") == 0) {
+        int num_frames = argc > 2 ? atoi(argv[2]) : 400000;
+        int max_merged_frames = argc > 3 ? atoi(argv[3]) : 16;
+        return bench_crowd(num_frames, max_merged_frames);
+    }
+
+    if (strcmp(argv[1], "sizes") == 0) {
+        return bench_sizes();
+    }
+
+    print_usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,159 @@
+/*
+ * NodeMLX host tracking service
+ *
+ * Runs one ThermalTracker per sensor stream on a Linux host so the whole fleet's raw frames can be processed (and the
+ * tracker tuned) centrally. Frames come from recordings on disk and/or live UDP datagrams; see README.md for formats.
+ *
+ * Usage: tracker_service [-t threads] [-q max_queued_frames] [-u udp_port] [-l] [-r replay_hz] [-s stats_interval]
+ *                        [recording ...]
+ */
+
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "FrameSource.h"
+#include "TrackerService.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_signal(int /* signal_number */) { stop_requested = 1; }
+
+static void print_usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [-t threads] [-q max_queued_frames] [-u udp_port] [-l] [-r replay_hz] [-s stats_interval] "
+            "[recording ...]\n"
+            "  -t  Worker threads (default: number of cores)\n"
+            "  -q  Frames queued per stream before frames are dropped or the replay waits (default: %u)\n"
+            "  -u  Receive live frames on this UDP port\n"
+            "  -l  Only accept UDP frames from the loopback interface\n"
+            "  -r  Replay recordings at this frame rate instead of as fast as possible\n"
+            "  -s  Seconds between statistics reports (default: 5; 0 disables)\n",
+            name, DEFAULT_MAX_QUEUED_FRAMES);
+}
+
+static void receive_udp_frames(UdpFrameSource* source, TrackerService* service) {
+    HostFrame frame;
+    while (source->read(frame)) {
+        service->submit(frame.stream, frame.pixels, false);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int num_threads = std::thread::hardware_concurrency();
+    unsigned int max_queued_frames = DEFAULT_MAX_QUEUED_FRAMES;
+    int udp_port = -1;
+    bool loopback_only = false;
+    double replay_rate = 0;
+    double stats_interval = 5;
+
+    int option;
+    while ((option = getopt(argc, argv, "t:q:u:lr:s:h")) != -1) {
+        switch (option) {
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 'q':
+                max_queued_frames = atoi(optarg);
+                break;
+            case 'u':
+                udp_port = atoi(optarg);
+                break;
+            case 'l':
+                loopback_only = true;
+                break;
+            case 'r':
+                replay_rate = atof(optarg);
+                break;
+            case 's':
+                stats_interval = atof(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc && udp_port < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    TrackerService service(num_threads, max_queued_frames);
+
+    // Recordings are numbered from zero in the order given
+    std::vector<FileFrameSource*> recordings;
+    for (int i = optind; i < argc; i++) {
+        FileFrameSource* source = new FileFrameSource(argv[i], recordings.size());
+        if (!source->is_open()) {
+            fprintf(stderr, "Could not open recording: %s\n", argv[i]);
+            delete source;
+            return 1;
+        }
+        recordings.push_back(source);
+    }
+
+    UdpFrameSource* udp_source = NULL;
+    std::thread udp_thread;
+    if (udp_port >= 0) {
+        udp_source = new UdpFrameSource(udp_port, loopback_only);
+        if (!udp_source->is_open()) {
+            fprintf(stderr, "Could not listen on UDP port %d\n", udp_port);
+            return 1;
+        }
+        udp_thread = std::thread(receive_udp_frames, udp_source, &service);
+    }
+
+    host_clock::time_point next_stats = host_clock::now();
+    host_clock::time_point next_replay = host_clock::now();
+    std::chrono::duration<double> stats_period(stats_interval);
+    std::chrono::duration<double> replay_period(replay_rate > 0 ? 1.0 / replay_rate : 0);
+    next_stats += std::chrono::duration_cast<host_clock::duration>(stats_period);
+
+    // Replay the recordings round-robin so every stream advances together, as it would with live sensors
+    unsigned int num_active_recordings = recordings.size();
+    HostFrame frame;
+    while (!stop_requested && (num_active_recordings > 0 || udp_source)) {
+        if (num_active_recordings > 0) {
+            num_active_recordings = 0;
+            for (unsigned int i = 0; i < recordings.size(); i++) {
+                if (recordings[i]->read(frame)) {
+                    service.submit(frame.stream, frame.pixels, true);
+                    num_active_recordings++;
+                }
+            }
+
+            if (replay_rate > 0) {
+                next_replay += std::chrono::duration_cast<host_clock::duration>(replay_period);
+                std::this_thread::sleep_until(next_replay);
+            }
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        if (stats_interval > 0 && host_clock::now() >= next_stats) {
+            service.print_stats(stdout);
+            next_stats += std::chrono::duration_cast<host_clock::duration>(stats_period);
+        }
+    }
+
+    if (udp_source) {
+        udp_source->close();
+        udp_thread.join();
+        if (udp_source->num_malformed_datagrams > 0) {
+            fprintf(stderr, "Discarded %lu malformed datagrams\n", udp_source->num_malformed_datagrams);
+        }
+        delete udp_source;
+    }
+
+    service.drain();
+    service.print_stats(stdout);
+
+    for (unsigned int i = 0; i < recordings.size(); i++) {
+        delete recordings[i];
+    }
+
+    return 0;
+}
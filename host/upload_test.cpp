@@ -0,0 +1,266 @@
+/*
+ * NodeMLX upload test
+ *
+ * Runs the Uploader against a stand-in HTTP server on the loopback interface that answers each connection in a
+ * scripted way: straight away, slowly, a byte at a time, with a server error, not at all, or by refusing the
+ * connection. Checks that every request ends the way it should after the expected number of attempts, and reports
+ * the longest any call to Uploader::update() took, which is how long an upload can hold up the device's main loop.
+ *
+ * Usage: upload_test [-m max_stall_us]
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "SocketTransport.h"
+#include "Uploader.h"
+
+typedef std::chrono::steady_clock test_clock;
+
+const unsigned long DEFAULT_MAX_STALL = 10000; /**< us */
+const unsigned long UPDATE_INTERVAL = 200;     /**< Time between update() calls, standing in for the rest of loop() */
+
+// Short enough for the test to run in a few seconds
+const unsigned long TEST_TIMEOUT = 500;
+const unsigned long TEST_MIN_BACKOFF = 50;
+const unsigned long TEST_MAX_BACKOFF = 200;
+const int TEST_MAX_ATTEMPTS = 4;
+
+const char* TEST_BODY = "{\"frame\":1024,\"people\":3}";
+
+enum server_replies { REPLY_OK, REPLY_SLOW, REPLY_DRIP, REPLY_SERVER_ERROR, REPLY_NOT_FOUND, REPLY_SILENT };
+
+////////////////////////////////////////////////////////////////////////////////
+// Stand-in server
+
+static std::mutex script_mutex;
+static std::string script; /**< One server_replies entry per connection still to come */
+
+static std::string read_request(int client_fd) {
+    /**
+    * Read a request up to the end of its body.
+    */
+    std::string request;
+    char buffer[256];
+
+    for (;;) {
+        size_t header_end = request.find("\r\n\r\n");
+        if (header_end != std::string::npos) {
+            size_t length_at = request.find("Content-Length: ");
+            size_t body_length = length_at < header_end ? atoi(request.c_str() + length_at + 16) : 0;
+            if (request.size() >= header_end + 4 + body_length) {
+                return request;
+            }
+        }
+
+        ssize_t length = recv(client_fd, buffer, sizeof(buffer), 0);
+        if (length <= 0) {
+            return request;
+        }
+        request.append(buffer, length);
+    }
+}
+
+static void serve_connection(int client_fd, int reply) {
+    std::string request = read_request(client_fd);
+
+    // A POST must arrive with its body intact
+    bool posted = request.compare(0, 5, "POST ") == 0;
+    bool intact = !posted || request.compare(request.size() - strlen(TEST_BODY), std::string::npos, TEST_BODY) == 0;
+    const char* response = intact ? "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok"
+                                   : "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+    switch (reply) {
+        case REPLY_SLOW:
+            usleep(TEST_TIMEOUT * 1000 / 2);
+            send(client_fd, response, strlen(response), MSG_NOSIGNAL);
+            break;
+
+        case REPLY_DRIP:
+            for (const char* c = response; *c; c++) {
+                send(client_fd, c, 1, MSG_NOSIGNAL);
+                usleep(3000);
+            }
+            break;
+
+        case REPLY_SERVER_ERROR:
+            response = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            send(client_fd, response, strlen(response), MSG_NOSIGNAL);
+            break;
+
+        case REPLY_NOT_FOUND:
+            response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            send(client_fd, response, strlen(response), MSG_NOSIGNAL);
+            break;
+
+        case REPLY_SILENT:
+            // Hold the connection open until the client gives up on it
+            while (recv(client_fd, &reply, sizeof(reply), 0) > 0) {
+            }
+            break;
+
+        default:
+            send(client_fd, response, strlen(response), MSG_NOSIGNAL);
+    }
+
+    close(client_fd);
+}
+
+static void run_server(int listen_fd) {
+    for (;;) {
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            return;
+        }
+
+        int reply = REPLY_OK;
+        {
+            std::lock_guard<std::mutex> lock(script_mutex);
+            if (!script.empty()) {
+                reply = script[0];
+                script.erase(0, 1);
+            }
+        }
+
+        std::thread(serve_connection, client_fd, reply).detach();
+    }
+}
+
+static int listen_on_loopback(uint16_t& port) {
+    /**
+    * Open a listening socket on a free loopback port.
+    */
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t address_size = sizeof(address);
+    if (bind(listen_fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd, 8) != 0 ||
+        getsockname(listen_fd, (sockaddr*)&address, &address_size) != 0) {
+        perror("listen");
+        exit(1);
+    }
+
+    port = ntohs(address.sin_port);
+    return listen_fd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scenarios
+
+struct Scenario {
+    const char* name;
+    const char* replies; /**< server_replies for each connection, as characters */
+    bool refuse;         /**< Connect to a port nothing listens on */
+    bool post;
+    int expected_result;
+    int expected_attempts;
+};
+
+static bool run_scenario(const Scenario& scenario, uint16_t server_port, uint16_t closed_port,
+                         unsigned long max_stall) {
+    {
+        std::lock_guard<std::mutex> lock(script_mutex);
+        script.clear();
+        for (const char* reply = scenario.replies; *reply; reply++) {
+            script += char(*reply - '0');
+        }
+    }
+
+    SocketTransport transport;
+    Uploader uploader(transport, "127.0.0.1", scenario.refuse ? closed_port : server_port);
+    uploader.resolve_timeout = TEST_TIMEOUT;
+    uploader.connect_timeout = TEST_TIMEOUT;
+    uploader.response_timeout = TEST_TIMEOUT;
+    uploader.min_backoff = TEST_MIN_BACKOFF;
+    uploader.max_backoff = TEST_MAX_BACKOFF;
+    uploader.max_attempts = TEST_MAX_ATTEMPTS;
+
+    test_clock::time_point start = test_clock::now();
+
+    if (!uploader.start("/dweet/for/upload-test?people=3", scenario.post ? TEST_BODY : NULL)) {
+        printf("%-22s could not start\n", scenario.name);
+        return false;
+    }
+
+    while (uploader.is_busy()) {
+        uploader.update();
+        usleep(UPDATE_INTERVAL);
+    }
+
+    double elapsed = std::chrono::duration<double, std::milli>(test_clock::now() - start).count();
+    bool passed = uploader.result == scenario.expected_result && uploader.num_attempts == scenario.expected_attempts &&
+                  uploader.max_update_micros <= max_stall;
+
+    printf("%-22s %-9s %8d %7d %9lu %10.0f %16lu  %s\n", scenario.name,
+           uploader.result == UPLOAD_SUCCEEDED ? "succeeded" : "abandoned", uploader.num_attempts,
+           uploader.last_status, uploader.num_timeouts, elapsed, uploader.max_update_micros, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+static void print_usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [-m max_stall_us]\n"
+            "  -m  Fail if any call to update() takes longer than this (default: %lu)\n",
+            name, DEFAULT_MAX_STALL);
+}
+
+int main(int argc, char* argv[]) {
+    unsigned long max_stall = DEFAULT_MAX_STALL;
+
+    int option;
+    while ((option = getopt(argc, argv, "m:h")) != -1) {
+        switch (option) {
+            case 'm':
+                max_stall = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    uint16_t server_port;
+    int listen_fd = listen_on_loopback(server_port);
+    std::thread(run_server, listen_fd).detach();
+
+    // A port that was free a moment ago refuses connections
+    uint16_t closed_port;
+    close(listen_on_loopback(closed_port));
+
+    // Replies are server_replies as digits, one per connection
+    const Scenario scenarios[] = {
+        {"immediate", "0", false, false, UPLOAD_SUCCEEDED, 1},
+        {"post", "0", false, true, UPLOAD_SUCCEEDED, 1},
+        {"slow reply", "1", false, false, UPLOAD_SUCCEEDED, 1},
+        {"drip-fed reply", "2", false, true, UPLOAD_SUCCEEDED, 1},
+        {"server error, retry", "30", false, false, UPLOAD_SUCCEEDED, 2},
+        {"silent, retry", "50", false, true, UPLOAD_SUCCEEDED, 2},
+        {"not found", "4", false, false, UPLOAD_ABANDONED, 1},
+        {"always failing", "3333", false, false, UPLOAD_ABANDONED, TEST_MAX_ATTEMPTS},
+        {"connection refused", "", true, false, UPLOAD_ABANDONED, TEST_MAX_ATTEMPTS},
+    };
+
+    printf("Timeouts %lu ms, backoff %lu-%lu ms, %d attempts, update() every %lu us\n\n", TEST_TIMEOUT,
+           TEST_MIN_BACKOFF, TEST_MAX_BACKOFF, TEST_MAX_ATTEMPTS, UPDATE_INTERVAL);
+    printf("scenario               result    attempts  status  timeouts  time (ms)  max update (us)\n");
+
+    bool passed = true;
+    for (const Scenario& scenario : scenarios) {
+        passed &= run_scenario(scenario, server_port, closed_port, max_stall);
+    }
+
+    close(listen_fd);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+#include "EventQueue.h"
+
+static void put_uint16(uint8_t* buffer, uint16_t value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = value >> 8;
+}
+
+static void put_uint32(uint8_t* buffer, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static uint16_t get_uint16(const uint8_t* buffer) { return buffer[0] | (buffer[1] << 8); }
+
+static uint32_t get_uint32(const uint8_t* buffer) {
+    return uint32_t(buffer[0]) | (uint32_t(buffer[1]) << 8) | (uint32_t(buffer[2]) << 16) |
+           (uint32_t(buffer[3]) << 24);
+}
+
+static int16_t scale_to_int16(float value, float scale) {
+    float scaled = constrain(value * scale, -32768.0f, 32767.0f);
+    return int16_t(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+
+EventQueue::EventQueue() {
+    batch_size = DEFAULT_EVENT_BATCH_SIZE;
+    batch_age = DEFAULT_EVENT_BATCH_AGE;
+    retry_delay = DEFAULT_EVENT_RETRY_DELAY;
+    boot_id = 0;
+
+    num_recorded = 0;
+    num_dropped = 0;
+    num_acknowledged = 0;
+    num_batches_sent = 0;
+
+    first = 0;
+    num_events = 0;
+    next_sequence = 0;
+    batch_in_flight = false;
+    release_time = 0;
+    is_holding = false;
+    last_sent_sequence = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+
+void EventQueue::add(int type, const TrackedBlob& blob, unsigned long time, int line, int crossing) {
+    /**
+    * Queue a tracking event.
+    * @param type From tracking_event_types
+    * @param blob Tracked blob the event is for
+    * @param time Time of the event, in ms since boot
+    * @param line Counting line crossed, for crossing events
+    * @param crossing From line_crossings, for crossing events
+    */
+    if (num_events == EVENT_QUEUE_CAPACITY) {
+        first = (first + 1) % EVENT_QUEUE_CAPACITY;
+        num_events--;
+        num_dropped++;
+    }
+
+    EventRecord& record = records[(first + num_events) % EVENT_QUEUE_CAPACITY];
+    num_events++;
+    num_recorded++;
+
+    record.sequence = next_sequence++;
+    record.time = time;
+    record.track_id = blob.id;
+    record.frames = constrain(blob.times_updated, 0, 0xFFFF);
+    record.travel[X] = scale_to_int16(float(blob.travel[X]), 100);
+    record.travel[Y] = scale_to_int16(float(blob.travel[Y]), 100);
+    record.temperature = scale_to_int16(float(blob._blob.average_temperature), 100);
+    record.type = type;
+    record.line = line;
+    record.crossing = crossing;
+    record.size = constrain(int(blob.max_size), 0, 0xFF);
+    record.start_position[X] = constrain(int(float(blob.start_pos[X]) * 10 + 0.5f), 0, 0xFF);
+    record.start_position[Y] = constrain(int(float(blob.start_pos[Y]) * 10 + 0.5f), 0, 0xFF);
+}
+
+bool EventQueue::is_batch_due(unsigned long now) {
+    /**
+    * Determine if a batch should be sent: batch_size events are waiting, or the oldest has waited batch_age.
+    * @param now Current time, in ms since boot
+    * @return False while a batch is being sent, or for retry_delay after one was given up on
+    */
+    if (is_holding && now - release_time < retry_delay) {
+        return false;
+    }
+    is_holding = false;
+
+    if (batch_in_flight || num_events == 0) {
+        return false;
+    }
+
+    return num_events >= batch_size || now - records[first].time >= batch_age;
+}
+
+size_t EventQueue::encode_batch(uint8_t* buffer, size_t size) {
+    /**
+    * Pack the oldest events into a batch and mark them as being sent.
+    * @param buffer Buffer to fill
+    * @param size Size of the buffer; at most as many records as fit are packed
+    * @return Number of bytes written, or 0 if there is nothing to send or a batch is already being sent
+    */
+    if (batch_in_flight || num_events == 0 || size < size_t(EVENT_BATCH_HEADER_SIZE + EVENT_RECORD_SIZE)) {
+        return 0;
+    }
+
+    int num_records = (size - EVENT_BATCH_HEADER_SIZE) / EVENT_RECORD_SIZE;
+    num_records = constrain(num_records, 1, num_events);
+    num_records = constrain(num_records, 1, constrain(batch_size, 1, 0xFF));
+
+    buffer[0] = EVENT_BATCH_VERSION;
+    buffer[1] = num_records;
+    buffer[2] = EVENT_RECORD_SIZE;
+    buffer[3] = 0;
+    put_uint32(buffer + 4, boot_id);
+    put_uint32(buffer + 8, num_dropped);
+
+    uint8_t* output = buffer + EVENT_BATCH_HEADER_SIZE;
+    for (int i = 0; i < num_records; i++) {
+        const EventRecord& record = records[(first + i) % EVENT_QUEUE_CAPACITY];
+
+        put_uint32(output, record.sequence);
+        put_uint32(output + 4, record.time);
+        put_uint16(output + 8, record.track_id);
+        put_uint16(output + 10, record.frames);
+        put_uint16(output + 12, record.travel[X]);
+        put_uint16(output + 14, record.travel[Y]);
+        put_uint16(output + 16, record.temperature);
+        output[18] = record.type;
+        output[19] = record.line;
+        output[20] = record.crossing;
+        output[21] = record.size;
+        output[22] = record.start_position[X];
+        output[23] = record.start_position[Y];
+        output += EVENT_RECORD_SIZE;
+
+        last_sent_sequence = record.sequence;
+    }
+
+    batch_in_flight = true;
+    num_batches_sent++;
+    return output - buffer;
+}
+
+void EventQueue::acknowledge_batch() {
+    /**
+    * Remove the batch being sent from the queue, now that it has been delivered.
+    * Events of the batch that were dropped while it was being sent have already gone.
+    */
+    if (!batch_in_flight) {
+        return;
+    }
+
+    while (num_events > 0 && int32_t(records[first].sequence - last_sent_sequence) <= 0) {
+        first = (first + 1) % EVENT_QUEUE_CAPACITY;
+        num_events--;
+        num_acknowledged++;
+    }
+
+    batch_in_flight = false;
+}
+
+void EventQueue::release_batch(unsigned long now) {
+    /**
+    * Give up sending the batch for now. Its events stay at the front of the queue, and are sent again after
+    * retry_delay.
+    * @param now Current time, in ms since boot
+    */
+    batch_in_flight = false;
+    release_time = now;
+    is_holding = true;
+}
+
+bool EventQueue::is_batch_in_flight() { return batch_in_flight; }
+
+int EventQueue::get_num_events() { return num_events; }
+
+////////////////////////////////////////////////////////////////////////////////
+// Decoding
+
+int decode_event_batch(const uint8_t* data, size_t length, EventBatchHeader& header, EventRecord* records,
+                       size_t capacity) {
+    /**
+    * Unpack a batch.
+    * @param data Batch as sent
+    * @param length Length of the batch
+    * @param header Header to fill in
+    * @param records Records to fill in
+    * @param capacity Number of records there is room for
+    * @return Number of records decoded, or -1 if the batch is malformed or does not fit
+    */
+    if (length < size_t(EVENT_BATCH_HEADER_SIZE) || data[0] != EVENT_BATCH_VERSION || data[2] != EVENT_RECORD_SIZE) {
+        return -1;
+    }
+
+    header.version = data[0];
+    header.num_records = data[1];
+    header.boot_id = get_uint32(data + 4);
+    header.num_dropped = get_uint32(data + 8);
+
+    if (length != size_t(EVENT_BATCH_HEADER_SIZE + header.num_records * EVENT_RECORD_SIZE) ||
+        header.num_records > capacity) {
+        return -1;
+    }
+
+    const uint8_t* input = data + EVENT_BATCH_HEADER_SIZE;
+    for (int i = 0; i < header.num_records; i++) {
+        EventRecord& record = records[i];
+
+        record.sequence = get_uint32(input);
+        record.time = get_uint32(input + 4);
+        record.track_id = get_uint16(input + 8);
+        record.frames = get_uint16(input + 10);
+        record.travel[X] = int16_t(get_uint16(input + 12));
+        record.travel[Y] = int16_t(get_uint16(input + 14));
+        record.temperature = int16_t(get_uint16(input + 16));
+        record.type = input[18];
+        record.line = input[19];
+        record.crossing = input[20];
+        record.size = input[21];
+        record.start_position[X] = input[22];
+        record.start_position[Y] = input[23];
+        input += EVENT_RECORD_SIZE;
+    }
+
+    return header.num_records;
+}
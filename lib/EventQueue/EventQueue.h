@@ -0,0 +1,156 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ThermalTracker.h"
+
+/*
+ * Tracking events batched for upload.
+ *
+ * Batch layout (EVENT_BATCH_HEADER_SIZE bytes, then EVENT_RECORD_SIZE bytes per record, little-endian):
+ *   0  uint8   EVENT_BATCH_VERSION
+ *   1  uint8   number of records
+ *   2  uint8   EVENT_RECORD_SIZE
+ *   3  uint8   reserved, 0
+ *   4  uint32  boot id, chosen at random each time the device starts
+ *   8  uint32  events dropped since boot because the queue was full
+ *
+ * Record layout:
+ *   0  uint32  sequence number, counting from 0 at boot
+ *   4  uint32  time recorded, in ms since boot
+ *   8  uint16  track id
+ *  10  uint16  frames the track was updated in
+ *  12  int16   travel in X, in hundredths of a pixel
+ *  14  int16   travel in Y, in hundredths of a pixel
+ *  16  int16   average temperature, in hundredths of a °C
+ *  18  uint8   type, from tracking_event_types
+ *  19  uint8   counting line crossed, or NO_COUNTING_LINE
+ *  20  uint8   crossing, from line_crossings; 0 unless the event is a crossing
+ *  21  uint8   largest size, in pixels
+ *  22  uint8   start position in X, in tenths of a pixel
+ *  23  uint8   start position in Y, in tenths of a pixel
+ *
+ * Sequence numbers are unique per boot id, so a collector can drop the duplicates that retried batches deliver.
+ */
+
+const uint8_t EVENT_BATCH_VERSION = 1;
+const int EVENT_BATCH_HEADER_SIZE = 12;
+const int EVENT_RECORD_SIZE = 24;
+
+const int EVENT_QUEUE_CAPACITY = 64;
+const int DEFAULT_EVENT_BATCH_SIZE = 16;
+const unsigned long DEFAULT_EVENT_BATCH_AGE = 60000;   /**< Longest an event waits for a batch to fill, in ms */
+const unsigned long DEFAULT_EVENT_RETRY_DELAY = 60000; /**< Wait before sending a batch again after giving up, in ms */
+
+/**
+* A tracking event, as queued and as sent.
+*/
+struct EventRecord {
+    uint32_t sequence;
+    uint32_t time; /**< ms since boot */
+    uint16_t track_id;
+    uint16_t frames;
+    int16_t travel[2];   /**< Hundredths of a pixel */
+    int16_t temperature; /**< Hundredths of a °C */
+    uint8_t type;        /**< From tracking_event_types */
+    uint8_t line;        /**< NO_COUNTING_LINE for start and end events */
+    uint8_t crossing;    /**< From line_crossings, for crossing events */
+    uint8_t size;
+    uint8_t start_position[2]; /**< Tenths of a pixel */
+};
+
+/**
+* Header of a decoded batch.
+*/
+struct EventBatchHeader {
+    uint8_t version;
+    uint8_t num_records;
+    uint32_t boot_id;
+    uint32_t num_dropped;
+};
+
+/**
+* Fixed-size ring of tracking events waiting to be uploaded.
+* Events are taken off in batches. A batch stays in the queue until it is acknowledged, and is sent again, with the
+* same sequence numbers, if its upload fails, so every event is delivered at least once. When the queue is full the
+* oldest event is dropped to make room, and counted.
+*/
+class EventQueue {
+   public:
+    EventQueue();
+
+    /**
+    * Queue a tracking event.
+    * @param type From tracking_event_types
+    * @param blob Tracked blob the event is for
+    * @param time Time of the event, in ms since boot
+    * @param line Counting line crossed, for crossing events
+    * @param crossing From line_crossings, for crossing events
+    */
+    void add(int type, const TrackedBlob& blob, unsigned long time, int line = NO_COUNTING_LINE, int crossing = 0);
+
+    /**
+    * Determine if a batch should be sent: batch_size events are waiting, or the oldest has waited batch_age.
+    * @param now Current time, in ms since boot
+    * @return False while a batch is being sent, or for retry_delay after one was given up on
+    */
+    bool is_batch_due(unsigned long now);
+
+    /**
+    * Pack the oldest events into a batch and mark them as being sent.
+    * @param buffer Buffer to fill
+    * @param size Size of the buffer; at most as many records as fit are packed
+    * @return Number of bytes written, or 0 if there is nothing to send or a batch is already being sent
+    */
+    size_t encode_batch(uint8_t* buffer, size_t size);
+
+    /**
+    * Remove the batch being sent from the queue, now that it has been delivered.
+    */
+    void acknowledge_batch();
+
+    /**
+    * Give up sending the batch for now. Its events stay at the front of the queue, and are sent again after
+    * retry_delay.
+    * @param now Current time, in ms since boot
+    */
+    void release_batch(unsigned long now);
+
+    bool is_batch_in_flight();
+    int get_num_events();
+
+    int batch_size;
+    unsigned long batch_age;
+    unsigned long retry_delay;
+    uint32_t boot_id; /**< Sent with every batch; set to a random number at startup */
+
+    unsigned long num_recorded;
+    unsigned long num_dropped;
+    unsigned long num_acknowledged;
+    unsigned long num_batches_sent; /**< Including batches sent again */
+
+   private:
+    EventRecord records[EVENT_QUEUE_CAPACITY];
+    int first;      /**< Index of the oldest record */
+    int num_events; /**< Records in the queue, including those being sent */
+    uint32_t next_sequence;
+    bool batch_in_flight;
+    uint32_t last_sent_sequence; /**< Last sequence number in the batch being sent */
+    unsigned long release_time;  /**< When a batch was last given up on */
+    bool is_holding;             /**< Waiting out retry_delay */
+};
+
+/**
+* Unpack a batch.
+* @param data Batch as sent
+* @param length Length of the batch
+* @param header Header to fill in
+* @param records Records to fill in
+* @param capacity Number of records there is room for
+* @return Number of records decoded, or -1 if the batch is malformed or does not fit
+*/
+int decode_event_batch(const uint8_t* data, size_t length, EventBatchHeader& header, EventRecord* records,
+                       size_t capacity);
+
+#endif
@@ -0,0 +1,106 @@
+#include "FrameCache.h"
+
+// Display range of each view, bottom then top, indexed by frame_views
+static const float DISPLAY_RANGES[NUM_FRAME_VIEWS][2] = {{20, 50}, {20, 50}, {0, 5}, {-5, 5}, {0, 1}};
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+
+FrameCache::FrameCache(ThermalTracker& tracker) : tracker(tracker) {
+    for (int i = 0; i < FRAME_CACHE_SLOTS; i++) {
+        slots[i].sequence = 0;
+        slots[i].last_used = 0;
+        slots[i].view = -1;
+        slots[i].products = 0;
+    }
+    num_requests = 0;
+    num_hits = 0;
+    num_misses = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+
+const frame_text (*FrameCache::get_text(int view))[FRAME_WIDTH] {
+    /**
+    * Get a view's pixels as text, as format_frame_text formats them.
+    * Like everything the cache returns, it stays good until another view is asked for or the frame changes.
+    * @param view View from frame_views
+    */
+    return require(view, FRAME_CACHE_TEXT).text;
+}
+
+const uint8_t (*FrameCache::get_colours(int view))[FRAME_WIDTH] {
+    /**
+    * Get a view's colour indices: each value's position in the view's display range, 0 (bottom) to
+    * FRAME_COLOUR_LEVELS - 1 (top), clamped.
+    * @param view View from frame_views
+    */
+    return require(view, FRAME_CACHE_TEXT).colours;
+}
+
+const uint8_t* FrameCache::get_packed(int view) {
+    /**
+    * Get a view packed in the binary layout, FRAME_EXPORT_BINARY_SIZE bytes.
+    * @param view View from frame_views
+    */
+    return require(view, FRAME_CACHE_PACKED).packed;
+}
+
+unsigned long FrameCache::get_sequence() { return tracker.frame_sequence; }
+
+////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+
+FrameCacheSlot& FrameCache::require(int view, uint8_t product) {
+    /**
+    * Find the slot holding a product of a view for the current frame, computing it if need be.
+    * @param view View from frame_views
+    * @param product FRAME_CACHE_TEXT or FRAME_CACHE_PACKED
+    * @return Slot holding the product
+    */
+    FrameCacheSlot* slot = &slots[0];
+    for (int i = 0; i < FRAME_CACHE_SLOTS; i++) {
+        if (slots[i].view == view) {
+            slot = &slots[i];
+            break;
+        }
+        if (slots[i].last_used < slot->last_used) {
+            slot = &slots[i];
+        }
+    }
+
+    slot->last_used = ++num_requests;
+    if (slot->view != view || slot->sequence != tracker.frame_sequence) {
+        slot->view = view;
+        slot->sequence = tracker.frame_sequence;
+        slot->products = 0;
+    }
+
+    if (slot->products & product) {
+        num_hits++;
+        return *slot;
+    }
+    num_misses++;
+
+    float values[FRAME_HEIGHT][FRAME_WIDTH];
+    get_frame_view(tracker, view, values);
+
+    if (product == FRAME_CACHE_TEXT) {
+        format_frame_text(values, slot->text);
+
+        float bottom = DISPLAY_RANGES[view][0];
+        float scale = (FRAME_COLOUR_LEVELS - 1) / (DISPLAY_RANGES[view][1] - bottom);
+        for (int i = 0; i < FRAME_HEIGHT; i++) {
+            for (int j = 0; j < FRAME_WIDTH; j++) {
+                float level = (values[i][j] - bottom) * scale + 0.5f;
+                slot->colours[i][j] = constrain(level, 0.0f, float(FRAME_COLOUR_LEVELS - 1));
+            }
+        }
+    } else if (product == FRAME_CACHE_PACKED) {
+        encode_frame_binary(values, view, tracker.frame_sequence, slot->packed);
+    }
+
+    slot->products |= product;
+    return *slot;
+}
@@ -0,0 +1,85 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <stdint.h>
+#include "FrameExport.h"
+#include "ThermalTracker.h"
+
+const int FRAME_COLOUR_LEVELS = 256;
+const int FRAME_CACHE_SLOTS = 2; /**< Views held at once; the live view and one other is the usual mix */
+
+// Products derived from a view, as bit flags
+const uint8_t FRAME_CACHE_TEXT = 1; /**< Pixel text and colour indices */
+const uint8_t FRAME_CACHE_PACKED = 2;
+
+/**
+* One view's products for one frame.
+*/
+struct FrameCacheSlot {
+    unsigned long sequence; /**< Frame the products were made from */
+    unsigned long last_used;
+    int8_t view;      /**< View from frame_views, or -1 while the slot is unused */
+    uint8_t products; /**< Products held, as FRAME_CACHE_ flags */
+    frame_text text[FRAME_HEIGHT][FRAME_WIDTH];
+    uint8_t colours[FRAME_HEIGHT][FRAME_WIDTH];
+    uint8_t packed[FRAME_EXPORT_BINARY_SIZE];
+};
+
+/**
+* Render-once cache of the views of a tracker's last published frame.
+* What a request sends is cached, not the values behind it: each pixel's formatted text and colour index, and the
+* packed binary form. Formatting the 64 temperatures is most of the work of a page, so it is done the first time a
+* view is asked for and then shared by every request for the same frame. Slots are keyed by the tracker's frame
+* sequence number, so the next update invalidates them without being told. Only FRAME_CACHE_SLOTS views are held;
+* asking for another reuses the least recently used slot.
+*/
+class FrameCache {
+   public:
+    /**
+    * @param tracker Tracker whose published frames are cached
+    */
+    FrameCache(ThermalTracker& tracker);
+
+    /**
+    * Get a view's pixels as text, as format_frame_text formats them.
+    * Like everything the cache returns, it stays good until another view is asked for or the frame changes.
+    * @param view View from frame_views
+    */
+    const frame_text (*get_text(int view))[FRAME_WIDTH];
+
+    /**
+    * Get a view's colour indices: each value's position in the view's display range, 0 (bottom) to
+    * FRAME_COLOUR_LEVELS - 1 (top), clamped.
+    * @param view View from frame_views
+    */
+    const uint8_t (*get_colours(int view))[FRAME_WIDTH];
+
+    /**
+    * Get a view packed in the binary layout, FRAME_EXPORT_BINARY_SIZE bytes.
+    * @param view View from frame_views
+    */
+    const uint8_t* get_packed(int view);
+
+    /**
+    * Get the frame sequence number the cached products belong to.
+    */
+    unsigned long get_sequence();
+
+    unsigned long num_hits;   /**< Products served from the cache */
+    unsigned long num_misses; /**< Products that had to be computed */
+
+   private:
+    /**
+    * Find the slot holding a product of a view for the current frame, computing it if need be.
+    * @param view View from frame_views
+    * @param product FRAME_CACHE_TEXT or FRAME_CACHE_PACKED
+    * @return Slot holding the product
+    */
+    FrameCacheSlot& require(int view, uint8_t product);
+
+    ThermalTracker& tracker;
+    FrameCacheSlot slots[FRAME_CACHE_SLOTS];
+    unsigned long num_requests; /**< Orders the slots by when they were last used */
+};
+
+#endif
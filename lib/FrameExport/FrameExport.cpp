@@ -0,0 +1,153 @@
+#include "FrameExport.h"
+
+static const char* const VIEW_NAMES[NUM_FRAME_VIEWS] = {"live", "average", "variance", "diff", "active"};
+
+int find_frame_view(const char* name) {
+    /**
+    * Find a view by name.
+    * @param name View name, e.g. "live"
+    * @return View from frame_views, or -1 if there is no such view
+    */
+    for (int view = 0; view < NUM_FRAME_VIEWS; view++) {
+        if (strcmp(name, VIEW_NAMES[view]) == 0) {
+            return view;
+        }
+    }
+
+    return -1;
+}
+
+const char* get_frame_view_name(int view) {
+    /**
+    * Get the name of a view.
+    * @param view View from frame_views
+    */
+    if (view < 0 || view >= NUM_FRAME_VIEWS) {
+        return "unknown";
+    }
+
+    return VIEW_NAMES[view];
+}
+
+void get_frame_view(ThermalTracker& tracker, int view, float values[FRAME_HEIGHT][FRAME_WIDTH]) {
+    /**
+    * Fill in a view of the tracker's last published frame.
+    * Live, average and variance are copies of the snapshot; diff is the frame less the background; active is 1 for
+    * pixels the difference marks as active and 0 elsewhere.
+    * @param tracker Tracker to read
+    * @param view View from frame_views
+    * @param values Frame to fill in
+    */
+    for (int i = 0; i < FRAME_HEIGHT; i++) {
+        for (int j = 0; j < FRAME_WIDTH; j++) {
+            float temp = tracker.frame[i][j];
+            float average = tracker.pixel_averages[i][j];
+            float variance = tracker.pixel_variance[i][j];
+            float temperature_difference = temp - average;
+
+            switch (view) {
+                case VIEW_AVERAGE:
+                    values[i][j] = average;
+                    break;
+                case VIEW_VARIANCE:
+                    values[i][j] = variance;
+                    break;
+                case VIEW_DIFF:
+                    values[i][j] = temperature_difference;
+                    break;
+                case VIEW_ACTIVE:
+                    temperature_difference = fabs(temperature_difference);
+                    values[i][j] = temperature_difference > variance * ACTIVE_VIEW_VARIANCE_SCALAR &&
+                                   temperature_difference > tracker.minimum_temperature_differential;
+                    break;
+                default:
+                    values[i][j] = temp;
+                    break;
+            }
+        }
+    }
+}
+
+size_t encode_frame_binary(const float values[FRAME_HEIGHT][FRAME_WIDTH], int view, unsigned long sequence,
+                           uint8_t* buffer) {
+    /**
+    * Pack a view into the binary layout.
+    * @param values View to pack
+    * @param view View from frame_views
+    * @param sequence Frame sequence number of the view
+    * @param buffer Buffer of FRAME_EXPORT_BINARY_SIZE bytes to fill
+    * @return Number of bytes written, FRAME_EXPORT_BINARY_SIZE
+    */
+    buffer[0] = FRAME_EXPORT_VERSION;
+    buffer[1] = view;
+    buffer[2] = FRAME_WIDTH;
+    buffer[3] = FRAME_HEIGHT;
+    for (int i = 0; i < 4; i++) {
+        buffer[4 + i] = (sequence >> (8 * i)) & 0xFF;
+    }
+
+    uint8_t* pixel = buffer + FRAME_EXPORT_HEADER_SIZE;
+    for (int i = 0; i < FRAME_HEIGHT; i++) {
+        for (int j = 0; j < FRAME_WIDTH; j++) {
+            float scaled = values[i][j] * FRAME_EXPORT_SCALE;
+            scaled = constrain(scaled, -32768.0f, 32767.0f);
+            int16_t value = int16_t(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+            *pixel++ = uint16_t(value) & 0xFF;
+            *pixel++ = uint16_t(value) >> 8;
+        }
+    }
+
+    return FRAME_EXPORT_BINARY_SIZE;
+}
+
+void format_frame_text(const float values[FRAME_HEIGHT][FRAME_WIDTH], frame_text text[FRAME_HEIGHT][FRAME_WIDTH]) {
+    /**
+    * Format a view's pixels as text, clamped to +/-FRAME_TEXT_LIMIT.
+    * @param values View to format
+    * @param text Text of each pixel, filled in
+    */
+    char formatted[FLOAT_TEXT_SIZE];
+
+    for (int i = 0; i < FRAME_HEIGHT; i++) {
+        for (int j = 0; j < FRAME_WIDTH; j++) {
+            size_t length = format_float(constrain(values[i][j], -FRAME_TEXT_LIMIT, FRAME_TEXT_LIMIT), 2, formatted);
+            memcpy(text[i][j], formatted, length + 1);
+        }
+    }
+}
+
+void write_frame_json(PageWriter& page, const frame_text text[FRAME_HEIGHT][FRAME_WIDTH], int view,
+                      unsigned long sequence) {
+    /**
+    * Write a view as a JSON object: {"view", "sequence", "width", "height", "pixels":[[row 0], ...]}.
+    * @param page Writer to write the object to
+    * @param text View to write, as format_frame_text formats it
+    * @param view View from frame_views
+    * @param sequence Frame sequence number of the view
+    */
+    page.print_P(PSTR("{\"view\":\""));
+    page.print(get_frame_view_name(view));
+    page.print_P(PSTR("\",\"sequence\":"));
+    page.print(sequence);
+    page.print_P(PSTR(",\"width\":"));
+    page.print(FRAME_WIDTH);
+    page.print_P(PSTR(",\"height\":"));
+    page.print(FRAME_HEIGHT);
+    page.print_P(PSTR(",\"pixels\":["));
+
+    for (int i = 0; i < FRAME_HEIGHT; i++) {
+        if (i > 0) {
+            page.print_P(PSTR(","));
+        }
+        page.print_P(PSTR("["));
+        for (int j = 0; j < FRAME_WIDTH; j++) {
+            if (j > 0) {
+                page.print_P(PSTR(","));
+            }
+            page.print(text[i][j]);
+        }
+        page.print_P(PSTR("]"));
+    }
+
+    page.print_P(PSTR("]}"));
+}
@@ -0,0 +1,87 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PageWriter.h"
+#include "ThermalTracker.h"
+
+/*
+ * Frame views exported for client-side rendering.
+ *
+ * Binary layout (FRAME_EXPORT_BINARY_SIZE bytes, little-endian):
+ *   0  uint8   FRAME_EXPORT_VERSION
+ *   1  uint8   view, from frame_views
+ *   2  uint8   width (FRAME_WIDTH)
+ *   3  uint8   height (FRAME_HEIGHT)
+ *   4  uint32  frame sequence number
+ *   8  int16   pixels in hundredths (°C, or °C² for variance), row by row, clamped to the int16 range
+ */
+
+const uint8_t FRAME_EXPORT_VERSION = 1;
+const int FRAME_EXPORT_HEADER_SIZE = 8;
+const int FRAME_EXPORT_BINARY_SIZE = FRAME_EXPORT_HEADER_SIZE + FRAME_HEIGHT * FRAME_WIDTH * 2;
+const float FRAME_EXPORT_SCALE = 100; /**< Binary pixel values are in hundredths */
+const float ACTIVE_VIEW_VARIANCE_SCALAR = 3;
+const int FRAME_TEXT_SIZE = 10;           /**< Room for a pixel's text, sign and terminator included */
+const float FRAME_TEXT_LIMIT = 99999.99f; /**< Pixels are clamped to this magnitude so their text fits */
+
+/**
+* A pixel formatted with two decimals, as PageWriter::print(value, 2) sends it.
+*/
+typedef char frame_text[FRAME_TEXT_SIZE];
+
+enum frame_views { VIEW_LIVE, VIEW_AVERAGE, VIEW_VARIANCE, VIEW_DIFF, VIEW_ACTIVE, NUM_FRAME_VIEWS };
+
+/**
+* Find a view by name.
+* @param name View name, e.g. "live"
+* @return View from frame_views, or -1 if there is no such view
+*/
+int find_frame_view(const char* name);
+
+/**
+* Get the name of a view.
+* @param view View from frame_views
+*/
+const char* get_frame_view_name(int view);
+
+/**
+* Fill in a view of the tracker's last published frame.
+* Live, average and variance are copies of the snapshot; diff is the frame less the background; active is 1 for
+* pixels the difference marks as active and 0 elsewhere.
+* @param tracker Tracker to read
+* @param view View from frame_views
+* @param values Frame to fill in
+*/
+void get_frame_view(ThermalTracker& tracker, int view, float values[FRAME_HEIGHT][FRAME_WIDTH]);
+
+/**
+* Pack a view into the binary layout.
+* @param values View to pack
+* @param view View from frame_views
+* @param sequence Frame sequence number of the view
+* @param buffer Buffer of FRAME_EXPORT_BINARY_SIZE bytes to fill
+* @return Number of bytes written, FRAME_EXPORT_BINARY_SIZE
+*/
+size_t encode_frame_binary(const float values[FRAME_HEIGHT][FRAME_WIDTH], int view, unsigned long sequence,
+                           uint8_t* buffer);
+
+/**
+* Format a view's pixels as text, clamped to +/-FRAME_TEXT_LIMIT.
+* @param values View to format
+* @param text Text of each pixel, filled in
+*/
+void format_frame_text(const float values[FRAME_HEIGHT][FRAME_WIDTH], frame_text text[FRAME_HEIGHT][FRAME_WIDTH]);
+
+/**
+* Write a view as a JSON object: {"view", "sequence", "width", "height", "pixels":[[row 0], ...]}.
+* @param page Writer to write the object to
+* @param text View to write, as format_frame_text formats it
+* @param view View from frame_views
+* @param sequence Frame sequence number of the view
+*/
+void write_frame_json(PageWriter& page, const frame_text text[FRAME_HEIGHT][FRAME_WIDTH], int view,
+                      unsigned long sequence);
+
+#endif
@@ -0,0 +1,243 @@
+#include "FrameScheduler.h"
+#include <limits.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+
+FrameScheduler::FrameScheduler() {
+    num_tasks = 0;
+    next_background_task = 0;
+    running_deadline_task = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+
+int FrameScheduler::add_deadline_task(const char* name, task_callback callback, unsigned long period,
+                                      unsigned long deadline, uint8_t priority) {
+    /**
+    * Add a periodic task with a deadline. It is first released on the next run().
+    * @param name Name shown in the statistics
+    * @param callback Function to run on each release
+    * @param period Time between releases, in us
+    * @param deadline Time after each release by which the run must have finished, in us
+    * @param priority Order among deadline tasks released together; lowest first
+    * @return Index of the task in tasks, or -1 if there are already MAX_SCHEDULED_TASKS
+    */
+    int index = add_task(name, callback, TASK_DEADLINE);
+    if (index < 0) {
+        return -1;
+    }
+
+    ScheduledTask& task = tasks[index];
+    task.period = period;
+    task.deadline = deadline;
+    task.priority = priority;
+    task.next_release = micros();
+
+    return index;
+}
+
+int FrameScheduler::add_background_task(const char* name, task_callback callback, unsigned long budget) {
+    /**
+    * Add a background task, run in turn with the other background tasks whenever its budget fits.
+    * @param name Name shown in the statistics
+    * @param callback Function doing the next step of the task's work, taking no longer than the budget
+    * @param budget Longest a run of the task may take, in us
+    * @return Index of the task in tasks, or -1 if there are already MAX_SCHEDULED_TASKS
+    */
+    int index = add_task(name, callback, TASK_BACKGROUND);
+    if (index < 0) {
+        return -1;
+    }
+
+    tasks[index].budget = budget;
+    return index;
+}
+
+void FrameScheduler::run() {
+    /**
+    * Run one scheduling iteration: the deadline tasks that are due, then each background task whose budget fits
+    * before the next release, checking the deadline tasks again after each one. Call from loop().
+    */
+    run_deadline_tasks();
+
+    int first = next_background_task;
+    bool first_run = true;
+
+    for (int i = 0; i < num_tasks; i++) {
+        int index = (first + i) % num_tasks;
+        ScheduledTask& task = tasks[index];
+        if (task.kind != TASK_BACKGROUND) {
+            continue;
+        }
+
+        if (get_time_to_release(micros()) < task.budget) {
+            task.num_deferrals++;
+            continue;
+        }
+
+        // The next iteration starts with the task after the first one that ran, so none is always last in line
+        if (first_run) {
+            next_background_task = (index + 1) % num_tasks;
+            first_run = false;
+        }
+
+        run_background_task(task);
+        run_deadline_tasks();
+    }
+}
+
+void FrameScheduler::run_deadline_tasks() {
+    /**
+    * Run only the deadline tasks that are due.
+    * For code that has to wait on something, so it can keep the deadlines while it does. Does nothing if called from
+    * a deadline task.
+    */
+    if (running_deadline_task) {
+        return;
+    }
+
+    unsigned long now = micros();
+    ScheduledTask* task;
+    while ((task = get_due_task(now)) != NULL) {
+        run_deadline_task(*task, now);
+        now = micros();
+    }
+}
+
+void FrameScheduler::reset_stats() {
+    /**
+    * Clear the run and deadline statistics of every task.
+    */
+    for (int i = 0; i < num_tasks; i++) {
+        tasks[i].num_runs = 0;
+        tasks[i].num_deadline_misses = 0;
+        tasks[i].num_skipped_releases = 0;
+        tasks[i].num_deferrals = 0;
+        tasks[i].max_lateness = 0;
+        tasks[i].max_run_time = 0;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+
+int FrameScheduler::add_task(const char* name, task_callback callback, uint8_t kind) {
+    /**
+    * Add a task with cleared statistics.
+    * @return Index of the task in tasks, or -1 if there are already MAX_SCHEDULED_TASKS
+    */
+    if (num_tasks >= MAX_SCHEDULED_TASKS) {
+        return -1;
+    }
+
+    ScheduledTask& task = tasks[num_tasks];
+    memset(&task, 0, sizeof(task));
+    task.name = name;
+    task.callback = callback;
+    task.kind = kind;
+
+    return num_tasks++;
+}
+
+ScheduledTask* FrameScheduler::get_due_task(unsigned long now) {
+    /**
+    * Get the most urgent deadline task that has been released.
+    * @param now Current time, in us
+    * @return Task to run next, or NULL if none are due
+    */
+    ScheduledTask* due_task = NULL;
+
+    for (int i = 0; i < num_tasks; i++) {
+        ScheduledTask& task = tasks[i];
+        if (task.kind != TASK_DEADLINE || long(now - task.next_release) < 0) {
+            continue;
+        }
+
+        // Most important first, then earliest deadline
+        if (due_task == NULL || task.priority < due_task->priority ||
+            (task.priority == due_task->priority &&
+             long(task.next_release + task.deadline - (due_task->next_release + due_task->deadline)) < 0)) {
+            due_task = &task;
+        }
+    }
+
+    return due_task;
+}
+
+unsigned long FrameScheduler::get_time_to_release(unsigned long now) {
+    /**
+    * Get how long until the next deadline task is released.
+    * @param now Current time, in us
+    * @return Time to the next release in us, 0 if one is due, or ULONG_MAX if there are no deadline tasks
+    */
+    unsigned long time_to_release = ULONG_MAX;
+
+    for (int i = 0; i < num_tasks; i++) {
+        if (tasks[i].kind != TASK_DEADLINE) {
+            continue;
+        }
+
+        long remaining = long(tasks[i].next_release - now);
+        if (remaining <= 0) {
+            return 0;
+        }
+        if ((unsigned long)remaining < time_to_release) {
+            time_to_release = remaining;
+        }
+    }
+
+    return time_to_release;
+}
+
+void FrameScheduler::run_deadline_task(ScheduledTask& task, unsigned long now) {
+    /**
+    * Run a released deadline task and check its deadline.
+    */
+    // Starting more than a period late means releases went by without a run; only the latest one is run
+    unsigned long lateness = now - task.next_release;
+    if (lateness >= task.period) {
+        unsigned long num_skipped = lateness / task.period;
+        task.num_skipped_releases += num_skipped;
+        task.next_release += num_skipped * task.period;
+        lateness -= num_skipped * task.period;
+    }
+
+    unsigned long release = task.next_release;
+    task.next_release += task.period;
+    if (lateness > task.max_lateness) {
+        task.max_lateness = lateness;
+    }
+
+    running_deadline_task = true;
+    task.callback();
+    running_deadline_task = false;
+
+    unsigned long end = micros();
+    unsigned long run_time = end - now;
+    task.num_runs++;
+    if (run_time > task.max_run_time) {
+        task.max_run_time = run_time;
+    }
+    if (end - release > task.deadline) {
+        task.num_deadline_misses++;
+    }
+}
+
+void FrameScheduler::run_background_task(ScheduledTask& task) {
+    /**
+    * Run a background task and check it kept to its budget.
+    */
+    unsigned long start = micros();
+    task.callback();
+    unsigned long run_time = micros() - start;
+
+    task.num_runs++;
+    if (run_time > task.max_run_time) {
+        task.max_run_time = run_time;
+    }
+    if (run_time > task.budget) {
+        task.num_deadline_misses++;
+    }
+}
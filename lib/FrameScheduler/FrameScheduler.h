@@ -0,0 +1,121 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <Arduino.h>
+
+const int MAX_SCHEDULED_TASKS = 8;
+
+typedef void (*task_callback)();
+
+enum task_kinds { TASK_DEADLINE, TASK_BACKGROUND };
+
+/**
+* A task and its deadline statistics. All times are in microseconds.
+*/
+struct ScheduledTask {
+    const char* name;
+    task_callback callback;
+    uint8_t kind;             /**< TASK_DEADLINE or TASK_BACKGROUND */
+    uint8_t priority;         /**< Deadline tasks due together run lowest priority number first */
+    unsigned long period;     /**< Deadline tasks: time between releases */
+    unsigned long deadline;   /**< Deadline tasks: time after its release by which a run must have finished */
+    unsigned long budget;     /**< Background tasks: longest a run may take */
+    unsigned long next_release;
+
+    unsigned long num_runs;
+    unsigned long num_deadline_misses;  /**< Runs that finished after their deadline, or went over their budget */
+    unsigned long num_skipped_releases; /**< Releases that passed without a run because the task started too late */
+    unsigned long num_deferrals;        /**< Background tasks: times held back because their budget did not fit */
+    unsigned long max_lateness;         /**< Longest from a release to the start of its run */
+    unsigned long max_run_time;
+};
+
+/**
+* Cooperative scheduler that protects periodic deadlines, such as reading each sensor frame, from everything else.
+* Deadline tasks run as soon as they are released, most urgent first. Background tasks share the time left over: one
+* is only started when its budget fits before the next release, and the deadline tasks are checked again after every
+* background run. Nothing is pre-empted, so a background task has to keep each run within its budget; work that takes
+* longer must be split into steps that resume where the last run stopped.
+*/
+class FrameScheduler {
+   public:
+    FrameScheduler();
+
+    /**
+    * Add a periodic task with a deadline. It is first released on the next run().
+    * @param name Name shown in the statistics
+    * @param callback Function to run on each release
+    * @param period Time between releases, in us
+    * @param deadline Time after each release by which the run must have finished, in us
+    * @param priority Order among deadline tasks released together; lowest first
+    * @return Index of the task in tasks, or -1 if there are already MAX_SCHEDULED_TASKS
+    */
+    int add_deadline_task(const char* name, task_callback callback, unsigned long period, unsigned long deadline,
+                          uint8_t priority = 0);
+
+    /**
+    * Add a background task, run in turn with the other background tasks whenever its budget fits.
+    * @param name Name shown in the statistics
+    * @param callback Function doing the next step of the task's work, taking no longer than the budget
+    * @param budget Longest a run of the task may take, in us
+    * @return Index of the task in tasks, or -1 if there are already MAX_SCHEDULED_TASKS
+    */
+    int add_background_task(const char* name, task_callback callback, unsigned long budget);
+
+    /**
+    * Run one scheduling iteration: the deadline tasks that are due, then each background task whose budget fits
+    * before the next release, checking the deadline tasks again after each one. Call from loop().
+    */
+    void run();
+
+    /**
+    * Run only the deadline tasks that are due.
+    * For code that has to wait on something, so it can keep the deadlines while it does. Does nothing if called from
+    * a deadline task.
+    */
+    void run_deadline_tasks();
+
+    /**
+    * Clear the run and deadline statistics of every task.
+    */
+    void reset_stats();
+
+    int num_tasks;
+    ScheduledTask tasks[MAX_SCHEDULED_TASKS];
+
+   private:
+    /**
+    * Add a task with cleared statistics.
+    * @return Index of the task in tasks, or -1 if there are already MAX_SCHEDULED_TASKS
+    */
+    int add_task(const char* name, task_callback callback, uint8_t kind);
+
+    /**
+    * Get the most urgent deadline task that has been released.
+    * @param now Current time, in us
+    * @return Task to run next, or NULL if none are due
+    */
+    ScheduledTask* get_due_task(unsigned long now);
+
+    /**
+    * Get how long until the next deadline task is released.
+    * @param now Current time, in us
+    * @return Time to the next release in us, 0 if one is due, or ULONG_MAX if there are no deadline tasks
+    */
+    unsigned long get_time_to_release(unsigned long now);
+
+    /**
+    * Run a released deadline task and check its deadline.
+    */
+    void run_deadline_task(ScheduledTask& task, unsigned long now);
+
+    /**
+    * Run a background task and check it kept to its budget.
+    */
+    void run_background_task(ScheduledTask& task);
+
+    int next_background_task;   /**< Background task to offer time to first, so they all get a turn */
+    bool running_deadline_task; /**< Set while a deadline task runs, so waits inside it do not run others */
+};
+
+#endif
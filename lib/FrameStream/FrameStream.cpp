@@ -0,0 +1,140 @@
+#include "FrameStream.h"
+
+static const char BASE64_DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char STREAM_HEADERS[] PROGMEM =
+    "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+    "Access-Control-Allow-Origin: *\r\nConnection: keep-alive\r\n\r\n";
+static const char STREAM_BUSY[] PROGMEM = "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+
+FrameStream::FrameStream(uint16_t port) : server(port) {
+    num_events_sent = 0;
+    num_events_dropped = 0;
+    num_clients_refused = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+
+void FrameStream::begin() {
+    /**
+    * Start listening for subscribers.
+    */
+    server.begin();
+    server.setNoDelay(true);
+}
+
+void FrameStream::update() {
+    /**
+    * Accept new subscribers and drop those that have disconnected. Never waits on a socket.
+    * Requests are not parsed: any connection is a subscription, and whatever it sends is discarded.
+    */
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        if (!clients[i].connected()) {
+            clients[i].stop();
+            continue;
+        }
+        while (clients[i].available()) {
+            clients[i].read();
+        }
+    }
+
+    WiFiClient client = server.available();
+    if (!client) {
+        return;
+    }
+
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        if (!clients[i].connected()) {
+            clients[i] = client;
+            clients[i].setNoDelay(true);
+            clients[i].write_P(STREAM_HEADERS, strlen_P(STREAM_HEADERS));
+
+            char retry[24];
+            int length = sprintf(retry, "retry: %ld\n\n", STREAM_RETRY_INTERVAL);
+            clients[i].write((const uint8_t*)retry, length);
+            return;
+        }
+    }
+
+    num_clients_refused++;
+    client.write_P(STREAM_BUSY, strlen_P(STREAM_BUSY));
+    client.stop();
+}
+
+void FrameStream::send_frame(const uint8_t* frame, size_t length, unsigned long sequence) {
+    /**
+    * Send a frame to every subscriber with room for it.
+    * The event is encoded once and only written to sockets that can take all of it, so writes never wait for
+    * acknowledgements and no subscriber ever receives part of an event.
+    * @param frame Frame to send, at most MAX_STREAM_FRAME_SIZE bytes
+    * @param length Number of bytes in the frame
+    * @param sequence Sequence number of the frame, sent as the event id
+    */
+    if (get_num_clients() == 0 || length > (size_t)MAX_STREAM_FRAME_SIZE) {
+        return;
+    }
+
+    size_t event_length = encode_event(frame, length, sequence);
+
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        if (!clients[i].connected()) {
+            continue;
+        }
+
+        if ((size_t)clients[i].availableForWrite() < event_length) {
+            num_events_dropped++;
+            continue;
+        }
+
+        clients[i].write((const uint8_t*)event_buffer, event_length);
+        num_events_sent++;
+    }
+}
+
+int FrameStream::get_num_clients() {
+    /**
+    * Get the number of subscribers connected.
+    */
+    int num_clients = 0;
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        if (clients[i].connected()) {
+            num_clients++;
+        }
+    }
+
+    return num_clients;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+
+size_t FrameStream::encode_event(const uint8_t* frame, size_t length, unsigned long sequence) {
+    /**
+    * Encode a frame as an event into event_buffer.
+    * @return Length of the event
+    */
+    char* output = event_buffer + sprintf(event_buffer, "id: %lu\ndata: ", sequence);
+
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t group = uint32_t(frame[i]) << 16;
+        if (i + 1 < length) {
+            group |= uint32_t(frame[i + 1]) << 8;
+        }
+        if (i + 2 < length) {
+            group |= frame[i + 2];
+        }
+
+        *output++ = BASE64_DIGITS[(group >> 18) & 0x3F];
+        *output++ = BASE64_DIGITS[(group >> 12) & 0x3F];
+        *output++ = i + 1 < length ? BASE64_DIGITS[(group >> 6) & 0x3F] : '=';
+        *output++ = i + 2 < length ? BASE64_DIGITS[group & 0x3F] : '=';
+    }
+
+    *output++ = '\n';
+    *output++ = '\n';
+
+    return output - event_buffer;
+}
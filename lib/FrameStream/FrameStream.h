@@ -0,0 +1,68 @@
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+const int MAX_STREAM_CLIENTS = 4;
+const int MAX_STREAM_FRAME_SIZE = 160; /**< Largest frame, in bytes, before encoding */
+const int MAX_STREAM_EVENT_SIZE = 24 + (MAX_STREAM_FRAME_SIZE + 2) / 3 * 4; /**< "id: n\ndata: base64\n\n" */
+const long STREAM_RETRY_INTERVAL = 1000; /**< How long browsers wait before reconnecting, in ms */
+
+/**
+* Server-Sent Events stream pushing each frame once to every subscriber.
+* Runs its own listening socket, so subscribers stay connected without tying up the web server. Each frame is sent
+* as an event whose id is the frame sequence number and whose data is the frame, base64 encoded. A subscriber
+* whose socket cannot take a whole event right away has that frame dropped, so a slow client never blocks the
+* caller; the gaps show up in the event ids.
+*/
+class FrameStream {
+   public:
+    /**
+    * @param port Port to listen for subscribers on
+    */
+    FrameStream(uint16_t port);
+
+    /**
+    * Start listening for subscribers.
+    */
+    void begin();
+
+    /**
+    * Accept new subscribers and drop those that have disconnected. Never waits on a socket.
+    * Requests are not parsed: any connection is a subscription, and whatever it sends is discarded.
+    */
+    void update();
+
+    /**
+    * Send a frame to every subscriber with room for it.
+    * The event is encoded once and only written to sockets that can take all of it, so writes never wait for
+    * acknowledgements and no subscriber ever receives part of an event.
+    * @param frame Frame to send, at most MAX_STREAM_FRAME_SIZE bytes
+    * @param length Number of bytes in the frame
+    * @param sequence Sequence number of the frame, sent as the event id
+    */
+    void send_frame(const uint8_t* frame, size_t length, unsigned long sequence);
+
+    /**
+    * Get the number of subscribers connected.
+    */
+    int get_num_clients();
+
+    unsigned long num_events_sent;     /**< Events written to subscribers, summed over subscribers */
+    unsigned long num_events_dropped;  /**< Events skipped because a subscriber's socket was full */
+    unsigned long num_clients_refused; /**< Subscribers turned away because every slot was taken */
+
+   private:
+    /**
+    * Encode a frame as an event into event_buffer.
+    * @return Length of the event
+    */
+    size_t encode_event(const uint8_t* frame, size_t length, unsigned long sequence);
+
+    WiFiServer server;
+    WiFiClient clients[MAX_STREAM_CLIENTS];
+    char event_buffer[MAX_STREAM_EVENT_SIZE];
+};
+
+#endif
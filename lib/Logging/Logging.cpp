@@ -1,133 +1,178 @@
 #include "Logging.h"
 
 void Logging::Init(int level, long baud){
-    _level = constrain(level,LOG_LEVEL_NOOUTPUT,LOG_LEVEL_VERBOSE);
+    _level = constrain(level,LOG_LEVEL_NOOUTPUT,LOG_LEVEL_MAX);
     _baud = baud;
     _printer = &Serial;
     Serial.begin(_baud);
 }
 
 void Logging::Init(int level, Print* printer){
-    _level = constrain(level,LOG_LEVEL_NOOUTPUT,LOG_LEVEL_VERBOSE);
+    _level = constrain(level,LOG_LEVEL_NOOUTPUT,LOG_LEVEL_MAX);
     _printer = printer;
 }
 
 void Logging::Error(const char* msg, ...){
-    if (LOG_LEVEL_ERRORS <= _level) {
-        _printer->print("ERROR:\t");
+    if (LOG_LEVEL_ERRORS <= LOG_LEVEL_MAX && LOG_LEVEL_ERRORS <= _level) {
         va_list args;
         va_start(args, msg);
-        print(msg,args);
+        print("ERROR:\t",msg,args);
+        va_end(args);
     }
 }
 
 
 void Logging::Info(const char* msg, ...){
-    if (LOG_LEVEL_INFOS <= _level) {
-    	_printer->print("INFO:\t");
+    if (LOG_LEVEL_INFOS <= LOG_LEVEL_MAX && LOG_LEVEL_INFOS <= _level) {
         va_list args;
         va_start(args, msg);
-        print(msg,args);
+        print("INFO:\t",msg,args);
+        va_end(args);
     }
 }
 
 void Logging::Debug(const char* msg, ...){
-    if (LOG_LEVEL_DEBUG <= _level) {
-    	_printer->print("DEBUG:\t");
+    if (LOG_LEVEL_DEBUG <= LOG_LEVEL_MAX && LOG_LEVEL_DEBUG <= _level) {
         va_list args;
         va_start(args, msg);
-        print(msg,args);
+        print("DEBUG:\t",msg,args);
+        va_end(args);
     }
 }
 
 
 void Logging::Verbose(const char* msg, ...){
-    if (LOG_LEVEL_VERBOSE <= _level) {
-    	_printer->print("VERBOSE:\t");
+    if (LOG_LEVEL_VERBOSE <= LOG_LEVEL_MAX && LOG_LEVEL_VERBOSE <= _level) {
         va_list args;
         va_start(args, msg);
-        print(msg,args);
+        print("VERBOSE:\t",msg,args);
+        va_end(args);
     }
 }
 
 
 
-void Logging::print(const char *format, va_list args) {
+void Logging::print(const char *prefix, const char *format, va_list args) {
     //
-    // loop through format string
+    // format the whole line into _buffer, then send it with one write
+    append(prefix);
     for (; *format != 0; ++format) {
         if (*format == '%') {
             ++format;
             if (*format == '\0') break;
             if (*format == '%') {
-                _printer->print(*format);
+                append(*format);
                 continue;
             }
             if( *format == 's' ) {
-				register char *s = (char *)va_arg( args, int );
-				_printer->print(s);
+				append(va_arg( args, const char * ));
 				continue;
 			}
             if( *format == 'd' || *format == 'i') {
-				_printer->print(va_arg( args, int ),DEC);
+				long n = va_arg( args, int );
+				if (n < 0) {
+					append('-');
+					n = -n;
+				}
+				appendNumber(n,DEC);
 				continue;
 			}
             if( *format == 'x' ) {
-				_printer->print(va_arg( args, int ),HEX);
+				appendNumber((long)va_arg( args, int ),HEX);
 				continue;
 			}
             if( *format == 'X' ) {
-				_printer->print("0x");
-				_printer->print(va_arg( args, int ),HEX);
+				append("0x");
+				appendNumber((long)va_arg( args, int ),HEX);
 				continue;
 			}
             if( *format == 'b' ) {
-				_printer->print(va_arg( args, int ),BIN);
+				appendNumber((long)va_arg( args, int ),BIN);
 				continue;
 			}
             if( *format == 'B' ) {
-				_printer->print("0b");
-				_printer->print(va_arg( args, int ),BIN);
+				append("0b");
+				appendNumber((long)va_arg( args, int ),BIN);
 				continue;
 			}
             if( *format == 'l' ) {
-				_printer->print(va_arg( args, long ),DEC);
+				long n = va_arg( args, long );
+				if (n < 0) {
+					append('-');
+					n = -n;
+				}
+				appendNumber(n,DEC);
 				continue;
 			}
 
             if( *format == 'c' ) {
-				_printer->print(char(va_arg( args, int )));
+				append(char(va_arg( args, int )));
 				continue;
 			}
             if( *format == 't' ) {
 				if (va_arg( args, int ) == 1) {
-					_printer->print("T");
+					append("T");
 				}
 				else {
-					_printer->print("F");
+					append("F");
 				}
 				continue;
 			}
             if( *format == 'T' ) {
 				if (va_arg( args, int ) == 1) {
-					_printer->print("true");
+					append("true");
 				}
 				else {
-					_printer->print("false");
+					append("false");
 				}
 				continue;
 			}
         }
         else if (*format == '\n') {
-            _printer->print('\r');
+            append('\r');
         }
-        _printer->print(*format);
+        append(*format);
+    }
+    append('\n');
+    flush();
+}
+
+void Logging::append(char c) {
+    if (_length == sizeof(_buffer)) {
+        flush();
+    }
+    _buffer[_length++] = c;
+}
+
+void Logging::append(const char *s) {
+    if (s == NULL) {
+        return;
+    }
+    for (; *s != 0; ++s) {
+        append(*s);
     }
-    _printer->print("\n");
 }
 
-int Logging::getLevel(){
-    return _level;
+void Logging::appendNumber(unsigned long n, int base) {
+    // digits come out lowest first, as in Print::printNumber
+    char digits[8 * sizeof(long)];
+    int i = 0;
+    do {
+        char digit = n % base;
+        digits[i++] = digit < 10 ? digit + '0' : digit + 'A' - 10;
+        n /= base;
+    } while (n > 0);
+
+    while (i > 0) {
+        append(digits[--i]);
+    }
+}
+
+void Logging::flush() {
+    if (_length > 0) {
+        _printer->write((const uint8_t*)_buffer, _length);
+        _length = 0;
+    }
 }
 
 Logging Log = Logging();
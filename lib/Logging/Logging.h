@@ -19,6 +19,32 @@
 // default loglevel if nothing is set from user
 #define LOGLEVEL LOG_LEVEL_DEBUG
 
+// highest level compiled in, e.g. -DLOG_LEVEL_MAX=LOG_LEVEL_INFOS; messages above it generate no code
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX LOG_LEVEL_VERBOSE
+#endif
+
+// longest line sent to the printer in one write; longer lines are sent in pieces
+#ifndef LOGGING_BUFFER_SIZE
+#define LOGGING_BUFFER_SIZE 192
+#endif
+
+/*!
+* Log a message only if its level is compiled in and enabled.
+* Unlike calling Log.Debug() etc. directly, the arguments are not evaluated
+* for a filtered message, and levels above LOG_LEVEL_MAX compile away.
+*/
+#define LOGGING_MESSAGE(level, method, ...) \
+    do { \
+        if ((level) <= LOG_LEVEL_MAX && (level) <= Log.getLevel()) { \
+            Log.method(__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOGGING_ERROR(...) LOGGING_MESSAGE(LOG_LEVEL_ERRORS, Error, __VA_ARGS__)
+#define LOGGING_INFO(...) LOGGING_MESSAGE(LOG_LEVEL_INFOS, Info, __VA_ARGS__)
+#define LOGGING_DEBUG(...) LOGGING_MESSAGE(LOG_LEVEL_DEBUG, Debug, __VA_ARGS__)
+#define LOGGING_VERBOSE(...) LOGGING_MESSAGE(LOG_LEVEL_VERBOSE, Verbose, __VA_ARGS__)
 
 #define CR "\n"
 #define LOGGING_VERSION 1
@@ -31,11 +57,14 @@
 * All methods are able to handle any number of output parameters.
 * All methods print out a formated string (like printf).<br>
 * To reduce output and program size, reduce loglevel.
+* Each message is formatted into a line buffer and sent with one write.
 * <br>
 * Output format string can contain below wildcards. Every wildcard
 * must be start with percent sign (\%)
 *
 * <b>Depending on loglevel, source code is excluded from compile !</b><br>
+* Use the LOGGING_ERROR() ... LOGGING_VERBOSE() macros and set LOG_LEVEL_MAX
+* for this: levels above LOG_LEVEL_MAX generate no code.<br>
 * <br>
 * <b>Wildcards</b><br>
 * <ul>
@@ -70,6 +99,8 @@ private:
     int _level;
     long _baud;
     Print* _printer;
+    char _buffer[LOGGING_BUFFER_SIZE];
+    size_t _length;
 public:
     /*!
 	 * default Constructor
@@ -77,11 +108,12 @@ public:
     Logging()
       : _level(LOG_LEVEL_NOOUTPUT),
         _baud(0),
-        _printer(NULL) {}
+        _printer(NULL),
+        _length(0) {}
 
     /**
 	* Initializing, must be called as first.
-	* \param level - logging levels <= this will be logged.
+	* \param level - logging levels <= this will be logged, up to LOG_LEVEL_MAX.
 	* \param baud - baud rate to initialize the serial port to.
 	* \return void
 	*
@@ -92,7 +124,7 @@ public:
     * Initializing, must be called as first. Note that if you use
     * this variant of Init, you need to initialize the baud rate
     * yourself, if printer happens to be a serial port.
-    * \param level - logging levels <= this will be logged.
+    * \param level - logging levels <= this will be logged, up to LOG_LEVEL_MAX.
     * \param printer - place that logging output will be sent to.
     * \return void
     *
@@ -146,11 +178,15 @@ public:
 
     void Verbose(const char* msg, ...);
 
-	int getLevel();
+	int getLevel() { return _level; }
 
 
 private:
-    void print(const char *format, va_list args);
+    void print(const char *prefix, const char *format, va_list args);
+    void append(char c);
+    void append(const char *s);
+    void appendNumber(unsigned long n, int base);
+    void flush();
 };
 
 extern Logging Log;
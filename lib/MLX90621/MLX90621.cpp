@@ -18,6 +18,10 @@
 ///////////////////////////////////////////////////////////////////////////////
 // Configuration
 
+MLX90621::MLX90621() {
+    ambient = 0;
+}
+
 void MLX90621::initialise(int refresh_rate) {
     /**
     * Start up the MLX90621 sensor and prepare for reads.
@@ -294,6 +298,7 @@ float MLX90621::get_ambient_temperature() {
     /**
     * Read the sensor and calculate the ambient temperature.
     * The calculated temperature is stored in a class variable to provide access to other functions
+    * This reads the bus, so code that is not reading frames should use get_frame_ambient_temperature instead.
     * @return Ambient temperature measured by the sensor in deg C.
     */
 
@@ -305,6 +310,14 @@ float MLX90621::get_ambient_temperature() {
     return ambient_temperature;
 }
 
+float MLX90621::get_frame_ambient_temperature() {
+    /**
+    * Get the ambient temperature calculated for the last frame read, without touching the bus.
+    * @return Ambient temperature in deg C, or 0 if no frame has been read yet
+    */
+    return ambient;
+}
+
 int MLX90621::get_PTAT() {
     /**
     * Read Proportional to Absolute Temperature sensor to find the ambient temperature of the chip
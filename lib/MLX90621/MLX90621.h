@@ -233,6 +233,8 @@ class MLX90621 {
     float calculate_pixel(uint8_t pixel_num, int ir_data[]);
 
    public:
+    MLX90621();
+
     /**
     * Start up the MLX90621 sensor and prepare for reads.
     * @param refresh_rate Refresh rate of the sensor in frames per second. {0 (0.5), 1, 2, 4, 8, 16, 32}
@@ -260,9 +262,16 @@ class MLX90621 {
     /**
     * Read the sensor and calculate the ambient temperature.
     * The calculated temperature is stored in a class variable to provide access to other functions
+    * This reads the bus, so code that is not reading frames should use get_frame_ambient_temperature instead.
     * @return Ambient temperature measured by the sensor in deg C.
     */
     float get_ambient_temperature();
+
+    /**
+    * Get the ambient temperature calculated for the last frame read, without touching the bus.
+    * @return Ambient temperature in deg C, or 0 if no frame has been read yet
+    */
+    float get_frame_ambient_temperature();
 };
 
 #endif
@@ -0,0 +1,277 @@
+#include "PageWriter.h"
+
+size_t format_float(float value, int decimals, char* text) {
+    /**
+    * Format a number with a fixed number of decimal places, as PageWriter::print(value, decimals) sends it.
+    * Numbers too large for an unsigned long once scaled come out as "ovf".
+    * @param value Number to format
+    * @param decimals Digits after the decimal point, at most 9
+    * @param text Buffer of FLOAT_TEXT_SIZE bytes, given the null-terminated text
+    * @return Length of the text
+    */
+    if (isnan(value)) {
+        strcpy(text, "nan");
+        return 3;
+    }
+
+    // Round at the last decimal place shown, then write the whole and fractional parts as integers
+    bool negative = value < 0;
+    float magnitude = negative ? -value : value;
+    unsigned long scale = 1;
+    for (int i = 0; i < decimals; i++) {
+        scale *= 10;
+    }
+
+    if (magnitude * scale >= 4294967295.0) {
+        strcpy(text, negative ? "-ovf" : "ovf");
+        return strlen(text);
+    }
+
+    unsigned long scaled = (unsigned long)(magnitude * scale + 0.5);
+    unsigned long whole = scaled / scale;
+    unsigned long fraction = scaled % scale;
+
+    // Digits are filled in from the end
+    char digits[FLOAT_TEXT_SIZE - 1];
+    int start = sizeof(digits);
+    for (int i = 0; i < decimals; i++) {
+        digits[--start] = '0' + fraction % 10;
+        fraction /= 10;
+    }
+    if (decimals > 0) {
+        digits[--start] = '.';
+    }
+    do {
+        digits[--start] = '0' + whole % 10;
+        whole /= 10;
+    } while (whole > 0);
+    if (negative && scaled > 0) {
+        digits[--start] = '-';
+    }
+
+    size_t length = sizeof(digits) - start;
+    memcpy(text, digits + start, length);
+    text[length] = '\0';
+    return length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+
+PageWriter::PageWriter(page_sink sink, void* context) {
+    this->sink = sink;
+    this->context = context;
+    bytes_written = 0;
+    num_chunks = 0;
+    failed = false;
+    buffered = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+
+void PageWriter::begin(const char* content_type, const char* etag) {
+    /**
+    * Send the status line and headers of a 200 response with a chunked body.
+    * @param content_type MIME type of the body
+    * @param etag Entity tag of the body, quotes included, or NULL to send none. Tagged responses are marked for
+    *             revalidation on every use, so clients can ask for them again with If-None-Match.
+    */
+    static const char status[] PROGMEM = "HTTP/1.1 200 OK\r\nContent-Type: ";
+    static const char etag_header[] PROGMEM = "\r\nCache-Control: no-cache\r\nETag: ";
+    static const char headers[] PROGMEM = "\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n";
+
+    // The headers go out as one unframed block through the chunk buffer
+    int length = 0;
+    length += copy_header_P(length, status);
+    length += copy_header(length, content_type);
+    if (etag) {
+        length += copy_header_P(length, etag_header);
+        length += copy_header(length, etag);
+    }
+    length += copy_header_P(length, headers);
+
+    send(buffer, length);
+}
+
+void PageWriter::print(const char* text) {
+    /**
+    * Add text to the body.
+    * @param text Null-terminated text in RAM
+    */
+    write((const uint8_t*)text, strlen(text));
+}
+
+void PageWriter::print_P(PGM_P text) {
+    /**
+    * Add text kept in flash (declared PROGMEM) to the body.
+    * @param text Null-terminated text in flash
+    */
+    size_t length = strlen_P(text);
+
+    while (length > 0) {
+        size_t space = PAGE_WRITER_BUFFER_SIZE - buffered;
+        size_t count = length < space ? length : space;
+        memcpy_P(buffer + PAGE_WRITER_CHUNK_HEADER_SIZE + buffered, text, count);
+        buffered += count;
+        text += count;
+        length -= count;
+
+        if (buffered == PAGE_WRITER_BUFFER_SIZE) {
+            flush();
+        }
+    }
+}
+
+void PageWriter::print(int value) { print(long(value)); }
+
+void PageWriter::print(unsigned int value) { print_number(value, false); }
+
+void PageWriter::print(long value) {
+    /**
+    * Add a number to the body in decimal.
+    * @param value Number to add
+    */
+    if (value < 0) {
+        print_number(0UL - (unsigned long)value, true);
+    } else {
+        print_number(value, false);
+    }
+}
+
+void PageWriter::print(unsigned long value) { print_number(value, false); }
+
+void PageWriter::print(float value, int decimals) {
+    /**
+    * Add a number to the body with a fixed number of decimal places.
+    * @param value Number to add
+    * @param decimals Digits after the decimal point
+    */
+    char text[FLOAT_TEXT_SIZE];
+    size_t length = format_float(value, decimals, text);
+    write((const uint8_t*)text, length);
+}
+
+void PageWriter::write(const uint8_t* data, size_t length) {
+    /**
+    * Add raw bytes to the body, sending chunks as the buffer fills.
+    * @param data Bytes to add
+    * @param length Number of bytes to add
+    */
+    while (length > 0) {
+        size_t space = PAGE_WRITER_BUFFER_SIZE - buffered;
+        size_t count = length < space ? length : space;
+        memcpy(buffer + PAGE_WRITER_CHUNK_HEADER_SIZE + buffered, data, count);
+        buffered += count;
+        data += count;
+        length -= count;
+
+        if (buffered == PAGE_WRITER_BUFFER_SIZE) {
+            flush();
+        }
+    }
+}
+
+void PageWriter::finish() {
+    /**
+    * Send whatever is buffered, then the empty chunk that ends the body.
+    */
+    static const uint8_t last_chunk[] = {'0', '\r', '\n', '\r', '\n'};
+
+    flush();
+    send(last_chunk, sizeof(last_chunk));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+
+int PageWriter::copy_header(int offset, const char* text) {
+    /**
+    * Copy header text into the buffer, as much as fits.
+    * @param offset Where in the buffer the text goes
+    * @param text Null-terminated text in RAM
+    * @return Number of bytes copied
+    */
+    int length = constrain(int(strlen(text)), 0, int(sizeof(buffer)) - offset);
+    memcpy(buffer + offset, text, length);
+    return length;
+}
+
+int PageWriter::copy_header_P(int offset, PGM_P text) {
+    /**
+    * Copy header text kept in flash into the buffer, as much as fits.
+    * @param offset Where in the buffer the text goes
+    * @param text Null-terminated text in flash
+    * @return Number of bytes copied
+    */
+    int length = constrain(int(strlen_P(text)), 0, int(sizeof(buffer)) - offset);
+    memcpy_P(buffer + offset, text, length);
+    return length;
+}
+
+void PageWriter::flush() {
+    /**
+    * Send the buffered body bytes as one chunk.
+    * The chunk's length is written into the space reserved in front of the data and the CRLF after it, so each chunk
+    * is a single write to the sink.
+    */
+    if (buffered == 0) {
+        return;
+    }
+
+    static const char hex_digits[] = "0123456789ABCDEF";
+    int start = PAGE_WRITER_CHUNK_HEADER_SIZE;
+    buffer[--start] = '\n';
+    buffer[--start] = '\r';
+    int length = buffered;
+    do {
+        buffer[--start] = hex_digits[length & 0xF];
+        length >>= 4;
+    } while (length > 0);
+
+    int end = PAGE_WRITER_CHUNK_HEADER_SIZE + buffered;
+    buffer[end++] = '\r';
+    buffer[end++] = '\n';
+
+    send(buffer + start, end - start);
+    bytes_written += buffered;
+    num_chunks++;
+    buffered = 0;
+}
+
+void PageWriter::send(const uint8_t* data, size_t length) {
+    /**
+    * Pass bytes to the sink, marking the writer failed if they are not all taken.
+    * Once a write has failed the response is broken, so nothing more is sent.
+    * @param data Bytes to send
+    * @param length Number of bytes to send
+    */
+    if (failed) {
+        return;
+    }
+
+    if (sink(context, data, length) != length) {
+        failed = true;
+    }
+}
+
+void PageWriter::print_number(unsigned long value, bool negative) {
+    /**
+    * Add an unsigned number to the body in decimal.
+    * @param value Number to add
+    * @param negative Put a minus sign in front
+    */
+    char digits[21];  // Room for a 64-bit value on the host
+    int start = sizeof(digits);
+
+    do {
+        digits[--start] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    if (negative) {
+        digits[--start] = '-';
+    }
+
+    write((const uint8_t*)digits + start, sizeof(digits) - start);
+}
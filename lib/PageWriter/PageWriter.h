@@ -0,0 +1,142 @@
+#ifndef PAGE_WRITER_H
+#define PAGE_WRITER_H
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+
+const int PAGE_WRITER_BUFFER_SIZE = 512;     /**< Chunk data size; a framed chunk fits one 536 byte TCP segment */
+const int PAGE_WRITER_CHUNK_HEADER_SIZE = 6; /**< Room for a chunk's hex length and CRLF */
+const int PAGE_WRITER_CHUNK_TRAILER_SIZE = 2;
+const int FLOAT_TEXT_SIZE = 24; /**< Room for any number format_float writes, terminator included */
+
+/**
+* Destination for the bytes of a response, such as a WiFiClient.
+* @param context Pointer given to the PageWriter
+* @param data Bytes to send
+* @param length Number of bytes to send
+* @return Number of bytes sent
+*/
+typedef size_t (*page_sink)(void* context, const uint8_t* data, size_t length);
+
+/**
+* Format a number with a fixed number of decimal places, as PageWriter::print(value, decimals) sends it.
+* Numbers too large for an unsigned long once scaled come out as "ovf".
+* @param value Number to format
+* @param decimals Digits after the decimal point, at most 9
+* @param text Buffer of FLOAT_TEXT_SIZE bytes, given the null-terminated text
+* @return Length of the text
+*/
+size_t format_float(float value, int decimals, char* text);
+
+/**
+* Writes an HTTP response straight to a sink, a buffer at a time, using chunked transfer encoding.
+* The page is never held in memory as a whole and nothing is allocated: text (including templates kept in flash) and
+* numbers are copied into a fixed buffer, which is sent as one chunk whenever it fills up.
+*/
+class PageWriter {
+   public:
+    /**
+    * @param sink Function the response is written with
+    * @param context Pointer passed to the sink, e.g. the client to write to
+    */
+    PageWriter(page_sink sink, void* context);
+
+    /**
+    * Send the status line and headers of a 200 response with a chunked body.
+    * @param content_type MIME type of the body
+    * @param etag Entity tag of the body, quotes included, or NULL to send none. Tagged responses are marked for
+    *             revalidation on every use, so clients can ask for them again with If-None-Match.
+    */
+    void begin(const char* content_type, const char* etag = NULL);
+
+    /**
+    * Add text to the body.
+    * @param text Null-terminated text in RAM
+    */
+    void print(const char* text);
+
+    /**
+    * Add text kept in flash (declared PROGMEM) to the body.
+    * @param text Null-terminated text in flash
+    */
+    void print_P(PGM_P text);
+
+    /**
+    * Add a number to the body in decimal.
+    * @param value Number to add
+    */
+    void print(int value);
+    void print(unsigned int value);
+    void print(long value);
+    void print(unsigned long value);
+
+    /**
+    * Add a number to the body with a fixed number of decimal places.
+    * @param value Number to add
+    * @param decimals Digits after the decimal point
+    */
+    void print(float value, int decimals);
+
+    /**
+    * Add raw bytes to the body, sending chunks as the buffer fills.
+    * @param data Bytes to add
+    * @param length Number of bytes to add
+    */
+    void write(const uint8_t* data, size_t length);
+
+    /**
+    * Send whatever is buffered, then the empty chunk that ends the body.
+    */
+    void finish();
+
+    unsigned long bytes_written; /**< Body bytes sent, not counting headers or chunk framing */
+    unsigned int num_chunks;     /**< Chunks sent, not counting the last empty one */
+    bool failed;                 /**< Set when the sink took fewer bytes than it was given; later output is dropped */
+
+   private:
+    /**
+    * Send the buffered body bytes as one chunk.
+    * The chunk's length is written into the space reserved in front of the data and the CRLF after it, so each chunk
+    * is a single write to the sink.
+    */
+    void flush();
+
+    /**
+    * Pass bytes to the sink, marking the writer failed if they are not all taken.
+    * Once a write has failed the response is broken, so nothing more is sent.
+    * @param data Bytes to send
+    * @param length Number of bytes to send
+    */
+    void send(const uint8_t* data, size_t length);
+
+    /**
+    * Add an unsigned number to the body in decimal.
+    * @param value Number to add
+    * @param negative Put a minus sign in front
+    */
+    void print_number(unsigned long value, bool negative);
+
+    /**
+    * Copy header text into the buffer, as much as fits.
+    * @param offset Where in the buffer the text goes
+    * @param text Null-terminated text in RAM
+    * @return Number of bytes copied
+    */
+    int copy_header(int offset, const char* text);
+
+    /**
+    * Copy header text kept in flash into the buffer, as much as fits.
+    * @param offset Where in the buffer the text goes
+    * @param text Null-terminated text in flash
+    * @return Number of bytes copied
+    */
+    int copy_header_P(int offset, PGM_P text);
+
+    page_sink sink;
+    void* context;
+    uint8_t buffer[PAGE_WRITER_CHUNK_HEADER_SIZE + PAGE_WRITER_BUFFER_SIZE + PAGE_WRITER_CHUNK_TRAILER_SIZE];
+    int buffered; /**< Body bytes waiting in the buffer */
+};
+
+#endif
@@ -0,0 +1,353 @@
+#include "SerialTelemetry.h"
+
+static void put_uint16(uint8_t* buffer, uint16_t value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = value >> 8;
+}
+
+static void put_uint32(uint8_t* buffer, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static uint16_t get_uint16(const uint8_t* buffer) { return buffer[0] | (buffer[1] << 8); }
+
+static uint32_t get_uint32(const uint8_t* buffer) {
+    return uint32_t(buffer[0]) | (uint32_t(buffer[1]) << 8) | (uint32_t(buffer[2]) << 16) |
+           (uint32_t(buffer[3]) << 24);
+}
+
+/**
+* Truncate a value to an int16, as int() does for the JSON packets, clamping it to the int16 range.
+*/
+static int16_t truncate_to_int16(float value) { return int16_t(constrain(value, -32768.0f, 32767.0f)); }
+
+static uint8_t truncate_to_uint8(float value) { return uint8_t(constrain(value, 0.0f, 255.0f)); }
+
+////////////////////////////////////////////////////////////////////////////////
+// Framing
+
+uint16_t telemetry_crc16(const uint8_t* data, size_t length) {
+    /**
+    * Calculate the CRC-16/CCITT-FALSE of some data.
+    */
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < length; i++) {
+        crc ^= uint16_t(data[i]) << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+size_t cobs_encode(const uint8_t* data, size_t length, uint8_t* output) {
+    /**
+    * COBS-encode some data. The output holds no zero bytes and is at most length + length / 254 + 1 bytes long.
+    * @return Number of bytes written
+    */
+    size_t code_index = 0;
+    size_t output_length = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == 0) {
+            output[code_index] = code;
+            code_index = output_length++;
+            code = 1;
+            continue;
+        }
+
+        output[output_length++] = data[i];
+        code++;
+
+        // A full block of 254 non-zero bytes ends without an implied zero
+        if (code == 0xFF && i + 1 < length) {
+            output[code_index] = code;
+            code_index = output_length++;
+            code = 1;
+        }
+    }
+
+    output[code_index] = code;
+    return output_length;
+}
+
+int cobs_decode(const uint8_t* data, size_t length, uint8_t* output, size_t capacity) {
+    /**
+    * Decode COBS-encoded data, without its delimiter.
+    * @param capacity Size of the output buffer
+    * @return Number of bytes decoded, or -1 if the data is not valid COBS or does not fit
+    */
+    size_t output_length = 0;
+    size_t i = 0;
+
+    while (i < length) {
+        uint8_t code = data[i++];
+        if (code == 0 || i + code - 1 > length) {
+            return -1;
+        }
+
+        for (int j = 1; j < code; j++) {
+            if (data[i] == 0 || output_length == capacity) {
+                return -1;
+            }
+            output[output_length++] = data[i++];
+        }
+
+        // Every block but a full one, or the last, stands for a zero after it
+        if (code != 0xFF && i < length) {
+            if (output_length == capacity) {
+                return -1;
+            }
+            output[output_length++] = 0;
+        }
+    }
+
+    return output_length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Encoder
+
+TelemetryEncoder::TelemetryEncoder(telemetry_sink _sink, void* _context) {
+    sink = _sink;
+    context = _context;
+    num_records = 0;
+    num_bytes = 0;
+}
+
+void TelemetryEncoder::write_track_start(const TrackedBlob& blob) {
+    uint8_t* record = record_buffer;
+
+    record[0] = TELEMETRY_TRACK_START;
+    put_uint16(record + 1, blob.id);
+    put_uint16(record + 3, truncate_to_int16(float(blob._blob.average_temperature) * 100));
+    record[5] = constrain(int(blob.max_size), 0, 0xFF);
+    record[6] = constrain(int(blob.max_width), 0, 0xFF);
+    record[7] = constrain(int(blob.max_height), 0, 0xFF);
+    record[8] = truncate_to_uint8(float(blob.start_pos[X]) * 10);
+    record[9] = truncate_to_uint8(float(blob.start_pos[Y]) * 10);
+    put_uint16(record + 10, 0);
+
+    send(TELEMETRY_TRACK_START_SIZE);
+}
+
+void TelemetryEncoder::write_track_end(const TrackedBlob& blob) {
+    uint8_t* record = record_buffer;
+
+    record[0] = TELEMETRY_TRACK_END;
+    put_uint16(record + 1, blob.id);
+    put_uint16(record + 3, truncate_to_int16(float(blob._blob.average_temperature) * 100));
+    record[5] = constrain(int(blob.max_size), 0, 0xFF);
+    record[6] = constrain(int(blob.max_width), 0, 0xFF);
+    record[7] = constrain(int(blob.max_height), 0, 0xFF);
+    record[8] = constrain(blob.max_num_dead_frames, 0, 0xFF);
+    put_uint32(record + 9, blob.event_duration);
+    put_uint16(record + 13, constrain(blob.times_updated, 0, 0xFFFF));
+    put_uint16(record + 15, truncate_to_int16(float(blob.travel[X]) * 100));
+
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_SUMMARY
+    put_uint16(record + 17, truncate_to_int16(blob.average_difference));
+    put_uint16(record + 19, truncate_to_int16(blob.max_difference));
+    record[21] = TELEMETRY_HAS_DIAGNOSTICS;
+#else
+    put_uint16(record + 17, 0);
+    put_uint16(record + 19, 0);
+    record[21] = 0;
+#endif
+    put_uint16(record + 22, 0);
+
+    send(TELEMETRY_TRACK_END_SIZE);
+}
+
+void TelemetryEncoder::write_line_crossing(const TrackedBlob& blob, int line, int crossing) {
+    uint8_t* record = record_buffer;
+
+    record[0] = TELEMETRY_LINE_CROSSING;
+    put_uint16(record + 1, blob.id);
+    record[3] = line;
+    record[4] = crossing;
+
+    send(TELEMETRY_LINE_CROSSING_SIZE);
+}
+
+void TelemetryEncoder::write_movements(const long movements[NUM_DIRECTION_CATEGORIES], int num_blobs) {
+    uint8_t* record = record_buffer;
+
+    record[0] = TELEMETRY_MOVEMENTS;
+    for (int i = 0; i < NUM_DIRECTION_CATEGORIES; i++) {
+        put_uint32(record + 1 + 4 * i, movements[i]);
+    }
+    record[21] = num_blobs;
+
+    send(TELEMETRY_MOVEMENTS_SIZE);
+}
+
+void TelemetryEncoder::write_ambient(float temperature) {
+    uint8_t* record = record_buffer;
+    float scaled = constrain(temperature * 100, -32768.0f, 32767.0f);
+
+    record[0] = TELEMETRY_AMBIENT;
+    put_uint16(record + 1, int16_t(scaled < 0 ? scaled - 0.5f : scaled + 0.5f));
+
+    send(TELEMETRY_AMBIENT_SIZE);
+}
+
+void TelemetryEncoder::write_frame(const float values[FRAME_HEIGHT][FRAME_WIDTH], unsigned long sequence) {
+    record_buffer[0] = TELEMETRY_FRAME;
+    encode_frame_binary(values, VIEW_LIVE, sequence, record_buffer + 1);
+
+    send(TELEMETRY_FRAME_SIZE);
+}
+
+void TelemetryEncoder::send(size_t length) {
+    /**
+    * Add the CRC to a record, then frame and send it.
+    * @param length Length of the record in record_buffer
+    */
+    put_uint16(record_buffer + length, telemetry_crc16(record_buffer, length));
+
+    size_t encoded_length = 0;
+    encoded_buffer[encoded_length++] = 0;
+    encoded_length += cobs_encode(record_buffer, length + TELEMETRY_CRC_SIZE, encoded_buffer + encoded_length);
+    encoded_buffer[encoded_length++] = 0;
+
+    (*sink)(context, encoded_buffer, encoded_length);
+    num_records++;
+    num_bytes += encoded_length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Decoder
+
+TelemetryDecoder::TelemetryDecoder() {
+    chunk = buffer;
+    chunk_length = 0;
+    num_records = 0;
+    num_other_chunks = 0;
+    length = 0;
+    overflowed = false;
+    record_length = 0;
+}
+
+int TelemetryDecoder::feed(uint8_t byte) {
+    /**
+    * Add the next byte of the stream.
+    * @return What, if anything, the byte completed, from telemetry_chunks
+    */
+    if (byte != 0) {
+        if (length < sizeof(buffer)) {
+            buffer[length++] = byte;
+        } else {
+            overflowed = true;
+        }
+        return TELEMETRY_CHUNK_NONE;
+    }
+
+    // Records are sent between two delimiters, so empty chunks are expected
+    if (length == 0) {
+        return TELEMETRY_CHUNK_NONE;
+    }
+
+    chunk_length = length;
+    length = 0;
+
+    int decoded_length = overflowed ? -1 : cobs_decode(buffer, chunk_length, record, sizeof(record));
+    overflowed = false;
+
+    if (decoded_length > TELEMETRY_CRC_SIZE &&
+        telemetry_crc16(record, decoded_length - TELEMETRY_CRC_SIZE) ==
+            get_uint16(record + decoded_length - TELEMETRY_CRC_SIZE)) {
+        record_length = decoded_length - TELEMETRY_CRC_SIZE;
+        num_records++;
+        return TELEMETRY_CHUNK_RECORD;
+    }
+
+    num_other_chunks++;
+    return TELEMETRY_CHUNK_OTHER;
+}
+
+bool TelemetryDecoder::get_record(TelemetryRecord& decoded) {
+    /**
+    * Unpack the record that feed() last completed.
+    * @return False if the record is of an unknown type or the wrong length
+    */
+    if (record_length == 0) {
+        return false;
+    }
+
+    decoded.type = record[0];
+
+    switch (decoded.type) {
+        case TELEMETRY_TRACK_START:
+            if (record_length != TELEMETRY_TRACK_START_SIZE) {
+                return false;
+            }
+            decoded.track_id = get_uint16(record + 1);
+            decoded.temperature = int16_t(get_uint16(record + 3));
+            decoded.size = record[5];
+            decoded.width = record[6];
+            decoded.height = record[7];
+            decoded.start_position[X] = record[8];
+            decoded.start_position[Y] = record[9];
+            return true;
+
+        case TELEMETRY_TRACK_END:
+            if (record_length != TELEMETRY_TRACK_END_SIZE) {
+                return false;
+            }
+            decoded.track_id = get_uint16(record + 1);
+            decoded.temperature = int16_t(get_uint16(record + 3));
+            decoded.size = record[5];
+            decoded.width = record[6];
+            decoded.height = record[7];
+            decoded.max_dead_frames = record[8];
+            decoded.duration = get_uint32(record + 9);
+            decoded.frames = get_uint16(record + 13);
+            decoded.travel = int16_t(get_uint16(record + 15));
+            decoded.average_difference = int16_t(get_uint16(record + 17));
+            decoded.max_difference = int16_t(get_uint16(record + 19));
+            decoded.has_diagnostics = record[21] & TELEMETRY_HAS_DIAGNOSTICS;
+            return true;
+
+        case TELEMETRY_LINE_CROSSING:
+            if (record_length != TELEMETRY_LINE_CROSSING_SIZE) {
+                return false;
+            }
+            decoded.track_id = get_uint16(record + 1);
+            decoded.line = record[3];
+            decoded.crossing = record[4];
+            return true;
+
+        case TELEMETRY_MOVEMENTS:
+            if (record_length != TELEMETRY_MOVEMENTS_SIZE) {
+                return false;
+            }
+            for (int i = 0; i < NUM_DIRECTION_CATEGORIES; i++) {
+                decoded.movements[i] = get_uint32(record + 1 + 4 * i);
+            }
+            decoded.num_blobs = record[21];
+            return true;
+
+        case TELEMETRY_AMBIENT:
+            if (record_length != TELEMETRY_AMBIENT_SIZE) {
+                return false;
+            }
+            decoded.temperature = int16_t(get_uint16(record + 1));
+            return true;
+
+        case TELEMETRY_FRAME:
+            if (record_length != TELEMETRY_FRAME_SIZE || record[1] != FRAME_EXPORT_VERSION ||
+                record[3] != FRAME_WIDTH || record[4] != FRAME_HEIGHT) {
+                return false;
+            }
+            decoded.frame = record + 1;
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,220 @@
+#ifndef SERIAL_TELEMETRY_H
+#define SERIAL_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "FrameExport.h"
+#include "ThermalTracker.h"
+
+/*
+ * Binary telemetry records for the serial port, in place of the "#{json}$" log packets.
+ *
+ * Each record is sent as 0x00, then the COBS encoding of the record and its CRC, then 0x00. COBS leaves no zero
+ * bytes inside the record, so a reader can always find the next record, and the leading zero keeps any log text
+ * printed in between out of it. The CRC is CRC-16/CCITT-FALSE over the record, sent little-endian.
+ *
+ * Records (little-endian) start with a uint8 type from telemetry_record_types:
+ *
+ *   TELEMETRY_TRACK_START (12 bytes)
+ *     1  uint16  track id
+ *     3  int16   average temperature, in hundredths of a °C, truncated
+ *     5  uint8   size, in pixels
+ *     6  uint8   width, in pixels
+ *     7  uint8   height, in pixels
+ *     8  uint8   start position in X, in tenths of a pixel
+ *     9  uint8   start position in Y, in tenths of a pixel
+ *    10  uint16  reserved, 0
+ *
+ *   TELEMETRY_TRACK_END (24 bytes)
+ *     1  uint16  track id
+ *     3  int16   average temperature, in hundredths of a °C, truncated
+ *     5  uint8   largest size, in pixels
+ *     6  uint8   largest width, in pixels
+ *     7  uint8   largest height, in pixels
+ *     8  uint8   most frames missing at once
+ *     9  uint32  duration, in ms
+ *    13  uint16  frames the track was updated in
+ *    15  int16   travel in X, in hundredths of a pixel, truncated
+ *    17  int16   average match difference, or 0 without tracking diagnostics
+ *    19  int16   largest match difference, or 0 without tracking diagnostics
+ *    21  uint8   TELEMETRY_HAS_DIAGNOSTICS if the match differences were kept
+ *    22  uint16  reserved, 0
+ *
+ *   TELEMETRY_LINE_CROSSING (5 bytes)
+ *     1  uint16  track id
+ *     3  uint8   counting line
+ *     4  uint8   crossing, from line_crossings
+ *
+ *   TELEMETRY_MOVEMENTS (22 bytes)
+ *     1  uint32  movements, indexed by directions (LEFT to NO_DIRECTION)
+ *    21  uint8   blobs in the last frame
+ *
+ *   TELEMETRY_AMBIENT (3 bytes)
+ *     1  int16   sensor ambient temperature, in hundredths of a °C
+ *
+ *   TELEMETRY_FRAME (1 + FRAME_EXPORT_BINARY_SIZE bytes)
+ *     1          the live frame in the FrameExport binary layout
+ */
+
+enum telemetry_record_types {
+    TELEMETRY_TRACK_START = 1,
+    TELEMETRY_TRACK_END = 2,
+    TELEMETRY_LINE_CROSSING = 3,
+    TELEMETRY_MOVEMENTS = 4,
+    TELEMETRY_AMBIENT = 5,
+    TELEMETRY_FRAME = 6,
+};
+
+const int TELEMETRY_TRACK_START_SIZE = 12;
+const int TELEMETRY_TRACK_END_SIZE = 24;
+const int TELEMETRY_LINE_CROSSING_SIZE = 5;
+const int TELEMETRY_MOVEMENTS_SIZE = 22;
+const int TELEMETRY_AMBIENT_SIZE = 3;
+const int TELEMETRY_FRAME_SIZE = 1 + FRAME_EXPORT_BINARY_SIZE;
+const int TELEMETRY_MAX_RECORD_SIZE = TELEMETRY_FRAME_SIZE;
+const int TELEMETRY_CRC_SIZE = 2;
+const uint8_t TELEMETRY_HAS_DIAGNOSTICS = 1;
+
+/** Largest record on the wire: both delimiters, and one COBS code byte per 254 bytes */
+const int TELEMETRY_MAX_ENCODED_SIZE =
+    2 + 1 + TELEMETRY_MAX_RECORD_SIZE + TELEMETRY_CRC_SIZE + (TELEMETRY_MAX_RECORD_SIZE + TELEMETRY_CRC_SIZE) / 254;
+
+/**
+* Destination for encoded records, such as the serial port.
+* @param context Pointer given to the TelemetryEncoder
+* @param data Bytes to send
+* @param length Number of bytes to send
+* @return Number of bytes sent
+*/
+typedef size_t (*telemetry_sink)(void* context, const uint8_t* data, size_t length);
+
+/**
+* Calculate the CRC-16/CCITT-FALSE of some data.
+*/
+uint16_t telemetry_crc16(const uint8_t* data, size_t length);
+
+/**
+* COBS-encode some data. The output holds no zero bytes and is at most length + length / 254 + 1 bytes long.
+* @return Number of bytes written
+*/
+size_t cobs_encode(const uint8_t* data, size_t length, uint8_t* output);
+
+/**
+* Decode COBS-encoded data, without its delimiter.
+* @param capacity Size of the output buffer
+* @return Number of bytes decoded, or -1 if the data is not valid COBS or does not fit
+*/
+int cobs_decode(const uint8_t* data, size_t length, uint8_t* output, size_t capacity);
+
+/**
+* Sends telemetry records to a sink, one write per record.
+*/
+class TelemetryEncoder {
+   public:
+    /**
+    * @param sink Function the records are written with
+    * @param context Pointer passed to the sink, e.g. the serial port
+    */
+    TelemetryEncoder(telemetry_sink sink, void* context);
+
+    void write_track_start(const TrackedBlob& blob);
+    void write_track_end(const TrackedBlob& blob);
+    void write_line_crossing(const TrackedBlob& blob, int line, int crossing);
+
+    /**
+    * @param movements Movements, indexed by directions
+    * @param num_blobs Blobs in the last frame
+    */
+    void write_movements(const long movements[NUM_DIRECTION_CATEGORIES], int num_blobs);
+
+    void write_ambient(float temperature);
+
+    /**
+    * @param values Frame of FRAME_HEIGHT x FRAME_WIDTH temperatures
+    * @param sequence Frame sequence number
+    */
+    void write_frame(const float values[FRAME_HEIGHT][FRAME_WIDTH], unsigned long sequence);
+
+    unsigned long num_records;
+    unsigned long num_bytes; /**< Sent, framing included */
+
+   private:
+    /**
+    * Add the CRC to a record, then frame and send it.
+    * @param length Length of the record in record_buffer
+    */
+    void send(size_t length);
+
+    telemetry_sink sink;
+    void* context;
+    uint8_t record_buffer[TELEMETRY_MAX_RECORD_SIZE + TELEMETRY_CRC_SIZE];
+    uint8_t encoded_buffer[TELEMETRY_MAX_ENCODED_SIZE];
+};
+
+/**
+* A record read back from the wire. Only the fields of its type are filled in.
+*/
+struct TelemetryRecord {
+    uint8_t type;
+    uint16_t track_id;
+    int16_t temperature; /**< Hundredths of a °C */
+    uint8_t size;
+    uint8_t width;
+    uint8_t height;
+    uint8_t start_position[2]; /**< Tenths of a pixel */
+    uint8_t max_dead_frames;
+    uint32_t duration;
+    uint16_t frames;
+    int16_t travel;
+    int16_t average_difference;
+    int16_t max_difference;
+    bool has_diagnostics;
+    uint8_t line;
+    uint8_t crossing;
+    uint32_t movements[NUM_DIRECTION_CATEGORIES];
+    uint8_t num_blobs;
+    const uint8_t* frame; /**< FrameExport binary layout, pointing into the decoded record */
+};
+
+enum telemetry_chunks {
+    TELEMETRY_CHUNK_NONE,   /**< Nothing complete yet */
+    TELEMETRY_CHUNK_RECORD, /**< A record that passed its CRC */
+    TELEMETRY_CHUNK_OTHER,  /**< Anything else between delimiters, such as log text or a damaged record */
+};
+
+const int TELEMETRY_DECODER_CHUNK_SIZE = 512;
+
+/**
+* Splits a byte stream into records.
+*/
+class TelemetryDecoder {
+   public:
+    TelemetryDecoder();
+
+    /**
+    * Add the next byte of the stream.
+    * @return What, if anything, the byte completed, from telemetry_chunks
+    */
+    int feed(uint8_t byte);
+
+    /**
+    * Unpack the record that feed() last completed.
+    * @return False if the record is of an unknown type or the wrong length
+    */
+    bool get_record(TelemetryRecord& record);
+
+    const uint8_t* chunk; /**< Bytes between the delimiters, for TELEMETRY_CHUNK_OTHER */
+    size_t chunk_length;
+
+    unsigned long num_records;
+    unsigned long num_other_chunks;
+
+   private:
+    uint8_t buffer[TELEMETRY_DECODER_CHUNK_SIZE];
+    size_t length;
+    bool overflowed;
+    uint8_t record[TELEMETRY_DECODER_CHUNK_SIZE];
+    size_t record_length;
+};
+
+#endif
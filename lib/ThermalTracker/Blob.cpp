@@ -45,9 +45,17 @@ void Blob::add_pixel(Pixel pixel) {
     *   - Pixel objects are not actually stored. The blob just absorbs its information (as blobs do).
     */
 
-    int pixel_x = pixel.get_x();
-    int pixel_y = pixel.get_y();
-    float pixel_temp = pixel.get_temperature();
+    add_pixel(pixel.get_x(), pixel.get_y(), pixel.get_temperature());
+}
+
+void Blob::add_pixel(int pixel_x, int pixel_y, float pixel_temp) {
+    /**
+    * Add a new pixel to the blob by its location and temperature.
+    * Same as add_pixel(Pixel), without needing a Pixel object.
+    * @param x Column location of the pixel
+    * @param y Row location of the pixel
+    * @param temperature Temperature of the pixel in deg C
+    */
     num_pixels++;
 
     average_temperature = (average_temperature * (num_pixels - 1) + pixel_temp) / float(num_pixels);
@@ -171,6 +179,6 @@ void Blob::recalculate_centroid(float pixel_x, float pixel_y) {
     total_x += pixel_x;
     total_y += pixel_y;
 
-    centroid[X] = total_x / num_pixels;
-    centroid[Y] = total_y / num_pixels;
+    centroid[X] = float(total_x) / num_pixels;
+    centroid[Y] = float(total_y) / num_pixels;
 }
@@ -1,9 +1,21 @@
 #ifndef BLOB_H
 #define BLOB_H
 
+#include "Fixed16.h"
 #include "Pixel.h"
 
-const static char* BLOB_VERSION = "20170606";
+const static char* const BLOB_VERSION = "20170606";
+
+// Define TRACKED_BLOB_COMPACT (e.g. in platformio.ini build_flags) to store blobs and tracked blobs with fixed-point
+// positions and byte-sized counts. Also turns the tracking diagnostics and the Kalman predictor state off by default
+// (see TrackedBlob.h); together they cut a TrackedBlob to under half its size.
+#ifdef TRACKED_BLOB_COMPACT
+typedef Fixed16 blob_position_t; /**< Fractional pixel positions */
+typedef uint8_t blob_size_t;     /**< Pixel coordinates, sizes and small counts */
+#else
+typedef float blob_position_t;
+typedef int blob_size_t;
+#endif
 
 class Blob {
    public:
@@ -31,6 +43,15 @@ class Blob {
     */
     void add_pixel(Pixel);
 
+    /**
+    * Add a new pixel to the blob by its location and temperature.
+    * Same as add_pixel(Pixel), without needing a Pixel object.
+    * @param x Column location of the pixel
+    * @param y Row location of the pixel
+    * @param temperature Temperature of the pixel in deg C
+    */
+    void add_pixel(int x, int y, float temperature);
+
     /**
     * Copy the information of another blob.
     * All previous information in the blob is overwritten.
@@ -69,14 +90,14 @@ class Blob {
     */
     bool is_assigned();
 
-    int min[2];
-    int max[2];
-    float centroid[2];
+    blob_size_t min[2];
+    blob_size_t max[2];
+    blob_position_t centroid[2];
     float aspect_ratio;
     float average_temperature;
-    int width;
-    int height;
-    int num_pixels;
+    blob_size_t width;
+    blob_size_t height;
+    blob_size_t num_pixels;
 
    private:
     /**
@@ -96,8 +117,8 @@ class Blob {
     */
     void recalculate_bounds(int x, int y);
 
-    float total_x;
-    float total_y;
+    uint16_t total_x;
+    uint16_t total_y;
     bool _is_assigned;
 };
 
@@ -0,0 +1,38 @@
+#ifndef FIXED16_H
+#define FIXED16_H
+
+#include <stdint.h>
+
+const float FIXED16_SCALE = 256.0; /**< 8 fractional bits; range +/-127.99 */
+
+/**
+* Signed 8.8 fixed-point number.
+* Used for blob positions in the compact layout (see TRACKED_BLOB_COMPACT). It converts implicitly to and from
+* float, so it can stand in for the float members it replaces without changing the code that uses them.
+*/
+class Fixed16 {
+   public:
+    Fixed16() : raw(0) {}
+    Fixed16(float value) : raw(from_float(value)) {}
+
+    operator float() const { return raw / FIXED16_SCALE; }
+
+    Fixed16& operator+=(float value) {
+        raw = from_float(float(*this) + value);
+        return *this;
+    }
+
+    Fixed16& operator-=(float value) {
+        raw = from_float(float(*this) - value);
+        return *this;
+    }
+
+    int16_t raw;
+
+   private:
+    static int16_t from_float(float value) {
+        return (int16_t)(value * FIXED16_SCALE + (value >= 0 ? 0.5f : -0.5f));
+    }
+};
+
+#endif
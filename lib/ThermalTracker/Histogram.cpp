@@ -0,0 +1,161 @@
+#include "Histogram.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+
+Histogram::Histogram() { reset(); }
+
+////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+
+void Histogram::reset() {
+    /**
+    * Empty the histogram.
+    */
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+        counts[i] = 0;
+    }
+    total_count = 0;
+    num_values = 0;
+    sum = 0;
+    min = 0;
+    max = 0;
+}
+
+void Histogram::add(uint32_t value) {
+    /**
+    * Add a value.
+    * @param value Value to add
+    */
+    int bucket = get_bucket(value);
+
+    if (counts[bucket] == HISTOGRAM_MAX_BUCKET_COUNT) {
+        halve();
+    }
+
+    if (total_count == 0 || value < min) {
+        min = value;
+    }
+    if (total_count == 0 || value > max) {
+        max = value;
+    }
+
+    counts[bucket]++;
+    num_values++;
+    sum += value;
+    total_count++;
+}
+
+uint32_t Histogram::get_count() { return num_values; }
+
+uint32_t Histogram::get_min() { return min; }
+
+uint32_t Histogram::get_max() { return max; }
+
+float Histogram::get_mean() {
+    /**
+    * Get the mean of the values the buckets hold.
+    * @return Mean value, or 0 if the histogram is empty
+    */
+    if (num_values == 0) {
+        return 0;
+    }
+
+    return float(sum) / num_values;
+}
+
+uint32_t Histogram::get_percentile(float fraction) {
+    /**
+    * Get the value that a fraction of the values held are at or below.
+    * Reported as the top of the bucket it falls in, so it is never under the true percentile.
+    * @param fraction Fraction of the values, 0 to 1 (e.g. 0.99 for the 99th percentile)
+    * @return Percentile value, or 0 if the histogram is empty
+    */
+    if (num_values == 0) {
+        return 0;
+    }
+
+    uint32_t rank = uint32_t(fraction * num_values + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > num_values) {
+        rank = num_values;
+    }
+
+    uint32_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint32_t top = get_bucket_max(i);
+            if (top > max) {
+                return max;
+            }
+            return top < min ? min : top;
+        }
+    }
+
+    return max;
+}
+
+int Histogram::get_bucket(uint32_t value) {
+    /**
+    * Get the bucket a value is counted in.
+    * @param value Value to find the bucket of
+    * @return Bucket index, 0 to HISTOGRAM_NUM_BUCKETS - 1
+    */
+    if (value < (uint32_t)HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+
+    // The highest set bit picks the power of two, the bits just below it pick the bucket within it
+    int top_bit = 31 - __builtin_clz(value);
+    int shift = top_bit - HISTOGRAM_SUB_BUCKET_BITS;
+    int sub_bucket = (value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+uint32_t Histogram::get_bucket_min(int bucket) {
+    /**
+    * Get the smallest value counted in a bucket.
+    * @param bucket Bucket index
+    */
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    uint32_t sub_bucket = bucket % HISTOGRAM_SUB_BUCKETS;
+
+    return (HISTOGRAM_SUB_BUCKETS + sub_bucket) << shift;
+}
+
+uint32_t Histogram::get_bucket_max(int bucket) {
+    /**
+    * Get the largest value counted in a bucket.
+    * @param bucket Bucket index
+    */
+    if (bucket >= HISTOGRAM_NUM_BUCKETS - 1) {
+        return 0xFFFFFFFF;
+    }
+
+    return get_bucket_min(bucket + 1) - 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+
+void Histogram::halve() {
+    /**
+    * Halve every bucket, keeping the buckets that held anything above zero.
+    */
+    uint32_t old_num_values = num_values;
+    num_values = 0;
+
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+        counts[i] = (counts[i] + 1) / 2;
+        num_values += counts[i];
+    }
+
+    sum = uint64_t(double(sum) * num_values / old_num_values);
+}
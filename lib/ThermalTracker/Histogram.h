@@ -0,0 +1,98 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+const int HISTOGRAM_SUB_BUCKET_BITS = 2; /**< 4 buckets per power of two, so a bucket is at most 25% wide */
+const int HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+const int HISTOGRAM_NUM_BUCKETS = (32 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+const uint16_t HISTOGRAM_MAX_BUCKET_COUNT = 0xFFFF;
+
+/**
+* Log-scale histogram of 32-bit values, such as durations in timer ticks.
+* Values below HISTOGRAM_SUB_BUCKETS get a bucket each; above that every power of two is split into
+* HISTOGRAM_SUB_BUCKETS buckets. Adding a value is O(1) and nothing is allocated. When a bucket fills up every bucket
+* is halved, so the distribution (and the mean and percentiles read from it) follows the most recent values. The
+* minimum and maximum are kept from the last reset.
+*/
+class Histogram {
+   public:
+    Histogram();
+
+    /**
+    * Empty the histogram.
+    */
+    void reset();
+
+    /**
+    * Add a value.
+    * @param value Value to add
+    */
+    void add(uint32_t value);
+
+    /**
+    * Get the number of values the buckets currently hold (after any halving).
+    */
+    uint32_t get_count();
+
+    /**
+    * Get the smallest value added since the last reset.
+    * @return Smallest value, or 0 if the histogram is empty
+    */
+    uint32_t get_min();
+
+    /**
+    * Get the largest value added since the last reset.
+    * @return Largest value, or 0 if the histogram is empty
+    */
+    uint32_t get_max();
+
+    /**
+    * Get the mean of the values the buckets hold.
+    * @return Mean value, or 0 if the histogram is empty
+    */
+    float get_mean();
+
+    /**
+    * Get the value that a fraction of the values held are at or below.
+    * Reported as the top of the bucket it falls in, so it is never under the true percentile.
+    * @param fraction Fraction of the values, 0 to 1 (e.g. 0.99 for the 99th percentile)
+    * @return Percentile value, or 0 if the histogram is empty
+    */
+    uint32_t get_percentile(float fraction);
+
+    /**
+    * Get the bucket a value is counted in.
+    * @param value Value to find the bucket of
+    * @return Bucket index, 0 to HISTOGRAM_NUM_BUCKETS - 1
+    */
+    static int get_bucket(uint32_t value);
+
+    /**
+    * Get the smallest value counted in a bucket.
+    * @param bucket Bucket index
+    */
+    static uint32_t get_bucket_min(int bucket);
+
+    /**
+    * Get the largest value counted in a bucket.
+    * @param bucket Bucket index
+    */
+    static uint32_t get_bucket_max(int bucket);
+
+    uint16_t counts[HISTOGRAM_NUM_BUCKETS];
+    unsigned long total_count; /**< Values added since the last reset, including those halved away */
+
+   private:
+    /**
+    * Halve every bucket, keeping the buckets that held anything above zero.
+    */
+    void halve();
+
+    uint32_t num_values; /**< Values the buckets hold */
+    uint64_t sum;        /**< Sum of the values the buckets hold, scaled with them when they are halved */
+    uint32_t min;
+    uint32_t max;
+};
+
+#endif
@@ -81,7 +81,7 @@ bool Pixel::is_adjacent(Pixel other_pixel) {
     * AN: Pixels are not adjacent if they occupy the same location.
     */
 
-    if (adjacency_fuzz == NULL) {
+    if (adjacency_fuzz == 0) {
         adjacency_fuzz = 0;
     }
 
@@ -7,7 +7,7 @@
 #include "WProgram.h"
 #endif
 
-const static char* PIXEL_VERSION = "20170613";
+const static char* const PIXEL_VERSION = "20170613";
 
 class Pixel {
    public:
@@ -3,13 +3,67 @@
 ////////////////////////////////////////////////////////////////////////////////
 // Constructor
 
-ThermalTracker::ThermalTracker() {
+ThermalTracker::ThermalTracker(int _blob_capacity) {
     /**
     * Constructor - Make a new thermal tracker object with the default configuration
     * The thermal tracker uses a MLX90621 thermopile array to observe moving objects in its view.
+    * @param blob_capacity Most blobs detected in a frame, and most blobs tracked at once. Storage for them is allocated
+    * here, once; at most NUM_PIXELS_PER_FRAME.
     */
 
+    // Every pixel could be its own blob, so there is no point going past one blob per pixel
+    blob_capacity = constrain(_blob_capacity, 1, NUM_PIXELS_PER_FRAME);
+    tracked_blobs = new TrackedBlob[blob_capacity];
+#ifdef ARDUINO_ARCH_ESP8266
+    published_tracks = tracked_blobs;
+#else
+    published_tracks = new TrackedBlob[blob_capacity];
+#endif
+    num_published_slots = 0;
+    frame_blobs = new Blob[blob_capacity];
+    match_candidates = new MatchCandidate[blob_capacity * MAX_MATCH_CANDIDATES];
+    track_order = new uint8_t[blob_capacity];
+    track_matches = new uint8_t[blob_capacity];
+    blob_matches = new uint8_t[blob_capacity];
+    track_groups = new uint8_t[blob_capacity];
+    track_partners = new uint8_t[blob_capacity];
+    memset(track_partners, NO_MATCH, blob_capacity);
+    num_blob_overflows = 0;
+    num_dropped_pixels = 0;
+    num_track_overflows = 0;
+    num_track_merges = 0;
+    num_track_splits = 0;
+    track_sequence = 0;
+
     num_background_frames = 0;
+    num_unchanged_frames = 0;
+    num_last_blobs = 0;
+    next_track_id = 0;
+    movement_changed_since_last_check = false;
+    tracking_start_callback = NULL;
+    tracking_end_callback = NULL;
+    line_crossing_callback = NULL;
+    num_counting_lines = 0;
+    event_sink = NULL;
+    event_frame = 0;
+    reset_movements();
+
+    memset(frame_buffers, 0, sizeof(frame_buffers));
+    memset(average_buffers, 0, sizeof(average_buffers));
+    memset(variance_buffers, 0, sizeof(variance_buffers));
+    back_frame = 0;
+    back_background = 1;
+    frame = frame_buffers[1];
+    pixel_averages = average_buffers[0];
+    pixel_variance = variance_buffers[0];
+    frame_sequence = 0;
+    reset_frame_counters();
+    stack_high_water = 0;
+    stack_paint_exhausted = false;
+    stack_base = 0;
+    stack_painted = 0;
+    current_frame = frame_buffers[back_frame];
+
     min_blob_size = DEFAULT_MIN_BLOB_SIZE;
     running_average_size = DEFAULT_RUNNING_AVERAGE_SIZE;
     minimum_travel_threshold = DEFAULT_MIN_TRAVEL_THRESHOLD;
@@ -17,16 +71,32 @@ ThermalTracker::ThermalTracker() {
     minimum_temperature_differential = DEFAULT_MIN_TEMPERATURE_DIFFERENTIAL;
     active_pixel_variance_scalar = DEFAULT_ACTIVE_PIXEL_VARIANCE_SCALAR;
     max_dead_frames = DEFAULT_MAX_DEAD_FRAMES;
+    max_merged_frames = DEFAULT_MAX_MERGED_FRAMES;
 
     TrackedBlob::position_penalty = DEFAULT_POSITION_PENALTY;
     TrackedBlob::area_penalty = DEFAULT_AREA_PENALTY;
     TrackedBlob::aspect_ratio_penalty = DEFAULT_ASPECT_RATIO_PENALTY;
     TrackedBlob::direction_penalty = DEFAULT_DIRECTION_PENALTY;
     TrackedBlob::temperature_penalty = DEFAULT_TEMPERATURE_PENALTY;
+    TrackedBlob::set_predictor(DEFAULT_PREDICTOR, DEFAULT_PROCESS_NOISE, DEFAULT_MEASUREMENT_NOISE);
 
     Pixel::adjacency_fuzz = DEFAULT_ADJACENCY_FUZZ;
 }
 
+ThermalTracker::~ThermalTracker() {
+#ifndef ARDUINO_ARCH_ESP8266
+    delete[] published_tracks;
+#endif
+    delete[] tracked_blobs;
+    delete[] frame_blobs;
+    delete[] match_candidates;
+    delete[] track_order;
+    delete[] track_matches;
+    delete[] blob_matches;
+    delete[] track_groups;
+    delete[] track_partners;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Initialisation
 
@@ -38,44 +108,291 @@ void ThermalTracker::update(float frame_buffer[FRAME_HEIGHT][FRAME_WIDTH]) {
     * @float frame_buffer A 2D array containing the pixel temperatures from the thermopile sensor.
     */
 
+    STAGE_TIMER_START(load_timer);
     load_frame(frame_buffer);
+    STAGE_TIMER_STOP(load_timer, STAGE_LOAD);
+
+    update();
+}
+
+void ThermalTracker::update() {
+    /**
+    * Process the frame that has been written into the back buffer, then publish it as the current frame.
+    * Lets the sensor driver hand frames over without the copy made by update(frame_buffer).
+    */
+    char stack_marker;
+    stack_base = (uintptr_t)&stack_marker;
+    paint_stack();
+
+    current_frame = frame_buffers[back_frame];
+    process_current_frame();
+    publish_frame();
+
+    measure_stack();
+}
+
+float (*ThermalTracker::get_back_buffer())[FRAME_WIDTH] {
+    /**
+    * Get the buffer the next frame should be written into.
+    * The buffer belongs to the tracker and is swapped with the published frame on the next update().
+    * @return Back frame buffer, FRAME_HEIGHT x FRAME_WIDTH
+    */
+    return frame_buffers[back_frame];
+}
+
+void ThermalTracker::update_batch(const float* frames, size_t num_frames, EventSink& events) {
+    /**
+    * Process a contiguous block of recorded frames.
+    * Frames are read in place rather than copied, and tracking events are appended to the event sink instead of being
+    * passed to the tracking callbacks. The last frame of the block is copied into the back buffer and published.
+    * @param frames num_frames frames of FRAME_HEIGHT x FRAME_WIDTH pixels, stored row by row
+    * @param num_frames Number of frames in the block
+    * @param events Event sink to record the tracking start and end events in
+    */
+    const int frame_size = FRAME_HEIGHT * FRAME_WIDTH;
+    char stack_marker;
+    stack_base = (uintptr_t)&stack_marker;
+    paint_stack();
+
+    event_sink = &events;
+    for (size_t i = 0; i < num_frames; i++) {
+        current_frame = (const float(*)[FRAME_WIDTH])(frames + i * frame_size);
+        event_frame = i;
+        process_current_frame();
+    }
+    event_sink = NULL;
+    measure_stack();
+
+    if (num_frames > 0) {
+        memcpy(frame_buffers[back_frame], frames + (num_frames - 1) * frame_size, sizeof(frame_buffers[back_frame]));
+        publish_frame();
+    }
+    current_frame = frame_buffers[back_frame];
+}
+
+void ThermalTracker::publish_frame() {
+    /**
+    * Make the back frame buffer the published frame.
+    */
+    frame = frame_buffers[back_frame];
+    back_frame ^= 1;
+    frame_sequence++;
+}
+
+void ThermalTracker::publish_background() {
+    /**
+    * Make the back background buffers the published background.
+    */
+    pixel_averages = average_buffers[back_background];
+    pixel_variance = variance_buffers[back_background];
+    back_background ^= 1;
+}
+
+void ThermalTracker::process_current_frame() {
+    /**
+    * Run the background and tracking stages on the frame pointed to by current_frame.
+    */
+
+    STAGE_TIMER_START(frame_timer);
 
     // Has the background been built first? If not; build it!
     if (!is_background_finished()) {
+        STAGE_TIMER_START(background_timer);
         build_background();
+        STAGE_TIMER_STOP(background_timer, STAGE_BACKGROUND);
     }
 
     // Background already built; go track all the things!
     else {
-        bool add_frame_to_average = true;
-        Blob blobs[MAX_BLOBS];
+        unsigned long start_time = micros();
+        STAGE_TIMER_START(scan_timer);
+        int num_active_pixels = scan_current_frame(scratch.active_indexes);
+        STAGE_TIMER_STOP(scan_timer, STAGE_SCAN);
+
+        // Nothing in view and nothing left to track - there are no blobs to build, so the frame goes straight into
+        // the background. This is the state the sensor spends most of its day in.
+        if (num_active_pixels == 0 && !has_live_tracks()) {
+            num_unchanged_frames = 0;
+            num_last_blobs = 0;
+            STAGE_TIMER_START(background_timer);
+            publish_background();
+            STAGE_TIMER_STOP(background_timer, STAGE_BACKGROUND);
+
+            num_idle_frames++;
+            idle_frame_micros += micros() - start_time;
+        }
+
+        else {
+            if (track_active_pixels(scratch.active_indexes, num_active_pixels, current_frame)) {
+                STAGE_TIMER_START(background_timer);
+                publish_background();
+                STAGE_TIMER_STOP(background_timer, STAGE_BACKGROUND);
+            }
+
+            num_active_frames++;
+            active_frame_micros += micros() - start_time;
+        }
+    }
+
+    STAGE_TIMER_STOP(frame_timer, STAGE_FRAME);
+}
 
-        get_blobs(blobs);
-        remove_small_blobs(blobs);
-        int num_blobs = get_num_blobs(blobs);
+int ThermalTracker::scan_current_frame(uint8_t active_indexes[]) {
+    /**
+    * Test every pixel of the current frame against the background and, in the same sweep, write the frame's rolling
+    * background update into the back background buffers. The update is only published if the frame turns out to
+    * belong in the background.
+    * @param active_indexes Array to pass the active pixel indexes (row * FRAME_WIDTH + column) into
+    * @return Number of active pixels
+    */
+    float(*averages)[FRAME_WIDTH] = average_buffers[back_background];
+    float(*variances)[FRAME_WIDTH] = variance_buffers[back_background];
+    int num_active = 0;
 
-        // Activity check - don't add frames to background when there is activity
-        // There is a limit to this though if the in-frame blobs stay the same for a certain amount of time (default 4
-        // seconds)
-        if (num_blobs > 0) {
-            add_frame_to_average = false;
+    for (int i = 0; i < FRAME_HEIGHT; i++) {
+        for (int j = 0; j < FRAME_WIDTH; j++) {
+            float temp = current_frame[i][j];
+            float average = pixel_averages[i][j];
+            float variance = pixel_variance[i][j];
 
-            num_unchanged_frames++;
+            float temperature_difference = absolute(average - temp);
 
-            if (num_unchanged_frames > UNCHANGED_FRAME_DELAY) {
-                add_frame_to_average = true;
+            if (temperature_difference > (variance * active_pixel_variance_scalar) &&
+                temperature_difference > minimum_temperature_differential) {
+                active_indexes[num_active++] = i * FRAME_WIDTH + j;
             }
-        } else {
-            num_unchanged_frames = 0;
+
+            // Same sums as add_current_frame_to_background
+            averages[i][j] = ((average * (running_average_size - 1)) + temp) / running_average_size;
+
+            float incremental_variance = absolute(temp - averages[i][j]);
+            variances[i][j] =
+                ((variance * (running_average_size - 1)) + incremental_variance) / running_average_size;
+        }
+    }
+
+    return num_active;
+}
+
+bool ThermalTracker::has_live_tracks() {
+    /**
+    * Determine if any blobs are still being tracked (including ones waiting out their dead frames).
+    * @return True if there is at least one active tracked blob
+    */
+    for (int i = 0; i < blob_capacity; i++) {
+        if (tracked_blobs[i].is_active()) {
+            return true;
         }
+    }
+
+    return false;
+}
+
+__attribute__((noinline)) void ThermalTracker::paint_stack() {
+    /**
+    * Fill the stack below the caller's frame with STACK_PAINT_PATTERN.
+    * The area is this function's own frame, so it is painted without writing below the stack pointer; it lies
+    * directly under update()'s frame, where everything update() calls will put theirs.
+    */
+#if TRACKER_STACK_PAINT_SIZE > 0
+    uint32_t area[TRACKER_STACK_PAINT_SIZE / 4];
+
+    // The barrier keeps the compiler from dropping the fill of an array that is never read
+    memset(area, STACK_PAINT_PATTERN, sizeof(area));
+    __asm__ __volatile__("" : : "r"(area) : "memory");
+    stack_painted = (uintptr_t)area;
+#endif
+}
+
+__attribute__((noinline)) void ThermalTracker::measure_stack() {
+    /**
+    * Find the deepest painted byte the update overwrote, and raise stack_high_water to match.
+    * The stack grows down, so the scan runs up from the bottom of the painted area to the first changed byte. This
+    * function's own small frame sits at the top of the area, well above anything deeper the update used.
+    */
+    if (stack_painted == 0) {
+        return;
+    }
+
+    // A word at a time, then down to the byte within the first changed word
+    const uint32_t painted_word = STACK_PAINT_PATTERN * 0x01010101u;
+    const volatile uint32_t* words = (const volatile uint32_t*)stack_painted;
+    int num_untouched_words = 0;
+    while (num_untouched_words < TRACKER_STACK_PAINT_SIZE / 4 && words[num_untouched_words] == painted_word) {
+        num_untouched_words++;
+    }
+
+    const volatile uint8_t* painted = (const volatile uint8_t*)stack_painted;
+    int num_untouched = num_untouched_words * 4;
+    while (num_untouched < TRACKER_STACK_PAINT_SIZE && painted[num_untouched] == STACK_PAINT_PATTERN) {
+        num_untouched++;
+    }
+
+    if (num_untouched == 0) {
+        stack_paint_exhausted = true;
+    }
+
+    unsigned int depth = stack_base - (stack_painted + num_untouched);
+    if (depth > stack_high_water) {
+        stack_high_water = depth;
+    }
+}
+
+void ThermalTracker::reset_frame_counters() {
+    /**
+    * Reset the idle and active frame counters and costs.
+    */
+    num_idle_frames = 0;
+    num_active_frames = 0;
+    idle_frame_micros = 0;
+    active_frame_micros = 0;
+}
+
+bool ThermalTracker::track_active_pixels(uint8_t active_indexes[], int num_active_pixels,
+                                         const float pixels[][FRAME_WIDTH]) {
+    /**
+    * Run the blob detection and inter-frame tracking stages on a set of active pixels.
+    * Background maintenance is left to the caller so the pixel tests and background update can be done elsewhere
+    * (e.g. for several sensors at once).
+    * @param active_indexes Indexes (row * FRAME_WIDTH + column) of the active pixels. Consumed while building blobs.
+    * @param num_active_pixels Number of active pixel indexes
+    * @param pixels Frame to read the active pixels' temperatures from
+    * @return True if the frame should be added to the running background
+    */
+    bool add_frame_to_average = true;
+    Blob* blobs = frame_blobs;
+
+    STAGE_TIMER_START(blobs_timer);
+    build_blobs(active_indexes, num_active_pixels, pixels, blobs);
+    STAGE_TIMER_STOP(blobs_timer, STAGE_BLOBS);
+
+    STAGE_TIMER_START(small_blobs_timer);
+    remove_small_blobs(blobs);
+    STAGE_TIMER_STOP(small_blobs_timer, STAGE_SMALL_BLOBS);
 
-        num_last_blobs = num_blobs;
-        track_blobs(blobs, tracked_blobs);
+    int num_blobs = get_num_blobs(blobs);
 
-        if (add_frame_to_average) {
-            add_current_frame_to_background();
+    // Activity check - don't add frames to background when there is activity
+    // There is a limit to this though if the in-frame blobs stay the same for a certain amount of time (default 4
+    // seconds)
+    if (num_blobs > 0) {
+        add_frame_to_average = false;
+
+        num_unchanged_frames++;
+
+        if (num_unchanged_frames > UNCHANGED_FRAME_DELAY) {
+            add_frame_to_average = true;
         }
+    } else {
+        num_unchanged_frames = 0;
     }
+
+    num_last_blobs = num_blobs;
+
+    track_blobs(blobs, tracked_blobs);
+    publish_tracks();
+
+    return add_frame_to_average;
 }
 
 bool ThermalTracker::is_background_finished() {
@@ -100,7 +417,7 @@ void ThermalTracker::load_frame(float frame_buffer[FRAME_HEIGHT][FRAME_WIDTH]) {
     */
     for (int i = 0; i < FRAME_HEIGHT; i++) {
         for (int j = 0; j < FRAME_WIDTH; j++) {
-            frame[i][j] = frame_buffer[i][j];
+            frame_buffers[back_frame][i][j] = frame_buffer[i][j];
         }
     }
 }
@@ -115,12 +432,14 @@ void ThermalTracker::build_background() {
     *       add_current_frame_to_background uses a running average and variance to operate whereas this function uses
     * a fixed population size.
     */
+    float(*averages)[FRAME_WIDTH] = average_buffers[back_background];
+    float(*variances)[FRAME_WIDTH] = variance_buffers[back_background];
 
     if (num_background_frames == 0) {
         for (int i = 0; i < FRAME_HEIGHT; i++) {
             for (int j = 0; j < FRAME_WIDTH; j++) {
-                pixel_averages[i][j] = frame[i][j];
-                pixel_variance[i][j] = 0;
+                averages[i][j] = current_frame[i][j];
+                variances[i][j] = 0;
             }
         }
     }
@@ -129,11 +448,11 @@ void ThermalTracker::build_background() {
         // Mean the frames together to form the background and calculate variance
         for (int i = 0; i < FRAME_HEIGHT; i++) {
             for (int j = 0; j < FRAME_WIDTH; j++) {
-                float temp = frame[i][j];
+                float temp = current_frame[i][j];
                 float last_average = pixel_averages[i][j];
 
-                pixel_averages[i][j] += (temp - last_average) / (num_background_frames + 1);
-                pixel_variance[i][j] += (temp - pixel_averages[i][j]) * (temp - last_average);
+                averages[i][j] = last_average + (temp - last_average) / (num_background_frames + 1);
+                variances[i][j] = pixel_variance[i][j] + (temp - averages[i][j]) * (temp - last_average);
             }
         }
     }
@@ -147,10 +466,12 @@ void ThermalTracker::build_background() {
         // Also: http://jonisalonen.com/2013/deriving-welfords-method-for-computing-variance/
         for (int i = 0; i < FRAME_HEIGHT; i++) {
             for (int j = 0; j < FRAME_WIDTH; j++) {
-                pixel_variance[i][j] = sqrtf(pixel_variance[i][j] / (num_background_frames - 1));
+                variances[i][j] = sqrtf(variances[i][j] / (num_background_frames - 1));
             }
         }
     }
+
+    publish_background();
 }
 
 void ThermalTracker::add_current_frame_to_background() {
@@ -162,19 +483,24 @@ void ThermalTracker::add_current_frame_to_background() {
     *       This results in the averages and variances to be inaccurate, but 'close enough' to function in this
     * implementation.
     */
+    float(*averages)[FRAME_WIDTH] = average_buffers[back_background];
+    float(*variances)[FRAME_WIDTH] = variance_buffers[back_background];
+
     for (int i = 0; i < FRAME_HEIGHT; i++) {
         for (int j = 0; j < FRAME_WIDTH; j++) {
-            float temp = frame[i][j];
+            float temp = current_frame[i][j];
 
             // Add the weighted average
-            pixel_averages[i][j] = ((pixel_averages[i][j] * (running_average_size - 1)) + temp) / running_average_size;
+            averages[i][j] = ((pixel_averages[i][j] * (running_average_size - 1)) + temp) / running_average_size;
 
             // Add the weighted variance
-            float incremental_variance = absolute(temp - pixel_averages[i][j]);
-            pixel_variance[i][j] =
+            float incremental_variance = absolute(temp - averages[i][j]);
+            variances[i][j] =
                 ((pixel_variance[i][j] * (running_average_size - 1)) + incremental_variance) / running_average_size;
         }
     }
+
+    publish_background();
 }
 
 void ThermalTracker::get_averages(float frame_buffer[FRAME_HEIGHT][FRAME_WIDTH]) {
@@ -224,7 +550,7 @@ float ThermalTracker::get_average_frame_temperature() {
 int ThermalTracker::get_blobs(Blob blobs[]) {
     /**
     * Search through the current frame to find pixel 'blobs' that appear in front of the background.
-    * @param blobs A Blob array to pass the detected blobs into.
+    * @param blobs A Blob array to pass the detected blobs into. Must hold get_blob_capacity() blobs.
     * @return Number of detected blobs
     *
     * Psuedo:
@@ -247,70 +573,87 @@ int ThermalTracker::get_blobs(Blob blobs[]) {
     * pixels, then are not operated on again
     */
 
-    Pixel active_pixels[FRAME_WIDTH * FRAME_HEIGHT];
+    // The scan's speculative background update only touches the back buffers, so it is safe to run here
+    int num_active_pixels = scan_current_frame(scratch.active_indexes);
+
+    return build_blobs(scratch.active_indexes, num_active_pixels, current_frame, blobs);
+}
+
+int ThermalTracker::build_blobs(uint8_t active_indexes[], int num_active_pixels, const float pixels[][FRAME_WIDTH],
+                                Blob blobs[]) {
+    /**
+    * Cluster a set of active pixels into blobs of adjacent pixels.
+    * See get_blobs for a description of the clustering. The sort queue lives in the tracker's scratch arena.
+    * Clustering stops once the blob capacity is reached; any pixels left over are counted as dropped.
+    * @param active_indexes Indexes (row * FRAME_WIDTH + column) of the active pixels to cluster. The array is
+    * reordered and consumed as pixels are assigned.
+    * @param num_active_pixels Number of active pixel indexes
+    * @param pixels Frame to read the active pixels' temperatures from
+    * @param blobs A Blob array to pass the detected blobs into. Must hold get_blob_capacity() blobs.
+    * @return Number of detected blobs
+    */
+    uint8_t* sort_queue = scratch.sort_queue;
+    const int reach = 1 + Pixel::adjacency_fuzz;
     int num_blobs = 0;
-    int vacant_index = FRAME_WIDTH * FRAME_HEIGHT + 1;
     clear_blobs(blobs);
 
-    int num_active_pixels = get_active_pixels(active_pixels);
-
     // Assign every active pixel to a blob
-    while ((num_active_pixels > 0) && (num_blobs < MAX_BLOBS)) {
+    while ((num_active_pixels > 0) && (num_blobs < blob_capacity)) {
         int num_queued_pixels = 0;
         int queue_index = 0;
-        vacant_index = 0;
-        Pixel sort_queue[FRAME_WIDTH * FRAME_HEIGHT];
-        sort_queue[num_queued_pixels++].set(active_pixels[vacant_index].get_x(), active_pixels[vacant_index].get_y(),
-                                            active_pixels[vacant_index].get_temperature());
-        bool first_pixel = true;
+
+        // The first active pixel seeds the blob, so it is already out of the active queue
+        sort_queue[num_queued_pixels++] = active_indexes[0];
+        int first_unsorted = 1;
 
         // Construct the current blob
         while (queue_index < num_queued_pixels) {
-            // Find adjacent active pixels in the queue
-            for (int i = 0; i < num_active_pixels; i++) {
-                if (first_pixel) {
-                    i++;
-                    first_pixel = false;
-                }
-
-                // If the pixel is adjacent to the current pixel, add it to the sort queue
-                if (sort_queue[queue_index].is_adjacent(active_pixels[i])) {
-                    sort_queue[num_queued_pixels++].set(active_pixels[i].get_x(), active_pixels[i].get_y(),
-                                                        active_pixels[i].get_temperature());
-                }
+            int x = sort_queue[queue_index] % FRAME_WIDTH;
+            int y = sort_queue[queue_index] / FRAME_WIDTH;
+            int vacant_index = 0;
 
-                else {
-                    if (vacant_index < i) {
-                        // Sort the pixel to the front of the queue
-                        active_pixels[vacant_index].set(active_pixels[i].get_x(), active_pixels[i].get_y(),
-                                                        active_pixels[i].get_temperature());
-                    }
-                    vacant_index++;
+            // Find adjacent active pixels in the queue
+            for (int i = first_unsorted; i < num_active_pixels; i++) {
+                int index = active_indexes[i];
+
+                // If the pixel is adjacent to the current pixel (same test as Pixel::is_adjacent), add it to the sort
+                // queue; otherwise sort it to the front of the active queue
+                if (abs(index % FRAME_WIDTH - x) <= reach && abs(index / FRAME_WIDTH - y) <= reach) {
+                    sort_queue[num_queued_pixels++] = index;
+                } else {
+                    active_indexes[vacant_index++] = index;
                 }
             }
 
             // Reset the number of active pixels in the queue
             // Note: This needs to be changed at the end of each search cycle; not during
             num_active_pixels = vacant_index;
-            vacant_index = 0;
+            first_unsorted = 0;
 
             // Searched finished; add the current pixel to the blob
-            blobs[num_blobs].add_pixel(sort_queue[queue_index++]);
+            blobs[num_blobs].add_pixel(x, y, pixels[y][x]);
+            queue_index++;
         }
 
         // Blob finished; add it to the current blobs and start on the next one
         num_blobs++;
     }
 
+    // Out of blobs before running out of pixels
+    if (num_active_pixels > 0) {
+        num_blob_overflows++;
+        num_dropped_pixels += num_active_pixels;
+    }
+
     return num_blobs;
 }
 
-void ThermalTracker::clear_blobs(Blob blobs[MAX_BLOBS]) {
+void ThermalTracker::clear_blobs(Blob blobs[]) {
     /**
     * Reset a list of blobs.
     * Useful for cleaning after inspecting a frame.
     */
-    for (int i = 0; i < MAX_BLOBS; i++) {
+    for (int i = 0; i < blob_capacity; i++) {
         blobs[i].clear();
     }
 }
@@ -325,7 +668,7 @@ int ThermalTracker::get_active_pixels(Pixel pixel_buffer[]) {
 
     for (int i = 0; i < FRAME_HEIGHT; i++) {
         for (int j = 0; j < FRAME_WIDTH; j++) {
-            float temp = frame[i][j];
+            float temp = current_frame[i][j];
             float average = pixel_averages[i][j];
             float variance = pixel_variance[i][j];
 
@@ -341,17 +684,17 @@ int ThermalTracker::get_active_pixels(Pixel pixel_buffer[]) {
     return num_active;
 }
 
-void ThermalTracker::remove_small_blobs(Blob blobs[MAX_BLOBS]) {
+void ThermalTracker::remove_small_blobs(Blob blobs[]) {
     /**
     * Drop any blobs that are smaller than the minimum required size.
     * Must be performed after the blobs have finished building
     * @param blobs Blob array comtaining the discovered blobs from a get_blobs call
     * @param minimum_size Minimum number of pixels a blob should have to avoid the chopping block
     */
-    int vacant_index = MAX_BLOBS + 1;
+    int vacant_index = blob_capacity + 1;
 
     // Pass over the blob array and pop the small ones
-    for (int i = 0; i < MAX_BLOBS; i++) {
+    for (int i = 0; i < blob_capacity; i++) {
         if (blobs[i].get_size() < min_blob_size) {
             // Blob too smol; pop it out
             blobs[i].clear();
@@ -369,14 +712,14 @@ void ThermalTracker::remove_small_blobs(Blob blobs[MAX_BLOBS]) {
     }
 }
 
-int ThermalTracker::get_num_blobs(Blob blobs[MAX_BLOBS]) {
+int ThermalTracker::get_num_blobs(Blob blobs[]) {
     /**
     * Get the number of active blobs in an array
     * @param blobs Array containing the blobs. Yup. Pretty much what it says on the label...
     * @return Number of active blobs in the array.
     */
     int num_blobs = 0;
-    for (int i = 0; i < MAX_BLOBS; i++) {
+    for (int i = 0; i < blob_capacity; i++) {
         if (blobs[i].is_active()) {
             num_blobs++;
         }
@@ -385,14 +728,14 @@ int ThermalTracker::get_num_blobs(Blob blobs[MAX_BLOBS]) {
     return num_blobs;
 }
 
-int ThermalTracker::get_num_blobs(TrackedBlob blobs[MAX_BLOBS]) {
+int ThermalTracker::get_num_blobs(TrackedBlob blobs[]) {
     /**
     * Get the number of active blobs in an array
     * @param blobs Array containing the blobs. Yup. Pretty much what it says on the label...
     * @return Number of active blobs in the array.
     */
     int num_blobs = 0;
-    for (int i = 0; i < MAX_BLOBS; i++) {
+    for (int i = 0; i < blob_capacity; i++) {
         if (blobs[i].is_active()) {
             num_blobs++;
         }
@@ -401,9 +744,214 @@ int ThermalTracker::get_num_blobs(TrackedBlob blobs[MAX_BLOBS]) {
     return num_blobs;
 }
 
+int ThermalTracker::get_track_handles(TrackHandle handles[]) {
+    /**
+    * Get handles to every active track.
+    * Only call this from the thread running the tracker (or from its callbacks); other threads should use
+    * read_track_handles.
+    * @param handles Array of at least get_blob_capacity() handles to fill
+    * @return Number of active tracks
+    */
+    int num_tracks = 0;
+
+    for (int i = 0; i < blob_capacity; i++) {
+        if (tracked_blobs[i].is_active()) {
+            handles[num_tracks].index = i;
+            handles[num_tracks].generation = tracked_blobs[i].generation;
+            num_tracks++;
+        }
+    }
+
+    return num_tracks;
+}
+
+TrackedBlob* ThermalTracker::get_track(TrackHandle handle) {
+    /**
+    * Look up the track a handle refers to.
+    * Only call this from the thread running the tracker; other threads should use read_track.
+    * @param handle Handle from get_track_handles
+    * @return The track, or NULL if the handle is stale
+    */
+    if (handle.index >= blob_capacity) {
+        return NULL;
+    }
+
+    TrackedBlob* track = &tracked_blobs[handle.index];
+    if (track->generation != handle.generation || !track->is_active()) {
+        return NULL;
+    }
+
+    return track;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reading tracks from other threads
+
+#ifdef ARDUINO_ARCH_ESP8266
+
+static void load_track(const TrackedBlob& source, TrackedBlob& track) { track = source; }
+
+void ThermalTracker::publish_tracks() {
+    /**
+    * The tracks are read in place, so only the sequence moves on.
+    */
+    track_sequence += 2;
+}
+
+unsigned long ThermalTracker::begin_track_read() {
+    unsigned long sequence = track_sequence;
+    __sync_synchronize();
+    return sequence;
+}
+
+bool ThermalTracker::end_track_read(unsigned long sequence) {
+    __sync_synchronize();
+    return track_sequence == sequence;
+}
+
+#else
+
+// Words a track is copied in; may_alias lets them read a TrackedBlob
+typedef uint32_t __attribute__((__may_alias__)) track_word;
+
+static_assert(sizeof(TrackedBlob) % sizeof(track_word) == 0 && alignof(TrackedBlob) >= alignof(track_word),
+              "TrackedBlob must be copyable a word at a time");
+
+static void load_track(const TrackedBlob& source, TrackedBlob& track) {
+    /**
+    * Copy a published track with relaxed atomic loads, one word at a time.
+    */
+    const track_word* from = (const track_word*)&source;
+    track_word* to = (track_word*)&track;
+
+    for (size_t i = 0; i < sizeof(TrackedBlob) / sizeof(track_word); i++) {
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+}
+
+void ThermalTracker::publish_tracks() {
+    /**
+    * Copy the tracks to published_tracks with relaxed atomic stores while the sequence is odd. Readers retry while
+    * the sequence is odd or has moved on.
+    * New tracks take the first free slots, so only the slots up to the last active one are copied, along with any
+    * freed since the last publish; the rest are already published as free.
+    */
+    int num_slots = blob_capacity;
+    while (num_slots > 0 && !tracked_blobs[num_slots - 1].is_active()) {
+        num_slots--;
+    }
+    int num_copied = num_slots > num_published_slots ? num_slots : num_published_slots;
+
+    unsigned long sequence = track_sequence.load(std::memory_order_relaxed);
+    track_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const track_word* from = (const track_word*)tracked_blobs;
+    track_word* to = (track_word*)published_tracks;
+    for (size_t i = 0; i < num_copied * sizeof(TrackedBlob) / sizeof(track_word); i++) {
+        __atomic_store_n(&to[i], from[i], __ATOMIC_RELAXED);
+    }
+
+    track_sequence.store(sequence + 2, std::memory_order_release);
+    num_published_slots = num_slots;
+}
+
+unsigned long ThermalTracker::begin_track_read() { return track_sequence.load(std::memory_order_acquire); }
+
+bool ThermalTracker::end_track_read(unsigned long sequence) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return track_sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+#endif
+
+int ThermalTracker::read_track_handles(TrackHandle handles[]) {
+    /**
+    * Get handles to every active track from any thread, without locking.
+    * @param handles Array of at least get_blob_capacity() handles to fill
+    * @return Number of active tracks, or -1 if the tracks kept changing during the read
+    */
+    for (int attempt = 0; attempt < TRACK_READ_ATTEMPTS; attempt++) {
+        unsigned long sequence = begin_track_read();
+        if (sequence & 1) {
+            continue;
+        }
+
+        int num_tracks = 0;
+        for (int i = 0; i < blob_capacity; i++) {
+            TrackedBlob track;
+            load_track(published_tracks[i], track);
+            if (track.is_active()) {
+                handles[num_tracks].index = i;
+                handles[num_tracks].generation = track.generation;
+                num_tracks++;
+            }
+        }
+
+        if (end_track_read(sequence)) {
+            return num_tracks;
+        }
+    }
+
+    return -1;
+}
+
+bool ThermalTracker::read_track(TrackHandle handle, TrackedBlob& track) {
+    /**
+    * Copy out the track a handle refers to from any thread, without locking.
+    * The copy is retried if the tracker updated the tracks part way through it.
+    * @param handle Handle from get_track_handles or read_track_handles
+    * @param track Tracked blob to copy the track into
+    * @return False if the handle is stale or the tracks kept changing during the read
+    */
+    if (handle.index >= blob_capacity) {
+        return false;
+    }
+
+    for (int attempt = 0; attempt < TRACK_READ_ATTEMPTS; attempt++) {
+        unsigned long sequence = begin_track_read();
+        if (sequence & 1) {
+            continue;
+        }
+
+        load_track(published_tracks[handle.index], track);
+
+        if (end_track_read(sequence)) {
+            return track.generation == handle.generation && track.is_active();
+        }
+    }
+
+    return false;
+}
+
+int ThermalTracker::get_blob_capacity() {
+    /**
+    * Get the most blobs that can be detected in a frame, which is also the most that can be tracked at once.
+    * Blob and tracked blob arrays passed to the tracker must be at least this long.
+    */
+    return blob_capacity;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Inter-frame tracking
 
+static int compare_match_candidates(const void* a, const void* b) {
+    /**
+    * qsort comparator ordering match candidates by difference, then tracked blob, then blob, so ties go the same way
+    * on every platform.
+    */
+    const MatchCandidate* first = (const MatchCandidate*)a;
+    const MatchCandidate* second = (const MatchCandidate*)b;
+
+    if (first->difference != second->difference) {
+        return (first->difference < second->difference) ? -1 : 1;
+    }
+    if (first->track != second->track) {
+        return first->track - second->track;
+    }
+    return first->blob - second->blob;
+}
+
 void ThermalTracker::track_blobs(Blob new_blobs[], TrackedBlob tracked_blobs[]) {
     /**
     * Track blobs between frames using its characteristics to match the old with the new.
@@ -415,196 +963,355 @@ void ThermalTracker::track_blobs(Blob new_blobs[], TrackedBlob tracked_blobs[])
 
     // Update any existing blobs
     if (num_tracked_blobs > 0) {
+        STAGE_TIMER_START(matching_timer);
         update_tracked_blobs(new_blobs, tracked_blobs);
-        sort_tracked_blobs(tracked_blobs);
+        STAGE_TIMER_STOP(matching_timer, STAGE_MATCHING);
+    }
+
+    STAGE_TIMER_START(tracks_timer);
+    if (num_tracked_blobs > 0) {
+        retire_tracked_blobs(tracked_blobs);
     }
 
     // All unassigned blobs get added to the track list
     add_remaining_blobs_to_tracked(new_blobs, tracked_blobs);
+    STAGE_TIMER_STOP(tracks_timer, STAGE_TRACKS);
 }
 
-void ThermalTracker::update_tracked_blobs(Blob new_blobs[MAX_BLOBS], TrackedBlob tracked_blobs[MAX_BLOBS]) {
+void ThermalTracker::update_tracked_blobs(Blob new_blobs[], TrackedBlob tracked_blobs[]) {
     /**
     * Update the details of previously tracked blobs if there is a similar enough to a current blob.
+    * Pairs are matched greedily, lowest difference first, until no pair is under the maximum difference threshold.
+    * Tracked blobs that have merged into the same blob are then carried through the frame together.
     * @param new_blobs Blobs from the last frame
     * @param tracked_blobs Previously tracked blobs to be updated if there are any matches
     */
-    for (int i = 0; i < MAX_BLOBS; i++) {
+    for (int i = 0; i < blob_capacity; i++) {
         tracked_blobs[i].reset_updated_status();
         new_blobs[i].clear_assigned();
+        track_matches[i] = NO_MATCH;
+        blob_matches[i] = NO_MATCH;
+        track_groups[i] = NO_MATCH;
     }
 
-    // Create a difference matrix to show which blobs are likely the same across frames (lower difference == more likely
-    // the
-    // same)
-    float difference_matrix[MAX_BLOBS][MAX_BLOBS]; /**< Stores the difference values between every tracked_blob/new_blob
-                                                    combination */
-    int indexes[2];
-    generate_difference_matrix(tracked_blobs, new_blobs, difference_matrix);
+    // Only pairs under the threshold could ever be matched, and each new blob only keeps its best few of those (lower
+    // difference == more likely the same)
+    int num_candidates = find_match_candidates(new_blobs, tracked_blobs, match_candidates);
+    qsort(match_candidates, num_candidates, sizeof(MatchCandidate), compare_match_candidates);
 
-    // Keep going until there are no more matches
-    float difference = get_lowest_difference(difference_matrix, indexes);
-    while (difference < max_difference_threshold) {
-        // Update the tracked blob
-        tracked_blobs[indexes[0]].update_blob(new_blobs[indexes[1]]);
+    // Take the lowest remaining difference until there are no more matches
+    for (int i = 0; i < num_candidates; i++) {
+        int track = match_candidates[i].track;
+        int blob = match_candidates[i].blob;
 
-        // Remove the matched up rows and columns from the difference matrix so they cannot be matched again
-        remove_difference_row_col(indexes[0], indexes[1], difference_matrix);
-        new_blobs[indexes[1]].set_assigned();
+        // Either side may already be matched up with something more similar
+        if (track_matches[track] != NO_MATCH || blob_matches[blob] != NO_MATCH) {
+            continue;
+        }
+
+        track_matches[track] = blob;
+        blob_matches[blob] = track;
+        new_blobs[blob].set_assigned();
+    }
 
-        // Find the next lowest difference
-        difference = get_lowest_difference(difference_matrix, indexes);
+    if (max_merged_frames > 0) {
+        reassign_split_tracked_blobs(new_blobs, tracked_blobs);
+        find_merged_tracked_blobs(new_blobs, tracked_blobs, num_candidates);
+    }
+
+    for (int i = 0; i < blob_capacity; i++) {
+        TrackedBlob& tracked_blob = tracked_blobs[i];
+        float last_position[2] = {tracked_blob._blob.centroid[0], tracked_blob._blob.centroid[1]};
+
+        if (track_groups[i] != NO_MATCH) {
+            if (tracked_blob.num_merged_frames == 0) {
+                num_track_merges++;
+            }
+            tracked_blob.update_merged(new_blobs[track_groups[i]]);
+        } else if (track_matches[i] != NO_MATCH) {
+            if (tracked_blob.num_merged_frames > 0) {
+                num_track_splits++;
+            }
+            tracked_blob.update_blob(new_blobs[track_matches[i]]);
+        } else {
+            continue;
+        }
+
+        if (num_counting_lines > 0) {
+            check_counting_lines(tracked_blob, last_position);
+        }
     }
 }
 
-void ThermalTracker::sort_tracked_blobs(TrackedBlob tracked_blobs[]) {
+void ThermalTracker::find_merged_tracked_blobs(Blob new_blobs[], TrackedBlob tracked_blobs[], int num_candidates) {
     /**
-    * Sort the tracked blobs to make sure there aren't any gaps.
-    * Tracked blobs that have not been updated are cleared from the list
-    * @param tracked_blobs List containing the tracked blobs to be sorted
+    * Find the tracked blobs that have merged into a blob matched to another tracked blob.
+    * A tracked blob has merged when nothing matched it, and its predicted position lies within a bigger blob that was
+    * matched to another tracked blob (e.g. two people walking side by side). Both tracked blobs are then grouped on
+    * that blob, for up to max_merged_frames, so neither takes on the group's shape and both are ready to be matched
+    * again when the group splits.
+    * Only the match candidates are searched, lowest difference first, so the work is bounded by
+    * capacity * MAX_MATCH_CANDIDATES like the matching itself.
+    * @param new_blobs Blobs from the latest frame, already matched up
+    * @param tracked_blobs List containing the tracked blobs
+    * @param num_candidates Number of sorted match candidates
     */
-    // Clean up at the end - Remove gaps in the tracked blobs table and process/clear old and un-updated tracked blobs
-    int free_index = MAX_BLOBS + 1;
-    for (int i = 0; i < MAX_BLOBS; i++) {
-        // If the blob hasn't been updated this frame, it might be dead
-        if (!tracked_blobs[i].has_updated) {
-            tracked_blobs[i].num_dead_frames++;
+    for (int i = 0; i < num_candidates; i++) {
+        int track = match_candidates[i].track;
+        int group = match_candidates[i].blob;
+        TrackedBlob& tracked_blob = tracked_blobs[track];
+        Blob& blob = new_blobs[group];
+
+        // Only unmatched tracked blobs merge, each into the first matched blob it fits
+        if (track_matches[track] != NO_MATCH || track_groups[track] != NO_MATCH || blob_matches[group] == NO_MATCH ||
+            tracked_blob.num_merged_frames >= max_merged_frames) {
+            continue;
         }
 
-        if (tracked_blobs[i].has_updated || tracked_blobs[i].num_dead_frames < max_dead_frames) {
-            // Tracked blob has updated
-            // Keep it in the list, but move it up if there are gaps
-            if (free_index < i) {
-                tracked_blobs[free_index++].copy(tracked_blobs[i]);
-                tracked_blobs[i].clear();
-            }
+        // A tracked blob that hasn't moved yet has no speed to coast at
+        if (tracked_blob.travel[X] == 0) {
+            continue;
         }
 
-        else {
-            // Tracked blob not updated
-            // If it was active, process the movement
-            if (tracked_blobs[i].is_active()) {
-                process_blob_movements(tracked_blobs[i]);
-            }
+        // A merged blob has grown by about this tracked blob since its own tracked blob last saw it. Once merged, the
+        // two may overlap completely, so a group that is already carrying this tracked blob keeps it whatever its size.
+        int owner = blob_matches[group];
+        if (tracked_blob.num_merged_frames == 0 &&
+            2 * blob.get_size() < 2 * tracked_blobs[owner]._blob.get_size() + tracked_blob._blob.get_size()) {
+            continue;
+        }
 
-            // Either way, clear it afterwards to make room for the real ones
-            tracked_blobs[i].clear();
-            if (free_index > i) {
-                free_index = i;
-            }
+        float position = tracked_blob.get_match_position(X);
+        if (position < blob.min[X] - 1 || position > blob.max[X] + 1) {
+            continue;
+        }
+
+        // The tracked blob that matched the group joins it too, unless it has been grouped for too long already
+        track_groups[track] = group;
+        track_partners[track] = owner;
+        if (tracked_blobs[owner].num_merged_frames < max_merged_frames) {
+            track_groups[owner] = group;
+            track_partners[owner] = track;
         }
     }
 }
 
-void ThermalTracker::generate_difference_matrix(TrackedBlob tracked_blobs[MAX_BLOBS], Blob blobs[MAX_BLOBS],
-                                                float output[MAX_BLOBS][MAX_BLOBS]) {
+void ThermalTracker::reassign_split_tracked_blobs(Blob new_blobs[], TrackedBlob tracked_blobs[]) {
     /**
-    * Generate a matrix of the differences between the tracked blobs and blobs.
+    * Make sure two tracked blobs that were merged take the blobs their group split into the right way round.
+    * While merged, each tracked blob coasts at its own speed, so their order across the frame says who has passed
+    * whom. The matching alone can get this backwards, as the shape and edge terms often outweigh a pixel or two of
+    * position, so if both picked up a blob of their own and in the opposite order to their own positions, the two
+    * blobs are swapped over.
+    * @param new_blobs Blobs from the latest frame, already matched up
     * @param tracked_blobs List containing the tracked blobs
-    * @param blobs List containing the new blobs from the frame
-    * @param output Matrix to store the difference values
     */
+    for (int i = 0; i < blob_capacity; i++) {
+        int partner = track_partners[i];
 
-    for (int i = 0; i < MAX_BLOBS; i++) {
-        for (int j = 0; j < MAX_BLOBS; j++) {
-            if (blobs[j].is_active() && tracked_blobs[i].is_active()) {
-                output[i][j] = tracked_blobs[i].get_difference(blobs[j]);
-            } else {
-                output[i][j] = max_difference_threshold;
-            }
+        // Each pair is handled once, from its lower index, and only while both were still merged with each other
+        if (partner == NO_MATCH || partner < i || tracked_blobs[i].num_merged_frames == 0 ||
+            tracked_blobs[partner].num_merged_frames == 0 || track_partners[partner] != i) {
+            continue;
+        }
+
+        int blob = track_matches[i];
+        int partner_blob = track_matches[partner];
+        if (blob == NO_MATCH || partner_blob == NO_MATCH) {
+            continue;
+        }
+
+        float position = tracked_blobs[i].get_match_position(X);
+        float partner_position = tracked_blobs[partner].get_match_position(X);
+        if (position == partner_position) {
+            continue;
+        }
+
+        if ((position < partner_position) != (new_blobs[blob].centroid[X] < new_blobs[partner_blob].centroid[X])) {
+            track_matches[i] = partner_blob;
+            track_matches[partner] = blob;
+            blob_matches[blob] = partner;
+            blob_matches[partner_blob] = i;
         }
     }
 }
 
-float ThermalTracker::get_lowest_difference(float difference_matrix[MAX_BLOBS][MAX_BLOBS], int indexes[2]) {
+void ThermalTracker::retire_tracked_blobs(TrackedBlob tracked_blobs[]) {
     /**
-    * Get the index and value of the lowest difference in the difference matrix
-    * @param difference_matrix Matrix containing the difference values between the different tracked blobs and normal
-    * blobs.
-    * @param indexes The location of the lowest difference in the matrix.
+    * Age the tracked blobs that were not updated this frame, and end the ones that have been dead for too long.
+    * Ended tracks free their slot in place; tracks are never moved, so handles to the others stay good.
+    * @param tracked_blobs List containing the tracked blobs
     */
-    float lowest = max_difference_threshold;
-    int x_index = -1;
-    int y_index = -1;
+    for (int i = 0; i < blob_capacity; i++) {
+        TrackedBlob& tracked_blob = tracked_blobs[i];
 
-    // Find the value and index of the lowest value in the matrix
-    for (int i = 0; i < MAX_BLOBS; i++) {
-        for (int j = 0; j < MAX_BLOBS; j++) {
-            float difference = difference_matrix[i][j];
-            if (difference < lowest && difference < max_difference_threshold) {
-                lowest = difference;
-                x_index = i;
-                y_index = j;
-            }
+        if (!tracked_blob.is_active() || tracked_blob.has_updated) {
+            continue;
         }
-    }
 
-    indexes[0] = x_index;
-    indexes[1] = y_index;
-    return lowest;
+        // If the blob hasn't been updated this frame, it might be dead
+        tracked_blob.num_dead_frames++;
+
+        if (tracked_blob.num_dead_frames >= max_dead_frames) {
+            process_blob_movements(tracked_blob);
+            tracked_blob.clear();
+        }
+    }
 }
 
-void ThermalTracker::remove_difference_row_col(int row, int col, float difference_matrix[MAX_BLOBS][MAX_BLOBS]) {
+int ThermalTracker::find_match_candidates(Blob new_blobs[], TrackedBlob tracked_blobs[],
+                                          MatchCandidate candidates[]) {
     /**
-    * Remove a row and column from the difference matrix so it cannot be used in matching up blobs with tracked blobs.
-    * The entire row and column are marked with a difference of max_difference_threshold, which is far above the maximum
-    * difference
-    * threshold.
-    * You'd use this function after a match has been found between a blob and a tracked blob.
-    * @param row The row number (tracked blob index) to remove from the difference matrix
-    * @param col The coloumn number (blob index) to remove from the difference matrix
-    * @param difference_matrix A 2D matrix containing the combination of difference between tracked blobs and blobs
+    * Find the best MAX_MATCH_CANDIDATES tracked blobs for each new blob, out of those whose difference is under the
+    * maximum difference threshold.
+    * Tracked blobs are sorted by position first, and each new blob is scored against them nearest first. Once a new
+    * blob has a full list, the search stops at the first tracked blob too far away for the position penalty alone to
+    * beat the worst one kept, so both the scoring and the candidate list grow with the capacity, not its square.
+    * @param new_blobs Blobs from the latest frame
+    * @param tracked_blobs Tracked blobs from the previous frame
+    * @param candidates Array of at least capacity * MAX_MATCH_CANDIDATES candidates to fill
+    * @return Number of candidates found
     */
-    for (int i = 0; i < MAX_BLOBS; i++) {
-        difference_matrix[row][i] = max_difference_threshold;
-        difference_matrix[i][col] = max_difference_threshold;
+    int num_tracks = 0;
+    int num_candidates = 0;
+
+    // Insertion sort the active tracks by X; they are usually still in order from the last frame
+    for (int i = 0; i < blob_capacity; i++) {
+        if (!tracked_blobs[i].is_active()) {
+            continue;
+        }
+
+        float position = tracked_blobs[i].get_match_position(X);
+        int j = num_tracks++;
+        while (j > 0 && tracked_blobs[track_order[j - 1]].get_match_position(X) > position) {
+            track_order[j] = track_order[j - 1];
+            j--;
+        }
+        track_order[j] = i;
+    }
+
+    for (int j = 0; j < blob_capacity; j++) {
+        if (!new_blobs[j].is_active()) {
+            continue;
+        }
+
+        float centroid = new_blobs[j].centroid[X];
+        float scale = TrackedBlob::position_penalty * TrackedBlob::get_side_edge_penalty(centroid);
+
+        // Binary search for the first track at or past the centroid, then walk outwards from it, nearest first
+        int right = 0;
+        int high = num_tracks;
+        while (right < high) {
+            int middle = (right + high) / 2;
+            if (tracked_blobs[track_order[middle]].get_match_position(X) < centroid) {
+                right = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        int left = right - 1;
+
+        // This blob's best candidates so far, kept sorted by difference
+        MatchCandidate* best = &candidates[num_candidates];
+        int num_best = 0;
+
+        while (left >= 0 || right < num_tracks) {
+            int k;
+            float distance;
+            float left_distance = left >= 0 ? centroid - tracked_blobs[track_order[left]].get_match_position(X) : 0;
+            float right_distance =
+                right < num_tracks ? tracked_blobs[track_order[right]].get_match_position(X) - centroid : 0;
+
+            if (right >= num_tracks || (left >= 0 && left_distance <= right_distance)) {
+                k = left--;
+                distance = left_distance;
+            } else {
+                k = right++;
+                distance = right_distance;
+            }
+
+            // Every term of the difference is positive, and the position term is at least the X distance scaled by
+            // the position and edge penalties, so no track this far away or further can beat the limit
+            float limit = num_best == MAX_MATCH_CANDIDATES ? best[num_best - 1].difference : max_difference_threshold;
+            if (distance * scale >= limit) {
+                break;
+            }
+
+            int i = track_order[k];
+            float difference = tracked_blobs[i].get_difference(new_blobs[j]);
+            if (difference >= limit) {
+                continue;
+            }
+
+            // Insert it in order, dropping the worst if the list is full
+            int n = num_best < MAX_MATCH_CANDIDATES ? num_best++ : MAX_MATCH_CANDIDATES - 1;
+            while (n > 0 && best[n - 1].difference > difference) {
+                best[n] = best[n - 1];
+                n--;
+            }
+            best[n].difference = difference;
+            best[n].track = i;
+            best[n].blob = j;
+        }
+
+        num_candidates += num_best;
     }
+
+    return num_candidates;
 }
 
-void ThermalTracker::add_remaining_blobs_to_tracked(Blob new_blobs[MAX_BLOBS], TrackedBlob tracked_blobs[MAX_BLOBS]) {
+void ThermalTracker::add_remaining_blobs_to_tracked(Blob new_blobs[], TrackedBlob tracked_blobs[]) {
     /**
     * Add any remaining, new blobs, to the tracked blob list.
+    * New blobs take the first free tracked blob slots, bumping the slot's generation so handles to its last track go
+    * stale. If there are no free slots left, the blob is counted as a track overflow and left untracked.
     * @param new_blobs Blobs from the latest frame - may contain newly discovered blobs to be tracked
     * @param tracked_blobs  A list containing the currently-tracked blobs
     */
-    int num_updated_blobs = get_num_updated_blobs(tracked_blobs);
-    int num_new_blobs = get_num_blobs(new_blobs);
     int num_unassigned_blobs = get_num_unassigned_blobs(new_blobs);
+    int free_index = 0;
+
+    int i = 0;
+    while (num_unassigned_blobs > 0 && i < blob_capacity) {
+        if (new_blobs[i].is_active() && !new_blobs[i].is_assigned()) {
+            // Dead tracks waiting out their dead frames still hold their slots
+            while (free_index < blob_capacity && tracked_blobs[free_index].is_active()) {
+                free_index++;
+            }
 
-    static int track_id = 0;
-
-    // AN: Can validate numbers here: num_updated_blobs == (new_blobs - num_unassigned_blobs)
-
-    if (num_unassigned_blobs > 0) {
-        // Make sure the latest tracking weights are up to date
-
-        int i = 0;
-        while (num_unassigned_blobs > 0 && i < MAX_BLOBS) {
-            if (new_blobs[i].is_active() && !new_blobs[i].is_assigned()) {
-                tracked_blobs[num_updated_blobs].set(new_blobs[i], track_id++);
-                new_blobs[i].set_assigned();  // Probably not necessary...
-                num_unassigned_blobs--;
-
-                // New tracking event. Do the callback if it exists
-                if (tracking_start_callback) {
-                    (*tracking_start_callback)(tracked_blobs[num_updated_blobs]);
-                }
+            if (free_index >= blob_capacity) {
+                num_track_overflows += num_unassigned_blobs;
+                return;
+            }
 
-                num_updated_blobs++;
+            // Generation 0 is never handed out, so zeroed handles are always stale
+            TrackedBlob& tracked_blob = tracked_blobs[free_index];
+            if (++tracked_blob.generation == 0) {
+                tracked_blob.generation = 1;
+            }
+            tracked_blob.set(new_blobs[i], next_track_id++);
+            new_blobs[i].set_assigned();  // Probably not necessary...
+            num_unassigned_blobs--;
+
+            // New tracking event. Record it or do the callback if it exists
+            if (event_sink) {
+                record_event(TRACKING_EVENT_START, tracked_blob, NO_DIRECTION);
+            } else if (tracking_start_callback) {
+                (*tracking_start_callback)(tracked_blob);
             }
-            i++;
         }
+        i++;
     }
 }
 
-int ThermalTracker::get_num_updated_blobs(TrackedBlob tracked_blobs[MAX_BLOBS]) {
+int ThermalTracker::get_num_updated_blobs(TrackedBlob tracked_blobs[]) {
     /**
     * Get the number of blobs that have been updated in the tracked blob list
     * @param tracked_blobs List containing the tracked blobs
     * @return Number of tracked blobs that have been updated
     */
     int num_updated = 0;
-    for (int i = 0; i < MAX_BLOBS; i++) {
+    for (int i = 0; i < blob_capacity; i++) {
         if (tracked_blobs[i].has_updated) {
             num_updated++;
         }
@@ -613,14 +1320,14 @@ int ThermalTracker::get_num_updated_blobs(TrackedBlob tracked_blobs[MAX_BLOBS])
     return num_updated;
 }
 
-int ThermalTracker::get_num_unassigned_blobs(Blob blobs[MAX_BLOBS]) {
+int ThermalTracker::get_num_unassigned_blobs(Blob blobs[]) {
     /**
     * Get the number of blobs that have not been assigned to a tracked blob
     * @param blobs A list of blobs to be tracked
     * @return Number of blobs that are not assigned to tracked blobs
     */
     int num_unassigned = 0;
-    for (int i = 0; i < MAX_BLOBS; i++) {
+    for (int i = 0; i < blob_capacity; i++) {
         if (blobs[i].is_active() && !blobs[i].is_assigned()) {
             num_unassigned++;
         }
@@ -629,47 +1336,74 @@ int ThermalTracker::get_num_unassigned_blobs(Blob blobs[MAX_BLOBS]) {
     return num_unassigned;
 }
 
-void ThermalTracker::process_blob_movements(TrackedBlob blob) {
+void ThermalTracker::process_blob_movements(TrackedBlob& blob) {
     /**
     * Check if a dying tracked blob has travelled far enough to register a movement.
     * If a tracked blob travels over the the net minimum travel threshold.
     * @param blob Tracked blob to be processed. Contains the travel information.
     */
-
-    bool movement_added = false;
+    int direction = NO_DIRECTION;
 
     // Check for horizontal movement
     if (abs(blob.get_travel(X)) > minimum_travel_threshold) {
-        movement_added = true;
         if (blob.get_travel(X) < 0) {
-            add_movement(LEFT);
+            direction = LEFT;
         } else {
-            add_movement(RIGHT);
+            direction = RIGHT;
         }
+        add_movement(direction);
     }
 
     // Check for vertical movement
     if (abs(blob.get_travel(Y)) > minimum_travel_threshold) {
-        movement_added = true;
-        if (blob.get_travel(Y) > 0) {
-            add_movement(UP);
-        } else {
-            add_movement(DOWN);
+        int vertical_direction = blob.get_travel(Y) > 0 ? UP : DOWN;
+        add_movement(vertical_direction);
+
+        if (direction == NO_DIRECTION) {
+            direction = vertical_direction;
         }
     }
 
     // No direction! Thing disappeared in a single frame or stopped moving. Cheeky shit.
-    if (!movement_added) {
+    if (direction == NO_DIRECTION) {
         add_movement(NO_DIRECTION);
     }
 
-    if (tracking_end_callback) {
+    if (event_sink) {
+        record_event(TRACKING_EVENT_END, blob, direction);
+    } else if (tracking_end_callback) {
         (*tracking_end_callback)(blob);
     }
 
     blob.id = 0;
 }
 
+void ThermalTracker::record_event(int type, TrackedBlob& blob, int direction, int line) {
+    /**
+    * Append a tracking event to the active event sink.
+    * @param type TRACKING_EVENT_START, TRACKING_EVENT_END or TRACKING_EVENT_CROSSING
+    * @param blob Tracked blob the event is for
+    * @param direction Movement recorded for the blob, or the line crossing; NO_DIRECTION for start events
+    * @param line Counting line crossed, for crossing events
+    */
+    TrackingEvent event;
+
+    event.type = type;
+    event.direction = direction;
+    event.line = line;
+    event.id = blob.id;
+    event.frame = event_frame;
+    event.start_position[X] = blob.start_pos[X];
+    event.start_position[Y] = blob.start_pos[Y];
+    event.travel[X] = blob.travel[X];
+    event.travel[Y] = blob.travel[Y];
+    event.times_updated = blob.times_updated;
+    event.max_size = blob.max_size;
+    event.temperature = blob._blob.average_temperature;
+
+    event_sink->add(event);
+}
+
 void ThermalTracker::add_movement(int direction) {
     /**
     * Increment the movement of the specified direction
@@ -743,3 +1477,211 @@ void ThermalTracker::set_tracking_end_callback(tracked_callback callback) {
         tracking_end_callback = NULL;
     }
 }
+
+void ThermalTracker::set_line_crossing_callback(crossing_callback callback) {
+    /**
+    * Set the callback for when a tracked blob crosses a counting line
+    * Call without parameters to clear the callback
+    *
+    * @param callback Function to call when a line is crossed (tracked blob, line and crossing are passed)
+    */
+    if (callback) {
+        line_crossing_callback = callback;
+    } else {
+        line_crossing_callback = NULL;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Counting lines
+
+int ThermalTracker::add_counting_line(float start_x, float start_y, float end_x, float end_y) {
+    /**
+    * Add a counting line.
+    * Tracked blobs are checked against the line every time they move, so crossings are counted on the frame they happen
+    * rather than when the track ends.
+    * @param start_x Column the line starts at
+    * @param start_y Row the line starts at
+    * @param end_x Column the line ends at
+    * @param end_y Row the line ends at
+    * @return Index of the new line in counting_lines, or -1 if there are already MAX_COUNTING_LINES
+    */
+    if (num_counting_lines >= MAX_COUNTING_LINES) {
+        return -1;
+    }
+
+    CountingLine& line = counting_lines[num_counting_lines];
+    line.start[X] = start_x;
+    line.start[Y] = start_y;
+    line.end[X] = end_x;
+    line.end[Y] = end_y;
+    line.crossings[CROSSING_FORWARD] = 0;
+    line.crossings[CROSSING_BACKWARD] = 0;
+
+    return num_counting_lines++;
+}
+
+void ThermalTracker::clear_counting_lines() {
+    /**
+    * Remove every counting line.
+    */
+    num_counting_lines = 0;
+}
+
+void ThermalTracker::reset_line_crossings() {
+    /**
+    * Reset the crossing counts of every counting line back to zeroes.
+    */
+    for (int i = 0; i < num_counting_lines; i++) {
+        counting_lines[i].crossings[CROSSING_FORWARD] = 0;
+        counting_lines[i].crossings[CROSSING_BACKWARD] = 0;
+    }
+}
+
+void ThermalTracker::check_counting_lines(TrackedBlob& blob, const float last_position[2]) {
+    /**
+    * Check the last movement of a tracked blob against the counting lines, counting and reporting any it crossed.
+    * Costs O(lines) per tracked blob. Movements over MAX_CROSSING_STEP are a track jumping to someone else rather than
+    * walking, so they are never counted.
+    * @param blob Tracked blob that has just moved
+    * @param last_position Position the tracked blob moved from, indexed by X and Y
+    */
+    float position[2] = {blob._blob.centroid[0], blob._blob.centroid[1]};
+    float movement[2] = {position[0] - last_position[0], position[1] - last_position[1]};
+
+    if (movement[X] == 0 && movement[Y] == 0) {
+        return;
+    }
+
+    if (absolute(movement[X]) > MAX_CROSSING_STEP || absolute(movement[Y]) > MAX_CROSSING_STEP) {
+        return;
+    }
+
+    for (int i = 0; i < num_counting_lines; i++) {
+        CountingLine& line = counting_lines[i];
+        float line_x = line.end[X] - line.start[X];
+        float line_y = line.end[Y] - line.start[Y];
+
+        // Which side of the line each end of the movement is on, positive being ahead of the line
+        float last_side = line_y * (last_position[X] - line.start[X]) - line_x * (last_position[Y] - line.start[Y]);
+        float side = line_y * (position[X] - line.start[X]) - line_x * (position[Y] - line.start[Y]);
+
+        if ((last_side > 0) == (side > 0)) {
+            continue;
+        }
+
+        // The movement crossed the line's extension; make sure it was between the line's ends
+        float start_side = movement[X] * (line.start[Y] - last_position[Y]) -
+                           movement[Y] * (line.start[X] - last_position[X]);
+        float end_side = movement[X] * (line.end[Y] - last_position[Y]) -
+                         movement[Y] * (line.end[X] - last_position[X]);
+
+        if ((start_side > 0 && end_side > 0) || (start_side < 0 && end_side < 0)) {
+            continue;
+        }
+
+        int crossing = side > 0 ? CROSSING_FORWARD : CROSSING_BACKWARD;
+        line.crossings[crossing]++;
+
+        if (event_sink) {
+            record_event(TRACKING_EVENT_CROSSING, blob, crossing, i);
+        } else if (line_crossing_callback) {
+            (*line_crossing_callback)(blob, i, crossing);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Stage timing
+
+bool ThermalTracker::get_stage_timing(int stage, StageTiming& timing) {
+    /**
+    * Get the timing of one stage of the update.
+    * @param stage Stage from tracker_stages
+    * @param timing Timing to fill in, in microseconds
+    * @return False if the stage is not valid or the tracker was built without TRACKER_STAGE_TIMING
+    */
+#if TRACKER_STAGE_TIMING
+    if (stage < 0 || stage >= NUM_TRACKER_STAGES) {
+        return false;
+    }
+
+    Histogram& histogram = stage_timings[stage];
+    const float ticks_per_microsecond = STAGE_TICKS_PER_MICROSECOND;
+
+    timing.count = histogram.total_count;
+    timing.min = histogram.get_min() / ticks_per_microsecond;
+    timing.mean = histogram.get_mean() / ticks_per_microsecond;
+    timing.max = histogram.get_max() / ticks_per_microsecond;
+    timing.p99 = histogram.get_percentile(STAGE_TIMING_PERCENTILE) / ticks_per_microsecond;
+
+    return true;
+#else
+    (void)stage;
+    (void)timing;
+    return false;
+#endif
+}
+
+const char* ThermalTracker::get_stage_name(int stage) {
+    /**
+    * Get the name of a stage, for reports.
+    * @param stage Stage from tracker_stages
+    */
+    static const char* stage_names[NUM_TRACKER_STAGES] = {"load",     "scan",   "blobs",      "small blobs",
+                                                          "matching", "tracks", "background", "frame"};
+
+    if (stage < 0 || stage >= NUM_TRACKER_STAGES) {
+        return "";
+    }
+
+    return stage_names[stage];
+}
+
+void ThermalTracker::reset_stage_timing() {
+    /**
+    * Reset the timing of every stage.
+    */
+#if TRACKER_STAGE_TIMING
+    for (int i = 0; i < NUM_TRACKER_STAGES; i++) {
+        stage_timings[i].reset();
+    }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Event sink
+
+EventSink::EventSink(TrackingEvent* buffer, size_t _capacity) {
+    /**
+    * Create an event sink over a preallocated buffer.
+    * @param buffer Storage for the events
+    * @param _capacity Number of events the buffer can hold
+    */
+    events = buffer;
+    capacity = _capacity;
+    clear();
+}
+
+void EventSink::clear() {
+    /**
+    * Empty the sink so the buffer can be reused for the next batch.
+    */
+    num_events = 0;
+    num_dropped_events = 0;
+}
+
+bool EventSink::add(const TrackingEvent& event) {
+    /**
+    * Append an event to the buffer.
+    * @param event Event to append
+    * @return False if the buffer was full and the event was dropped
+    */
+    if (num_events >= capacity) {
+        num_dropped_events++;
+        return false;
+    }
+
+    events[num_events++] = event;
+    return true;
+}
@@ -1,15 +1,62 @@
+#ifndef THERMAL_TRACKER_H
+#define THERMAL_TRACKER_H
+
 #include <Arduino.h>
-#include <SimpleTimer.h>
 #include <stdarg.h>
 #include "Blob.h"
+#include "Histogram.h"
 #include "Pixel.h"
 #include "TrackedBlob.h"
 
-const static char* TRACKER_VERSION = "20170825";
+// On the host, tracks are read from other threads through a sequence lock (see read_track). The ESP8266 runs the
+// tracker and everything that reads it on one loop.
+#ifndef ARDUINO_ARCH_ESP8266
+#include <atomic>
+#endif
+
+// Per-stage timing of the tracker's update. Set TRACKER_STAGE_TIMING=1 in the build flags to time each stage into a
+// histogram (see get_stage_timing); with the default of 0 the timers compile away completely.
+#ifndef TRACKER_STAGE_TIMING
+#define TRACKER_STAGE_TIMING 0
+#endif
+
+#if TRACKER_STAGE_TIMING
+#ifdef ARDUINO_ARCH_ESP8266
+#include <Esp.h>
+// CPU cycles; 32 bits wrap after 26 s at 160 MHz, far longer than any stage
+#define STAGE_TICKS_PER_MICROSECOND (F_CPU / 1000000)
+inline uint32_t read_stage_ticks() { return ESP.getCycleCount(); }
+#else
+#include <chrono>
+// Nanoseconds from the steady clock; rdtsc is not guaranteed to tick at a fixed rate on every host
+#define STAGE_TICKS_PER_MICROSECOND 1000
+inline uint32_t read_stage_ticks() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+#endif
+#define STAGE_TIMER_START(timer) uint32_t timer = read_stage_ticks()
+#define STAGE_TIMER_STOP(timer, stage) stage_timings[stage].add(read_stage_ticks() - timer)
+#else
+#define STAGE_TIMER_START(timer)
+#define STAGE_TIMER_STOP(timer, stage)
+#endif
+
+// Stack high-water measurement, off by default like TRACKER_STAGE_TIMING. When set, each update() fills this many
+// bytes below its frame with a pattern and finds the deepest byte overwritten afterwards (see stack_high_water). The
+// painted area is itself on the stack, so it must fit in what the loop and scheduler leave of the ESP8266's 4 KB,
+// and it has to be deeper than the update goes for the reading to mean anything.
+#ifndef TRACKER_STACK_PAINT_SIZE
+#define TRACKER_STACK_PAINT_SIZE 0
+#endif
+
+const static char* const TRACKER_VERSION = "20170825";
 
 const int FRAME_WIDTH = 16;
 const int FRAME_HEIGHT = 4;
-const int MAX_BLOBS = 8;
+const int MAX_BLOBS = 8; /**< Default blob and track capacity; see ThermalTracker(int) */
+const int NUM_PIXELS_PER_FRAME = FRAME_WIDTH * FRAME_HEIGHT;
 
 // Default configuration
 const int DEFAULT_MIN_TRAVEL_THRESHOLD = 4;
@@ -26,6 +73,10 @@ const float DEFAULT_AREA_PENALTY = 5.0;
 const float DEFAULT_ASPECT_RATIO_PENALTY = 10.0;
 const float DEFAULT_TEMPERATURE_PENALTY = 10.0;
 const float DEFAULT_DIRECTION_PENALTY = 50.0;
+const int DEFAULT_PREDICTOR = PREDICT_LAST_MOVEMENT;
+const float DEFAULT_PROCESS_NOISE = 0.05; /**< pixels/frame^2 */
+const float DEFAULT_MEASUREMENT_NOISE = 0.5; /**< pixels */
+const int DEFAULT_MAX_MERGED_FRAMES = 0; /**< Off; 16 is a good starting point where people cross paths */
 const float DEFAULT_DEAD_FRAME_PENALTY = DEFAULT_MAX_DIFFERENCE_THRESHOLD / DEFAULT_MAX_DEAD_FRAMES;
 const int DEFAULT_ADJACENCY_FUZZ = 1;
 
@@ -37,15 +88,153 @@ const int NUM_DIRECTION_CATEGORIES = 5;
 enum directions { LEFT = 0, RIGHT = 1, UP = 2, DOWN = 3, NO_DIRECTION = 4 };
 
 typedef void (*event_callback)(void); /**< Callback function structure - must have no parameters. */
-typedef void (*tracked_callback)(TrackedBlob blob);
+typedef void (*tracked_callback)(const TrackedBlob& blob);
+
+const int MAX_COUNTING_LINES = 4;
+const uint8_t NO_COUNTING_LINE = 0xFF;
+const float MAX_CROSSING_STEP = 2; /**< Longest movement (pixels, either axis) that can count as a line crossing */
+const int MAX_MATCH_CANDIDATES = 4; /**< Tracked blobs each new blob keeps as possible matches, best first */
+enum line_crossings { CROSSING_FORWARD = 0, CROSSING_BACKWARD = 1 };
+
+/**
+* Callback for a tracked blob crossing a counting line.
+* @param blob Tracked blob that crossed the line
+* @param line Index of the line in counting_lines
+* @param crossing CROSSING_FORWARD or CROSSING_BACKWARD
+*/
+typedef void (*crossing_callback)(const TrackedBlob& blob, int line, int crossing);
+
+/**
+* Virtual line in frame coordinates that counts tracked blobs as they cross it.
+* Forward crossings move along the line's normal, (end[Y] - start[Y], start[X] - end[X]) in (x, y): a line drawn from
+* the top of the frame to the bottom counts rightward movement as forward.
+*/
+struct CountingLine {
+    float start[2];    /**< Indexed by X and Y, in pixels */
+    float end[2];      /**< Indexed by X and Y, in pixels */
+    long crossings[2]; /**< Indexed by CROSSING_FORWARD and CROSSING_BACKWARD */
+};
+
+enum tracking_event_types { TRACKING_EVENT_START = 0, TRACKING_EVENT_END = 1, TRACKING_EVENT_CROSSING = 2 };
+
+/**
+* Compact record of a tracking start, end or line crossing, used in place of the callbacks for batch processing.
+*/
+struct TrackingEvent {
+    uint8_t type;      /**< TRACKING_EVENT_START, TRACKING_EVENT_END or TRACKING_EVENT_CROSSING */
+    uint8_t direction; /**< Movement recorded when tracking ended, or the line crossing; NO_DIRECTION for starts */
+    uint8_t line;      /**< Counting line crossed; NO_COUNTING_LINE for start and end events */
+    unsigned int id;
+    unsigned long frame; /**< Index of the frame within the batch that raised the event */
+    float start_position[2];
+    float travel[2];
+    int times_updated;
+    int max_size;
+    float temperature;
+};
+
+/**
+* Fixed-capacity event buffer that update_batch appends tracking events to.
+* Storage is supplied by the caller so nothing is allocated while processing.
+*/
+class EventSink {
+   public:
+    /**
+    * Create an event sink over a preallocated buffer.
+    * @param buffer Storage for the events
+    * @param capacity Number of events the buffer can hold
+    */
+    EventSink(TrackingEvent* buffer, size_t capacity);
+
+    /**
+    * Empty the sink so the buffer can be reused for the next batch.
+    */
+    void clear();
+
+    /**
+    * Append an event to the buffer.
+    * @param event Event to append
+    * @return False if the buffer was full and the event was dropped
+    */
+    bool add(const TrackingEvent& event);
+
+    TrackingEvent* events;
+    size_t capacity;
+    size_t num_events;
+    unsigned long num_dropped_events;
+};
+
+/**
+* Working memory for finding and clustering active pixels.
+* Pixels are stored as uint8_t indexes (row * FRAME_WIDTH + column) rather than Pixel objects. The tracker owns one,
+* so none of it comes off the ESP8266's 4 KB stack.
+*/
+struct BlobScratch {
+    uint8_t active_indexes[NUM_PIXELS_PER_FRAME];
+    uint8_t sort_queue[NUM_PIXELS_PER_FRAME];
+};
+
+/**
+* A tracked blob/new blob pairing that could be a match, with its difference score.
+*/
+struct MatchCandidate {
+    float difference;
+    uint8_t track;
+    uint8_t blob;
+};
+
+/**
+* Reference to a track in the tracker's pool.
+* Tracks never move once started, so a handle stays good for as long as its track lasts. When the slot is reused for
+* another track its generation changes and the handle goes stale.
+*/
+struct TrackHandle {
+    uint8_t index;
+    uint16_t generation;
+};
+
+const uint8_t NO_MATCH = 0xFF; /**< Unmatched blob or tracked blob, in the per-frame match tables */
+const uint8_t STACK_PAINT_PATTERN = 0xA5; /**< Fills the stack below update() for stack_high_water */
+
+const int TRACK_READ_ATTEMPTS = 8; /**< Retries read_track makes while the tracks are being updated */
+
+// Stages of an update timed when TRACKER_STAGE_TIMING is set
+enum tracker_stages {
+    STAGE_LOAD = 0,        /**< Copying the frame in (update(frame_buffer) only) */
+    STAGE_SCAN = 1,        /**< Active pixel detection, with the running background sums done in the same sweep */
+    STAGE_BLOBS = 2,       /**< Clustering the active pixels into blobs */
+    STAGE_SMALL_BLOBS = 3, /**< Removing blobs under the minimum size */
+    STAGE_MATCHING = 4,    /**< Matching blobs to tracked blobs, and counting lines */
+    STAGE_TRACKS = 5,      /**< Retiring dead tracked blobs and starting new ones */
+    STAGE_BACKGROUND = 6,  /**< Building or publishing the background */
+    STAGE_FRAME = 7,       /**< The whole frame, from the scan to the background */
+    NUM_TRACKER_STAGES = 8
+};
+
+const float STAGE_TIMING_PERCENTILE = 0.99;
+
+/**
+* Timing of one stage of the tracker's update, in microseconds.
+* The minimum and maximum are since the last reset; the mean and percentile follow the most recent frames.
+*/
+struct StageTiming {
+    unsigned long count; /**< Times the stage has run since the last reset */
+    float min;
+    float mean;
+    float max;
+    float p99; /**< 99th percentile, rounded up to the top of its histogram bucket */
+};
 
 class ThermalTracker {
    public:
     /**
     * Constructor - Make a new thermal tracker object with the default configuration
     * The thermal tracker uses a MLX90621 thermopile array to observe moving objects in its view.
+    * @param blob_capacity Most blobs detected in a frame, and most blobs tracked at once. Storage for them is allocated
+    * here, once; at most NUM_PIXELS_PER_FRAME.
     */
-    ThermalTracker();
+    explicit ThermalTracker(int blob_capacity = MAX_BLOBS);
+    ~ThermalTracker();
 
     /**
     * Process an input thermal frame.
@@ -55,6 +244,29 @@ class ThermalTracker {
     */
     void update(float frame_buffer[FRAME_HEIGHT][FRAME_WIDTH]);
 
+    /**
+    * Process the frame that has been written into the back buffer, then publish it as the current frame.
+    * Lets the sensor driver hand frames over without the copy made by update(frame_buffer).
+    */
+    void update();
+
+    /**
+    * Get the buffer the next frame should be written into.
+    * The buffer belongs to the tracker and is swapped with the published frame on the next update().
+    * @return Back frame buffer, FRAME_HEIGHT x FRAME_WIDTH
+    */
+    float (*get_back_buffer())[FRAME_WIDTH];
+
+    /**
+    * Process a contiguous block of recorded frames.
+    * Frames are read in place rather than copied, and tracking events are appended to the event sink instead of being
+    * passed to the tracking callbacks. The last frame of the block is copied into the back buffer and published.
+    * @param frames num_frames frames of FRAME_HEIGHT x FRAME_WIDTH pixels, stored row by row
+    * @param num_frames Number of frames in the block
+    * @param events Event sink to record the tracking start and end events in
+    */
+    void update_batch(const float* frames, size_t num_frames, EventSink& events);
+
     /**
     * Determine if the tracker has finished build its background frames.
     * @return True if the tracker has gathered the minumum number of frames.
@@ -94,12 +306,34 @@ class ThermalTracker {
     */
     void add_current_frame_to_background();
 
+    /**
+    * Run the blob detection and inter-frame tracking stages on a set of active pixels.
+    * Background maintenance is left to the caller so the pixel tests and background update can be done elsewhere
+    * (e.g. for several sensors at once).
+    * @param active_indexes Indexes (row * FRAME_WIDTH + column) of the active pixels. Consumed while building blobs.
+    * @param num_active_pixels Number of active pixel indexes
+    * @param pixels Frame to read the active pixels' temperatures from
+    * @return True if the frame should be added to the running background
+    */
+    bool track_active_pixels(uint8_t active_indexes[], int num_active_pixels, const float pixels[][FRAME_WIDTH]);
+
+    /**
+    * Determine if any blobs are still being tracked (including ones waiting out their dead frames).
+    * @return True if there is at least one active tracked blob
+    */
+    bool has_live_tracks();
+
+    /**
+    * Reset the idle and active frame counters and costs.
+    */
+    void reset_frame_counters();
+
     ////////////////////////////////////////////////////////////////////////////////
     // Blob detection
 
     /**
     * Search through the current frame to find pixel 'blobs' that appear in front of the background.
-    * @param blobs A Blob array to pass the detected blobs into.
+    * @param blobs A Blob array to pass the detected blobs into. Must hold get_blob_capacity() blobs.
     * @return Number of detected blobs
     *
     * Psuedo:
@@ -123,11 +357,24 @@ class ThermalTracker {
     */
     int get_blobs(Blob blobs[]);
 
+    /**
+    * Cluster a set of active pixels into blobs of adjacent pixels.
+    * See get_blobs for a description of the clustering. The sort queue lives in the tracker's scratch arena.
+    * @param active_indexes Indexes (row * FRAME_WIDTH + column) of the active pixels to cluster. The array is
+    * reordered and consumed as pixels are assigned.
+    * @param num_active_pixels Number of active pixel indexes
+    * @param pixels Frame to read the active pixels' temperatures from
+    * @param blobs A Blob array to pass the detected blobs into.
+    * @return Number of detected blobs
+    */
+    int build_blobs(uint8_t active_indexes[], int num_active_pixels, const float pixels[][FRAME_WIDTH],
+                    Blob blobs[]);
+
     /**
     * Reset a list of blobs.
     * Useful for cleaning after inspecting a frame.
     */
-    void clear_blobs(Blob blobs[MAX_BLOBS]);
+    void clear_blobs(Blob blobs[]);
 
     /**
     * Return the active pixels in the current frame.
@@ -158,6 +405,50 @@ class ThermalTracker {
     */
     int get_num_blobs(TrackedBlob blobs[]);
 
+    /**
+    * Get handles to every active track.
+    * Only call this from the thread running the tracker (or from its callbacks); other threads should use
+    * read_track_handles.
+    * @param handles Array of at least get_blob_capacity() handles to fill
+    * @return Number of active tracks
+    */
+    int get_track_handles(TrackHandle handles[]);
+
+    /**
+    * Look up the track a handle refers to.
+    * Only call this from the thread running the tracker; other threads should use read_track.
+    * @param handle Handle from get_track_handles
+    * @return The track, or NULL if the handle is stale
+    */
+    TrackedBlob* get_track(TrackHandle handle);
+
+    /**
+    * Get handles to every active track from any thread, without locking.
+    * On the host, readers never touch the tracks the tracker is working on. After each tracking pass the tracker
+    * publishes a copy with relaxed atomic stores inside a sequence lock (a std::atomic with acquire/release
+    * ordering), and readers copy it out with relaxed atomic loads, so there is no data race. On the ESP8266 the
+    * tracks are read in place, since the tracker and everything that reads it run on one loop.
+    * @param handles Array of at least get_blob_capacity() handles to fill
+    * @return Number of active tracks, or -1 if the tracks kept changing during the read
+    */
+    int read_track_handles(TrackHandle handles[]);
+
+    /**
+    * Copy out the track a handle refers to from any thread, without locking.
+    * The copy is retried if the tracker updated the tracks part way through it. See read_track_handles for the
+    * memory ordering.
+    * @param handle Handle from get_track_handles or read_track_handles
+    * @param track Tracked blob to copy the track into
+    * @return False if the handle is stale or the tracks kept changing during the read
+    */
+    bool read_track(TrackHandle handle, TrackedBlob& track);
+
+    /**
+    * Get the most blobs that can be detected in a frame, which is also the most that can be tracked at once.
+    * Blob and tracked blob arrays passed to the tracker must be at least this long.
+    */
+    int get_blob_capacity();
+
     ////////////////////////////////////////////////////////////////////////////////
     // Inter-frame tracking
 
@@ -166,77 +457,90 @@ class ThermalTracker {
     * @param new_blobs Blobs from the latest frame
     * @param tracked_blobs Tracked blobs from the previous frame
     */
-    void track_blobs(Blob new_blobs[MAX_BLOBS], TrackedBlob old_tracked_blobs[MAX_BLOBS]);
+    void track_blobs(Blob new_blobs[], TrackedBlob old_tracked_blobs[]);
 
     /**
-    * Sort the tracked blobs to make sure there aren't any gaps.
-    * Tracked blobs that have not been updated are cleared from the list
-    * @param tracked_blobs List containing the tracked blobs to be sorted
+    * Find the tracked blobs that have merged into a blob matched to another tracked blob.
+    * A tracked blob has merged when nothing matched it, and its predicted position lies within a bigger blob that was
+    * matched to another tracked blob (e.g. two people walking side by side). Both tracked blobs are then grouped on
+    * that blob, for up to max_merged_frames, so neither takes on the group's shape and both are ready to be matched
+    * again when the group splits.
+    * Only the match candidates are searched, lowest difference first, so the work is bounded by
+    * capacity * MAX_MATCH_CANDIDATES like the matching itself.
+    * @param new_blobs Blobs from the latest frame, already matched up
+    * @param tracked_blobs List containing the tracked blobs
+    * @param num_candidates Number of sorted match candidates
+    */
+    void find_merged_tracked_blobs(Blob new_blobs[], TrackedBlob tracked_blobs[], int num_candidates);
+
+    /**
+    * Make sure two tracked blobs that were merged take the blobs their group split into the right way round.
+    * While merged, each tracked blob coasts at its own speed, so their order across the frame says who has passed
+    * whom. The matching alone can get this backwards, as the shape and edge terms often outweigh a pixel or two of
+    * position, so if both picked up a blob of their own and in the opposite order to their own positions, the two
+    * blobs are swapped over.
+    * @param new_blobs Blobs from the latest frame, already matched up
+    * @param tracked_blobs List containing the tracked blobs
     */
-    void sort_tracked_blobs(TrackedBlob tracked_blobs[MAX_BLOBS]);
+    void reassign_split_tracked_blobs(Blob new_blobs[], TrackedBlob tracked_blobs[]);
+
+    /**
+    * Age the tracked blobs that were not updated this frame, and end the ones that have been dead for too long.
+    * Ended tracks free their slot in place; tracks are never moved, so handles to the others stay good.
+    * @param tracked_blobs List containing the tracked blobs
+    */
+    void retire_tracked_blobs(TrackedBlob tracked_blobs[]);
 
     /**
     * Add any remaining, new blobs, to the tracked blob list.
+    * Each new track takes a free slot and bumps its generation, making any handles to the slot's last track stale.
     * @param new_blobs Blobs from the latest frame - may contain newly discovered blobs to be tracked
     * @param tracked_blobs  A list containing the currently-tracked blobs
     */
-    void add_remaining_blobs_to_tracked(Blob new_blobs[MAX_BLOBS], TrackedBlob old_tracked_blobs[MAX_BLOBS]);
+    void add_remaining_blobs_to_tracked(Blob new_blobs[], TrackedBlob old_tracked_blobs[]);
 
     /**
     * Get the number of blobs that have been updated in the tracked blob list
     * @param tracked_blobs List containing the tracked blobs
     * @return Number of tracked blobs that have been updated
     */
-    int get_num_updated_blobs(TrackedBlob tracked_blobs[MAX_BLOBS]);
+    int get_num_updated_blobs(TrackedBlob tracked_blobs[]);
 
     /**
     * Get the number of blobs that have not been assigned to a tracked blob
     * @param blobs A list of blobs to be tracked
     * @return Number of blobs that are not assigned to tracked blobs
     */
-    int get_num_unassigned_blobs(Blob blobs[MAX_BLOBS]);
+    int get_num_unassigned_blobs(Blob blobs[]);
 
     /**
     * Update the details of previously tracked blobs if there is a similar enough to a current blob.
+    * Pairs are matched greedily, lowest difference first, until no pair is under the maximum difference threshold.
+    * Tracked blobs that have merged into the same blob are then carried through the frame together.
     * @param new_blobs Blobs from the last frame
     * @param tracked_blobs Previously tracked blobs to be updated if there are any matches
     */
-    void update_tracked_blobs(Blob new_blobs[MAX_BLOBS], TrackedBlob old_tracked_blobs[MAX_BLOBS]);
+    void update_tracked_blobs(Blob new_blobs[], TrackedBlob old_tracked_blobs[]);
 
     /**
-    * Generate a matrix of the differences between the tracked blobs and blobs.
-    * @param tracked_blobs List containing the tracked blobs
-    * @param blobs List containing the new blobs from the frame
-    * @param output Matrix to store the difference values
-    */
-    void generate_difference_matrix(TrackedBlob tracked_blobs[MAX_BLOBS], Blob blobs[MAX_BLOBS],
-                                    float output[MAX_BLOBS][MAX_BLOBS]);
-
-    /**
-    * Get the index and value of the lowest difference in the difference matrix
-    * @param difference_matrix Matrix containing the difference values between the different tracked blobs and normal
-    * blobs.
-    * @param indexes The location of the lowest difference in the matrix.
-    */
-    float get_lowest_difference(float difference_matrix[MAX_BLOBS][MAX_BLOBS], int indexes[2]);
-
-    /**
-    * Remove a row and column from the difference matrix so it cannot be used in matching up blobs with tracked blobs.
-    * The entire row and column are marked with a difference of 999, which is far above the maximum difference
-    * threshold.
-    * You'd use this function after a match has been found between a blob and a tracked blob.
-    * @param row The row number (tracked blob index) to remove from the difference matrix
-    * @param col The coloumn number (blob index) to remove from the difference matrix
-    * @param difference_matrix A 2D matrix containing the combination of difference between tracked blobs and blobs
+    * Find the best MAX_MATCH_CANDIDATES tracked blobs for each new blob, out of those whose difference is under the
+    * maximum difference threshold.
+    * Tracked blobs are sorted by position first, and each new blob is scored against them nearest first. Once a new
+    * blob has a full list, the search stops at the first tracked blob too far away for the position penalty alone to
+    * beat the worst one kept, so both the scoring and the candidate list grow with the capacity, not its square.
+    * @param new_blobs Blobs from the latest frame
+    * @param tracked_blobs Tracked blobs from the previous frame
+    * @param candidates Array of at least capacity * MAX_MATCH_CANDIDATES candidates to fill
+    * @return Number of candidates found
     */
-    void remove_difference_row_col(int row, int col, float difference_matrix[MAX_BLOBS][MAX_BLOBS]);
+    int find_match_candidates(Blob new_blobs[], TrackedBlob tracked_blobs[], MatchCandidate candidates[]);
 
     /**
     * Check if a dying tracked blob has travelled far enough to register a movement.
     * If a tracked blob travels over the the net minimum travel threshold.
     * @param blob Tracked blob to be processed. Contains the travel information.
     */
-    void process_blob_movements(TrackedBlob blob);
+    void process_blob_movements(TrackedBlob& blob);
 
     /**
     * Increment the movement of the specified direction
@@ -282,12 +586,80 @@ class ThermalTracker {
     */
     void set_tracking_end_callback(tracked_callback callback = NULL);
 
+    ////////////////////////////////////////////////////////////////////////////////
+    // Counting lines
+
+    /**
+    * Add a counting line.
+    * Tracked blobs are checked against the line every time they move, so crossings are counted on the frame they happen
+    * rather than when the track ends.
+    * @param start_x Column the line starts at
+    * @param start_y Row the line starts at
+    * @param end_x Column the line ends at
+    * @param end_y Row the line ends at
+    * @return Index of the new line in counting_lines, or -1 if there are already MAX_COUNTING_LINES
+    */
+    int add_counting_line(float start_x, float start_y, float end_x, float end_y);
+
+    /**
+    * Remove every counting line.
+    */
+    void clear_counting_lines();
+
+    /**
+    * Reset the crossing counts of every counting line back to zeroes.
+    */
+    void reset_line_crossings();
+
+    /**
+    * Check the last movement of a tracked blob against the counting lines, counting and reporting any it crossed.
+    * Costs O(lines) per tracked blob. Movements over MAX_CROSSING_STEP are a track jumping to someone else rather than
+    * walking, so they are never counted.
+    * @param blob Tracked blob that has just moved
+    * @param last_position Position the tracked blob moved from, indexed by X and Y
+    */
+    void check_counting_lines(TrackedBlob& blob, const float last_position[2]);
+
+    /**
+    * Set the callback for when a tracked blob crosses a counting line
+    * Call without parameters to clear the callback
+    *
+    * @param callback Function to call when a line is crossed (tracked blob, line and crossing are passed)
+    */
+    void set_line_crossing_callback(crossing_callback callback = NULL);
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Stage timing
+
+    /**
+    * Get the timing of one stage of the update.
+    * @param stage Stage from tracker_stages
+    * @param timing Timing to fill in, in microseconds
+    * @return False if the stage is not valid or the tracker was built without TRACKER_STAGE_TIMING
+    */
+    bool get_stage_timing(int stage, StageTiming& timing);
+
+    /**
+    * Get the name of a stage, for reports.
+    * @param stage Stage from tracker_stages
+    */
+    static const char* get_stage_name(int stage);
+
+    /**
+    * Reset the timing of every stage.
+    */
+    void reset_stage_timing();
+
     ////////////////////////////////////////////////////////////////////////////////
     // Variables
 
-    TrackedBlob tracked_blobs[MAX_BLOBS];
+    TrackedBlob* tracked_blobs; /**< get_blob_capacity() tracked blobs */
     tracked_callback tracking_start_callback;
     tracked_callback tracking_end_callback;
+    crossing_callback line_crossing_callback;
+
+    CountingLine counting_lines[MAX_COUNTING_LINES];
+    int num_counting_lines;
 
     // Running configuration
     int running_average_size;
@@ -297,19 +669,142 @@ class ThermalTracker {
     float minimum_temperature_differential;
     float active_pixel_variance_scalar;
     int max_dead_frames;
+    int max_merged_frames; /**< Longest a merged tracked blob is kept alive (up to 255); 0 turns merging off */
 
     // Runtime variables
     int num_background_frames;
-    float frame[FRAME_HEIGHT][FRAME_WIDTH];
-    float pixel_averages[FRAME_HEIGHT][FRAME_WIDTH];
-    float pixel_variance[FRAME_HEIGHT][FRAME_WIDTH];
     long movements[5];
 
+    // Snapshot of the last completed update. These point into the tracker's double buffers and are swapped, never
+    // written through, so a reader always sees a frame together with the background it was compared against.
+    const float (*frame)[FRAME_WIDTH];
+    const float (*pixel_averages)[FRAME_WIDTH];
+    const float (*pixel_variance)[FRAME_WIDTH];
+    unsigned long frame_sequence; /**< Number of frames published; changes whenever the snapshot does */
+
+    // Frames processed since the background finished, split by whether the blob and tracking stages had to run
+    unsigned long num_idle_frames;
+    unsigned long num_active_frames;
+    uint64_t idle_frame_micros;   /**< Total processing time of the idle frames */
+    uint64_t active_frame_micros; /**< Total processing time of the active frames */
+
+    // Capacity overflows - if these climb, the tracker needs a larger blob capacity
+    unsigned long num_blob_overflows;  /**< Frames where clustering stopped at capacity with pixels left over */
+    unsigned long num_dropped_pixels;  /**< Active pixels left out of any blob by those overflows */
+    unsigned long num_track_overflows; /**< New blobs that could not be tracked because every track was in use */
+
+    // Merges and splits - tracked blobs carried through frames where they were merged with another
+    unsigned long num_track_merges; /**< Tracked blobs that merged into another tracked blob's blob */
+    unsigned long num_track_splits; /**< Merged tracked blobs that picked up a blob of their own again */
+
+    /**
+    * Deepest stack use below update() in any update so far, in bytes, found by stack painting, so it includes qsort,
+    * the tracking callbacks and everything else called from the update. It cannot exceed the painted area; see
+    * stack_paint_exhausted. 0 unless the tracker is built with TRACKER_STACK_PAINT_SIZE.
+    */
+    unsigned int stack_high_water;
+    bool stack_paint_exhausted; /**< Set if an update overwrote the whole painted area, so it went deeper still */
+
     int num_unchanged_frames;
     int num_last_blobs;
     bool movement_changed_since_last_check;
+    unsigned int next_track_id;
 
    private:
+    /**
+    * Run the background and tracking stages on the frame pointed to by current_frame.
+    */
+    void process_current_frame();
+
+    /**
+    * Test every pixel of the current frame against the background and, in the same sweep, write the frame's rolling
+    * background update into the back background buffers. The update is only published if the frame turns out to
+    * belong in the background.
+    * @param active_indexes Array to pass the active pixel indexes (row * FRAME_WIDTH + column) into
+    * @return Number of active pixels
+    */
+    int scan_current_frame(uint8_t active_indexes[]);
+
+    /**
+    * Append a tracking event to the active event sink.
+    * @param type TRACKING_EVENT_START, TRACKING_EVENT_END or TRACKING_EVENT_CROSSING
+    * @param blob Tracked blob the event is for
+    * @param direction Movement recorded for the blob, or the line crossing; NO_DIRECTION for start events
+    * @param line Counting line crossed, for crossing events
+    */
+    void record_event(int type, TrackedBlob& blob, int direction, int line = NO_COUNTING_LINE);
+
+    /**
+    * Make the back frame buffer the published frame.
+    */
+    void publish_frame();
+
+    /**
+    * Make the back background buffers the published background.
+    */
+    void publish_background();
+
+    float frame_buffers[2][FRAME_HEIGHT][FRAME_WIDTH];
+    float average_buffers[2][FRAME_HEIGHT][FRAME_WIDTH];
+    float variance_buffers[2][FRAME_HEIGHT][FRAME_WIDTH];
+    int back_frame;      /**< Index of the frame buffer being filled by the driver */
+    int back_background; /**< Index of the background buffers being written by the current update */
+
+    BlobScratch scratch;
+
+#if TRACKER_STAGE_TIMING
+    Histogram stage_timings[NUM_TRACKER_STAGES]; /**< Durations in ticks, indexed by tracker_stages */
+#endif
+
+    // Storage allocated once by the constructor, sized by the blob capacity
+    int blob_capacity;
+    Blob* frame_blobs;                 /**< Blobs of the frame being tracked */
+    MatchCandidate* match_candidates;  /**< capacity * MAX_MATCH_CANDIDATES */
+    uint8_t* track_order;              /**< Active tracked blob indexes, sorted by position while matching */
+    uint8_t* track_matches;            /**< Blob matched to each tracked blob, or NO_MATCH */
+    uint8_t* blob_matches;             /**< Tracked blob matched to each blob, or NO_MATCH */
+    uint8_t* track_groups;             /**< Blob each merged tracked blob is grouped on, or NO_MATCH */
+    uint8_t* track_partners;           /**< Tracked blob each merged tracked blob was last grouped with, or NO_MATCH */
+
+    TrackedBlob* published_tracks; /**< Copy of tracked_blobs for other threads; tracked_blobs itself on the ESP8266 */
+    int num_published_slots;       /**< Slots copied by the last publish; the ones after it are published as free */
+
+    // Sequence lock over published_tracks: odd while they are being written
+#ifdef ARDUINO_ARCH_ESP8266
+    volatile unsigned long track_sequence;
+#else
+    std::atomic<unsigned long> track_sequence;
+#endif
+    uintptr_t stack_base;    /**< Stack position on entry to update() */
+    uintptr_t stack_painted; /**< Lowest address of the painted area; 0 if nothing was painted */
+
+    /**
+    * Fill the stack below the caller's frame with STACK_PAINT_PATTERN.
+    */
+    void paint_stack();
+
+    /**
+    * Find the deepest painted byte the update overwrote, and raise stack_high_water to match.
+    */
+    void measure_stack();
+
+    /**
+    * Make the tracks from the last tracking pass visible to read_track and read_track_handles.
+    */
+    void publish_tracks();
+
+    /**
+    * Start and finish a read of published_tracks from another thread.
+    * @return begin_track_read: the sequence number, odd if the tracks are being updated. end_track_read: true if
+    * the tracks did not change since begin_track_read returned sequence.
+    */
+    unsigned long begin_track_read();
+    bool end_track_read(unsigned long sequence);
+
+    const float (*current_frame)[FRAME_WIDTH]; /**< Frame being processed; the back buffer or a batch frame */
+    EventSink* event_sink;                     /**< Set while update_batch is running */
+    unsigned long event_frame;
+
     /**
     * Load an input frame into the buffer.
     * @param frame_buffer A 2D array containing the pixel temperatures to be added to the buffer
@@ -326,4 +821,10 @@ class ThermalTracker {
     * a fixed population size.
     */
     void build_background();
+
+    // The published pointers refer to the tracker's own buffers, so trackers can't be copied
+    ThermalTracker(const ThermalTracker&);
+    ThermalTracker& operator=(const ThermalTracker&);
 };
+
+#endif
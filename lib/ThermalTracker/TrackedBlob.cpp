@@ -1,4 +1,5 @@
 #include "TrackedBlob.h"
+#include <math.h>
 
 float absolute(float f) {
     if (f < 0.0) {
@@ -13,6 +14,10 @@ float TrackedBlob::aspect_ratio_penalty = 0;
 float TrackedBlob::temperature_penalty = 0;
 float TrackedBlob::direction_penalty = 0;
 float TrackedBlob::dead_frame_penalty = 0;
+int TrackedBlob::predictor = PREDICT_LAST_MOVEMENT;
+float TrackedBlob::process_noise = 0;
+float TrackedBlob::measurement_noise = 1;
+float TrackedBlob::steady_gain[2] = {1, 1};
 
 int TrackedBlob::frame_width = 16;
 
@@ -27,12 +32,38 @@ TrackedBlob::TrackedBlob() {
     * updates)
     */
 
+    generation = 0;
     clear();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // Public Methods
 
+void TrackedBlob::set_predictor(int _predictor, float _process_noise, float _measurement_noise) {
+    /**
+    * Choose how tracked blobs predict their next position.
+    * Shared by every tracked blob, like the penalties. Without TRACKER_POSITION_FILTER this is always
+    * PREDICT_LAST_MOVEMENT.
+    * @param predictor One of position_predictors
+    * @param process_noise Standard deviation of a blob's change in speed between frames, in pixels/frame^2
+    * @param measurement_noise Standard deviation of the error in a blob's centroid, in pixels
+    */
+#if TRACKER_POSITION_FILTER
+    predictor = _predictor;
+#else
+    (void)_predictor;
+    predictor = PREDICT_LAST_MOVEMENT;
+#endif
+    process_noise = _process_noise;
+    measurement_noise = _measurement_noise;
+
+    // Steady-state gains from the tracking index (Kalata, 1984); what the full filter's gains settle to
+    float index = measurement_noise > 0 ? process_noise / measurement_noise : 1000;
+    float root = (4 + index - sqrtf(8 * index + index * index)) / 4;
+    steady_gain[0] = 1 - root * root;
+    steady_gain[1] = 2 * (2 - steady_gain[0]) - 4 * sqrtf(1 - steady_gain[0]);
+}
+
 void TrackedBlob::clear() {
     /**
     * Clear the tracked blob's characteristics
@@ -48,17 +79,24 @@ void TrackedBlob::clear() {
     total_travel[X] = 0;
     total_travel[Y] = 0;
     max_size = 0;
-    max_difference = 0;
-    average_difference = 0;
     max_width = 0;
     max_height = 0;
     num_dead_frames = 0;
+    max_num_dead_frames = 0;
+    num_merged_frames = 0;
+
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_SUMMARY
+    max_difference = 0;
+    average_difference = 0;
+#endif
+
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_FULL
     average_position_difference = 0;
     average_aspect_ratio_difference = 0;
     average_area_difference = 0;
     average_direction_difference = 0;
     average_temperature_difference = 0;
-    max_num_dead_frames = 0;
+#endif
 
     reset_updated_status();
 }
@@ -79,6 +117,16 @@ void TrackedBlob::set(Blob blob) {
     start_time = millis();
     max_width = blob.width;
     max_height = blob.height;
+
+#if TRACKER_POSITION_FILTER
+    filter_position[X] = blob.centroid[X];
+    filter_position[Y] = blob.centroid[Y];
+    filter_velocity[X] = 0;
+    filter_velocity[Y] = 0;
+    filter_covariance[0] = measurement_noise * measurement_noise;
+    filter_covariance[1] = 0;
+    filter_covariance[2] = KALMAN_INITIAL_VELOCITY_VARIANCE;
+#endif
 }
 void TrackedBlob::set(Blob blob, unsigned int _id) {
     id = _id;
@@ -102,7 +150,9 @@ void TrackedBlob::update_blob(Blob blob) {
     */
 
     event_duration = millis() - start_time;
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_SUMMARY
     update_differences(blob);
+#endif
 
     update_movements(blob);
     copy_blob(blob);
@@ -113,6 +163,7 @@ void TrackedBlob::update_blob(Blob blob) {
         max_num_dead_frames = num_dead_frames;
     }
     num_dead_frames = 0;
+    num_merged_frames = 0;
     times_updated++;
 }
 
@@ -125,8 +176,17 @@ void TrackedBlob::update_movements(Blob blob) {
     movement[X] = blob.centroid[X] - _blob.centroid[X];
     movement[Y] = blob.centroid[Y] - _blob.centroid[Y];
 
-    predicted_position[X] = blob.centroid[X] + movement[X];
-    predicted_position[Y] = blob.centroid[Y] + movement[Y];
+#if TRACKER_POSITION_FILTER
+    if (predictor != PREDICT_LAST_MOVEMENT) {
+        update_filter(blob);
+        predicted_position[X] = filter_position[X] + filter_velocity[X];
+        predicted_position[Y] = filter_position[Y] + filter_velocity[Y];
+    } else
+#endif
+    {
+        predicted_position[X] = blob.centroid[X] + movement[X];
+        predicted_position[Y] = blob.centroid[Y] + movement[Y];
+    }
 
     travel[X] += movement[X];
     travel[Y] += movement[Y];
@@ -135,6 +195,92 @@ void TrackedBlob::update_movements(Blob blob) {
     total_travel[Y] += abs(movement[Y]);
 }
 
+#if TRACKER_POSITION_FILTER
+void TrackedBlob::update_filter(Blob blob) {
+    /**
+    * Run the constant-velocity filter on a new centroid.
+    * The frames the blob was missing for are predicted over in one step.
+    * @param blob New blob state
+    */
+    float dt = 1 + num_dead_frames;
+    float gain[2];
+
+    if (predictor == PREDICT_KALMAN_STEADY) {
+        gain[0] = steady_gain[0];
+        gain[1] = steady_gain[1] / dt;
+    } else {
+        // Predict the covariance forward, with random changes in speed between frames
+        float q = process_noise * process_noise;
+        float dt2 = dt * dt;
+        float position_variance = filter_covariance[0] + dt * (2 * filter_covariance[1] + dt * filter_covariance[2]) +
+                                  q * dt2 * dt2 / 4;
+        float covariance = filter_covariance[1] + dt * filter_covariance[2] + q * dt2 * dt / 2;
+        float velocity_variance = filter_covariance[2] + q * dt2;
+
+        // Both axes see the same noise, so they share the covariance and gains
+        float innovation_variance = position_variance + measurement_noise * measurement_noise;
+        gain[0] = position_variance / innovation_variance;
+        gain[1] = covariance / innovation_variance;
+
+        filter_covariance[0] = (1 - gain[0]) * position_variance;
+        filter_covariance[1] = (1 - gain[0]) * covariance;
+        filter_covariance[2] = velocity_variance - gain[1] * covariance;
+    }
+
+    for (int axis = 0; axis < 2; axis++) {
+        float predicted = filter_position[axis] + filter_velocity[axis] * dt;
+        float residual = blob.centroid[axis] - predicted;
+
+        filter_position[axis] = predicted + gain[0] * residual;
+        filter_velocity[axis] += gain[1] * residual;
+    }
+}
+#endif
+
+void TrackedBlob::update_merged(Blob group) {
+    /**
+    * Carry the tracked blob through a frame where it has merged into a blob tracked by another tracked blob.
+    * The tracked blob keeps its own size and shape, and moves on at its predicted speed while staying within the
+    * merged blob, so it can pick up its own blob again when the group splits.
+    * @param group Blob the tracked blob has merged into
+    */
+    float velocity = 0;
+    float position;
+
+    // Coast at the filter's speed, or the average speed so far; the last movement alone is mostly 0 or 1 pixel
+#if TRACKER_POSITION_FILTER
+    if (predictor != PREDICT_LAST_MOVEMENT) {
+        velocity = filter_velocity[X];
+        position = filter_position[X] + velocity;
+    } else
+#endif
+    {
+        int num_frames = times_updated + num_merged_frames;
+        if (num_frames > 0) {
+            velocity = travel[X] / num_frames;
+        }
+        position = _blob.centroid[X] + velocity;
+    }
+
+    // Allow a pixel either side, so a tracked blob walking out of the group or off the frame is let go of
+    position = constrain(position, group.min[X] - 1, group.max[X] + 1);
+
+    float movement = position - _blob.centroid[X];
+    travel[X] += movement;
+    total_travel[X] += abs(movement);
+
+    _blob.centroid[X] = position;
+#if TRACKER_POSITION_FILTER
+    filter_position[X] = position;
+#endif
+    predicted_position[X] = position + velocity;
+    predicted_position[Y] = _blob.centroid[Y];
+
+    event_duration = millis() - start_time;
+    has_updated = true;
+    num_merged_frames++;
+}
+
 void TrackedBlob::update_geometry(Blob blob) {
     /**
     * Update the geometry variables that need to change from the last blob update
@@ -156,8 +302,10 @@ void TrackedBlob::update_geometry(Blob blob) {
 void TrackedBlob::update_differences(Blob blob) {
     /**
     * Update the difference factors from the last blob update
+    * Diagnostics only; see TRACKER_DIAGNOSTICS_LEVEL.
     * @return None
     */
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_SUMMARY
     float difference = get_difference(blob);
 
     // Calculate average difference
@@ -168,7 +316,11 @@ void TrackedBlob::update_differences(Blob blob) {
     if (difference > max_difference) {
         max_difference = difference;
     }
+#else
+    (void)blob;
+#endif
 
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_FULL
     average_area_difference = (average_area_difference * times_updated + area_difference) / (times_updated + 1);
 
     average_position_difference =
@@ -182,6 +334,7 @@ void TrackedBlob::update_differences(Blob blob) {
 
     average_temperature_difference =
         (average_temperature_difference * times_updated + temperature_difference) / (times_updated + 1);
+#endif
 }
 
 void TrackedBlob::reset_updated_status() {
@@ -195,13 +348,14 @@ void TrackedBlob::reset_updated_status() {
 void TrackedBlob::copy(TrackedBlob tblob) {
     /**
     * Overwrite the tracked blob with the information from another tracked blob.
-    * Useful for shuffling tracked blobs around in arrays
+    * Useful for keeping a snapshot of a track that has ended
     * Information from the source blob completely overwrites any currently-held information
     * @param tblob Tracked blob to copy information from
     */
     copy_blob(tblob._blob);
 
     id = tblob.id;
+    generation = tblob.generation;
     predicted_position[X] = tblob.predicted_position[X];
     predicted_position[Y] = tblob.predicted_position[Y];
     travel[Y] = tblob.travel[Y];
@@ -215,18 +369,35 @@ void TrackedBlob::copy(TrackedBlob tblob) {
     event_duration = tblob.event_duration;
     has_updated = tblob.has_updated;
     times_updated = tblob.times_updated;
-    average_difference = tblob.average_difference;
-    max_difference = tblob.max_difference;
     max_size = tblob.max_size;
     max_width = tblob.max_width;
     max_height = tblob.max_height;
+    max_num_dead_frames = tblob.max_num_dead_frames;
+    num_dead_frames = tblob.num_dead_frames;
+    num_merged_frames = tblob.num_merged_frames;
+
+#if TRACKER_POSITION_FILTER
+    for (int i = 0; i < 2; i++) {
+        filter_position[i] = tblob.filter_position[i];
+        filter_velocity[i] = tblob.filter_velocity[i];
+    }
+    for (int i = 0; i < 3; i++) {
+        filter_covariance[i] = tblob.filter_covariance[i];
+    }
+#endif
+
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_SUMMARY
+    average_difference = tblob.average_difference;
+    max_difference = tblob.max_difference;
+#endif
+
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_FULL
     average_area_difference = tblob.average_area_difference;
     average_position_difference = tblob.average_position_difference;
     average_aspect_ratio_difference = tblob.average_aspect_ratio_difference;
     average_direction_difference = tblob.average_direction_difference;
     average_temperature_difference = tblob.average_temperature_difference;
-    max_num_dead_frames = tblob.max_num_dead_frames;
-    num_dead_frames = tblob.num_dead_frames;
+#endif
 }
 
 float TrackedBlob::get_travel(int axis) {
@@ -259,18 +430,25 @@ float TrackedBlob::get_difference(Blob other_blob) {
     float difference_factor = 0.0;
 
     edge_penalty = get_edge_penalty(other_blob.centroid[X]);
-    position_difference = calculate_position_difference(other_blob);
-    area_difference = calculate_area_difference(other_blob);
-    aspect_ratio_difference = calculate_aspect_ratio_difference(other_blob);
-    temperature_difference = calculate_temperature_difference(other_blob);
-    direction_difference = calculate_direction_difference(other_blob);
+    float position = calculate_position_difference(other_blob);
+    float area = calculate_area_difference(other_blob);
+    float aspect_ratio = calculate_aspect_ratio_difference(other_blob);
+    float temperature = calculate_temperature_difference(other_blob);
+    float direction = calculate_direction_difference(other_blob);
+
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_FULL
+    position_difference = position;
+    area_difference = area;
+    aspect_ratio_difference = aspect_ratio;
+    temperature_difference = temperature;
+    direction_difference = direction;
     dead_frame_difference = calculate_dead_frame_difference();
+#endif
 
     // Soften the difference if the blob is touching the sides of the frame
     // Blobs close to the centre do not get much leeway
     // Blobs close to the edges are probably still forming, so the penalties are softened a bunch
-    difference_factor =
-        position_difference + area_difference + aspect_ratio_difference + temperature_difference + direction_difference;
+    difference_factor = position + area + aspect_ratio + temperature + direction;
 
     return difference_factor;
 }
@@ -279,12 +457,35 @@ float TrackedBlob::get_edge_penalty(float position) {
     float edge_penalty = 1;
 
     if (is_touching_side()) {
-        edge_penalty = (1 - absolute((frame_width / 2 - position)) / (frame_width / 2));
+        edge_penalty = get_side_edge_penalty(position);
     }
 
     return edge_penalty;
 }
 
+float TrackedBlob::get_side_edge_penalty(float position) {
+    /**
+    * Get the edge penalty a blob at a position would get from a tracked blob touching the side of the frame.
+    * This is the smallest edge penalty any tracked blob can apply at that position.
+    * @param position Centroid X of the blob being compared
+    * @return Edge penalty scalar, from 0 (at the frame edge) to 1 (in the middle)
+    */
+    return (1 - absolute((frame_width / 2 - position)) / (frame_width / 2));
+}
+
+float TrackedBlob::get_match_position(int axis) {
+    /**
+    * Get the position new blobs are compared against: the predicted position once the tracked blob has moved, or its
+    * centroid before then.
+    * @param axis Axis (X or Y) of the position
+    */
+    if (predicted_position[X] >= 0 && predicted_position[Y] >= 0) {
+        return predicted_position[axis];
+    }
+
+    return _blob.centroid[axis];
+}
+
 void TrackedBlob::copy_blob(Blob blob) {
     /**
     * Copy the details from a given blob into the tracked blob.
@@ -305,13 +506,8 @@ void TrackedBlob::copy_blob(Blob blob) {
 
 float TrackedBlob::calculate_position_difference(Blob other_blob) {
     float difference_factor = 0;
-    if (predicted_position[X] >= 0 && predicted_position[Y] >= 0) {
-        difference_factor += absolute(predicted_position[X] - other_blob.centroid[X]) * position_penalty;
-        difference_factor += absolute(predicted_position[Y] - other_blob.centroid[Y]) * position_penalty;
-    } else {
-        difference_factor += absolute(_blob.centroid[X] - other_blob.centroid[X]) * position_penalty;
-        difference_factor += absolute(_blob.centroid[Y] - other_blob.centroid[Y]) * position_penalty;
-    }
+    difference_factor += absolute(get_match_position(X) - other_blob.centroid[X]) * position_penalty;
+    difference_factor += absolute(get_match_position(Y) - other_blob.centroid[Y]) * position_penalty;
     return difference_factor * edge_penalty;
 }
 
@@ -329,7 +525,7 @@ float TrackedBlob::calculate_aspect_ratio_difference(Blob other_blob) {
     return difference * edge_penalty;
 }
 
-float TrackedBlob::calculate_direction_difference(Blob other_blob) {
+float TrackedBlob::calculate_direction_difference(Blob /* other_blob */) {
     /**
     * Calculate the penalty for any changes in the blobs direction of travel
     * This penalty is binary.
@@ -343,7 +539,7 @@ float TrackedBlob::calculate_direction_difference(Blob other_blob) {
     int latest_direction = predicted_position[X] - _blob.centroid[X];
 
     // Check if that direction matches the overall travel of the blob
-    if (!is_touching_side() && times_updated > 1 && (latest_direction >= 0) != (travel >= 0)) {
+    if (!is_touching_side() && times_updated > 1 && (latest_direction >= 0) != (travel[X] >= 0)) {
         difference += direction_penalty;
     }
 
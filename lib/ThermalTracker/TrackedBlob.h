@@ -6,12 +6,59 @@
 
 float absolute(float f);
 
-const static char* TBLOB_VERSION = "20170825";
+const static char* const TBLOB_VERSION = "20170825";
+
+// Tracking diagnostics kept on each tracked blob. Set TRACKER_DIAGNOSTICS_LEVEL in the build flags:
+//  - NONE: nothing; tracking does no extra work for them
+//  - SUMMARY: average and maximum match difference (one extra difference evaluation per update)
+//  - FULL: SUMMARY plus every difference term of the last match evaluation and their running averages
+// Defaults to FULL, or NONE for the compact layout.
+#define TRACKER_DIAGNOSTICS_NONE 0
+#define TRACKER_DIAGNOSTICS_SUMMARY 1
+#define TRACKER_DIAGNOSTICS_FULL 2
+
+#ifndef TRACKER_DIAGNOSTICS_LEVEL
+#ifdef TRACKED_BLOB_COMPACT
+#define TRACKER_DIAGNOSTICS_LEVEL TRACKER_DIAGNOSTICS_NONE
+#else
+#define TRACKER_DIAGNOSTICS_LEVEL TRACKER_DIAGNOSTICS_FULL
+#endif
+#endif
+
+// Constant-velocity filter state for PREDICT_KALMAN and PREDICT_KALMAN_STEADY: seven floats on every tracked blob. Set
+// TRACKER_POSITION_FILTER=0 in the build flags to leave it out; set_predictor then always uses PREDICT_LAST_MOVEMENT.
+// Defaults to on, or off for the compact layout.
+#ifndef TRACKER_POSITION_FILTER
+#ifdef TRACKED_BLOB_COMPACT
+#define TRACKER_POSITION_FILTER 0
+#else
+#define TRACKER_POSITION_FILTER 1
+#endif
+#endif
+
+// Ways of predicting where a tracked blob will be in the next frame; see TrackedBlob::set_predictor
+enum position_predictors {
+    PREDICT_LAST_MOVEMENT = 0, /**< Centroid plus the movement since the last frame */
+    PREDICT_KALMAN = 1,        /**< Constant-velocity Kalman filter */
+    PREDICT_KALMAN_STEADY = 2  /**< Constant-velocity filter with precomputed steady-state gains (alpha-beta) */
+};
+
+const float KALMAN_INITIAL_VELOCITY_VARIANCE = 1.0; /**< (pixels/frame)^2; new tracks could be going either way */
 
 class TrackedBlob {
    public:
     TrackedBlob();
 
+    /**
+    * Choose how tracked blobs predict their next position.
+    * Shared by every tracked blob, like the penalties. Without TRACKER_POSITION_FILTER this is always
+    * PREDICT_LAST_MOVEMENT.
+    * @param predictor One of position_predictors
+    * @param process_noise Standard deviation of a blob's change in speed between frames, in pixels/frame^2
+    * @param measurement_noise Standard deviation of the error in a blob's centroid, in pixels
+    */
+    static void set_predictor(int predictor, float process_noise, float measurement_noise);
+
     /**
     * Clear the tracked blob's characteristics
     * The tracked blob object will be marked inactive until the blob is reinitialised.
@@ -37,7 +84,24 @@ class TrackedBlob {
     void update_blob(Blob blob);
 
     void update_movements(Blob blob);
+
+#if TRACKER_POSITION_FILTER
+    /**
+    * Run the constant-velocity filter on a new centroid.
+    * The frames the blob was missing for are predicted over in one step.
+    * @param blob New blob state
+    */
+    void update_filter(Blob blob);
+#endif
     void update_geometry(Blob blob);
+
+    /**
+    * Carry the tracked blob through a frame where it has merged into a blob tracked by another tracked blob.
+    * The tracked blob keeps its own size and shape, and moves on at its predicted speed while staying within the
+    * merged blob, so it can pick up its own blob again when the group splits.
+    * @param group Blob the tracked blob has merged into
+    */
+    void update_merged(Blob group);
     void update_differences(Blob blob);
 
     /**
@@ -61,6 +125,21 @@ class TrackedBlob {
 
     float get_difference(Blob other_blob);
     float get_edge_penalty(float position);
+
+    /**
+    * Get the edge penalty a blob at a position would get from a tracked blob touching the side of the frame.
+    * This is the smallest edge penalty any tracked blob can apply at that position.
+    * @param position Centroid X of the blob being compared
+    * @return Edge penalty scalar, from 0 (at the frame edge) to 1 (in the middle)
+    */
+    static float get_side_edge_penalty(float position);
+
+    /**
+    * Get the position new blobs are compared against: the predicted position once the tracked blob has moved, or its
+    * centroid before then.
+    * @param axis Axis (X or Y) of the position
+    */
+    float get_match_position(int axis);
     float calculate_position_difference(Blob other_blob);
     float calculate_area_difference(Blob other_blob);
     float calculate_temperature_difference(Blob other_blob);
@@ -84,7 +163,7 @@ class TrackedBlob {
 
     /**
     * Overwrite the tracked blob with the information from another tracked blob.
-    * Useful for shuffling tracked blobs around in arrays
+    * Useful for keeping a snapshot of a track that has ended
     * Information from the source blob completely overwrites any currently-held information
     * @param tblob Tracked blob to copy information from
     */
@@ -103,39 +182,57 @@ class TrackedBlob {
     static float temperature_penalty;
     static float direction_penalty;
     static float dead_frame_penalty;
+    static int predictor;
+    static float process_noise;
+    static float measurement_noise;
+    static float steady_gain[2]; /**< Position and velocity gains used by PREDICT_KALMAN_STEADY */
     static int frame_width;
 
-    float predicted_position[2];
-    float travel[2];
+    blob_position_t predicted_position[2];
+    blob_position_t travel[2];
     int total_travel[2];
     long start_time;
     long event_duration;
     bool has_updated;
     int times_updated;
-    float start_pos[2];
+    blob_position_t start_pos[2];
+    blob_size_t max_size;
+    blob_size_t max_width;
+    blob_size_t max_height;
+    unsigned int id;
+    uint16_t generation; /**< Bumped by the tracker each time the slot starts a new track; see TrackHandle */
+    blob_size_t num_dead_frames;
+    blob_size_t max_num_dead_frames;
+    blob_size_t num_merged_frames; /**< Frames the tracked blob has been merged into another blob for */
+    float edge_penalty;
+
+#if TRACKER_POSITION_FILTER
+    // Constant-velocity filter state; unused by PREDICT_LAST_MOVEMENT
+    float filter_position[2];
+    float filter_velocity[2];
+    float filter_covariance[3]; /**< Position variance, covariance, velocity variance; the same for both axes */
+#endif
+
+    // Diagnostics; only used for logging and the debug web page
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_SUMMARY
     float average_difference;
     float max_difference;
-    int max_size;
-    int max_width;
-    int max_height;
-    unsigned int id;
-    unsigned int num_dead_frames;
+#endif
 
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_FULL
     float position_difference;
     float direction_difference;
     float temperature_difference;
     float aspect_ratio_difference;
     float area_difference;
     float dead_frame_difference;
-    float edge_penalty;
 
     float average_position_difference;
     float average_direction_difference;
     float average_temperature_difference;
     float average_aspect_ratio_difference;
     float average_area_difference;
-
-    int max_num_dead_frames;
+#endif
 };
 
 #endif
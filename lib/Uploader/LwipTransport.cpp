@@ -0,0 +1,198 @@
+#include "LwipTransport.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+
+LwipTransport::LwipTransport() {
+    lookup_started = false;
+    lookup_progress = TRANSPORT_PENDING;
+    pcb = NULL;
+    connect_progress = TRANSPORT_PENDING;
+    received = NULL;
+    received_offset = 0;
+    remote_closed = false;
+}
+
+LwipTransport::~LwipTransport() { close(); }
+
+////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+
+int LwipTransport::resolve(const char* host) {
+    /**
+    * Look up the address of a host.
+    * lwIP answers from its cache or parses a dotted address straight away; otherwise the lookup finishes in
+    * handle_dns_found.
+    */
+    if (!lookup_started) {
+        lookup_started = true;
+        lookup_progress = TRANSPORT_PENDING;
+
+        err_t err = dns_gethostbyname(host, &address, handle_dns_found, this);
+        if (err == ERR_OK) {
+            lookup_progress = TRANSPORT_DONE;
+        } else if (err != ERR_INPROGRESS) {
+            lookup_progress = TRANSPORT_FAILED;
+        }
+    }
+
+    // The next call starts a new lookup
+    if (lookup_progress != TRANSPORT_PENDING) {
+        lookup_started = false;
+    }
+
+    return lookup_progress;
+}
+
+int LwipTransport::connect(uint16_t port) {
+    /**
+    * Open a connection to the address last resolved.
+    * The first call starts connecting; the connection is made in handle_connected, or fails in handle_error.
+    */
+    if (pcb == NULL && connect_progress == TRANSPORT_PENDING) {
+        pcb = tcp_new();
+        if (pcb == NULL) {
+            return TRANSPORT_FAILED;
+        }
+
+        remote_closed = false;
+        tcp_arg(pcb, this);
+        tcp_err(pcb, handle_error);
+        tcp_recv(pcb, handle_received);
+
+        if (tcp_connect(pcb, &address, port, handle_connected) != ERR_OK) {
+            close();
+            return TRANSPORT_FAILED;
+        }
+    }
+
+    return connect_progress;
+}
+
+int LwipTransport::write(const uint8_t* data, size_t length) {
+    /**
+    * Send as much of some data as fits in the connection's send buffer, copying it there.
+    */
+    if (pcb == NULL || connect_progress != TRANSPORT_DONE) {
+        return -1;
+    }
+
+    size_t room = tcp_sndbuf(pcb);
+    if (length > room) {
+        length = room;
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    // Out of memory for segments is worth trying again later
+    if (tcp_write(pcb, data, length, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+        return 0;
+    }
+    tcp_output(pcb);
+
+    return length;
+}
+
+int LwipTransport::read(uint8_t* buffer, size_t length) {
+    /**
+    * Read from the data received so far, opening the receive window again by as much as is read.
+    */
+    if (received != NULL) {
+        size_t available = received->tot_len - received_offset;
+        if (length > available) {
+            length = available;
+        }
+
+        pbuf_copy_partial(received, buffer, length, received_offset);
+        received_offset += length;
+
+        if (received_offset == received->tot_len) {
+            pbuf_free(received);
+            received = NULL;
+            received_offset = 0;
+        }
+
+        if (pcb != NULL) {
+            tcp_recved(pcb, length);
+        }
+        return length;
+    }
+
+    if (remote_closed || pcb == NULL) {
+        return TRANSPORT_CLOSED;
+    }
+
+    return 0;
+}
+
+void LwipTransport::close() {
+    /**
+    * Close the connection, if open, and drop anything still unread.
+    */
+    if (pcb != NULL) {
+        tcp_arg(pcb, NULL);
+        tcp_err(pcb, NULL);
+        tcp_recv(pcb, NULL);
+
+        if (tcp_close(pcb) != ERR_OK) {
+            tcp_abort(pcb);
+        }
+        pcb = NULL;
+    }
+
+    if (received != NULL) {
+        pbuf_free(received);
+        received = NULL;
+    }
+
+    received_offset = 0;
+    connect_progress = TRANSPORT_PENDING;
+    remote_closed = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+
+void LwipTransport::handle_dns_found(const char* name, const ip_addr_t* found_address, void* arg) {
+    LwipTransport* transport = (LwipTransport*)arg;
+
+    if (found_address != NULL) {
+        transport->address = *found_address;
+        transport->lookup_progress = TRANSPORT_DONE;
+    } else {
+        transport->lookup_progress = TRANSPORT_FAILED;
+    }
+}
+
+err_t LwipTransport::handle_connected(void* arg, tcp_pcb* connected_pcb, err_t err) {
+    LwipTransport* transport = (LwipTransport*)arg;
+    transport->connect_progress = err == ERR_OK ? TRANSPORT_DONE : TRANSPORT_FAILED;
+    return ERR_OK;
+}
+
+err_t LwipTransport::handle_received(void* arg, tcp_pcb* receiving_pcb, pbuf* buffer, err_t err) {
+    LwipTransport* transport = (LwipTransport*)arg;
+
+    // No buffer means the other end has closed the connection
+    if (buffer == NULL) {
+        transport->remote_closed = true;
+        return ERR_OK;
+    }
+
+    if (transport->received == NULL) {
+        transport->received = buffer;
+    } else {
+        pbuf_cat(transport->received, buffer);
+    }
+
+    return ERR_OK;
+}
+
+void LwipTransport::handle_error(void* arg, err_t err) {
+    // lwIP has already freed the connection
+    LwipTransport* transport = (LwipTransport*)arg;
+    transport->pcb = NULL;
+    transport->connect_progress = TRANSPORT_FAILED;
+    transport->remote_closed = true;
+}
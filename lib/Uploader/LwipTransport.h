@@ -0,0 +1,42 @@
+#ifndef LWIP_TRANSPORT_H
+#define LWIP_TRANSPORT_H
+
+#include <Arduino.h>
+#include "UploadTransport.h"
+#include "lwip/dns.h"
+#include "lwip/tcp.h"
+
+/**
+* UploadTransport over the ESP8266's lwIP stack, using its raw callback API.
+* WiFiClient::connect() and WiFi.hostByName() wait for the network, so this talks to lwIP directly instead: lookups and
+* connections are started and then polled, and received data is held in lwIP's buffers until it is read. The
+* callbacks run between loop() iterations, never during a call to this class.
+*/
+class LwipTransport : public UploadTransport {
+   public:
+    LwipTransport();
+    ~LwipTransport();
+
+    int resolve(const char* host);
+    int connect(uint16_t port);
+    int write(const uint8_t* data, size_t length);
+    int read(uint8_t* buffer, size_t length);
+    void close();
+
+   private:
+    static void handle_dns_found(const char* name, const ip_addr_t* found_address, void* arg);
+    static err_t handle_connected(void* arg, tcp_pcb* connected_pcb, err_t err);
+    static err_t handle_received(void* arg, tcp_pcb* receiving_pcb, pbuf* buffer, err_t err);
+    static void handle_error(void* arg, err_t err);
+
+    ip_addr_t address;
+    bool lookup_started;
+    int lookup_progress; /**< TRANSPORT_ progress of the lookup, set by handle_dns_found */
+    tcp_pcb* pcb;
+    int connect_progress; /**< TRANSPORT_ progress of the connection, set by handle_connected and handle_error */
+    pbuf* received;         /**< Received data not yet read */
+    size_t received_offset; /**< Bytes of received already read */
+    bool remote_closed;
+};
+
+#endif
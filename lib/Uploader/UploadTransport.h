@@ -0,0 +1,57 @@
+#ifndef UPLOAD_TRANSPORT_H
+#define UPLOAD_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Progress of a transport operation
+const int TRANSPORT_FAILED = -1;
+const int TRANSPORT_PENDING = 0;
+const int TRANSPORT_DONE = 1;
+
+const int TRANSPORT_CLOSED = -1; /**< read(): the connection has closed and everything it sent has been read */
+
+/**
+* Interface for the TCP connection an Uploader sends its requests over.
+* No call may wait on the network: operations that cannot finish straight away report TRANSPORT_PENDING and are
+* called again until they finish. The Uploader applies the timeouts.
+*/
+class UploadTransport {
+   public:
+    virtual ~UploadTransport() {}
+
+    /**
+    * Look up the address of a host.
+    * @param host Host name or dotted address
+    * @return TRANSPORT_DONE once the address is known, TRANSPORT_PENDING while it is being looked up, or
+    * TRANSPORT_FAILED
+    */
+    virtual int resolve(const char* host) = 0;
+
+    /**
+    * Open a connection to the address last resolved.
+    * @param port TCP port to connect to
+    * @return TRANSPORT_DONE once connected, TRANSPORT_PENDING while connecting, or TRANSPORT_FAILED
+    */
+    virtual int connect(uint16_t port) = 0;
+
+    /**
+    * Send as much of some data as the connection will take right now.
+    * @return Number of bytes taken, which may be 0, or -1 if the connection has failed
+    */
+    virtual int write(const uint8_t* data, size_t length) = 0;
+
+    /**
+    * Read whatever has been received.
+    * @return Number of bytes read, which may be 0, or TRANSPORT_CLOSED once the connection has closed and been read
+    * to the end
+    */
+    virtual int read(uint8_t* buffer, size_t length) = 0;
+
+    /**
+    * Close the connection, if open, and drop anything still unread.
+    */
+    virtual void close() = 0;
+};
+
+#endif
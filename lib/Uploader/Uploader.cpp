@@ -0,0 +1,258 @@
+#include "Uploader.h"
+
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+
+Uploader::Uploader(UploadTransport& transport, const char* host, uint16_t port)
+    : transport(transport), host(host), port(port) {
+    resolve_timeout = DEFAULT_UPLOAD_RESOLVE_TIMEOUT;
+    connect_timeout = DEFAULT_UPLOAD_CONNECT_TIMEOUT;
+    response_timeout = DEFAULT_UPLOAD_RESPONSE_TIMEOUT;
+    min_backoff = DEFAULT_UPLOAD_MIN_BACKOFF;
+    max_backoff = DEFAULT_UPLOAD_MAX_BACKOFF;
+    max_attempts = DEFAULT_UPLOAD_MAX_ATTEMPTS;
+
+    state = UPLOAD_IDLE;
+    result = UPLOAD_NONE;
+    last_status = 0;
+    num_attempts = 0;
+    num_succeeded = 0;
+    num_abandoned = 0;
+    num_failed_attempts = 0;
+    num_timeouts = 0;
+    max_update_micros = 0;
+
+    request_length = 0;
+    num_sent = 0;
+    status_line_length = 0;
+    state_start = 0;
+    backoff = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+
+bool Uploader::start(const char* path, const char* body) {
+    /**
+    * Start a request. It is sent by later calls to update().
+    * @param path Path and query to request
+    * @param body JSON body to POST, or NULL to send a GET
+    * @return False if a request is already under way or the request does not fit in UPLOAD_REQUEST_SIZE
+    */
+    if (body) {
+        return start(path, (const uint8_t*)body, strlen(body), "application/json");
+    }
+
+    if (is_busy()) {
+        return false;
+    }
+
+    int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", path,
+                          host);
+    if (length < 0 || length >= int(sizeof(request))) {
+        return false;
+    }
+
+    request_length = length;
+    begin_attempts();
+    return true;
+}
+
+bool Uploader::start(const char* path, const uint8_t* body, size_t length, const char* content_type) {
+    /**
+    * Start a POST request with a body of any type.
+    * @param path Path and query to request
+    * @param body Body to POST; copied
+    * @param length Length of the body
+    * @param content_type MIME type of the body
+    * @return False if a request is already under way or the request does not fit in UPLOAD_REQUEST_SIZE
+    */
+    if (is_busy()) {
+        return false;
+    }
+
+    int header_length = snprintf(request, sizeof(request),
+                                 "POST %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\nContent-Type: %s\r\n"
+                                 "Content-Length: %u\r\n\r\n",
+                                 path, host, content_type, unsigned(length));
+    if (header_length < 0 || header_length + length > sizeof(request)) {
+        return false;
+    }
+
+    memcpy(request + header_length, body, length);
+    request_length = header_length + length;
+    begin_attempts();
+    return true;
+}
+
+void Uploader::update() {
+    /**
+    * Take the request in progress a step further. Never waits on the network.
+    */
+    if (state == UPLOAD_IDLE) {
+        return;
+    }
+
+    unsigned long start = micros();
+    step();
+    unsigned long duration = micros() - start;
+
+    if (duration > max_update_micros) {
+        max_update_micros = duration;
+    }
+}
+
+bool Uploader::is_busy() {
+    /**
+    * Determine if a request is under way, including waiting to retry.
+    */
+    return state != UPLOAD_IDLE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+
+void Uploader::step() {
+    /**
+    * Take the request a step further.
+    */
+    unsigned long elapsed = millis() - state_start;
+    int progress;
+
+    switch (state) {
+        case UPLOAD_RESOLVING:
+            progress = transport.resolve(host);
+            if (progress == TRANSPORT_DONE) {
+                enter(UPLOAD_CONNECTING);
+            } else if (progress == TRANSPORT_FAILED) {
+                fail(true);
+            } else if (elapsed > resolve_timeout) {
+                num_timeouts++;
+                fail(true);
+            }
+            break;
+
+        case UPLOAD_CONNECTING:
+            progress = transport.connect(port);
+            if (progress == TRANSPORT_DONE) {
+                num_sent = 0;
+                status_line_length = 0;
+                last_status = 0;
+                enter(UPLOAD_SENDING);
+            } else if (progress == TRANSPORT_FAILED) {
+                fail(true);
+            } else if (elapsed > connect_timeout) {
+                num_timeouts++;
+                fail(true);
+            }
+            break;
+
+        case UPLOAD_SENDING:
+            progress = transport.write((const uint8_t*)request + num_sent, request_length - num_sent);
+            if (progress < 0) {
+                fail(true);
+                break;
+            }
+
+            num_sent += progress;
+            if (num_sent == request_length) {
+                // The response timeout carries on from the start of sending
+                state = UPLOAD_RECEIVING;
+            } else if (elapsed > response_timeout) {
+                num_timeouts++;
+                fail(true);
+            }
+            break;
+
+        case UPLOAD_RECEIVING:
+            receive();
+            if (state == UPLOAD_RECEIVING && elapsed > response_timeout) {
+                num_timeouts++;
+                fail(true);
+            }
+            break;
+
+        case UPLOAD_BACKOFF:
+            if (elapsed >= backoff) {
+                backoff = backoff * 2 < max_backoff ? backoff * 2 : max_backoff;
+                enter(UPLOAD_RESOLVING);
+            }
+            break;
+    }
+}
+
+void Uploader::receive() {
+    /**
+    * Read what has arrived of the response, keeping the status code.
+    */
+    for (int i = 0; i < UPLOAD_MAX_READS_PER_UPDATE; i++) {
+        uint8_t buffer[UPLOAD_READ_SIZE];
+        int length = transport.read(buffer, sizeof(buffer));
+
+        if (length == 0) {
+            return;
+        }
+
+        if (length == TRANSPORT_CLOSED) {
+            transport.close();
+            status_line[status_line_length] = '\0';
+            last_status = strncmp(status_line, "HTTP/1.", 7) == 0 ? atoi(status_line + 9) : 0;
+
+            if (last_status >= 200 && last_status < 300) {
+                num_attempts++;
+                num_succeeded++;
+                result = UPLOAD_SUCCEEDED;
+                state = UPLOAD_IDLE;
+            } else {
+                // Only a missing response or a server error might go better next time
+                fail(last_status == 0 || last_status >= 500);
+            }
+            return;
+        }
+
+        // Only the status line is kept; the rest of the response is drained and dropped
+        for (int j = 0; j < length && status_line_length < sizeof(status_line) - 1; j++) {
+            status_line[status_line_length++] = buffer[j];
+        }
+    }
+}
+
+void Uploader::begin_attempts() {
+    /**
+    * Start making attempts at the request just built.
+    */
+    result = UPLOAD_NONE;
+    last_status = 0;
+    num_attempts = 0;
+    backoff = min_backoff;
+    enter(UPLOAD_RESOLVING);
+}
+
+void Uploader::enter(int new_state) {
+    /**
+    * Enter a stage, starting its timer.
+    */
+    state = new_state;
+    state_start = millis();
+}
+
+void Uploader::fail(bool retry) {
+    /**
+    * End a failed attempt: wait to retry, or give the request up.
+    * @param retry False if retrying could not help
+    */
+    transport.close();
+    num_attempts++;
+    num_failed_attempts++;
+
+    if (!retry || num_attempts >= max_attempts) {
+        num_abandoned++;
+        result = UPLOAD_ABANDONED;
+        state = UPLOAD_IDLE;
+        return;
+    }
+
+    enter(UPLOAD_BACKOFF);
+}
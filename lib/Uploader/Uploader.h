@@ -0,0 +1,131 @@
+#ifndef UPLOADER_H
+#define UPLOADER_H
+
+#include <Arduino.h>
+#include "UploadTransport.h"
+
+const int UPLOAD_REQUEST_SIZE = 768;
+const int UPLOAD_READ_SIZE = 64;           /**< Bytes of the response read at a time */
+const int UPLOAD_MAX_READS_PER_UPDATE = 4; /**< So a long response is drained over several updates */
+
+const unsigned long DEFAULT_UPLOAD_RESOLVE_TIMEOUT = 5000; /**< ms */
+const unsigned long DEFAULT_UPLOAD_CONNECT_TIMEOUT = 5000; /**< ms */
+const unsigned long DEFAULT_UPLOAD_RESPONSE_TIMEOUT = 5000; /**< From connecting to the response ending, in ms */
+const unsigned long DEFAULT_UPLOAD_MIN_BACKOFF = 2000;      /**< Wait before the first retry, in ms */
+const unsigned long DEFAULT_UPLOAD_MAX_BACKOFF = 60000;     /**< The wait doubles after each failure up to this */
+const int DEFAULT_UPLOAD_MAX_ATTEMPTS = 5;
+
+enum upload_states {
+    UPLOAD_IDLE,
+    UPLOAD_RESOLVING,
+    UPLOAD_CONNECTING,
+    UPLOAD_SENDING,
+    UPLOAD_RECEIVING,
+    UPLOAD_BACKOFF,
+};
+
+enum upload_results { UPLOAD_NONE, UPLOAD_SUCCEEDED, UPLOAD_ABANDONED };
+
+/**
+* Sends HTTP requests without ever waiting on the network.
+* Each request moves through resolving the host, connecting, sending, and reading the response to the end. update()
+* takes it a step further each time it is called, so it can run in the time between frames. Every stage has a
+* timeout. A failed attempt is retried after a backoff that doubles each time, until the request succeeds or
+* max_attempts is reached. Only attempts that get no response or a 5xx are retried.
+*/
+class Uploader {
+   public:
+    /**
+    * @param transport Connection to send requests over
+    * @param host Host to send requests to; not copied
+    * @param port TCP port of the host
+    */
+    Uploader(UploadTransport& transport, const char* host, uint16_t port);
+
+    /**
+    * Start a request. It is sent by later calls to update().
+    * @param path Path and query to request
+    * @param body JSON body to POST, or NULL to send a GET
+    * @return False if a request is already under way or the request does not fit in UPLOAD_REQUEST_SIZE
+    */
+    bool start(const char* path, const char* body = NULL);
+
+    /**
+    * Start a POST request with a body of any type.
+    * @param path Path and query to request
+    * @param body Body to POST; copied
+    * @param length Length of the body
+    * @param content_type MIME type of the body
+    * @return False if a request is already under way or the request does not fit in UPLOAD_REQUEST_SIZE
+    */
+    bool start(const char* path, const uint8_t* body, size_t length, const char* content_type);
+
+    /**
+    * Take the request in progress a step further. Never waits on the network.
+    */
+    void update();
+
+    /**
+    * Determine if a request is under way, including waiting to retry.
+    */
+    bool is_busy();
+
+    unsigned long resolve_timeout;
+    unsigned long connect_timeout;
+    unsigned long response_timeout;
+    unsigned long min_backoff;
+    unsigned long max_backoff;
+    int max_attempts;
+
+    int state;       /**< Stage the request is at, from upload_states */
+    int result;      /**< How the last request ended, from upload_results; UPLOAD_NONE while one is under way */
+    int last_status; /**< HTTP status of the last response, or 0 if the last attempt got none */
+    int num_attempts; /**< Attempts made at the current or last request */
+
+    unsigned long num_succeeded;
+    unsigned long num_abandoned;
+    unsigned long num_failed_attempts;
+    unsigned long num_timeouts;
+    unsigned long max_update_micros; /**< Longest a call to update() has taken */
+
+   private:
+    /**
+    * Start making attempts at the request just built.
+    */
+    void begin_attempts();
+
+    /**
+    * Take the request a step further.
+    */
+    void step();
+
+    /**
+    * Read what has arrived of the response, keeping the status code.
+    */
+    void receive();
+
+    /**
+    * Enter a stage, starting its timer.
+    */
+    void enter(int new_state);
+
+    /**
+    * End a failed attempt: wait to retry, or give the request up.
+    * @param retry False if retrying could not help
+    */
+    void fail(bool retry);
+
+    UploadTransport& transport;
+    const char* host;
+    uint16_t port;
+
+    char request[UPLOAD_REQUEST_SIZE];
+    size_t request_length;
+    size_t num_sent;
+    char status_line[13]; /**< Start of the response: "HTTP/1.1 200" */
+    size_t status_line_length;
+    unsigned long state_start; /**< When the current stage started, in ms */
+    unsigned long backoff;     /**< Wait before the next retry, in ms */
+};
+
+#endif
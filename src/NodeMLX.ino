@@ -6,13 +6,23 @@
 #include "ArduinoJson.h"
 #include "Button.h"
 #include "ESP8266WiFi.h"
+#include "EventQueue.h"
+#include "FrameCache.h"
+#include "FrameExport.h"
+#include "FrameScheduler.h"
+#include "FrameStream.h"
+#include "Histogram.h"
 #include "Logging.h"
+#include "LwipTransport.h"
 #include "MLX90621.h"
 #include "PIR.h"
+#include "PageWriter.h"
 #include "SD.h"
 #include "SPI.h"
+#include "SerialTelemetry.h"
 #include "SimpleTimer.h"
 #include "ThermalTracker.h"
+#include "Uploader.h"
 #include "Wire.h"
 #include "user_interface.h"
 
@@ -40,7 +50,9 @@ const long SERIAL_BAUD = 115200;
 const int LOGGER_LEVEL = LOG_LEVEL_INFOS;
 const char PACKET_START = '#';
 const char PACKET_END = '$';
-const int PROCESSED_FRAME_CHECK_INTERVAL = 1000;
+const bool SERIAL_BINARY_TELEMETRY = false; /**< Send COBS-framed records (SerialTelemetry.h) instead of "#{json}$" */
+const bool SERIAL_BINARY_FRAMES = false;    /**< Also send every frame as a record, with SERIAL_BINARY_TELEMETRY */
+const long TIMING_TELEMETRY_INTERVAL = 10000;
 
 // Thermal flow
 const int REFRESH_RATE = 32;
@@ -50,10 +62,22 @@ const long BACKGROUND_CHECK_INTERVAL = 200;
 const long PRINT_FRAME_INTERVAL = 1000;
 const long THERMAL_PRINT_AMBIENT_INTERVAL = 5000;
 
+// Scheduler - frames are deadline tasks; everything else runs in the time between them, within these budgets (us)
+const unsigned long FRAME_TASK_PERIOD = THERMAL_FRAME_INTERVAL * 1000L;
+const unsigned long FRAME_TASK_DEADLINE = FRAME_TASK_PERIOD; /**< Each frame must be read before the next is due */
+const unsigned long TIMER_TASK_BUDGET = 2000;
+const unsigned long WEB_TASK_BUDGET = 15000;
+const unsigned long STREAM_TASK_BUDGET = 3000;
+const unsigned long SD_TASK_BUDGET = 10000;
+const unsigned long UPLOAD_TASK_BUDGET = 2000;
+const unsigned long EVENT_UPLOAD_TASK_BUDGET = 2000;
+
 // Thermal flow tracker
 const int TRACKER_NUM_BACKGROUND_FRAMES = 200;
 const int TRACKER_MINIMUM_DISTANCE = 150;
 const int TRACKER_MINIMUM_BLOB_SIZE = 3;
+const float MISSED_FRAME_PERIOD_SCALAR = 1.5; /**< Frame periods this many intervals long have missed a frame */
+const float TRACKER_COUNTING_LINE_COLUMN = (FRAME_WIDTH - 1) / 2.0; /**< Counting line down the middle of the view */
 
 // Motion
 const long MOTION_INITIALISATION_TIME = 10000;
@@ -74,19 +98,63 @@ const long WIFI_RECONNECT_INTERVAL = 15000;
 // HTTP Uploading
 const char* SERVER_ADDRESS = "www.dweet.io";
 const int UPLOAD_SERVER_PORT = 80;
-const char GET_REQUEST[] = "GET /dweet/for/";
-const char GET_TAIL[] = " HTTP/1.1\r\n\r\n";
-const long TIMEOUT = 5000;  // TCP timeout in ms
+const char UPLOAD_PATH[] = "/dweet/for/";
+const long TIMEOUT = 5000;  // TCP timeout in ms, for each stage of an upload
+
+// Tracking event uploads - batches of events are posted to EVENTS_PATH + DEVICE_NAME (see host/event_collector)
+const char* EVENT_SERVER_ADDRESS = "192.168.43.100";
+const int EVENT_SERVER_PORT = 8080;
+const char EVENTS_PATH[] = "/events/";
+const char EVENT_BATCH_CONTENT_TYPE[] = "application/octet-stream";
+const int EVENT_BATCH_BUFFER_SIZE = EVENT_BATCH_HEADER_SIZE + EVENT_RECORD_SIZE * DEFAULT_EVENT_BATCH_SIZE;
 const int TRACKED_BLOB_BUFFER_SIZE = 5;
-const char* NAV_TABLE =
+const char NAV_TABLE[] PROGMEM =
     "<hr><table bgcolor=\"#a4b2ec\" style=\"width:75%\"><th><a href=\"live\">Live feed</a></th><th><a "
     "href=\"average\">Averages</a></th><th><a href=\"variance\">Variances</a></th><th><a "
-    "href=\"diff\">Difference</a></th><th><a href=\"active\">Active Pixels</a></th></table>";
+    "href=\"diff\">Difference</a></th><th><a href=\"active\">Active Pixels</a></th><th><a "
+    "href=\"timing\">Timing</a></th><th><a href=\"viewer\">Viewer</a></th></table>";
 
 // Server
 const int SERVER_PORT = 80;
-const float DEFAULT_MAX_DISPLAY_TEMPERATURE = 50.0;
-const float DEFAULT_MIN_DISPLAY_TEMPERATURE = 0.0;
+const int STREAM_PORT = 81; /**< Server-Sent Events stream of live frames */
+const char PAGE_FOOTER[] PROGMEM = "</body></html>";
+const char INFO_PAGE_HEADER[] PROGMEM =
+    "<html><head><title> NodeMLX Info</title><style>table, th, td {border: 1px solid black;}</style><meta "
+    "http-equiv=\"refresh\" content=\"1\"/></head><body bgcolor=\"#8a8f8a\">";
+const char TIMING_PAGE_HEADER[] PROGMEM =
+    "<html><head><title>NodeMLX Timing</title><style>table, th, td {border: 1px solid black;}</style><meta "
+    "http-equiv=\"refresh\" content=\"5\"/></head><body bgcolor=\"#8a8f8a\"><h1>Tracker stage timing</h1>";
+const char LIVE_PAGE_HEADER[] PROGMEM =
+    "<html><head><title> NodeMLX Live Feed</title><style type=\"text/css\">\n.thermal{color: 0xFFFFFF; border: 1px "
+    "solid black; width: 100%; height: 60%}\n</style><meta http-equiv=\"refresh\" content=\"0.25\"/></head><body>";
+const char LIVE_PAGE_FOOTER[] PROGMEM = "<hr><a href=\"\\\">Back</a></body></html>";
+const char* FRAME_HEADERS[] = {"If-None-Match"};
+
+// Client-side viewer: polls /frame.bin with If-None-Match, or subscribes to the frame stream, and colours the cells
+// itself, using the same display ranges and hues as the server-rendered views
+const char VIEWER_PAGE[] PROGMEM =
+    "<html><head><title> NodeMLX Viewer</title><style>table{width:100%;height:60%;border-collapse:collapse}"
+    "td{border:1px solid black;text-align:center}</style></head><body><p><select id=v><option>live<option>average"
+    "<option>variance<option>diff<option>active<option value=push>live (pushed)</select> <span id=s></span></p>"
+    "<table id=t></table>"
+    "<hr><a href=\"/\">Back</a><script>"
+    "var R={live:[20,50],average:[20,50],variance:[0,5],diff:[-5,5],active:[0,1],push:[20,50]};"
+    "var tag='',cells=[],es;"
+    "var t=document.getElementById('t'),v=document.getElementById('v'),s=document.getElementById('s');"
+    "v.onchange=function(){tag='';if(es){es.close();es=null;}if(v.value=='push')push();};"
+    "function push(){es=new EventSource('http://'+location.hostname+':81/');es.onmessage=function(e){"
+    "var b=atob(e.data),a=new Uint8Array(b.length);for(var i=0;i<b.length;i++)a[i]=b.charCodeAt(i);draw(a.buffer);};}"
+    "function draw(b){var d=new DataView(b),w=d.getUint8(2),h=d.getUint8(3),q=R[v.value];"
+    "if(cells.length!=w*h){t.innerHTML='';cells=[];for(var y=0;y<h;y++){var r=t.insertRow();"
+    "for(var x=0;x<w;x++)cells.push(r.insertCell());}}"
+    "s.textContent='frame '+d.getUint32(4,true);"
+    "for(var i=0;i<w*h;i++){var c=d.getInt16(8+2*i,true)/100,k=Math.min(Math.max((c-q[0])/(q[1]-q[0]),0),1);"
+    "cells[i].style.background='hsl('+Math.round(240-240*k)+',100%,50%)';cells[i].textContent=c.toFixed(2);}}"
+    "function tick(){if(es){setTimeout(tick,250);return;}"
+    "fetch('frame.bin?view='+v.value,{headers:tag?{'If-None-Match':tag}:{},cache:'no-store'})"
+    ".then(function(r){if(r.status==200){tag=r.headers.get('ETag');return r.arrayBuffer().then(draw);}})"
+    ".catch(function(){}).then(function(){setTimeout(tick,250);});}"
+    "tick();</script></body></html>";
 const int HOT_HUE = 0;
 const int COLD_HUE = 240;
 
@@ -95,6 +163,7 @@ const long RTC_CHECK_DATE_INTERVAL = 60000;
 
 // SD Card
 const long SD_WRITE_DATA_INTERVAL = 5 * 60 * 1000;
+enum sd_write_steps { SD_WRITE_IDLE, SD_WRITE_OPEN, SD_WRITE_ENTRY, SD_WRITE_CLOSE };
 
 // Button
 const long BUTTON_CHECK_INTERVAL = 200;
@@ -116,7 +185,11 @@ void process_new_frame();
 void print_new_movements();
 void check_background();
 void print_frame();
-void print_tracked_blob(TrackedBlob blob);
+void print_timing_telemetry();
+void reset_timing_histograms();
+void publish_telemetry();
+void print_tracked_blob(const TrackedBlob& blob);
+void run_timers();
 
 void start_pir();
 void update_pir();
@@ -124,7 +197,10 @@ void motion_event();
 
 void start_wifi();
 bool attempt_wifi_connection(long timeout = WIFI_DEFAULT_TIMEOUT);
+void start_uploader();
 void upload_data();
+void update_uploader();
+void update_event_upload();
 void assemble_data_packet(char* packet_buffer);
 void add_to_array(char* buffer, char* insert);
 
@@ -132,9 +208,12 @@ void start_light_sensor();
 void check_light_sensor();
 
 void start_sd_card();
+void request_data_write();
 void append_data_to_file();
 
 void start_rtc();
+void read_rtc();
+DateTime get_current_time();
 void get_datetime(char* buffer);
 void get_date(char* buffer);
 void check_for_date_change();
@@ -150,35 +229,90 @@ void flash_check();
 void indicator_off();
 void indicator_on();
 
+void count_bus_transfer();
+
 void handle_root();
 void handle_live();
+void handle_timing();
+void handle_histograms();
+void handle_reset_histograms();
+void handle_frame_bin();
+void handle_frame_json();
+void handle_viewer();
+void send_frame(bool json);
+void stream_new_frame();
 void handle_not_found();
-String generate_colour_map(float[4][16]);
-String generate_temperature_table(float[4][16]);
+void handle_web_clients();
+void update_frame_stream();
+void send_live_view(int view);
+void write_scheduler_table(PageWriter& page);
+void write_temperature_table(PageWriter& page, const frame_text[4][16], const uint8_t[4][16]);
+size_t write_to_client(void* context, const uint8_t* data, size_t length);
+size_t write_to_serial(void* context, const uint8_t* data, size_t length);
+void start_page(PageWriter& page, const char* content_type, const char* etag = NULL);
+void finish_page(PageWriter& page);
 
 ////////////////////////////////////////////////////////////////////////////////
 // Variables
 ////////////////////////////////////////////////////////////////////////////////
 
+FrameScheduler scheduler;
 SimpleTimer timer;
 MLX90621 thermal_flow;
 ThermalTracker tracker;
+FrameCache frame_cache(tracker);
 PIR motion(PIR_PIN, MOTION_COOLDOWN_DEFAULT);
 Button button = Button(BUTTON_PIN, BUTTON_PULLUP, BUTTON_DEBOUNCE_ENABLED, BUTTON_DEBOUNCE_TIME);
 File data_file;
-
-// Debug
-int num_processed_frames;
-int last_num_processed_frames;
-long last_check_time;
+int sd_write_step = SD_WRITE_IDLE; /**< Next step of the SD card write in progress */
+
+// Debug - all times in microseconds
+Histogram frame_period_histogram;  /**< Time between the starts of consecutive frames */
+Histogram frame_process_histogram; /**< Time to read and track a frame */
+Histogram loop_histogram;          /**< Time taken by each loop() iteration */
+Histogram page_histogram;          /**< Time to generate and send each web page */
+unsigned long page_start = 0;
+unsigned long num_frames_not_modified = 0; /**< Frame requests answered with a 304 */
+uint32_t page_min_free_heap = 0xFFFFFFFF; /**< Lowest free heap seen while sending web pages, in bytes */
+unsigned long last_frame_start = 0;
+unsigned long num_missed_frames = 0;
+
+/**
+* Snapshot of the sensor and tracker state, published by the acquisition loop after every frame, and of the real-time
+* clock, read by the date check timer.
+* Web handlers and telemetry read this rather than the devices, so they never start I2C transactions of their own.
+*/
+struct Telemetry {
+    unsigned long frame_sequence; /**< Frame the snapshot was taken after */
+    float ambient_temperature;    /**< Sensor ambient temperature read with the frame, in °C */
+    float frame_rate;             /**< Mean processed frames per second */
+    unsigned long num_missed_frames;
+    int num_background_frames;
+    int running_average_size;
+    unsigned long num_idle_frames;
+    unsigned long num_active_frames;
+    unsigned long mean_idle_frame_micros;
+    unsigned long mean_active_frame_micros;
+    unsigned long num_bus_transfers;                /**< I2C writes and reads by any device's driver */
+    unsigned long num_bus_transfers_outside_frames; /**< Those not made by process_new_frame */
+    DateTime rtc_time;                              /**< Time last read from the RTC */
+    unsigned long rtc_read_millis;                  /**< millis() when rtc_time was read */
+    bool has_rtc_time;                              /**< Set once the RTC has been read */
+};
+Telemetry telemetry;
+TelemetryEncoder serial_telemetry(write_to_serial, &Serial); /**< Binary records, with SERIAL_BINARY_TELEMETRY */
 
 // RTC
 RTC_DS3231 rtc;
 int rtc_day = 0;
 
+// I2C bus, counted for every driver by wrapping the core's twi_writeTo and twi_readFrom (see platformio.ini)
+bool reading_frame = false; /**< Set while process_new_frame reads the sensor */
+unsigned long num_bus_transfers = 0;
+unsigned long num_bus_transfers_outside_frames = 0;
+
 // Thermal
 long movements[NUM_DIRECTION_CATEGORIES];
-float frame[NUM_ROWS][NUM_COLS];
 bool background_building = true;
 
 // Light
@@ -191,9 +325,18 @@ int max_led_flash_count;
 // Server
 MDNSResponder mdns;
 ESP8266WebServer server(SERVER_PORT);
-float min_display_temperature = DEFAULT_MIN_DISPLAY_TEMPERATURE;
-float max_display_temperature = DEFAULT_MAX_DISPLAY_TEMPERATURE;
+FrameStream frame_stream(STREAM_PORT);
+unsigned long last_streamed_sequence = 0;
 TrackedBlob last_blobs[TRACKED_BLOB_BUFFER_SIZE];
+int last_blob_index = 0;  // Where the next ended blob goes; last_blobs is a ring
+
+// HTTP Uploading
+LwipTransport upload_transport;
+Uploader uploader(upload_transport, SERVER_ADDRESS, UPLOAD_SERVER_PORT);
+unsigned long last_num_abandoned_uploads = 0;
+EventQueue event_queue; /**< Tracking events waiting to be uploaded */
+LwipTransport event_transport;
+Uploader event_uploader(event_transport, EVENT_SERVER_ADDRESS, EVENT_SERVER_PORT);
 
 ////////////////////////////////////////////////////////////////////////////////
 // Main
@@ -210,13 +353,15 @@ void setup() {
 
     Log.Init(LOGGER_LEVEL, SERIAL_BAUD);
     Wire.begin(D2, D3);
-    Log.Info("NodeMLX Starting...");
+    LOGGING_INFO("NodeMLX Starting...");
 
+    scheduler.add_background_task("timers", run_timers, TIMER_TASK_BUDGET);
     start_thermal_flow();
 
     if (DEBUG_ENABLED) {
         start_wifi();
         start_server();
+        start_uploader();
 
     } else {
         disable_wifi();
@@ -234,14 +379,15 @@ void setup() {
 void loop() {
     /**
     * Main loop
-    * Everything is called off timer events
+    * Everything runs off the scheduler: frames as deadline tasks, then the timers, web server and SD card writes in
+    * the time between frames
     */
-    timer.run();
+    unsigned long loop_start = micros();
+
+    scheduler.run();
     wdt_reset();
 
-    if (DEBUG_ENABLED) {
-        server.handleClient();
-    }
+    loop_histogram.add(micros() - loop_start);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -255,58 +401,114 @@ void start_thermal_flow() {
     */
     thermal_flow.initialise(REFRESH_RATE);
 
-    timer.setInterval(THERMAL_FRAME_INTERVAL, process_new_frame);
+    scheduler.add_deadline_task("frame", process_new_frame, FRAME_TASK_PERIOD, FRAME_TASK_DEADLINE);
     timer.setTimeout(BACKGROUND_CHECK_INTERVAL, check_background);
     timer.setInterval(THERMAL_PRINT_AMBIENT_INTERVAL, print_ambient_temperature);
 
     tracker.set_tracking_start_callback(handle_tracked_start);
     tracker.set_tracking_end_callback(handle_tracked_end);
+    tracker.add_counting_line(TRACKER_COUNTING_LINE_COLUMN, 0, TRACKER_COUNTING_LINE_COLUMN, FRAME_HEIGHT - 1);
+    tracker.set_line_crossing_callback(handle_line_crossing);
 
-    num_processed_frames = 0;
-    timer.setInterval(1000, check_frames_per_second);
+    timer.setInterval(TIMING_TELEMETRY_INTERVAL, print_timing_telemetry);
 
-    Log.Info("Thermal flow started.");
+    LOGGING_INFO("Tracker memory: ThermalTracker %d bytes, TrackedBlob %d bytes, Blob %d bytes, last blobs %d bytes",
+                 int(sizeof(ThermalTracker)), int(sizeof(TrackedBlob)), int(sizeof(Blob)), int(sizeof(last_blobs)));
+    LOGGING_INFO("Free heap: %d bytes", int(ESP.getFreeHeap()));
+    LOGGING_INFO("Thermal flow started.");
 }
 
-void handle_tracked_start(TrackedBlob blob) {
-    Log.Info(
+void handle_tracked_start(const TrackedBlob& blob) {
+    event_queue.add(TRACKING_EVENT_START, blob, millis());
+
+    if (SERIAL_BINARY_TELEMETRY) {
+        serial_telemetry.write_track_start(blob);
+        return;
+    }
+
+    LOGGING_INFO(
         "%c{\"id\":\"%s\",\"type\":\"start\",\"t_id\":%d,\"size\":%d,\"start_x\":%d,\"start_y\":%d,\"temp\":%d,"
         "\"w\":%d,\"h\":%d}%c",
         PACKET_START, DEVICE_NAME, blob.id, blob.max_size, int(blob.start_pos[X]), int(blob.start_pos[Y]),
         int(blob._blob.average_temperature * 100), blob.max_width, blob.max_height, PACKET_END);
 }
 
-void handle_tracked_end(TrackedBlob blob) {
-    Log.Info(
-        "%c{\"id\":\"%s\",\"type\":\"end\",\"t_id\":%d,\"av_diff\":%d,\"max_diff\":%d,\"time\":%d,\"frames\":%d,"
-        "\"size\":%d,\"travel\":%d,\"temp\":%d,\"w\":%d,\"h\":%d,\"dead\":%d}%c",
-        PACKET_START, DEVICE_NAME, blob.id, int(blob.average_difference), int(blob.max_difference), blob.event_duration,
-        blob.times_updated, blob.max_size, int(blob.travel[X] * 100), int(blob._blob.average_temperature * 100),
-        blob.max_width, blob.max_height, blob.max_num_dead_frames, PACKET_END);
+void handle_tracked_end(const TrackedBlob& blob) {
+    event_queue.add(TRACKING_EVENT_END, blob, millis());
+
+    if (SERIAL_BINARY_TELEMETRY) {
+        serial_telemetry.write_track_end(blob);
+    } else {
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_SUMMARY
+        LOGGING_INFO(
+            "%c{\"id\":\"%s\",\"type\":\"end\",\"t_id\":%d,\"av_diff\":%d,\"max_diff\":%d,\"time\":%d,\"frames\":%d,"
+            "\"size\":%d,\"travel\":%d,\"temp\":%d,\"w\":%d,\"h\":%d,\"dead\":%d}%c",
+            PACKET_START, DEVICE_NAME, blob.id, int(blob.average_difference), int(blob.max_difference),
+            blob.event_duration, blob.times_updated, blob.max_size, int(blob.travel[X] * 100),
+            int(blob._blob.average_temperature * 100), blob.max_width, blob.max_height, blob.max_num_dead_frames,
+            PACKET_END);
+#else
+        LOGGING_INFO(
+            "%c{\"id\":\"%s\",\"type\":\"end\",\"t_id\":%d,\"time\":%d,\"frames\":%d,"
+            "\"size\":%d,\"travel\":%d,\"temp\":%d,\"w\":%d,\"h\":%d,\"dead\":%d}%c",
+            PACKET_START, DEVICE_NAME, blob.id, blob.event_duration, blob.times_updated, blob.max_size,
+            int(blob.travel[X] * 100), int(blob._blob.average_temperature * 100), blob.max_width, blob.max_height,
+            blob.max_num_dead_frames, PACKET_END);
+#endif
+    }
 
     // Keep a list of the most recent blobs if the option is enabled
     if (DEBUG_ENABLED) {
-        for (int i = TRACKED_BLOB_BUFFER_SIZE - 1; i > 0; i--) {
-            // Cycle through the tracked blobs so the most recent is first
-            last_blobs[i].copy(last_blobs[i - 1]);
-        }
-        last_blobs[0].copy(blob);
+        last_blobs[last_blob_index].copy(blob);
+        last_blob_index = (last_blob_index + 1) % TRACKED_BLOB_BUFFER_SIZE;
+    }
+}
+
+void handle_line_crossing(const TrackedBlob& blob, int line, int crossing) {
+    event_queue.add(TRACKING_EVENT_CROSSING, blob, millis(), line, crossing);
+
+    if (SERIAL_BINARY_TELEMETRY) {
+        serial_telemetry.write_line_crossing(blob, line, crossing);
+        return;
     }
+
+    LOGGING_INFO("%c{\"id\":\"%s\",\"type\":\"cross\",\"t_id\":%d,\"line\":%d,\"dir\":\"%s\"}%c", PACKET_START,
+                 DEVICE_NAME, blob.id, line, crossing == CROSSING_FORWARD ? "fwd" : "back", PACKET_END);
 }
 
 void process_new_frame() {
     /**
     * Grab the next frame in from the MLX90621 sensor and pass it to the tracking
     * algorithm
+    * The sensor writes straight into the tracker's back buffer, which is published once the update finishes.
     */
 
-    long start_time = millis();
-    thermal_flow.get_temperatures(frame, true);
-    tracker.update(frame);
-    long process_time = millis() - start_time;
+    unsigned long start_time = micros();
+
+    // A period well over the frame interval means the timer fell behind and frames were skipped
+    if (last_frame_start != 0) {
+        unsigned long period = start_time - last_frame_start;
+        frame_period_histogram.add(period);
+
+        if (period > THERMAL_FRAME_INTERVAL * 1000 * MISSED_FRAME_PERIOD_SCALAR) {
+            num_missed_frames += (period + THERMAL_FRAME_INTERVAL * 500) / (THERMAL_FRAME_INTERVAL * 1000) - 1;
+        }
+    }
+    last_frame_start = start_time;
+
+    reading_frame = true;
+    thermal_flow.get_temperatures(tracker.get_back_buffer(), true);
+    reading_frame = false;
+    tracker.update();
+    unsigned long process_time = micros() - start_time;
+    frame_process_histogram.add(process_time);
+    publish_telemetry();
+
+    if (SERIAL_BINARY_TELEMETRY && SERIAL_BINARY_FRAMES) {
+        serial_telemetry.write_frame(tracker.frame, tracker.frame_sequence);
+    }
 
-    Log.Debug("Blobs in frame: %d\tprocess time %l ms", tracker.num_last_blobs, process_time);
-    num_processed_frames++;
+    LOGGING_DEBUG("Blobs in frame: %d\tprocess time %l us", tracker.num_last_blobs, long(process_time));
 }
 
 void print_new_movements() {
@@ -317,7 +519,12 @@ void print_new_movements() {
         tracker.get_movements(movements);
         int num_blobs = tracker.num_last_blobs;
 
-        Log.Debug(
+        if (SERIAL_BINARY_TELEMETRY) {
+            serial_telemetry.write_movements(movements, num_blobs);
+            return;
+        }
+
+        LOGGING_DEBUG(
             "%c{\"id\":\"thermal\",\"left\":%l,\"right\":%l,\"zero\":%l,"
             "\"blobs\":%d}%c",
             PACKET_START, movements[LEFT], movements[RIGHT], movements[NO_DIRECTION], num_blobs, PACKET_END);
@@ -332,7 +539,7 @@ void check_background() {
     */
 
     if (tracker.is_background_finished()) {
-        Log.Info(
+        LOGGING_INFO(
             "Thermal background finished building.;\tThermal flow detection "
             "started.");
     } else {
@@ -346,12 +553,12 @@ void print_frame() {
     * Temperatures are only printed if the logger priority is debug or lower.
     * Temperatures are in °C.
     */
-    if (Log.getLevel() == LOG_LEVEL_VERBOSE) {
+    if (LOG_LEVEL_VERBOSE <= LOG_LEVEL_MAX && Log.getLevel() == LOG_LEVEL_VERBOSE) {
         for (int i = 0; i < NUM_ROWS; i++) {
             Serial.print('[');
             for (int j = 0; j < NUM_COLS; j++) {
                 Serial.print('\t');
-                Serial.print(frame[i][j], 2);
+                Serial.print(tracker.frame[i][j], 2);
             }
             Serial.println(']');
         }
@@ -359,33 +566,94 @@ void print_frame() {
     }
 }
 
+void run_timers() {
+    /**
+    * Run the SimpleTimer events that are due, as a background task.
+    * Timer callbacks are all short; anything longer runs as a background task of its own.
+    */
+    timer.run();
+}
+
+void publish_telemetry() {
+    /**
+    * Take a snapshot of the sensor and tracker state for the web handlers and telemetry.
+    * Only reads what the frame just processed left behind, so it never touches the bus.
+    */
+    float mean_period = frame_period_histogram.get_mean();
+
+    telemetry.frame_sequence = tracker.frame_sequence;
+    telemetry.ambient_temperature = thermal_flow.get_frame_ambient_temperature();
+    telemetry.frame_rate = mean_period > 0 ? 1000000 / mean_period : 0;
+    telemetry.num_missed_frames = num_missed_frames;
+    telemetry.num_background_frames = tracker.num_background_frames;
+    telemetry.running_average_size = tracker.running_average_size;
+    telemetry.num_idle_frames = tracker.num_idle_frames;
+    telemetry.num_active_frames = tracker.num_active_frames;
+    telemetry.mean_idle_frame_micros =
+        tracker.num_idle_frames ? tracker.idle_frame_micros / tracker.num_idle_frames : 0;
+    telemetry.mean_active_frame_micros =
+        tracker.num_active_frames ? tracker.active_frame_micros / tracker.num_active_frames : 0;
+    telemetry.num_bus_transfers = num_bus_transfers;
+    telemetry.num_bus_transfers_outside_frames = num_bus_transfers_outside_frames;
+}
+
 void print_ambient_temperature() {
     char temperature[8];
 
-    float ambient = thermal_flow.get_ambient_temperature();
-    dtostrf(ambient, 0, 2, temperature);
-    Log.Info("%c{\"id\":\"ambient\", \"temp\":%s}%c", PACKET_START, temperature, PACKET_END);
+    if (SERIAL_BINARY_TELEMETRY) {
+        serial_telemetry.write_ambient(telemetry.ambient_temperature);
+        return;
+    }
+
+    dtostrf(telemetry.ambient_temperature, 0, 2, temperature);
+    LOGGING_INFO("%c{\"id\":\"ambient\", \"temp\":%s}%c", PACKET_START, temperature, PACKET_END);
 }
 
-void print_tracked_blob(TrackedBlob blob) {
-    Log.Info(
+void print_tracked_blob(const TrackedBlob& blob) {
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_SUMMARY
+    int distance = int(blob.average_difference);
+#else
+    int distance = 0;  // Not kept at this diagnostics level
+#endif
+
+    LOGGING_INFO(
         "%c{\"id\":\"thermal\",\"duration\":%l,\"start\":(%d,%d),\"travel\":(%d,%d),\"frames\":%d,\"distance\":%d,"
         "\"size\":%d}%c",
-        PACKET_START, blob.event_duration, blob.start_pos[0], blob.start_pos[1], blob.travel[0], blob.travel[1],
-        blob.times_updated, int(blob.average_difference), blob._blob.get_size(), PACKET_END);
+        PACKET_START, blob.event_duration, int(blob.start_pos[0]), int(blob.start_pos[1]), int(blob.travel[0]),
+        int(blob.travel[1]), blob.times_updated, distance, blob._blob.get_size(), PACKET_END);
 }
 
-void check_frames_per_second() {
-    // Just assume we're fine for the first check
-    if (last_check_time == 0) {
-        last_check_time = millis() + 1000;
-    }
-
-    Log.Debug("Processed frames - %d second(s): %d", PROCESSED_FRAME_CHECK_INTERVAL / 1000, num_processed_frames);
-    last_num_processed_frames = (num_processed_frames * 1000) / (millis() - last_check_time);
+void print_timing_telemetry() {
+    /**
+    * Print a summary of the frame and loop timing histograms, in microseconds.
+    */
+    char frame_rate[8];
+    float mean_period = frame_period_histogram.get_mean();
+    dtostrf(mean_period > 0 ? 1000000 / mean_period : 0, 0, 2, frame_rate);
+
+    LOGGING_INFO(
+        "%c{\"id\":\"%s\",\"type\":\"timing\",\"fps\":%s,\"period_p99\":%l,\"period_max\":%l,"
+        "\"missed\":%l,\"process_mean\":%l,\"process_p99\":%l,\"process_max\":%l,\"loop_p99\":%l,"
+        "\"loop_max\":%l}%c",
+        PACKET_START, DEVICE_NAME, frame_rate,
+        long(frame_period_histogram.get_percentile(0.99)), long(frame_period_histogram.get_max()),
+        long(num_missed_frames), long(frame_process_histogram.get_mean()),
+        long(frame_process_histogram.get_percentile(0.99)), long(frame_process_histogram.get_max()),
+        long(loop_histogram.get_percentile(0.99)), long(loop_histogram.get_max()), PACKET_END);
+}
 
-    last_check_time = millis();
-    num_processed_frames = 0;
+void reset_timing_histograms() {
+    /**
+    * Start the frame, loop and web page timing histograms again.
+    */
+    frame_period_histogram.reset();
+    frame_process_histogram.reset();
+    loop_histogram.reset();
+    page_histogram.reset();
+    page_min_free_heap = 0xFFFFFFFF;
+    num_missed_frames = 0;
+    last_frame_start = 0;
+    scheduler.reset_stats();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -402,7 +670,7 @@ void start_pir() {
 
     // Start up regular reads
     timer.setInterval(MOTION_CHECK_INTERVAL, update_pir);
-    Log.Info(("Motion detection started."));
+    LOGGING_INFO(("Motion detection started."));
 
     motion.update();
 }
@@ -411,7 +679,7 @@ void update_pir() { motion.update(); }
 
 void motion_event() {
     flash();
-    Log.Debug("Motion event @ %d \t: %d - %d ms", millis(), motion.num_detections);
+    LOGGING_DEBUG("Motion event @ %d \t: %d - %d ms", millis(), motion.num_detections);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -425,47 +693,98 @@ void start_wifi() {
     */
 
     if (WiFi.status() != WL_CONNECTED) {
-        Log.Info("Connecting to WiFi - \"%s\"", WIFI_SSID);
+        LOGGING_INFO("Connecting to WiFi - \"%s\"", WIFI_SSID);
         WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
     }
 
     else {
-        Log.Info("Connected to WiFi - \"%s\": %s", WIFI_SSID, WiFi.localIP().toString().c_str());
+        LOGGING_INFO("Connected to WiFi - \"%s\": %s", WIFI_SSID, WiFi.localIP().toString().c_str());
     }
 
     timer.setTimeout(WIFI_RECONNECT_INTERVAL, start_wifi);
 }
 
+void start_uploader() {
+    /**
+    * Set up the uploader and run it in the time between frames.
+    */
+    uploader.resolve_timeout = TIMEOUT;
+    uploader.connect_timeout = TIMEOUT;
+    uploader.response_timeout = TIMEOUT;
+    event_uploader.resolve_timeout = TIMEOUT;
+    event_uploader.connect_timeout = TIMEOUT;
+    event_uploader.response_timeout = TIMEOUT;
+
+    // Sequence numbers restart at every boot; the boot id tells the collector they are new events
+    event_queue.boot_id = RANDOM_REG32;
+
+    scheduler.add_background_task("upload", update_uploader, UPLOAD_TASK_BUDGET);
+    scheduler.add_background_task("events", update_event_upload, EVENT_UPLOAD_TASK_BUDGET);
+}
+
 void upload_data() {
     /**
     * Upload the gathered data to the preconfigured web server
     * In this case, the web server is dweet so the data can be displayed on freeboard.io
     * All data is uploaded using a GET request to avoid bullshit HTTP flags and junk.
+    * The request is only started here; the "upload" task sends it, and retries it, without holding up frames.
     */
-
-    WiFiClient client;
     char packet_buffer[400];
 
-    // Attempt connection to data server
-    if (client.connect(SERVER_ADDRESS, UPLOAD_SERVER_PORT)) {
-        // Send data if connection is available
-        assemble_data_packet(packet_buffer);
-        client.print(packet_buffer);
+    assemble_data_packet(packet_buffer);
+    if (uploader.start(packet_buffer)) {
         flash(1);
+    } else {
+        LOGGING_ERROR("Upload to [%s] skipped: the last one is still in progress", SERVER_ADDRESS);
+    }
+}
+
+void update_uploader() {
+    /**
+    * Take the upload in progress a step further, reporting any upload given up on.
+    */
+    uploader.update();
+
+    if (uploader.num_abandoned != last_num_abandoned_uploads) {
+        last_num_abandoned_uploads = uploader.num_abandoned;
+        LOGGING_ERROR("Upload to [%s] failed after %d attempts (HTTP status %d)", SERVER_ADDRESS, uploader.num_attempts,
+                      uploader.last_status);
+    }
+}
+
+void update_event_upload() {
+    /**
+    * Send the queued tracking events in batches, once enough have built up or the oldest has waited long enough.
+    * A batch leaves the queue only once the collector has accepted it; otherwise it is sent again later, so the
+    * collector sees every event at least once and drops duplicates by sequence number.
+    */
+    event_uploader.update();
+    if (event_uploader.is_busy()) {
+        return;
+    }
 
-        timer.run();
-        while (client.available() > 0) {
-            Serial.print(client.readString());
-            timer.run();
-            delay(1);
+    if (event_queue.is_batch_in_flight()) {
+        if (event_uploader.result == UPLOAD_SUCCEEDED) {
+            event_queue.acknowledge_batch();
+        } else {
+            event_queue.release_batch(millis());
+            LOGGING_ERROR("Event upload to [%s] failed (HTTP status %d); %d events queued", EVENT_SERVER_ADDRESS,
+                          event_uploader.last_status, event_queue.get_num_events());
         }
     }
 
-    else {
-        Log.Error("Connection to [%s] failed", SERVER_ADDRESS);
+    if (WiFi.status() != WL_CONNECTED || !event_queue.is_batch_due(millis())) {
+        return;
     }
 
-    client.stopAll();
+    char path[sizeof(EVENTS_PATH) + 32];
+    snprintf(path, sizeof(path), "%s%s", EVENTS_PATH, DEVICE_NAME);
+
+    uint8_t batch[EVENT_BATCH_BUFFER_SIZE];
+    size_t length = event_queue.encode_batch(batch, sizeof(batch));
+    if (!event_uploader.start(path, batch, length, EVENT_BATCH_CONTENT_TYPE)) {
+        event_queue.release_batch(millis());
+    }
 }
 
 void assemble_data_packet(char* packet_buffer) {
@@ -477,7 +796,7 @@ void assemble_data_packet(char* packet_buffer) {
     */
     char entry[50];
 
-    sprintf(packet_buffer, "%s%s?", GET_REQUEST, DEVICE_NAME);
+    sprintf(packet_buffer, "%s%s?", UPLOAD_PATH, DEVICE_NAME);
 
     sprintf(entry, "&therm_left=%d", movements[LEFT]);
     add_to_array(packet_buffer, entry);
@@ -499,8 +818,6 @@ void assemble_data_packet(char* packet_buffer) {
 
     sprintf(entry, "&pir_count=%d", motion.num_detections);
     add_to_array(packet_buffer, entry);
-
-    add_to_array(packet_buffer, const_cast<char*>(GET_TAIL));
 }
 
 void add_to_array(char* buffer, char* insert) {
@@ -530,7 +847,7 @@ void disable_wifi() {
     WiFi.mode(WIFI_OFF);
     WiFi.forceSleepBegin();
     delay(1);
-    Log.Info("Wifi disabled");
+    LOGGING_INFO("Wifi disabled");
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -544,29 +861,42 @@ void start_sd_card() {
     bool sd_status = SD.begin(CHIP_SELECT_PIN);
 
     if (sd_status) {
-        timer.setInterval(SD_WRITE_DATA_INTERVAL, append_data_to_file);
-        append_data_to_file();
+        timer.setInterval(SD_WRITE_DATA_INTERVAL, request_data_write);
+        scheduler.add_background_task("sd", append_data_to_file, SD_TASK_BUDGET);
+        request_data_write();
+    }
+}
+
+void request_data_write() {
+    /**
+    * Start writing the sensor data to the SD card, unless a write is already under way
+    */
+    if (sd_write_step == SD_WRITE_IDLE) {
+        sd_write_step = SD_WRITE_OPEN;
     }
 }
 
 void append_data_to_file() {
     /**
-    * Write the sensor data to the SD card in JSON format
-    * A timestamp is also added to the data
+    * Write the sensor data to the SD card in JSON format, one step per call
+    * Runs as a background task: opening the file, writing the entry and closing the file each take a run of their
+    * own, so none of them holds up a frame. A timestamp is also added to the data
     */
     char filename[50];
     char temp[30];
     StaticJsonBuffer<500> json_buffer;
 
-    // Open up the current datefile - Changes by date
-    get_date(temp);
-    add_to_array(filename, temp);
-    sprintf(temp, "_%s.log", DEVICE_NAME);
-    add_to_array(filename, temp);
-    data_file = SD.open(filename, FILE_WRITE);
-
-    // Write all the data if the file is available
-    if (data_file) {
+    if (sd_write_step == SD_WRITE_OPEN) {
+        // Open up the current datefile - Changes by date
+        filename[0] = '\0';
+        get_date(temp);
+        add_to_array(filename, temp);
+        sprintf(temp, "_%s.log", DEVICE_NAME);
+        add_to_array(filename, temp);
+        data_file = SD.open(filename, FILE_WRITE);
+        sd_write_step = data_file ? SD_WRITE_ENTRY : SD_WRITE_CLOSE;
+
+    } else if (sd_write_step == SD_WRITE_ENTRY) {
         JsonObject& entry = json_buffer.createObject();
 
         get_datetime(temp);
@@ -582,9 +912,12 @@ void append_data_to_file() {
         entry.printTo(data_file);
         data_file.println();
         flash(2);
-    }
+        sd_write_step = SD_WRITE_CLOSE;
 
-    data_file.close();
+    } else if (sd_write_step == SD_WRITE_CLOSE) {
+        data_file.close();
+        sd_write_step = SD_WRITE_IDLE;
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -616,16 +949,36 @@ void start_rtc() {
     * Start up the real-time clock
     */
     rtc.begin();
+    read_rtc();
     timer.setInterval(RTC_CHECK_DATE_INTERVAL, check_for_date_change);
 }
 
+void read_rtc() {
+    /**
+    * Read the real-time clock into the telemetry.
+    * This is the only place the clock is read; everything else works out the time from the reading, so pages and
+    * logs do not add bus traffic.
+    */
+    telemetry.rtc_time = rtc.now();
+    telemetry.rtc_read_millis = millis();
+    telemetry.has_rtc_time = true;
+}
+
+DateTime get_current_time() {
+    /**
+    * Get the time from the last RTC reading, moved on by the time since, without touching the bus.
+    * The reading is refreshed every RTC_CHECK_DATE_INTERVAL, so the millis() clock never drifts far from it.
+    */
+    return telemetry.rtc_time + TimeSpan((millis() - telemetry.rtc_read_millis) / 1000);
+}
+
 void get_datetime(char* buffer) {
     /** Get the datetime in string format
     * DateTime follows the standard ISO format ("YYYY-MM-DD hh:mm:ss")
     * @param buffer Character buffer to write datetime to; Must be at least 20
     * char wide.
     */
-    DateTime now = rtc.now();
+    DateTime now = get_current_time();
 
     // Get the DateTime into the standard, readable format
     sprintf(buffer, ("%04d-%02d-%02d %02d:%02d:%02d"), now.year(), now.month(), now.day(), now.hour(), now.minute(),
@@ -637,7 +990,7 @@ void get_date(char* buffer) {
     * Get the current date string
     * @param buffer Buffer to hold date string. Must be at least 11 characters wide
     */
-    DateTime now = rtc.now();
+    DateTime now = get_current_time();
 
     // Get the DateTime into the standard, readable format
     sprintf(buffer, ("%04d-%02d-%02d"), now.year(), now.month(), now.day());
@@ -648,8 +1001,8 @@ void check_for_date_change() {
     * Check to see if the date has changed since last check
     * If the date changes, reset all the counters
     */
-    DateTime now = rtc.now();
-    int current_day = now.day();
+    read_rtc();
+    int current_day = telemetry.rtc_time.day();
 
     if (current_day != rtc_day) {
         rtc_day = current_day;
@@ -662,10 +1015,47 @@ void reset_counters() {
     * Reset all of the counters (usually because its a new day)
     */
     tracker.reset_movements();
+    tracker.reset_line_crossings();
     tracker.reset_background();
     motion.num_detections = 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// I2C bus
+
+void count_bus_transfer() {
+    /**
+    * Count a write or read on the I2C bus.
+    * Transfers made while no frame is being read are counted separately: they are bus traffic that the frame reads
+    * have to compete with. Start-up and the RTC reading every RTC_CHECK_DATE_INTERVAL account for a few; any that
+    * grow with web requests or other work are worth finding.
+    */
+    num_bus_transfers++;
+    if (!reading_frame) {
+        num_bus_transfers_outside_frames++;
+    }
+}
+
+// Every driver's transfers go through the core's twi_writeTo and twi_readFrom, which the linker points here
+extern "C" {
+unsigned char __real_twi_writeTo(unsigned char address, unsigned char* buffer, unsigned int length,
+                                 unsigned char send_stop);
+unsigned char __real_twi_readFrom(unsigned char address, unsigned char* buffer, unsigned int length,
+                                  unsigned char send_stop);
+
+unsigned char __wrap_twi_writeTo(unsigned char address, unsigned char* buffer, unsigned int length,
+                                 unsigned char send_stop) {
+    count_bus_transfer();
+    return __real_twi_writeTo(address, buffer, length, send_stop);
+}
+
+unsigned char __wrap_twi_readFrom(unsigned char address, unsigned char* buffer, unsigned int length,
+                                  unsigned char send_stop) {
+    count_bus_transfer();
+    return __real_twi_readFrom(address, buffer, length, send_stop);
+}
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Button
 
@@ -749,7 +1139,7 @@ void start_server() {
 
     WiFi.softAP(DEVICE_NAME);
     if (mdns.begin(DEVICE_NAME, WiFi.localIP())) {
-        Log.Info("MDNS responder started");
+        LOGGING_INFO("MDNS responder started");
     }
 
     server.on("/", handle_root);
@@ -758,11 +1148,38 @@ void start_server() {
     server.on("/variance", handle_variance);
     server.on("/diff", handle_diff);
     server.on("/active", handle_active);
+    server.on("/timing", handle_timing);
+    server.on("/histograms", handle_histograms);
+    server.on("/histograms/reset", handle_reset_histograms);
+    server.on("/frame.bin", handle_frame_bin);
+    server.on("/frame.json", handle_frame_json);
+    server.on("/viewer", handle_viewer);
     server.onNotFound(handle_not_found);
+    server.collectHeaders(FRAME_HEADERS, sizeof(FRAME_HEADERS) / sizeof(FRAME_HEADERS[0]));
 
     server.begin();
-    Log.Info("HTTP server started: Local %s, Hosted %s", WiFi.localIP().toString().c_str(),
-             WiFi.softAPIP().toString().c_str());
+    frame_stream.begin();
+    scheduler.add_background_task("web", handle_web_clients, WEB_TASK_BUDGET);
+    scheduler.add_background_task("stream", update_frame_stream, STREAM_TASK_BUDGET);
+    LOGGING_INFO("HTTP server started: Local %s, Hosted %s", WiFi.localIP().toString().c_str(),
+                 WiFi.softAPIP().toString().c_str());
+}
+
+void handle_web_clients() {
+    /**
+    * Serve a waiting web request, as a background task.
+    * Pages are streamed through PageWriter and frames come from the frame cache, so a request fits in
+    * WEB_TASK_BUDGET.
+    */
+    server.handleClient();
+}
+
+void update_frame_stream() {
+    /**
+    * Look after the frame stream's subscribers and push them the last frame, as a background task.
+    */
+    frame_stream.update();
+    stream_new_frame();
 }
 
 void handle_root() {
@@ -770,38 +1187,35 @@ void handle_root() {
     * Generate the HTML for the basic web page.
     * The root page just displays basic information at this stage
     */
-
-    String header =
-        "<html><head><title> NodeMLX Info</title><style>table, th, td {border: 1px solid black;}</style><meta "
-        "http-equiv=\"refresh\" content=\"1\"/></head><body bgcolor=\"#8a8f8a\">";
-    String footer = "</body></html>";
-
-    String body = "<h1>NodeMLX Thermal Tracker - Ver:";
-    body += NODE_MLX_VERSION;
-    body += "</h1>";
-
-    body += "<h2> Compile time: ";
-    body += COMPILE_DATE;
-    body += " ";
-    body += COMPILE_TIME;
-    body += " - ";
-    body += DEVICE_NAME;
-    body += "</h2><hr>";
-
-    body += "<h2> Basic Info</h2>";
-    body += generate_basic_info_table();
-    body += "<h2> Tracking Variables</h2>";
-    body += generate_tracking_info_table();
-    body += "<h2>Inter-frame Track Weightings</h2>";
-    body += generate_penalty_table();
-    body += "<h2> Recent Tracked Blobs</h2>";
-    body += generate_last_blobs_table();
-    body += "<hr>";
-    body += NAV_TABLE;
-
+    WiFiClient client = server.client();
+    PageWriter page(write_to_client, &client);
+    start_page(page, "text/html");
+
+    page.print_P(INFO_PAGE_HEADER);
+    page.print_P(PSTR("<h1>NodeMLX Thermal Tracker - Ver:"));
+    page.print(NODE_MLX_VERSION);
+    page.print_P(PSTR("</h1><h2> Compile time: "));
+    page.print(COMPILE_DATE);
+    page.print_P(PSTR(" "));
+    page.print(COMPILE_TIME);
+    page.print_P(PSTR(" - "));
+    page.print(DEVICE_NAME);
+    page.print_P(PSTR("</h2><hr>"));
+
+    page.print_P(PSTR("<h2> Basic Info</h2>"));
+    write_basic_info_table(page);
+    page.print_P(PSTR("<h2> Tracking Variables</h2>"));
+    write_tracking_info_table(page);
+    page.print_P(PSTR("<h2>Inter-frame Track Weightings</h2>"));
+    write_penalty_table(page);
+    page.print_P(PSTR("<h2> Recent Tracked Blobs</h2>"));
+    write_last_blobs_table(page);
+    page.print_P(PSTR("<hr>"));
+    page.print_P(NAV_TABLE);
+    page.print_P(PAGE_FOOTER);
+
+    finish_page(page);
     handle_server_args();
-
-    server.send(200, "text/html", header + body + footer);
 }
 
 void handle_server_args() {
@@ -810,11 +1224,7 @@ void handle_server_args() {
     */
 
     for (int i = 0; i < server.args(); i++) {
-        if (server.argName(i) == "min") {
-            min_display_temperature = server.arg(i).toFloat();
-        } else if (server.argName(i) == "max") {
-            max_display_temperature = server.arg(i).toFloat();
-        } else if (server.argName(i) == "min_blob") {
+        if (server.argName(i) == "min_blob") {
             tracker.min_blob_size = server.arg(i).toInt();
         } else if (server.argName(i) == "avg_size") {
             tracker.running_average_size = server.arg(i).toInt();
@@ -834,291 +1244,621 @@ void handle_server_args() {
             TrackedBlob::direction_penalty = server.arg(i).toFloat();
         } else if (server.argName(i) == "pen_temp") {
             TrackedBlob::temperature_penalty = server.arg(i).toFloat();
+        } else if (server.argName(i) == "predictor") {
+            TrackedBlob::set_predictor(server.arg(i).toInt(), TrackedBlob::process_noise,
+                                       TrackedBlob::measurement_noise);
+        } else if (server.argName(i) == "kal_q") {
+            TrackedBlob::set_predictor(TrackedBlob::predictor, server.arg(i).toFloat(),
+                                       TrackedBlob::measurement_noise);
+        } else if (server.argName(i) == "kal_r") {
+            TrackedBlob::set_predictor(TrackedBlob::predictor, TrackedBlob::process_noise,
+                                       server.arg(i).toFloat());
         } else if (server.argName(i) == "max_dead") {
             tracker.max_dead_frames = server.arg(i).toInt();
+        } else if (server.argName(i) == "max_merged") {
+            tracker.max_merged_frames = constrain(server.arg(i).toInt(), 0, 255);
         } else if (server.argName(i) == "ad_fuzz") {
             Pixel::adjacency_fuzz = server.arg(i).toInt();
         }
     }
 }
 
-String generate_basic_info_table() {
+void write_basic_info_table(PageWriter& page) {
     char temp[30];
-    String output = "<table bgcolor=\"#e6f4a4\" style=\"width:50%\">";
-    get_datetime(temp);
-    output += "<tr><th>Last update</th><td>";
-    output += temp;
-    output += "</td></tr>";
-    output += "<tr><th>Ambient Temperature</th><td>";
-    dtostrf(thermal_flow.get_ambient_temperature(), 4, 2, temp);
-    output += temp;
-    output += " °C</td></tr>";
-
-    output += "<tr><th>Processed frame rate (last second)</th><td>";
-    output += last_num_processed_frames;
-
-    output += "<tr><th>Background status</th><td>";
-    output += tracker.num_background_frames;
-    output += "/";
-    output += tracker.running_average_size;
-
-    output += "</td></tr></table>";
-
-    return output;
-}
-
-String generate_tracking_info_table() {
-    char temp[10];
-    String output =
-        "<hr><table bgcolor=\"#a7f47d\" style =\"width:50%\"><tr><th>Tracking Variables</th><th>Var "
-        "Name</th><th>Value</th></tr><tr>";
-    output += "<td>Min blob size</td><td>min_blob</td><td>";
-    output += tracker.min_blob_size;
-    output += "</td></tr>";
-
-    output += "<td>Running average frames</td><td>avg_size</td><td>";
-    output += tracker.running_average_size;
-    output += "</td></tr>";
-
-    output += "<td>Max difference threshold</td><td>max_diff</td><td>";
-    output += tracker.max_difference_threshold;
-    output += "</td></tr>";
-
-    output += "<td>Min temp differential</td><td>min_t_diff</td><td>";
-    dtostrf(tracker.minimum_temperature_differential, 4, 2, temp);
-    output += temp;
-    output += "</td></tr>";
-
-    output += "<td>Active pixel variance scalar</td><td>ap_scalar</td><td>";
-    dtostrf(tracker.active_pixel_variance_scalar, 4, 2, temp);
-    output += temp;
-    output += "</td></tr>";
-
-    output += "<td>Adjacency fuzz factor</td><td>ad_fuzz</td><td>";
-    dtostrf(tracker.active_pixel_variance_scalar, 4, 2, temp);
-    output += temp;
-    output += "</td></tr>";
-
-    output += "<td>Maximum dead frames</td><td>max_dead</td><td>";
-    output += tracker.max_dead_frames;
-    output += "</td></tr></table>";
-
-    return output;
-}
-
-String generate_penalty_table() {
-    char temp[10];
-    String output =
-        "<hr><table bgcolor=\"#eeb77d\" style=\"width:50%\"><th>Blob tracking</th><th>Var "
-        "Name</th><th>Value</th></tr><tr>";
-    output += "<td>Position penalty</td><td>pen_pos</td><td>";
-    dtostrf(TrackedBlob::position_penalty, 4, 2, temp);
-    output += temp;
-    output += "</td></tr>";
-    output += "<td>Area penalty</td><td>pen_area</td><td>";
-    dtostrf(TrackedBlob::area_penalty, 4, 2, temp);
-    output += temp;
-    output += "</td></tr>";
-    output += "<td>Aspect Ratio penalty</td><td>pen_aratio</td><td>";
-    dtostrf(TrackedBlob::aspect_ratio_penalty, 4, 2, temp);
-    output += temp;
-    output += "</td></tr>";
-    output += "<td>Direction penalty</td><td>pen_dir</td><td>";
-    dtostrf(TrackedBlob::direction_penalty, 4, 2, temp);
-    output += temp;
-    output += "</td></tr>";
-    output += "<td>Temperature penalty</td><td>pen_temp</td><td>";
-    dtostrf(TrackedBlob::temperature_penalty, 4, 2, temp);
-    output += temp;
-    output += "</td></tr></table>";
-
-    return output;
-}
-
-String generate_last_blobs_table() {
-    char temp[10];
-    String output =
-        "<hr><table bgcolor=\"#a972b4\" style=\"width:80%\"><tr><th>Track id</th><th>Tracked frames</th><th>Max blob "
-        "size</th><th>Travel</th><th>Width</th><th>Height</th><th>Temperature</th><th>A diff</th><th>P diff</th><th>AR "
-        "diff</th><th>D diff</th><th>T diff</th><th>Num Dead</tr>";
+    page.print_P(PSTR("<table bgcolor=\"#e6f4a4\" style=\"width:50%\">"));
+    page.print_P(PSTR("<tr><th>Last update</th><td>"));
+    if (telemetry.has_rtc_time) {
+        get_datetime(temp);
+        page.print(temp);
+    } else {
+        page.print_P(PSTR("RTC not read"));
+    }
+    page.print_P(PSTR("</td></tr><tr><th>Ambient Temperature</th><td>"));
+    page.print(telemetry.ambient_temperature, 2);
+    page.print_P(PSTR(" °C</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Processed frame rate</th><td>"));
+    page.print(telemetry.frame_rate, 1);
+    page.print_P(PSTR(" fps, "));
+    page.print(telemetry.num_missed_frames);
+    page.print_P(PSTR(" frames missed</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>I2C bus transfers</th><td>"));
+    page.print(telemetry.num_bus_transfers);
+    page.print_P(PSTR(", "));
+    page.print(telemetry.num_bus_transfers_outside_frames);
+    page.print_P(PSTR(" outside frame reads</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Frame period p99 / max</th><td>"));
+    page.print(frame_period_histogram.get_percentile(0.99));
+    page.print_P(PSTR(" / "));
+    page.print(frame_period_histogram.get_max());
+    page.print_P(PSTR(" us</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Frame processing mean / p99 / max</th><td>"));
+    page.print(long(frame_process_histogram.get_mean()));
+    page.print_P(PSTR(" / "));
+    page.print(frame_process_histogram.get_percentile(0.99));
+    page.print_P(PSTR(" / "));
+    page.print(frame_process_histogram.get_max());
+    page.print_P(PSTR(" us</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Loop p99 / max</th><td>"));
+    page.print(loop_histogram.get_percentile(0.99));
+    page.print_P(PSTR(" / "));
+    page.print(loop_histogram.get_max());
+    page.print_P(PSTR(" us (<a href=\"histograms\">histograms</a>, <a href=\"histograms/reset\">reset</a>)</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Web page mean / p99 / max</th><td>"));
+    page.print(long(page_histogram.get_mean()));
+    page.print_P(PSTR(" / "));
+    page.print(page_histogram.get_percentile(0.99));
+    page.print_P(PSTR(" / "));
+    page.print(page_histogram.get_max());
+    page.print_P(PSTR(" us, lowest free heap "));
+    page.print(page_min_free_heap);
+    page.print_P(PSTR(" bytes, "));
+    page.print(num_frames_not_modified);
+    page.print_P(PSTR(" frames not modified</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Frame stream (port 81)</th><td>"));
+    page.print(frame_stream.get_num_clients());
+    page.print_P(PSTR(" clients, "));
+    page.print(frame_stream.num_events_sent);
+    page.print_P(PSTR(" frames sent, "));
+    page.print(frame_stream.num_events_dropped);
+    page.print_P(PSTR(" dropped for slow clients</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Uploads</th><td>"));
+    page.print(uploader.num_succeeded);
+    page.print_P(PSTR(" succeeded, "));
+    page.print(uploader.num_abandoned);
+    page.print_P(PSTR(" given up, "));
+    page.print(uploader.num_failed_attempts);
+    page.print_P(PSTR(" failed attempts, last status "));
+    page.print(uploader.last_status);
+    page.print_P(PSTR(", max update "));
+    page.print(uploader.max_update_micros);
+    page.print_P(PSTR(" us</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Tracking events</th><td>"));
+    page.print(event_queue.num_recorded);
+    page.print_P(PSTR(" recorded, "));
+    page.print(event_queue.get_num_events());
+    page.print_P(PSTR(" queued, "));
+    page.print(event_queue.num_acknowledged);
+    page.print_P(PSTR(" delivered, "));
+    page.print(event_queue.num_dropped);
+    page.print_P(PSTR(" dropped, "));
+    page.print(event_queue.num_batches_sent);
+    page.print_P(PSTR(" batches sent</td></tr>"));
+
+    if (SERIAL_BINARY_TELEMETRY) {
+        page.print_P(PSTR("<tr><th>Serial telemetry</th><td>"));
+        page.print(serial_telemetry.num_records);
+        page.print_P(PSTR(" records, "));
+        page.print(serial_telemetry.num_bytes);
+        page.print_P(PSTR(" bytes</td></tr>"));
+    }
 
-    for (int i = 0; i < TRACKED_BLOB_BUFFER_SIZE; i++) {
-        output += "<tr><td>";
-        output += last_blobs[i].id;
-        output += "</td><td>";
-        output += last_blobs[i].times_updated;
-        output += "</td><td>";
-        output += last_blobs[i].max_size;
-        output += "</td><td>";
-        dtostrf(last_blobs[i].travel[X], 4, 2, temp);
-        output += temp;
-        output += "</td><td>";
-        output += last_blobs[i].max_width;
-        output += "</td><td>";
-        output += last_blobs[i].max_height;
-        output += "</td><td>";
-        dtostrf(last_blobs[i]._blob.average_temperature, 4, 2, temp);
-        output += temp;
-        output += "</td><td>";
-        dtostrf(last_blobs[i].average_area_difference, 4, 2, temp);
-        output += temp;
-        output += "</td><td>";
-        dtostrf(last_blobs[i].average_position_difference, 4, 2, temp);
-        output += temp;
-        output += "</td><td>";
-        dtostrf(last_blobs[i].average_aspect_ratio_difference, 4, 2, temp);
-        output += temp;
-        output += "</td><td>";
-        dtostrf(last_blobs[i].average_direction_difference, 4, 2, temp);
-        output += temp;
-        output += "</td><td>";
-        dtostrf(last_blobs[i].average_temperature_difference, 4, 2, temp);
-        output += temp;
-        output += "</td><td>";
-        output += last_blobs[i].max_num_dead_frames;
-        output += "</td></tr>";
+    page.print_P(PSTR("<tr><th>Frame cache hits / misses</th><td>"));
+    page.print(frame_cache.num_hits);
+    page.print_P(PSTR(" / "));
+    page.print(frame_cache.num_misses);
+    page.print_P(PSTR("</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Background status</th><td>"));
+    page.print(telemetry.num_background_frames);
+    page.print_P(PSTR("/"));
+    page.print(telemetry.running_average_size);
+    page.print_P(PSTR("</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Idle / active frames</th><td>"));
+    page.print(telemetry.num_idle_frames);
+    page.print_P(PSTR(" / "));
+    page.print(telemetry.num_active_frames);
+    page.print_P(PSTR("</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Mean idle / active frame time</th><td>"));
+    page.print(telemetry.mean_idle_frame_micros);
+    page.print_P(PSTR(" / "));
+    page.print(telemetry.mean_active_frame_micros);
+    page.print_P(PSTR(" us</td></tr>"));
+
+    page.print_P(PSTR("<tr><th>Tracker stack high-water</th><td>"));
+    if (TRACKER_STACK_PAINT_SIZE > 0) {
+        page.print(tracker.stack_high_water);
+        page.print_P(tracker.stack_paint_exhausted ? PSTR(" bytes or more") : PSTR(" bytes"));
+    } else {
+        page.print_P(PSTR("not measured"));
     }
 
-    output += "</table>";
+    page.print_P(PSTR("</td></tr><tr><th>Blob capacity</th><td>"));
+    page.print(tracker.get_blob_capacity());
+
+    page.print_P(PSTR("</td></tr><tr><th>Blob overflows</th><td>"));
+    page.print(tracker.num_blob_overflows);
+    page.print_P(PSTR(" frames, "));
+    page.print(tracker.num_dropped_pixels);
+    page.print_P(PSTR(" pixels dropped"));
+
+    page.print_P(PSTR("</td></tr><tr><th>Track overflows</th><td>"));
+    page.print(tracker.num_track_overflows);
+
+    page.print_P(PSTR("</td></tr><tr><th>Track merges</th><td>"));
+    page.print(tracker.num_track_merges);
+    page.print_P(PSTR(", "));
+    page.print(tracker.num_track_splits);
+    page.print_P(PSTR(" split again"));
+
+    for (int i = 0; i < tracker.num_counting_lines; i++) {
+        page.print_P(PSTR("</td></tr><tr><th>Line "));
+        page.print(i);
+        page.print_P(PSTR(" crossings</th><td>"));
+        page.print(tracker.counting_lines[i].crossings[CROSSING_FORWARD]);
+        page.print_P(PSTR(" forward, "));
+        page.print(tracker.counting_lines[i].crossings[CROSSING_BACKWARD]);
+        page.print_P(PSTR(" back"));
+    }
 
-    return output;
+    page.print_P(PSTR("</td></tr></table>"));
 }
 
-void handle_live() {
-    min_display_temperature = 20;
-    max_display_temperature = 50;
-    String page = generate_live_view(tracker.frame);
-    server.send(200, "text/html", page);
+void write_tracking_info_table(PageWriter& page) {
+    page.print_P(
+        PSTR("<hr><table bgcolor=\"#a7f47d\" style =\"width:50%\"><tr><th>Tracking Variables</th><th>Var "
+             "Name</th><th>Value</th></tr><tr>"));
+    page.print_P(PSTR("<td>Min blob size</td><td>min_blob</td><td>"));
+    page.print(tracker.min_blob_size);
+    page.print_P(PSTR("</td></tr>"));
+
+    page.print_P(PSTR("<td>Running average frames</td><td>avg_size</td><td>"));
+    page.print(tracker.running_average_size);
+    page.print_P(PSTR("</td></tr>"));
+
+    page.print_P(PSTR("<td>Max difference threshold</td><td>max_diff</td><td>"));
+    page.print(tracker.max_difference_threshold);
+    page.print_P(PSTR("</td></tr>"));
+
+    page.print_P(PSTR("<td>Min temp differential</td><td>min_t_diff</td><td>"));
+    page.print(tracker.minimum_temperature_differential, 2);
+    page.print_P(PSTR("</td></tr>"));
+
+    page.print_P(PSTR("<td>Active pixel variance scalar</td><td>ap_scalar</td><td>"));
+    page.print(tracker.active_pixel_variance_scalar, 2);
+    page.print_P(PSTR("</td></tr>"));
+
+    page.print_P(PSTR("<td>Adjacency fuzz factor</td><td>ad_fuzz</td><td>"));
+    page.print(tracker.active_pixel_variance_scalar, 2);
+    page.print_P(PSTR("</td></tr>"));
+
+    page.print_P(PSTR("<td>Maximum dead frames</td><td>max_dead</td><td>"));
+    page.print(tracker.max_dead_frames);
+    page.print_P(PSTR("</td></tr>"));
+
+    page.print_P(PSTR("<td>Maximum merged frames</td><td>max_merged</td><td>"));
+    page.print(tracker.max_merged_frames);
+    page.print_P(PSTR("</td></tr></table>"));
 }
 
-void handle_average() {
-    min_display_temperature = 20;
-    max_display_temperature = 50;
-    String page = generate_live_view(tracker.pixel_averages);
-    server.send(200, "text/html", page);
+void write_penalty_table(PageWriter& page) {
+    page.print_P(
+        PSTR("<hr><table bgcolor=\"#eeb77d\" style=\"width:50%\"><th>Blob tracking</th><th>Var "
+             "Name</th><th>Value</th></tr><tr>"));
+    page.print_P(PSTR("<td>Position penalty</td><td>pen_pos</td><td>"));
+    page.print(TrackedBlob::position_penalty, 2);
+    page.print_P(PSTR("</td></tr>"));
+    page.print_P(PSTR("<td>Area penalty</td><td>pen_area</td><td>"));
+    page.print(TrackedBlob::area_penalty, 2);
+    page.print_P(PSTR("</td></tr>"));
+    page.print_P(PSTR("<td>Aspect Ratio penalty</td><td>pen_aratio</td><td>"));
+    page.print(TrackedBlob::aspect_ratio_penalty, 2);
+    page.print_P(PSTR("</td></tr>"));
+    page.print_P(PSTR("<td>Direction penalty</td><td>pen_dir</td><td>"));
+    page.print(TrackedBlob::direction_penalty, 2);
+    page.print_P(PSTR("</td></tr>"));
+    page.print_P(PSTR("<td>Temperature penalty</td><td>pen_temp</td><td>"));
+    page.print(TrackedBlob::temperature_penalty, 2);
+    page.print_P(PSTR("</td></tr>"));
+    page.print_P(PSTR("<td>Predictor (0 last move, 1 Kalman, 2 steady)</td><td>predictor</td><td>"));
+    page.print(TrackedBlob::predictor);
+    page.print_P(PSTR("</td></tr>"));
+    page.print_P(PSTR("<td>Predictor process noise</td><td>kal_q</td><td>"));
+    page.print(TrackedBlob::process_noise, 2);
+    page.print_P(PSTR("</td></tr>"));
+    page.print_P(PSTR("<td>Predictor measurement noise</td><td>kal_r</td><td>"));
+    page.print(TrackedBlob::measurement_noise, 2);
+    page.print_P(PSTR("</td></tr></table>"));
 }
 
-void handle_variance() {
-    min_display_temperature = 0;
-    max_display_temperature = 5;
-    String page = generate_live_view(tracker.pixel_variance);
-    server.send(200, "text/html", page);
+void write_last_blobs_table(PageWriter& page) {
+    page.print_P(
+        PSTR("<hr><table bgcolor=\"#a972b4\" style=\"width:80%\"><tr><th>Track id</th><th>Tracked frames</th><th>Max "
+             "blob size</th><th>Travel</th><th>Width</th><th>Height</th><th>Temperature</th>"));
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_FULL
+    page.print_P(PSTR("<th>A diff</th><th>P diff</th><th>AR diff</th><th>D diff</th><th>T diff</th>"));
+#endif
+    page.print_P(PSTR("<th>Num Dead</tr>"));
+
+    for (int i = 0; i < TRACKED_BLOB_BUFFER_SIZE; i++) {
+        // Most recent first
+        int index = (last_blob_index + TRACKED_BLOB_BUFFER_SIZE - 1 - i) % TRACKED_BLOB_BUFFER_SIZE;
+        TrackedBlob& last_blob = last_blobs[index];
+
+        page.print_P(PSTR("<tr><td>"));
+        page.print(last_blob.id);
+        page.print_P(PSTR("</td><td>"));
+        page.print(last_blob.times_updated);
+        page.print_P(PSTR("</td><td>"));
+        page.print(last_blob.max_size);
+        page.print_P(PSTR("</td><td>"));
+        page.print(float(last_blob.travel[X]), 2);
+        page.print_P(PSTR("</td><td>"));
+        page.print(last_blob.max_width);
+        page.print_P(PSTR("</td><td>"));
+        page.print(last_blob.max_height);
+        page.print_P(PSTR("</td><td>"));
+        page.print(last_blob._blob.average_temperature, 2);
+        page.print_P(PSTR("</td><td>"));
+#if TRACKER_DIAGNOSTICS_LEVEL >= TRACKER_DIAGNOSTICS_FULL
+        page.print(last_blob.average_area_difference, 2);
+        page.print_P(PSTR("</td><td>"));
+        page.print(last_blob.average_position_difference, 2);
+        page.print_P(PSTR("</td><td>"));
+        page.print(last_blob.average_aspect_ratio_difference, 2);
+        page.print_P(PSTR("</td><td>"));
+        page.print(last_blob.average_direction_difference, 2);
+        page.print_P(PSTR("</td><td>"));
+        page.print(last_blob.average_temperature_difference, 2);
+        page.print_P(PSTR("</td><td>"));
+#endif
+        page.print(last_blob.max_num_dead_frames);
+        page.print_P(PSTR("</td></tr>"));
+    }
+
+    page.print_P(PSTR("</table>"));
 }
 
-void handle_diff() {
-    min_display_temperature = -5;
-    max_display_temperature = 5;
-    float diff[4][16];
+void handle_live() { send_live_view(VIEW_LIVE); }
 
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 16; j++) {
-            diff[i][j] = tracker.frame[i][j] - tracker.pixel_averages[i][j];
-        }
+void handle_average() { send_live_view(VIEW_AVERAGE); }
+
+void handle_variance() { send_live_view(VIEW_VARIANCE); }
+
+void handle_diff() { send_live_view(VIEW_DIFF); }
+
+void handle_active() { send_live_view(VIEW_ACTIVE); }
+
+void handle_frame_bin() { send_frame(false); }
+
+void handle_frame_json() { send_frame(true); }
+
+void send_frame(bool json) {
+    /**
+    * Send a view of the last frame for client-side rendering, packed (see FrameExport.h) or as JSON.
+    * Takes view=live|average|variance|diff|active, live by default. The ETag is the view and the frame sequence
+    * number, so a client that sends back the ETag of the frame it already has gets a 304 until a new frame arrives.
+    * @param json Send JSON rather than the packed binary layout
+    */
+    int view = server.hasArg("view") ? find_frame_view(server.arg("view").c_str()) : VIEW_LIVE;
+    if (view < 0) {
+        server.send(400, "text/plain", "Unknown view\n");
+        return;
     }
 
-    String page = generate_live_view(diff);
-    server.send(200, "text/html", page);
-}
+    char etag[24];
+    sprintf(etag, "\"%s-%lu\"", get_frame_view_name(view), tracker.frame_sequence);
+    if (server.header("If-None-Match") == etag) {
+        num_frames_not_modified++;
+        server.sendHeader("ETag", etag);
+        server.send(304, "text/plain", "");
+        return;
+    }
 
-void handle_active() {
-    min_display_temperature = 0;
-    max_display_temperature = 1;
-    float active[4][16];
+    WiFiClient client = server.client();
+    PageWriter page(write_to_client, &client);
 
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 16; j++) {
-            float temp = tracker.frame[i][j];
-            float average = tracker.pixel_averages[i][j];
-            float variance = tracker.pixel_variance[i][j];
+    if (json) {
+        start_page(page, "application/json", etag);
+        write_frame_json(page, frame_cache.get_text(view), view, tracker.frame_sequence);
+    } else {
+        start_page(page, "application/octet-stream", etag);
+        page.write(frame_cache.get_packed(view), FRAME_EXPORT_BINARY_SIZE);
+    }
 
-            float temperature_difference = absolute(average - temp);
+    finish_page(page);
+}
 
-            if (temperature_difference > (variance * 3) &&
-                temperature_difference > tracker.minimum_temperature_differential) {
-                active[i][j] = 1;
-            } else {
-                active[i][j] = 0;
-            }
-        }
+void stream_new_frame() {
+    /**
+    * Push the live view of a newly published frame to the frame stream's subscribers, once per frame.
+    * Subscribers that are behind have the frame dropped rather than holding up the loop.
+    */
+    if (tracker.frame_sequence == last_streamed_sequence) {
+        return;
+    }
+    last_streamed_sequence = tracker.frame_sequence;
+
+    if (frame_stream.get_num_clients() == 0) {
+        return;
     }
 
-    String page = generate_live_view(active);
-    server.send(200, "text/html", page);
+    frame_stream.send_frame(frame_cache.get_packed(VIEW_LIVE), FRAME_EXPORT_BINARY_SIZE, tracker.frame_sequence);
+}
+
+void handle_viewer() {
+    /**
+    * Send the client-side viewer, which renders the frame endpoints in the browser.
+    */
+    WiFiClient client = server.client();
+    PageWriter page(write_to_client, &client);
+    start_page(page, "text/html");
+    page.print_P(VIEWER_PAGE);
+    finish_page(page);
 }
 
-String generate_live_view(float values[4][16]) {
+void write_histogram_json(PageWriter& page, const char* name, Histogram& histogram) {
     /**
-    * Generate the html for the live page.
-    * The live page contains a false-colour temperature map of the sensor output
+    * Write a histogram as a JSON object member, "name":{summary, "buckets":[[lowest value, count], ...]}.
+    * Only the buckets holding anything are listed.
     */
+    page.print_P(PSTR("\""));
+    page.print(name);
+    page.print_P(PSTR("\":{\"count\":"));
+    page.print(histogram.total_count);
+    page.print_P(PSTR(",\"min\":"));
+    page.print(histogram.get_min());
+    page.print_P(PSTR(",\"mean\":"));
+    page.print(long(histogram.get_mean()));
+    page.print_P(PSTR(",\"p99\":"));
+    page.print(histogram.get_percentile(0.99));
+    page.print_P(PSTR(",\"max\":"));
+    page.print(histogram.get_max());
+    page.print_P(PSTR(",\"buckets\":["));
+
+    bool first = true;
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+        if (histogram.counts[i] == 0) {
+            continue;
+        }
+        if (!first) {
+            page.print_P(PSTR(","));
+        }
+        page.print_P(PSTR("["));
+        page.print(Histogram::get_bucket_min(i));
+        page.print_P(PSTR(","));
+        page.print(histogram.counts[i]);
+        page.print_P(PSTR("]"));
+        first = false;
+    }
 
-    String page = "";
-    page += generate_colour_map(values);
-    page += "<html><head><title> NodeMLX Live Feed</title><meta http-equiv=\"refresh\" content=\"0.25\"/></head><body>";
-    page += generate_temperature_table(values);
-    page += "<hr><a href=\"\\\">Back</a></body></html>";
+    page.print_P(PSTR("]}"));
+}
 
-    return page;
+void handle_histograms() {
+    /**
+    * Export the frame period, frame processing, loop and web page timing histograms as JSON, in microseconds.
+    */
+    WiFiClient client = server.client();
+    PageWriter page(write_to_client, &client);
+    start_page(page, "application/json");
+
+    page.print_P(PSTR("{\"id\":\""));
+    page.print(DEVICE_NAME);
+    page.print_P(PSTR("\",\"missed_frames\":"));
+    page.print(num_missed_frames);
+    page.print_P(PSTR(",\"page_min_free_heap\":"));
+    page.print(page_min_free_heap);
+    page.print_P(PSTR(","));
+    write_histogram_json(page, "frame_period", frame_period_histogram);
+    page.print_P(PSTR(","));
+    write_histogram_json(page, "frame_process", frame_process_histogram);
+    page.print_P(PSTR(","));
+    write_histogram_json(page, "loop", loop_histogram);
+    page.print_P(PSTR(","));
+    write_histogram_json(page, "page", page_histogram);
+    page.print_P(PSTR("}"));
+
+    finish_page(page);
 }
 
-int calculate_hue(float temperature) {
+void handle_reset_histograms() {
     /**
-    * Calculate the hue of the temperature according to the colour map
-    * Hue bounds are set by COLD_HUE and HOT_HUE
-    * @param temperature Temperature to map to a hue
-    * @return Hue of the input temperature relative to the set bounds
+    * Reset the frame, loop and web page timing histograms, and the scheduler's deadline statistics.
     */
-    int temp = constrain(temperature * 5, min_display_temperature * 5, max_display_temperature * 5);
-    int hue = map(temp, min_display_temperature * 5, max_display_temperature * 5, COLD_HUE, HOT_HUE);
-    return hue;
+    reset_timing_histograms();
+    server.send(200, "text/plain", "Timing histograms reset\n");
 }
 
-String generate_colour_map(float temperatures[4][16]) {
+void handle_timing() {
     /**
-    * Generate the CSS for displaying the table colours for the thermal image
-    * Table generation is handled in generate_temperature_table
-    * @param temperature The temperature frame recorded by the sensor
-    * @return The CSS script for displaying the table colours
+    * Generate the stage timing page.
+    * Shows the scheduler's deadline statistics for each task, then how long each stage of the tracker's update takes,
+    * if the tracker was built with TRACKER_STAGE_TIMING.
+    * Pass reset=1 to start the stage timings again.
     */
-    String css =
-        "<style type=\"text/css\">\n.thermal{color: 0xFFFFFF; border: 1px solid black; width: 100%; height: 60%}\n";
-
-    for (int y = 0; y < 4; y++) {
-        for (int x = 0; x < 16; x++) {
-            char row[50];
-            int hue = calculate_hue(temperatures[y][x]);
-            sprintf(row, ".r%dc%d{background-color: hsl(%d,100%,50%)}\n", y, x, hue);
-            css += row;
+    if (server.arg("reset") == "1") {
+        tracker.reset_stage_timing();
+    }
+
+    WiFiClient client = server.client();
+    PageWriter page(write_to_client, &client);
+    start_page(page, "text/html");
+
+    page.print_P(TIMING_PAGE_HEADER);
+    write_scheduler_table(page);
+
+    StageTiming timing;
+    if (!tracker.get_stage_timing(STAGE_FRAME, timing)) {
+        page.print_P(PSTR("<p>Built without stage timing; set TRACKER_STAGE_TIMING=1 in the build flags.</p>"));
+    } else {
+        page.print_P(
+            PSTR("<table><tr><th>Stage</th><th>Count</th><th>Min (us)</th><th>Mean (us)</th><th>Max (us)</th>"
+                 "<th>p99 (us)</th></tr>"));
+
+        for (int stage = 0; stage < NUM_TRACKER_STAGES; stage++) {
+            tracker.get_stage_timing(stage, timing);
+            page.print_P(PSTR("<tr><td>"));
+            page.print(ThermalTracker::get_stage_name(stage));
+            page.print_P(PSTR("</td><td>"));
+            page.print(timing.count);
+            page.print_P(PSTR("</td><td>"));
+            page.print(timing.min, 1);
+            page.print_P(PSTR("</td><td>"));
+            page.print(timing.mean, 1);
+            page.print_P(PSTR("</td><td>"));
+            page.print(timing.max, 1);
+            page.print_P(PSTR("</td><td>"));
+            page.print(timing.p99, 1);
+            page.print_P(PSTR("</td></tr>"));
         }
+
+        page.print_P(PSTR("</table><p><a href=\"timing?reset=1\">Reset</a></p>"));
+    }
+
+    page.print_P(NAV_TABLE);
+    page.print_P(PAGE_FOOTER);
+    finish_page(page);
+}
+
+void write_scheduler_table(PageWriter& page) {
+    /**
+    * Write the scheduler's run and deadline statistics for each task. Times are in microseconds.
+    */
+    page.print_P(
+        PSTR("<table><tr><th>Task</th><th>Runs</th><th>Deadline misses</th><th>Skipped</th><th>Deferred</th>"
+             "<th>Max late (us)</th><th>Max run (us)</th><th>Deadline / budget (us)</th></tr>"));
+
+    for (int i = 0; i < scheduler.num_tasks; i++) {
+        const ScheduledTask& task = scheduler.tasks[i];
+        page.print_P(PSTR("<tr><td>"));
+        page.print(task.name);
+        page.print_P(PSTR("</td><td>"));
+        page.print(task.num_runs);
+        page.print_P(PSTR("</td><td>"));
+        page.print(task.num_deadline_misses);
+        page.print_P(PSTR("</td><td>"));
+        page.print(task.num_skipped_releases);
+        page.print_P(PSTR("</td><td>"));
+        page.print(task.num_deferrals);
+        page.print_P(PSTR("</td><td>"));
+        page.print(task.max_lateness);
+        page.print_P(PSTR("</td><td>"));
+        page.print(task.max_run_time);
+        page.print_P(PSTR("</td><td>"));
+        page.print(task.kind == TASK_DEADLINE ? task.deadline : task.budget);
+        page.print_P(PSTR("</td></tr>"));
     }
-    css += "</style>\n";
-    return css;
+
+    page.print_P(PSTR("</table><p><a href=\"histograms/reset\">Reset</a></p>"));
 }
 
-String generate_temperature_table(float temperature[4][16]) {
+void send_live_view(int view) {
     /**
-    * Generate the html for displaying the recorded temperatures
-    * Colour mapping is handled in generate_colour_map
-    * @param temperature The temperature frame recorded by the sensor
-    * @return The HTML script for displaying the table
+    * Send the live page.
+    * The live page contains a false-colour temperature map of the sensor output, each cell coloured inline.
+    * The view's text and colours come from the frame cache, so they are worked out once per frame however many
+    * clients are watching.
+    * @param view View from frame_views to display
     */
-    String table = "<table class=thermal>\n";
+    WiFiClient client = server.client();
+    PageWriter page(write_to_client, &client);
+    start_page(page, "text/html");
+
+    page.print_P(LIVE_PAGE_HEADER);
+    write_temperature_table(page, frame_cache.get_text(view), frame_cache.get_colours(view));
+    page.print_P(LIVE_PAGE_FOOTER);
+
+    finish_page(page);
+}
+
+void write_temperature_table(PageWriter& page, const frame_text temperature[4][16], const uint8_t colours[4][16]) {
+    /**
+    * Write the html for displaying the recorded temperatures
+    * Each cell carries its own false colour, a hue between COLD_HUE and HOT_HUE picked by its colour index
+    * @param temperature The temperature frame recorded by the sensor, formatted by the frame cache
+    * @param colours Colour index of each temperature, from the frame cache
+    */
+    page.print_P(PSTR("<table class=thermal>\n"));
 
     for (int row = 0; row < 4; row++) {
-        table += "<tr>\n";
+        page.print_P(PSTR("<tr>\n"));
 
         for (int column = 0; column < 16; column++) {
-            char cell[50];
-            char temp[8];
-            dtostrf(temperature[row][column], 0, 2, temp);
-            sprintf(cell, "<th class=r%dc%d> %s </th>\n", row, column, temp);
-            table += cell;
+            page.print_P(PSTR("<th style=\"background-color:hsl("));
+            page.print(COLD_HUE + (HOT_HUE - COLD_HUE) * colours[row][column] / (FRAME_COLOUR_LEVELS - 1));
+            page.print_P(PSTR(",100%,50%)\"> "));
+            page.print(temperature[row][column]);
+            page.print_P(PSTR(" </th>\n"));
         }
-        table += "</tr>\n";
+        page.print_P(PSTR("</tr>\n"));
+    }
+
+    page.print_P(PSTR("</table>\n"));
+}
+
+size_t write_to_client(void* context, const uint8_t* data, size_t length) {
+    /**
+    * PageWriter sink sending a response to a web server client.
+    * Also keeps the lowest free heap seen while pages are being sent.
+    * @param context The WiFiClient to write to
+    */
+    uint32_t free_heap = ESP.getFreeHeap();
+    if (free_heap < page_min_free_heap) {
+        page_min_free_heap = free_heap;
     }
 
-    table += "</table>\n";
-    return table;
+    return ((WiFiClient*)context)->write(data, length);
+}
+
+size_t write_to_serial(void* context, const uint8_t* data, size_t length) {
+    /**
+    * TelemetryEncoder sink sending records out of the serial port.
+    * @param context The HardwareSerial to write to
+    */
+    return ((HardwareSerial*)context)->write(data, length);
+}
+
+void start_page(PageWriter& page, const char* content_type, const char* etag) {
+    /**
+    * Start timing a page and send its headers.
+    * @param content_type MIME type of the page
+    * @param etag Entity tag of the page, or NULL
+    */
+    page_start = micros();
+    page.begin(content_type, etag);
+}
+
+void finish_page(PageWriter& page) {
+    /**
+    * End a page and record how long it took to generate and send.
+    */
+    page.finish();
+    page_histogram.add(micros() - page_start);
+
+    if (page.failed) {
+        LOGGING_DEBUG("Page write failed after %l bytes", long(page.bytes_written));
+    }
 }
 
 void handle_not_found() {